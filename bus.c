@@ -1,235 +1,316 @@
 #include "bus.h"
 #include "memory.h"
 #include "controller.h"
+#include "trace.h"
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 
-static Mapper *active_mapper = NULL;
-static PPU *active_ppu = NULL;
-static Controller *ctrl1 = NULL;
-static Controller *ctrl2 = NULL;
-static APU *active_apu = NULL;
+static void bus_bump_page_gen(Bus *bus, int p) {
+    if (++bus->page_gen[p] == 0) bus->page_gen[p] = 1;
+    bus->code_page[p] = 0;
+}
+
+static void bus_invalidate_code(Bus *bus, Word addr) {
+    int p = addr >> 8;
+    if (p < 0x20) {
+        /* internal RAM: the same bytes are visible through all four mirrors */
+        for (int m = p & 0x07; m < 0x20; m += 0x08) bus_bump_page_gen(bus, m);
+    } else {
+        bus_bump_page_gen(bus, p);
+    }
+}
+
+void bus_mark_code_page(Bus *bus, Word addr) {
+    int p = addr >> 8;
+    if (p < 0x20) {
+        for (int m = p & 0x07; m < 0x20; m += 0x08) bus->code_page[m] = 1;
+    } else {
+        bus->code_page[p] = 1;
+    }
+}
+
+int bus_page_cacheable(const Bus *bus, Word addr) {
+    return bus->read_page[addr >> 8] != NULL;
+}
+
+int bus_page_rom(const Bus *bus, Word addr) {
+    return bus_prg_offset(bus, addr) >= 0;
+}
+
+long bus_prg_offset(const Bus *bus, Word addr) {
+    const Byte *page = bus->read_page[addr >> 8];
+    const Cartridge *cart = bus->mapper ? bus->mapper->cart : NULL;
+    if (!page || !cart || !cart->prg_rom) return -1;
+    if (page < cart->prg_rom || page >= cart->prg_rom + cart->prg_size) return -1;
+    return (long)(page - cart->prg_rom) + (addr & 0xFF);
+}
 
-/* DMA state */
-static int   dma_transfer = 0;   /* 1 = DMA in progress */
-static int   dma_dummy    = 1;   /* 1 = waiting for alignment cycle */
-static Byte  dma_page     = 0;   /* high byte of source address */
-static Byte  dma_addr     = 0;   /* current byte index 0–255 */
-static Byte  dma_data     = 0;   /* read buffer */
+static void bus_map_ram_pages(Bus *bus) {
+    Byte *ram = bus->ram.data;
+    for (int p = 0x00; p < 0x20; p++) {
+        if (bus->read_page[p] != ram + ((p & 0x07) << 8)) {
+            bus_bump_page_gen(bus, p);
+        }
+        bus->read_page[p]  = ram + ((p & 0x07) << 8);
+        bus->write_page[p] = ram + ((p & 0x07) << 8);
+    }
+}
 
-/* Fallback for when no mapper is connected.
-   Covers only 0xFFFE–0xFFFF so the BRK test (which writes the IRQ vector
-   directly via bus_write) still works without a cartridge. */
-static Byte irq_vector_fallback[2];
-static BusDebugStats debug_stats;
-static uint64_t current_instruction_id = 0;
-static uint64_t last_mmc1_write_instruction_id = UINT64_MAX;
+static void bus_map_cart_pages(Mapper *m, void *ctx) {
+    Bus *bus = ctx;
+    for (int p = 0x60; p < 0x100; p++) {
+        int window = p >> 5;
+        int offset = (p & 0x1F) << 8;
+        Byte *r = m ? m->prg_read_map[window]  : NULL;
+        Byte *w = m ? m->prg_write_map[window] : NULL;
+        if (bus->read_page[p] != (r ? r + offset : NULL)) {
+            bus_bump_page_gen(bus, p);   /* different bank now visible here */
+        }
+        bus->read_page[p]  = r ? r + offset : NULL;
+        bus->write_page[p] = w ? w + offset : NULL;
+    }
+}
 
-void bus_reset_debug_stats(void) {
-    debug_stats.ppustatus_reads = 0;
-    debug_stats.ppustatus_vblank_set_reads = 0;
-    debug_stats.ppustatus_sprite0_set_reads = 0;
-    debug_stats.last_ppustatus_value = 0;
-    debug_stats.ppuscroll_writes = 0;
-    debug_stats.ppuaddr_writes = 0;
-    debug_stats.ppudata_writes = 0;
-    debug_stats.oamaddr_writes = 0;
-    debug_stats.last_oamaddr_value = 0;
-    debug_stats.oamdata_writes = 0;
-    debug_stats.oamdma_starts = 0;
-    debug_stats.last_oamdma_page = 0;
+void bus_set_cpu_instruction_id(Bus *bus, uint64_t instruction_id) {
+    bus->instruction_id = instruction_id;
 }
 
-void bus_get_debug_stats(BusDebugStats *out_stats) {
-    if (out_stats) *out_stats = debug_stats;
+static inline void bus_ppu_catch_up(const Bus *bus) {
+    if (bus->ppu_catch_up) bus->ppu_catch_up(bus->ppu_catch_up_ctx);
 }
 
-void bus_set_cpu_instruction_id(uint64_t instruction_id) {
-    current_instruction_id = instruction_id;
+int bus_read_idle_safe(const Bus *bus, Word addr) {
+    if ((addr & 0xE007) == 0x2002) return 1;   /* PPUSTATUS and its mirrors */
+    return bus->read_page[addr >> 8] != NULL;
 }
 
-void bus_reset() {
-    mem_reset();
-    irq_vector_fallback[0] = 0x00;
-    irq_vector_fallback[1] = 0x00;
-    /* active_mapper is NOT cleared here — soft reset must keep mapper attached */
-    /* active_ppu is NOT cleared here either - same reasoning */
-    dma_transfer = 0;
-    dma_dummy    = 1;
-    dma_page     = 0;
-    dma_addr     = 0;
-    dma_data     = 0;
-    current_instruction_id = 0;
-    last_mmc1_write_instruction_id = UINT64_MAX;
-    bus_reset_debug_stats();
+int bus_idle_cycles(const Bus *bus) {
+    /* the CPU runs after the PPU's dot on the same clock, 3 dots per cycle */
+    if (!bus->ppu) return 0;
+    bus_ppu_catch_up(bus);
+    return ppu_quiet_dots(bus->ppu) / 3;
 }
 
-void bus_set_mapper(Mapper *m) {
-    active_mapper = m;
+int bus_interrupt_cycles(const Bus *bus) {
+    if (!bus->ppu) return INT_MAX;
+    bus_ppu_catch_up(bus);
+    return ppu_interrupt_dots(bus->ppu) / 3;
 }
 
-void bus_connect_ppu(PPU *ppu) {
-    active_ppu = ppu;
+void bus_init(Bus *bus) {
+    memset(bus, 0, sizeof(*bus));
+    bus_reset(bus);
 }
 
-void bus_connect_controllers(Controller *c1, Controller *c2) {
-    ctrl1 = c1;
-    ctrl2 = c2;
+void bus_reset(Bus *bus) {
+    mem_reset(&bus->ram);
+    bus->irq_vector_fallback[0] = 0x00;
+    bus->irq_vector_fallback[1] = 0x00;
+    /* mapper is NOT cleared here — soft reset must keep mapper attached */
+    /* ppu is NOT cleared here either - same reasoning */
+    bus->dma_transfer = 0;
+    bus->dma_dummy    = 1;
+    bus->dma_page     = 0;
+    bus->dma_addr     = 0;
+    bus->dma_data     = 0;
+    bus->instruction_id = 0;
+    bus->last_mmc1_write_instruction_id = UINT64_MAX;
+    bus_map_ram_pages(bus);
+    /* RAM was cleared: drop every decoded instruction */
+    for (int p = 0; p < 256; p++) bus_bump_page_gen(bus, p);
 }
 
-void bus_connect_apu(APU *apu) {
-    active_apu = apu;
+void bus_set_mapper(Bus *bus, Mapper *m) {
+    if (bus->mapper && bus->mapper != m) {
+        bus->mapper->prg_map_listener = NULL;
+        bus->mapper->prg_map_ctx      = NULL;
+    }
+    bus->mapper = m;
+    bus->map_epoch++;
+    if (m) {
+        m->prg_map_listener = bus_map_cart_pages;
+        m->prg_map_ctx      = bus;
+    }
+    bus_map_ram_pages(bus);
+    bus_map_cart_pages(m, bus);
 }
 
-Byte bus_read(Word addr) {
+void bus_connect_ppu(Bus *bus, PPU *ppu) {
+    bus->ppu = ppu;
+}
+
+void bus_connect_controllers(Bus *bus, Controller *c1, Controller *c2) {
+    bus->ctrl1 = c1;
+    bus->ctrl2 = c2;
+}
+
+void bus_connect_apu(Bus *bus, APU *apu) {
+    bus->apu = apu;
+}
+
+void bus_set_ppu_catch_up(Bus *bus, void (*fn)(void *ctx), void *ctx) {
+    bus->ppu_catch_up     = fn;
+    bus->ppu_catch_up_ctx = ctx;
+}
+
+Byte bus_read(Bus *bus, Word addr) {
+    const Byte *page = bus->read_page[addr >> 8];
+    if (page) {
+        return page[addr & 0xFF];
+    }
     if (addr <= 0x1FFF) {
-        return mem_read(addr & 0x07FF);
+        return mem_read(&bus->ram, addr & 0x07FF);
     }
     if (addr <= 0x3FFF) {
-        if (active_ppu) {
+        if (bus->ppu) {
             Byte reg = addr & 0x07;
-            Byte val = ppu_reg_read(active_ppu, reg);
-            if (reg == 0x02) {
-                debug_stats.ppustatus_reads++;
-                debug_stats.last_ppustatus_value = val;
-                if (val & 0x80) debug_stats.ppustatus_vblank_set_reads++;
-                if (val & 0x40) debug_stats.ppustatus_sprite0_set_reads++;
-                if (debug_stats.ppustatus_reads == 10000 ||
-                    debug_stats.ppustatus_reads == 50000 ||
-                    debug_stats.ppustatus_reads == 100000) {
-                    fprintf(stderr,
-                            "PPUSTATUS_POLL: reads=%llu val=%02X vblank_reads=%llu sp0_reads=%llu | PPU sl=%d dot=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X x=%d w=%d | OAM0 Y=%u tile=%02X attr=%02X X=%u\n",
-                            (unsigned long long)debug_stats.ppustatus_reads,
-                            val,
-                            (unsigned long long)debug_stats.ppustatus_vblank_set_reads,
-                            (unsigned long long)debug_stats.ppustatus_sprite0_set_reads,
-                            active_ppu->scanline, active_ppu->dot, active_ppu->status,
-                            active_ppu->ctrl, active_ppu->mask, active_ppu->v, active_ppu->t,
-                            active_ppu->x, active_ppu->w,
-                            active_ppu->oam[0], active_ppu->oam[1], active_ppu->oam[2], active_ppu->oam[3]);
-                }
-            }
+            bus_ppu_catch_up(bus);
+            Byte val = ppu_reg_read(bus->ppu, reg);
+            TRACE_PPU_REG_READ(reg, val);
             return val;
         }
         return 0x00;
     }
     if (addr <= 0x401F) {
-        if (addr == 0x4016) return ctrl1 ? controller_read(ctrl1) : 0x00;
-        if (addr == 0x4017) return ctrl2 ? controller_read(ctrl2) : 0x00;
-        if (addr == 0x4015) return active_apu ? apu_read(active_apu, addr) : 0x00;
+        if (addr == 0x4016) return bus->ctrl1 ? controller_read(bus->ctrl1) : 0x00;
+        if (addr == 0x4017) return bus->ctrl2 ? controller_read(bus->ctrl2) : 0x00;
+        if (addr == 0x4015) return bus->apu ? apu_read(bus->apu, addr) : 0x00;
         return 0x00;
     }
     /* 0x4020–0xFFFF: cartridge space */
-    if (active_mapper) {
-        return mapper_prg_read(active_mapper, addr);
+    if (bus->mapper) {
+        return mapper_prg_read(bus->mapper, addr);
     }
     /* No mapper: IRQ vector fallback for test compatibility */
-    if (addr == 0xFFFE) return irq_vector_fallback[0];
-    if (addr == 0xFFFF) return irq_vector_fallback[1];
+    if (addr == 0xFFFE) return bus->irq_vector_fallback[0];
+    if (addr == 0xFFFF) return bus->irq_vector_fallback[1];
     return 0x00;
 }
 
-void bus_write(Word addr, Byte data) {
+/* Debugger/trace read: same memory view as bus_read for RAM and cartridge
+   space, but never touches PPU/APU/controller registers (reads as 0). */
+Byte bus_peek(const Bus *bus, Word addr) {
+    const Byte *page = bus->read_page[addr >> 8];
+    if (page) {
+        return page[addr & 0xFF];
+    }
     if (addr <= 0x1FFF) {
-        mem_write(addr & 0x07FF, data);
+        return mem_read(&bus->ram, addr & 0x07FF);
+    }
+    if (addr <= 0x401F) {
+        return 0x00;
+    }
+    if (bus->mapper) {
+        return mapper_prg_read(bus->mapper, addr);
+    }
+    if (addr == 0xFFFE) return bus->irq_vector_fallback[0];
+    if (addr == 0xFFFF) return bus->irq_vector_fallback[1];
+    return 0x00;
+}
+
+void bus_write(Bus *bus, Word addr, Byte data) {
+    Byte *page = bus->write_page[addr >> 8];
+    if (page) {
+        page[addr & 0xFF] = data;
+        if (bus->code_page[addr >> 8]) bus_invalidate_code(bus, addr);
+        return;
+    }
+    if (addr <= 0x1FFF) {
+        mem_write(&bus->ram, addr & 0x07FF, data);
         return;
     }
     if (addr <= 0x3FFF) {
-        if (active_ppu) {
+        if (bus->ppu) {
             Byte reg = addr & 0x07;
-            if (reg == 0x03) {
-                debug_stats.oamaddr_writes++;
-                debug_stats.last_oamaddr_value = data;
-            } else if (reg == 0x04) {
-                debug_stats.oamdata_writes++;
-            } else if (reg == 0x05) {
-                debug_stats.ppuscroll_writes++;
-            } else if (reg == 0x06) {
-                debug_stats.ppuaddr_writes++;
-            } else if (reg == 0x07) {
-                debug_stats.ppudata_writes++;
-            }
-            ppu_reg_write(active_ppu, reg, data);
+            TRACE_PPU_REG_WRITE(reg, data);
+            bus_ppu_catch_up(bus);
+            ppu_reg_write(bus->ppu, reg, data);
         }
         return;
     }
     if (addr == 0x4014) {
         /* OAM DMA: copy 256 bytes from CPU page $XX00-$XXFF to PPU OAM */
-        debug_stats.oamdma_starts++;
-        debug_stats.last_oamdma_page = data;
-        dma_page     = data;
-        dma_addr     = 0x00;
-        dma_transfer = 1;
-        dma_dummy    = 1;
+        TRACE_OAMDMA(data);
+        bus_ppu_catch_up(bus);
+        bus->dma_page     = data;
+        bus->dma_addr     = 0x00;
+        bus->dma_transfer = 1;
+        bus->dma_dummy    = 1;
         return;
     }
     if (addr == 0x4016) {
-        if (ctrl1) controller_write(ctrl1, data);
-        if (ctrl2) controller_write(ctrl2, data); /* strobe is broadcast to both */
+        if (bus->ctrl1) controller_write(bus->ctrl1, data);
+        if (bus->ctrl2) controller_write(bus->ctrl2, data); /* strobe is broadcast to both */
         return;
     }
     if (addr >= 0x4000 && addr <= 0x4013) {
-        if (active_apu) apu_write(active_apu, addr, data);
+        if (bus->apu) apu_write(bus->apu, addr, data);
         return;
     }
     if (addr == 0x4015) {
-        if (active_apu) apu_write(active_apu, addr, data);
+        if (bus->apu) apu_write(bus->apu, addr, data);
         return;
     }
     if (addr == 0x4017) {
-        if (active_apu) apu_write(active_apu, addr, data);
+        if (bus->apu) apu_write(bus->apu, addr, data);
         return;
     }
     /* 0x4020–0xFFFF: cartridge space */
-    if (active_mapper) {
-        if (active_mapper->cart &&
-            active_mapper->cart->mapper_id == 1 &&
+    if (bus->mapper) {
+        if (bus->code_page[addr >> 8]) bus_invalidate_code(bus, addr);
+        if (bus->mapper->cart &&
+            bus->mapper->cart->mapper_id == 1 &&
             addr >= 0x8000) {
             /* MMC1 quirk: ignore additional writes from the same CPU instruction.
                This filters RMW double-writes that otherwise corrupt serial load. */
-            if (last_mmc1_write_instruction_id == current_instruction_id) {
+            if (bus->last_mmc1_write_instruction_id == bus->instruction_id) {
                 return;
             }
-            last_mmc1_write_instruction_id = current_instruction_id;
+            bus->last_mmc1_write_instruction_id = bus->instruction_id;
         }
-        mapper_prg_write(active_mapper, addr, data);
+        bus_ppu_catch_up(bus);
+        if (bus->ppu) ppu_sync(bus->ppu);   /* may switch CHR banks or mirroring */
+        mapper_prg_write(bus->mapper, addr, data);
         return;
     }
     /* No mapper: IRQ vector fallback for test compatibility */
-    if (addr == 0xFFFE) { irq_vector_fallback[0] = data; return; }
-    if (addr == 0xFFFF) { irq_vector_fallback[1] = data; return; }
+    if (addr == 0xFFFE) { bus->irq_vector_fallback[0] = data; return; }
+    if (addr == 0xFFFF) { bus->irq_vector_fallback[1] = data; return; }
 }
 
 /* Called once per CPU-rate clock when dma_transfer is active.
-   system_clock is the global system clock counter (used for odd/even alignment).
+   system_clock is the console's system clock counter (used for odd/even alignment).
    Returns 1 while DMA is still in progress, 0 when complete. */
-int bus_dma_tick(uint64_t system_clock) {
-    if (dma_dummy) {
+int bus_dma_tick(Bus *bus, uint64_t system_clock) {
+    if (bus->dma_dummy) {
         /* Wait for an odd CPU-rate clock to align (matches real hardware) */
         if (system_clock % 2 == 1)
-            dma_dummy = 0;
+            bus->dma_dummy = 0;
         return 1;
     }
     if (system_clock % 2 == 0) {
         /* Even: read one byte from CPU bus */
-        dma_data = bus_read((Word)dma_page << 8 | dma_addr);
+        bus->dma_data = bus_read(bus, (Word)bus->dma_page << 8 | bus->dma_addr);
     } else {
         /* Odd: write it to PPU OAM */
-        if (active_ppu) {
+        if (bus->ppu) {
             /* OAM DMA starts at current OAMADDR and wraps at 256 bytes. */
-            Byte oam_index = (Byte)(active_ppu->oam_addr + dma_addr);
-            active_ppu->oam[oam_index] = dma_data;
+            Byte oam_index = (Byte)(bus->ppu->oam_addr + bus->dma_addr);
+            bus->ppu->oam[oam_index] = bus->dma_data;
+            if ((oam_index & 3) == 0) bus->ppu->oam_dirty = 1;   /* a Y byte */
         }
-        dma_addr++;
-        if (dma_addr == 0x00) {
+        bus->dma_addr++;
+        if (bus->dma_addr == 0x00) {
             /* All 256 bytes written — DMA complete */
-            dma_transfer = 0;
-            dma_dummy    = 1;
+            bus->dma_transfer = 0;
+            bus->dma_dummy    = 1;
             return 0;
         }
     }
     return 1;
 }
 
-int bus_dma_active(void) {
-    return dma_transfer;
-}
\ No newline at end of file
+int bus_dma_active(const Bus *bus) {
+    return bus->dma_transfer;
+}
@@ -7,34 +7,101 @@
 #include "ppu.h"
 #include "controller.h"
 #include "apu.h"
+#include "memory.h"
 
-typedef struct {
-    uint64_t ppustatus_reads;
-    uint64_t ppustatus_vblank_set_reads;
-    uint64_t ppustatus_sprite0_set_reads;
-    Byte     last_ppustatus_value;
-    uint64_t ppuscroll_writes;
-    uint64_t ppuaddr_writes;
-    uint64_t ppudata_writes;
-    uint64_t oamaddr_writes;
-    Byte     last_oamaddr_value;
-    uint64_t oamdata_writes;
-    uint64_t oamdma_starts;
-    Byte     last_oamdma_page;
-} BusDebugStats;
-
-void bus_reset(void);
-void bus_set_mapper(Mapper *m);   /* NULL to disconnect */
-void bus_connect_ppu(PPU *ppu);   /* call once after ppu_init */
-void bus_connect_controllers(Controller *c1, Controller *c2); /* c2 may be NULL */
-void bus_connect_apu(APU *apu);
-
-Byte bus_read(Word addr);
-void bus_write(Word addr, Byte data);
-int  bus_dma_active(void);
-int  bus_dma_tick(uint64_t system_clock);  /* returns 1 if DMA still running */
-void bus_get_debug_stats(BusDebugStats *out_stats);
-void bus_reset_debug_stats(void);
-void bus_set_cpu_instruction_id(uint64_t instruction_id);
+/* Everything behind the CPU's address space for one console: internal
+   RAM, the attached devices, OAM DMA progress and the page tables. Owned
+   by whoever embeds it (normally an NES, see nes.h); fields are maintained
+   by bus.c and read-only elsewhere. */
+typedef struct Bus {
+    Memory      ram;
+    Mapper     *mapper;
+    PPU        *ppu;
+    Controller *ctrl1;
+    Controller *ctrl2;
+    APU        *apu;
+
+    /* OAM DMA state */
+    int  dma_transfer;   /* 1 = DMA in progress */
+    int  dma_dummy;      /* 1 = waiting for alignment cycle */
+    Byte dma_page;       /* high byte of source address */
+    Byte dma_addr;       /* current byte index 0–255 */
+    Byte dma_data;       /* read buffer */
+
+    /* Fallback for when no mapper is connected.
+       Covers only 0xFFFE–0xFFFF so the BRK test (which writes the IRQ vector
+       directly via bus_write) still works without a cartridge. */
+    Byte irq_vector_fallback[2];
+
+    /* Current CPU instruction, for the MMC1 same-instruction write filter */
+    uint64_t instruction_id;
+    uint64_t last_mmc1_write_instruction_id;
+
+    /* Direct pointers for each 256-byte CPU page: internal RAM and its
+       mirrors, plus whatever the mapper exposes at $6000-$FFFF. NULL pages
+       (PPU/APU/IO registers, mapper registers, unmapped space) take the
+       slow path in bus_read/bus_write. */
+    Byte *read_page[256];
+    Byte *write_page[256];
+
+    /* Code tracking for the CPU decode cache and JIT. page_gen[p] changes
+       whenever the bytes visible at page p may have changed (RAM/PRG-RAM
+       write to a page holding decoded code, bank switch, reset).
+       Generation 0 is never used, so it can mark cache entries that must
+       not hit. code_page[p] is set while decoded instructions from page p
+       are live, so ordinary data writes cost a single flag test. map_epoch
+       is bumped whenever a different mapper is attached. */
+    uint32_t page_gen[256];
+    Byte     code_page[256];
+    uint32_t map_epoch;
+
+    /* Called before anything the PPU can see is touched (its registers,
+       OAM DMA, mapper registers) and before the idle horizon is measured,
+       so a PPU running behind the CPU catches up first. NULL when the PPU
+       is kept in step. */
+    void (*ppu_catch_up)(void *ctx);
+    void  *ppu_catch_up_ctx;
+} Bus;
+
+void bus_init(Bus *bus);          /* power-on state, nothing attached */
+void bus_reset(Bus *bus);
+void bus_set_mapper(Bus *bus, Mapper *m);   /* NULL to disconnect */
+void bus_connect_ppu(Bus *bus, PPU *ppu);   /* call once after ppu_init */
+void bus_connect_controllers(Bus *bus, Controller *c1, Controller *c2); /* c2 may be NULL */
+void bus_connect_apu(Bus *bus, APU *apu);
+void bus_set_ppu_catch_up(Bus *bus, void (*fn)(void *ctx), void *ctx);   /* fn NULL to clear */
+
+Byte bus_read(Bus *bus, Word addr);
+Byte bus_peek(const Bus *bus, Word addr);   /* side-effect-free read for tracing/debugging */
+void bus_write(Bus *bus, Word addr, Byte data);
+int  bus_dma_active(const Bus *bus);
+int  bus_dma_tick(Bus *bus, uint64_t system_clock);  /* returns 1 if DMA still running */
+void bus_set_cpu_instruction_id(Bus *bus, uint64_t instruction_id);
+
+/* Decode-cache support: whether a page is plain memory that may be
+   cached, and registering a page as holding decoded code so writes to it
+   bump its generation. */
+int  bus_page_cacheable(const Bus *bus, Word addr);
+void bus_mark_code_page(Bus *bus, Word addr);
+
+/* JIT support (cpu_jit.c): whether a page currently shows PRG-ROM, whose
+   bytes never change. */
+int  bus_page_rom(const Bus *bus, Word addr);
+
+/* Offset into PRG-ROM of the byte the CPU sees at addr, or -1 if addr
+   does not show PRG-ROM. Identifies code across bank switches. */
+long bus_prg_offset(const Bus *bus, Word addr);
+
+/* Idle-loop support: whether repeated reads of addr have no effect beyond
+   the first one (plain memory, PPUSTATUS), and how many CPU cycles may pass
+   before a PPU or mapper event could change what such reads return or raise
+   an interrupt. 0 when no PPU is connected. */
+int  bus_read_idle_safe(const Bus *bus, Word addr);
+int  bus_idle_cycles(const Bus *bus);
+
+/* CPU cycles that may pass before the PPU or a mapper it clocks could
+   raise an NMI or IRQ, with nothing else touching the PPU; INT_MAX when
+   no PPU is connected. */
+int  bus_interrupt_cycles(const Bus *bus);
 
 #endif
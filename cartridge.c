@@ -41,7 +41,7 @@ Cartridge *cartridge_load(const char *path) {
     cart->chr_rom   = chr;
     cart->chr_size  = chr_size;
     cart->mapper_id = ((hdr.flags6 >> 4) & 0x0F) | (hdr.flags7 & 0xF0);
-    cart->mirroring = hdr.flags6 & 0x01;
+    cart->mirroring = (hdr.flags6 & 0x08) ? 4 : (hdr.flags6 & 0x01);   /* 4 = four-screen */
     cart->has_battery = (hdr.flags6 >> 1) & 0x01;
 
     return cart;
@@ -23,7 +23,7 @@ typedef struct {
     Byte *chr_rom;      /* CHR-ROM data (NULL if CHR-RAM) */
     size_t chr_size;    /* CHR-ROM size in bytes (0 if CHR-RAM) */
     int mapper_id;      /* mapper number (0–255) */
-    Byte mirroring;     /* 0 = horizontal, 1 = vertical */
+    Byte mirroring;     /* 0 = horizontal, 1 = vertical, 4 = four-screen (MirrorMode) */
     Byte has_battery;   /* battery-backed SRAM present */
 } Cartridge;
 
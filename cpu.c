@@ -1,11 +1,20 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "cpu.h"
 
 #include "bus.h"
-#include "opcodes.h"
-#include "util.h"
+#ifdef NES_CPU_JIT
+#include "cpu_jit.h"
+#endif
+#include "profiler.h"
+#include "trace.h"
+
+/* The interpreters reach memory through the console's bus */
+#define CPU_READ(cpu, addr)         bus_read((cpu)->bus, (addr))
+#define CPU_WRITE(cpu, addr, value) bus_write((cpu)->bus, (addr), (value))
+#include "cpu_ops.h"
 
 /* ------------------------------------------------------------------ */
 /*  Type definitions                                                   */
@@ -21,12 +30,6 @@ typedef struct {
     Byte        cycles;
 } Instruction;
 
-typedef enum {
-    AM_IMP, AM_ACC, AM_IMM, AM_ZP0, AM_ZPX, AM_ZPY,
-    AM_REL, AM_ABS, AM_ABX, AM_ABY, AM_IZX, AM_IZY,
-    AM_IND
-} AddrModeId;
-
 /* ------------------------------------------------------------------ */
 /*  CPU lifecycle                                                      */
 /* ------------------------------------------------------------------ */
@@ -39,11 +42,10 @@ void cpu_reset(CPU *cpu) {
     cpu->regs.X = 0x00;
     cpu->regs.Y = 0x00;
                /*NVUBDIZC*/
-    cpu->flags = 0b00100100;
+    cpu_load_flags(cpu, 0b00100100);
 
     cpu->opcode       = 0;
     cpu->addr_abs     = 0;
-    cpu->fetched      = 0;
     cpu->page_crossed = 0;
     cpu->addr_mode_id = AM_IMP;
     cpu->cycles       = 0;
@@ -51,12 +53,12 @@ void cpu_reset(CPU *cpu) {
     cpu->irq_pending  = 0;
     cpu->cycles_remaining = 0;
 
-    bus_reset();
+    bus_reset(cpu->bus);
 
     /* Read reset vector from 0xFFFC/0xFFFD (little-endian).
        Returns 0x0000 until a mapper/ROM is connected. */
-    Byte lo = bus_read(0xFFFC);
-    Byte hi = bus_read(0xFFFD);
+    Byte lo = bus_read(cpu->bus, 0xFFFC);
+    Byte hi = bus_read(cpu->bus, 0xFFFD);
     cpu->PC = (Word)lo | ((Word)hi << 8);
 }
 
@@ -65,26 +67,41 @@ void cpu_reset(CPU *cpu) {
 /* ------------------------------------------------------------------ */
 
 void stack_push(Byte value, CPU *cpu) {
-    bus_write(0x100 + cpu->SP, value);
+    bus_write(cpu->bus, 0x100 + cpu->SP, value);
     cpu->SP -= 1;
 }
 
 Byte stack_pop(CPU *cpu) {
     cpu->SP += 1;
-    return bus_read(0x100 + cpu->SP);
+    return bus_read(cpu->bus, 0x100 + cpu->SP);
 }
 
 /* ------------------------------------------------------------------ */
 /*  Flags                                                              */
 /* ------------------------------------------------------------------ */
 
+Byte cpu_flags(const CPU *cpu) {
+    return lazy_nz_flags(cpu);
+}
+
+void cpu_load_flags(CPU *cpu, Byte flags) {
+    cpu->flags = flags | (1 << U);
+    lazy_nz_load(cpu);
+}
+
 Byte cpu_read_flag(Flags flag, CPU *cpu) {
+    if (flag == N) return flag_N(cpu);
+    if (flag == Z) return flag_Z(cpu);
     return (cpu->flags >> flag) & 0x01;
 }
 
 void cpu_set_flag(Flags flag, Byte value, CPU *cpu) {
     Byte mask = 0x01 << flag;
 
+    /* N and Z are kept in lazy_n/lazy_z */
+    if (flag == N) cpu->lazy_n = value ? 0x80 : 0x00;
+    if (flag == Z) cpu->lazy_z = value ? 0x00 : 0x01;
+
     if (value == 0) {
         cpu->flags &= ~mask;
     } else {
@@ -98,6 +115,8 @@ void cpu_set_flag(Flags flag, Byte value, CPU *cpu) {
 
 void cpu_toggle_flag(Flags flag, CPU *cpu) {
     Byte mask = 0x01 << flag;
+    if (flag == N) cpu->lazy_n ^= 0x80;
+    if (flag == Z) cpu->lazy_z = cpu->lazy_z == 0;
     cpu->flags ^= mask;
 }
 
@@ -106,7 +125,7 @@ void cpu_toggle_flag(Flags flag, CPU *cpu) {
 /* ------------------------------------------------------------------ */
 
 Byte fetch_program_byte(CPU *cpu) {
-    Byte data = bus_read(cpu->PC);
+    Byte data = bus_read(cpu->bus, cpu->PC);
     cpu->PC++;
     return data;
 }
@@ -118,837 +137,392 @@ Word fetch_program_word(CPU *cpu) {
 }
 
 /* ------------------------------------------------------------------ */
-/*  Addressing modes                                                   */
-/* ------------------------------------------------------------------ */
-
-static Byte am_IMP(CPU *cpu) {
-    cpu->addr_mode_id = AM_IMP;
-    return 0;
-}
-
-static Byte am_ACC(CPU *cpu) {
-    cpu->addr_mode_id = AM_ACC;
-    return 0;
-}
-
-static Byte am_IMM(CPU *cpu) {
-    cpu->addr_abs     = cpu->PC++;
-    cpu->addr_mode_id = AM_IMM;
-    return 0;
-}
-
-static Byte am_ZP0(CPU *cpu) {
-    cpu->addr_abs     = fetch_program_byte(cpu) & 0xFF;
-    cpu->addr_mode_id = AM_ZP0;
-    return 0;
-}
-
-static Byte am_ZPX(CPU *cpu) {
-    cpu->addr_abs     = (fetch_program_byte(cpu) + cpu->regs.X) & 0xFF;
-    cpu->addr_mode_id = AM_ZPX;
-    return 0;
-}
-
-static Byte am_ZPY(CPU *cpu) {
-    cpu->addr_abs     = (fetch_program_byte(cpu) + cpu->regs.Y) & 0xFF;
-    cpu->addr_mode_id = AM_ZPY;
-    return 0;
-}
-
-static Byte am_REL(CPU *cpu) {
-    Byte raw          = fetch_program_byte(cpu);
-    cpu->addr_abs     = (Word)(int8_t)raw;
-    cpu->addr_mode_id = AM_REL;
-    return 0;
-}
-
-static Byte am_ABS(CPU *cpu) {
-    cpu->addr_abs     = fetch_program_word(cpu);
-    cpu->addr_mode_id = AM_ABS;
-    return 0;
-}
-
-static Byte am_ABX(CPU *cpu) {
-    Word base         = fetch_program_word(cpu);
-    cpu->addr_abs     = base + cpu->regs.X;
-    cpu->addr_mode_id = AM_ABX;
-    return (cpu->addr_abs & 0xFF00) != (base & 0xFF00) ? 1 : 0;
-}
-
-static Byte am_ABY(CPU *cpu) {
-    Word base         = fetch_program_word(cpu);
-    cpu->addr_abs     = base + cpu->regs.Y;
-    cpu->addr_mode_id = AM_ABY;
-    return (cpu->addr_abs & 0xFF00) != (base & 0xFF00) ? 1 : 0;
-}
-
-static Byte am_IZX(CPU *cpu) {
-    Byte zp           = (fetch_program_byte(cpu) + cpu->regs.X) & 0xFF;
-    cpu->addr_abs     = bus_read(zp) | (bus_read((zp + 1) & 0xFF) << 8);
-    cpu->addr_mode_id = AM_IZX;
-    return 0;
-}
-
-static Byte am_IZY(CPU *cpu) {
-    Byte zp           = fetch_program_byte(cpu);
-    Word base         = bus_read(zp) | (bus_read((zp + 1) & 0xFF) << 8);
-    cpu->addr_abs     = base + cpu->regs.Y;
-    cpu->addr_mode_id = AM_IZY;
-    return (cpu->addr_abs & 0xFF00) != (base & 0xFF00) ? 1 : 0;
-}
-
-static Byte am_IND(CPU *cpu) {
-    Word ptr = fetch_program_word(cpu);
-    /* 6502 page-wrap bug: if low byte of ptr is 0xFF, high byte wraps within
-       the same page instead of crossing to the next page. */
-    Byte lo = bus_read(ptr);
-    Byte hi = bus_read((ptr & 0xFF00) | ((ptr + 1) & 0xFF));
-    cpu->addr_abs     = lo | (hi << 8);
-    cpu->addr_mode_id = AM_IND;
-    return 0;
-}
-
-/* ------------------------------------------------------------------ */
-/*  fetch()                                                            */
-/* ------------------------------------------------------------------ */
-
-static Byte fetch(CPU *cpu) {
-    if (cpu->addr_mode_id == AM_IMP) return 0;
-    if (cpu->addr_mode_id == AM_ACC) cpu->fetched = cpu->regs.A;
-    else                             cpu->fetched = bus_read(cpu->addr_abs);
-    return cpu->fetched;
-}
-
-/* ------------------------------------------------------------------ */
-/*  Flag helpers                                                       */
+/*  Table dispatcher                                                   */
 /* ------------------------------------------------------------------ */
 
-static void set_NZ_from(Byte v, CPU *cpu) {
-    cpu_set_flag(Z, v == 0, cpu);
-    cpu_set_flag(N, (v >> 7) & 1, cpu);
-}
-
-static void set_NZ_flags(CPU *cpu) {
-    set_NZ_from(cpu->regs.A, cpu);
-}
+/* am_* / op_* entry points: the addressing mode publishes its result
+   through the addr_abs / addr_mode_id scratch fields for the op. */
+#define DEFINE_TABLE_MODE(mode, len)                                       \
+    static Byte am_##mode(CPU *cpu) {                                      \
+        Word operand = 0;                                                  \
+        if (len == 1) operand = fetch_program_byte(cpu);                   \
+        if (len == 2) operand = fetch_program_word(cpu);                   \
+        cpu->addr_mode_id = AM_##mode;                                     \
+        return ea_##mode(cpu, operand, &cpu->addr_abs);                    \
+    }
+CPU_ADDR_MODES(DEFINE_TABLE_MODE)
+#undef DEFINE_TABLE_MODE
 
-void set_CMP_flags(Word result, CPU *cpu) {
-    cpu_set_flag(N, read_bit(result & 0xFF, 7), cpu);
-    cpu_set_flag(Z, (result & 0xFF) == 0x00, cpu);
-    cpu_set_flag(C, result <= 0xFF, cpu);
-}
+#define DEFINE_TABLE_OP(mnem)                                              \
+    static Byte op_##mnem(CPU *cpu) {                                      \
+        return do_##mnem(cpu, (AddrModeId)cpu->addr_mode_id, cpu->addr_abs); \
+    }
+CPU_MNEMONICS(DEFINE_TABLE_OP)
+#undef DEFINE_TABLE_OP
 
-/* ------------------------------------------------------------------ */
-/*  Branch helper                                                      */
-/* ------------------------------------------------------------------ */
+#define TABLE_ENTRY(opc, mnem, mode, cyc) [opc] = { #mnem, op_##mnem, am_##mode, cyc },
+static const Instruction INSTR_TABLE[256] = {
+    CPU_OPCODE_TABLE(TABLE_ENTRY)
+};
+#undef TABLE_ENTRY
 
-static void branch_if(CPU *cpu, Byte cond) {
-    if (!cond) return;
-    Word new_pc = cpu->PC + (int8_t)(cpu->addr_abs & 0xFF);
-    /* +1 for taken, +1 more for page cross */
-    cpu->cycles += 1 + ((cpu->PC & 0xFF00) != (new_pc & 0xFF00));
-    cpu->PC = new_pc;
+const char *cpu_opcode_name(Byte opcode) {
+    return INSTR_TABLE[opcode].name;
 }
 
 /* ------------------------------------------------------------------ */
-/*  Opcode implementations                                             */
+/*  Decode cache                                                       */
 /* ------------------------------------------------------------------ */
 
-/* --- LDA --- */
-static Byte op_LDA(CPU *cpu) {
-    fetch(cpu);
-    cpu->regs.A = cpu->fetched;
-    set_NZ_flags(cpu);
-    return 1; /* page-cross-sensitive */
-}
-
-/* --- STA --- */
-static Byte op_STA(CPU *cpu) {
-    bus_write(cpu->addr_abs, cpu->regs.A);
-    return 0;
-}
+/* Operand byte count per opcode (0 for unknown opcodes) */
+#define MODE_LEN(mode, len) enum { OPERAND_LEN_##mode = len };
+CPU_ADDR_MODES(MODE_LEN)
+#undef MODE_LEN
 
-/* --- ADC --- */
-static Byte op_ADC(CPU *cpu) {
-    fetch(cpu);
-    Byte operand = cpu->fetched;
-    Word result  = cpu->regs.A + operand + cpu_read_flag(C, cpu);
-    cpu_set_flag(C, result > 0xFF, cpu);
-    cpu_set_flag(V, ((cpu->regs.A ^ result) & (operand ^ result) & 0x80) != 0, cpu);
-    cpu->regs.A = result & 0xFF;
-    set_NZ_flags(cpu);
-    return 1;
-}
-
-/* --- AND --- */
-static Byte op_AND(CPU *cpu) {
-    fetch(cpu);
-    cpu->regs.A &= cpu->fetched;
-    set_NZ_flags(cpu);
-    return 1;
-}
-
-/* --- ASL --- */
-static Byte op_ASL(CPU *cpu) {
-    fetch(cpu);
-    Word shifted = cpu->fetched << 1;
-    cpu_set_flag(C, shifted > 0xFF, cpu);
-    cpu_set_flag(Z, (shifted & 0xFF) == 0, cpu);
-    cpu_set_flag(N, ((shifted & 0xFF) >> 7) & 1, cpu);
-    if (cpu->addr_mode_id == AM_ACC)
-        cpu->regs.A = shifted & 0xFF;
-    else
-        bus_write(cpu->addr_abs, shifted & 0xFF);
-    return 0;
-}
-
-/* --- Branches --- */
-static Byte op_BCC(CPU *cpu) { branch_if(cpu, cpu_read_flag(C, cpu) == 0); return 0; }
-static Byte op_BCS(CPU *cpu) { branch_if(cpu, cpu_read_flag(C, cpu) == 1); return 0; }
-static Byte op_BNE(CPU *cpu) { branch_if(cpu, cpu_read_flag(Z, cpu) == 0); return 0; }
-static Byte op_BEQ(CPU *cpu) { branch_if(cpu, cpu_read_flag(Z, cpu) == 1); return 0; }
-static Byte op_BPL(CPU *cpu) { branch_if(cpu, cpu_read_flag(N, cpu) == 0); return 0; }
-static Byte op_BMI(CPU *cpu) { branch_if(cpu, cpu_read_flag(N, cpu) == 1); return 0; }
-static Byte op_BVC(CPU *cpu) { branch_if(cpu, cpu_read_flag(V, cpu) == 0); return 0; }
-static Byte op_BVS(CPU *cpu) { branch_if(cpu, cpu_read_flag(V, cpu) == 1); return 0; }
-
-/* --- BIT --- */
-static Byte op_BIT(CPU *cpu) {
-    fetch(cpu);
-    cpu_set_flag(Z, (cpu->regs.A & cpu->fetched) == 0, cpu);
-    cpu_set_flag(N, read_bit(cpu->fetched, 7), cpu);
-    cpu_set_flag(V, read_bit(cpu->fetched, 6), cpu);
-    return 0;
-}
-
-/* --- BRK --- */
-static Byte op_BRK(CPU *cpu) {
-    /* After dispatch fetched opcode, PC = BRK_addr+1.
-       Push PC+1 to skip the padding byte; RTI returns to BRK_addr+2. */
-    Word stack_PC    = cpu->PC + 1;
-    Byte stack_PC_lo = stack_PC & 0xFF;
-    Byte stack_PC_hi = (stack_PC >> 8) & 0xFF;
-    stack_push(stack_PC_hi, cpu);
-    stack_push(stack_PC_lo, cpu);
-
-    cpu_set_flag(I, 1, cpu);
-    cpu_set_flag(B, 1, cpu);
-    stack_push(cpu->flags, cpu);
-    cpu_set_flag(B, 0, cpu);
-
-    Byte lo = bus_read(0xFFFE);
-    Byte hi = bus_read(0xFFFF);
-    cpu->PC = lo | (hi << 8);
-    return 0;
-}
+#define LEN_ENTRY(opc, mnem, mode, cyc) [opc] = OPERAND_LEN_##mode,
+static const Byte OPERAND_LEN[256] = {
+    CPU_OPCODE_TABLE(LEN_ENTRY)
+};
+#undef LEN_ENTRY
+
+/* Predecoded instructions for the fused engine, direct-mapped by PC.
+   An entry is valid while the generation of its page still matches
+   the bus's page_gen: the bus bumps it on bank switches and on writes to pages
+   holding decoded code, which covers both PRG-ROM banking and code running
+   from RAM or PRG-RAM. Instructions whose bytes straddle a page, or that
+   sit on pages the bus cannot map directly, are decoded every time. */
+typedef struct {
+    uint32_t gen;      /* page generation at decode time, 0 = empty */
+    Word     pc;
+    Word     operand;  /* operand bytes, little-endian */
+    Byte     opcode;
+    Byte     len;      /* operand byte count */
+} DecodedInstr;
 
-/* --- Clear flags --- */
-static Byte op_CLC(CPU *cpu) { cpu_set_flag(C, 0, cpu); return 0; }
-static Byte op_CLD(CPU *cpu) { cpu_set_flag(D, 0, cpu); return 0; }
-static Byte op_CLI(CPU *cpu) { cpu_set_flag(I, 0, cpu); return 0; }
-static Byte op_CLV(CPU *cpu) { cpu_set_flag(V, 0, cpu); return 0; }
-
-/* --- CMP --- */
-static Byte op_CMP(CPU *cpu) {
-    fetch(cpu);
-    Word result = cpu->regs.A - cpu->fetched;
-    set_CMP_flags(result, cpu);
-    return 1;
-}
+#define DECODE_CACHE_SIZE 8192
 
-/* --- CPX --- */
-static Byte op_CPX(CPU *cpu) {
-    fetch(cpu);
-    Word result = cpu->regs.X - cpu->fetched;
-    set_CMP_flags(result, cpu);
-    return 0;
-}
+/* Last loop found by idle_scan (see "Idle-loop skipping" below) */
+typedef struct {
+    Word     head;        /* loop start: target of the backward jump */
+    Word     end;         /* first byte after the jump back */
+    uint32_t gen;         /* page generation when the body was scanned */
+    Byte     ok;          /* body qualifies as an idle loop */
+    Byte     misses;
+    Byte     max_cycles;  /* upper bound for one pass through the body */
+} IdleLoop;
+
+struct CpuCache {
+    DecodedInstr decode[DECODE_CACHE_SIZE];
+    IdleLoop     idle;
+    int          idle_skip_enabled;
+#ifdef NES_CPU_JIT
+    CpuJit      *jit;
+#endif
+};
 
-/* --- CPY --- */
-static Byte op_CPY(CPU *cpu) {
-    fetch(cpu);
-    Word result = cpu->regs.Y - cpu->fetched;
-    set_CMP_flags(result, cpu);
+int cpu_init(CPU *cpu, Bus *bus) {
+    memset(cpu, 0, sizeof(*cpu));
+    cpu->bus   = bus;
+    cpu->cache = calloc(1, sizeof(*cpu->cache));
+    if (!cpu->cache) return -1;
+    cpu->cache->idle_skip_enabled = 1;
+#ifdef NES_CPU_JIT
+    cpu->cache->jit = cpu_jit_create(bus);
+    if (!cpu->cache->jit) {
+        cpu_free(cpu);
+        return -1;
+    }
+#endif
     return 0;
 }
 
-/* --- DEC --- */
-static Byte op_DEC(CPU *cpu) {
-    fetch(cpu);
-    Byte result = cpu->fetched - 1;
-    bus_write(cpu->addr_abs, result);
-    set_NZ_from(result, cpu);
-    return 0;
+void cpu_free(CPU *cpu) {
+    if (!cpu->cache) return;
+#ifdef NES_CPU_JIT
+    cpu_jit_destroy(cpu->cache->jit);
+#endif
+    free(cpu->cache);
+    cpu->cache = NULL;
 }
 
-/* --- DEX --- */
-static Byte op_DEX(CPU *cpu) {
-    cpu->regs.X--;
-    set_NZ_from(cpu->regs.X, cpu);
-    return 0;
+static void cpu_decode_at(CPU *cpu, Word pc, DecodedInstr *d) {
+    d->pc      = pc;
+    d->opcode  = bus_read(cpu->bus, pc);
+    d->len     = OPERAND_LEN[d->opcode];
+    d->operand = 0;
+    if (d->len >= 1) d->operand  = bus_read(cpu->bus, (Word)(pc + 1));
+    if (d->len == 2) d->operand |= bus_read(cpu->bus, (Word)(pc + 2)) << 8;
 }
 
-/* --- DEY --- */
-static Byte op_DEY(CPU *cpu) {
-    cpu->regs.Y--;
-    set_NZ_from(cpu->regs.Y, cpu);
-    return 0;
+CPU_INLINE const DecodedInstr *cpu_decode(CPU *cpu, Word pc, DecodedInstr *scratch) {
+    Bus *bus = cpu->bus;
+    DecodedInstr *d = &cpu->cache->decode[pc & (DECODE_CACHE_SIZE - 1)];
+    uint32_t gen = bus->page_gen[pc >> 8];
+    if (d->pc == pc && d->gen == gen && gen != 0) {
+        return d;
+    }
+    if (!bus_page_cacheable(bus, pc) || ((pc + 2) >> 8) != (pc >> 8)) {
+        cpu_decode_at(cpu, pc, scratch);
+        return scratch;
+    }
+    cpu_decode_at(cpu, pc, d);
+    d->gen = gen;
+    bus_mark_code_page(bus, pc);
+    return d;
 }
 
 /* ------------------------------------------------------------------ */
-/*  Group A — Flag Sets                                                */
-/* ------------------------------------------------------------------ */
-
-/* SEC */
-static Byte op_SEC(CPU *cpu) { cpu_set_flag(C, 1, cpu); return 0; }
-
-/* SED */
-static Byte op_SED(CPU *cpu) { cpu_set_flag(D, 1, cpu); return 0; }
-
-/* SEI */
-static Byte op_SEI(CPU *cpu) { cpu_set_flag(I, 1, cpu); return 0; }
-
-/* ------------------------------------------------------------------ */
-/*  Group B — NOP                                                      */
-/* ------------------------------------------------------------------ */
-
-/* NOP */
-static Byte op_NOP(CPU *cpu) { (void)cpu; return 0; }
-
-/* ------------------------------------------------------------------ */
-/*  Group C — Register Transfers                                       */
+/*  Dispatch loop                                                      */
 /* ------------------------------------------------------------------ */
 
-/* TAX */
-static Byte op_TAX(CPU *cpu) {
-    cpu->regs.X = cpu->regs.A;
-    set_NZ_from(cpu->regs.X, cpu);
-    return 0;
-}
-
-/* TAY */
-static Byte op_TAY(CPU *cpu) {
-    cpu->regs.Y = cpu->regs.A;
-    set_NZ_from(cpu->regs.Y, cpu);
-    return 0;
-}
-
-/* TXA */
-static Byte op_TXA(CPU *cpu) {
-    cpu->regs.A = cpu->regs.X;
-    set_NZ_from(cpu->regs.A, cpu);
-    return 0;
-}
-
-/* TYA */
-static Byte op_TYA(CPU *cpu) {
-    cpu->regs.A = cpu->regs.Y;
-    set_NZ_from(cpu->regs.A, cpu);
-    return 0;
+/* Reference engine: two indirect calls per instruction through
+   INSTR_TABLE, talking through the CPU scratch fields. */
+void cpu_step_table(CPU *cpu) {
+    cpu->opcode = fetch_program_byte(cpu);
+    const Instruction *ins = &INSTR_TABLE[cpu->opcode];
+    if (ins->op == NULL) {
+        cpu_unknown_opcode(cpu);
+        return;
+    }
+    cpu->cycles = 0;
+    Byte am_extra = ins->mode(cpu);
+    Byte op_extra = ins->op(cpu);
+    cpu->cycles += ins->cycles + (am_extra & op_extra);
+    cpu_service_interrupts(cpu);
 }
 
-/* TSX */
-static Byte op_TSX(CPU *cpu) {
-    cpu->regs.X = cpu->SP;
-    set_NZ_from(cpu->regs.X, cpu);
-    return 0;
-}
+/* Fused engine: one switch case per opcode with the addressing mode and
+   the operation inlined together, so the effective address stays in a
+   local and accumulator/memory variants are resolved at compile time.
+   Opcode and operands come from the decode cache. */
+void cpu_step_fused(CPU *cpu) {
+    DecodedInstr scratch;
+    const DecodedInstr *d = cpu_decode(cpu, cpu->PC, &scratch);
+    Word operand = d->operand;
 
-/* TXS */
-static Byte op_TXS(CPU *cpu) {
-    cpu->SP = cpu->regs.X;
-    return 0;
+    cpu->opcode = d->opcode;
+    cpu->PC    += 1 + d->len;
+    cpu->cycles = 0;
+    switch (cpu->opcode) {
+#define FUSED_CASE(opc, mnem, mode, cyc)                                   \
+        case opc: {                                                        \
+            Word addr;                                                     \
+            Byte am_extra = ea_##mode(cpu, operand, &addr);                \
+            Byte op_extra = do_##mnem(cpu, AM_##mode, addr);               \
+            cpu->cycles += cyc + (am_extra & op_extra);                    \
+            break;                                                         \
+        }
+        CPU_OPCODE_TABLE(FUSED_CASE)
+#undef FUSED_CASE
+        default:
+            cpu_unknown_opcode(cpu);
+            return;
+    }
+    cpu_service_interrupts(cpu);
+}
+
+#ifdef NES_CPU_JIT
+/* JIT engine: runs a whole translated block per call and reports its
+   cycles as one step, so callers counting cycles_remaining down see a
+   single long instruction. The block only runs instructions that start
+   before the PPU could raise an interrupt (bus_interrupt_cycles), so none
+   can become pending while its cycles are counted down and interrupts
+   are taken after the same instruction as in the interpreter. Whatever
+   the translator leaves to the interpreter, including an access that made
+   a block leave before its first instruction, goes through the fused
+   engine. */
+void cpu_step_jit(CPU *cpu) {
+    /* an interrupt that is already pending is taken after one instruction,
+       exactly as without the JIT */
+    int pending = cpu->nmi_pending || (cpu->irq_pending && !cpu_read_flag(I, cpu));
+    int budget  = pending ? 0 : bus_interrupt_cycles(cpu->bus);
+    CpuJitBlock block = budget > 0 ? cpu_jit_block(cpu->cache->jit, cpu->PC) : NULL;
+    if (block) {
+        cpu->cycles = 0;
+        block(cpu, budget);
+        if (cpu->cycles != 0) {
+            cpu_service_interrupts(cpu);
+            return;
+        }
+    }
+    cpu_step_fused(cpu);
 }
+#endif
 
 /* ------------------------------------------------------------------ */
-/*  Group D — INC/INX/INY                                              */
+/*  Idle-loop skipping                                                 */
 /* ------------------------------------------------------------------ */
 
-/* INC */
-static Byte op_INC(CPU *cpu) {
-    fetch(cpu);
-    Byte result = cpu->fetched + 1;
-    bus_write(cpu->addr_abs, result);
-    set_NZ_from(result, cpu);
-    return 0;
-}
-
-/* INX */
-static Byte op_INX(CPU *cpu) {
-    cpu->regs.X++;
-    set_NZ_from(cpu->regs.X, cpu);
-    return 0;
-}
-
-/* INY */
-static Byte op_INY(CPU *cpu) {
-    cpu->regs.Y++;
-    set_NZ_from(cpu->regs.Y, cpu);
-    return 0;
-}
+/* A short loop that only reads plain memory or PPUSTATUS, computes on
+   registers and branches back to its start can do nothing new until an
+   interrupt arrives or the PPU changes what it reads. Once one pass
+   leaves every register exactly as it found it, further passes up to the
+   bus's idle horizon are accounted as cycles without being executed. The
+   PPU, APU and mapper still see every cycle, so nothing but the CPU's own
+   work changes. */
 
-/* ------------------------------------------------------------------ */
-/*  Group E — EOR, ORA, SBC                                            */
-/* ------------------------------------------------------------------ */
-
-/* EOR */
-static Byte op_EOR(CPU *cpu) {
-    fetch(cpu);
-    cpu->regs.A ^= cpu->fetched;
-    set_NZ_flags(cpu);
-    return 1;
-}
+#define IDLE_MAX_BYTES  16   /* longest loop body considered */
+#define IDLE_MAX_MISSES 2    /* passes that did not repeat before giving up */
 
-/* ORA */
-static Byte op_ORA(CPU *cpu) {
-    fetch(cpu);
-    cpu->regs.A |= cpu->fetched;
-    set_NZ_flags(cpu);
-    return 1;
-}
+enum { IDLE_NO, IDLE_REG, IDLE_READ, IDLE_BRANCH, IDLE_JUMP };
 
-/* SBC */
-static Byte op_SBC(CPU *cpu) {
-    fetch(cpu);
-    Byte operand = cpu->fetched ^ 0xFF;
-    Word result  = cpu->regs.A + operand + cpu_read_flag(C, cpu);
-    cpu_set_flag(C, result > 0xFF, cpu);
-    cpu_set_flag(V, ((cpu->regs.A ^ result) & (operand ^ result) & 0x80) != 0, cpu);
-    cpu->regs.A = result & 0xFF;
-    set_NZ_flags(cpu);
-    return 1;
+#define IDLE_ENTRY(opc, mnem, mode, cyc) [opc] = { MN_##mnem, AM_##mode, cyc },
+static const struct { Byte mnem, mode, cycles; } IDLE_INFO[256] = {
+    CPU_OPCODE_TABLE(IDLE_ENTRY)
+};
+#undef IDLE_ENTRY
+
+void cpu_set_idle_skip(CPU *cpu, int enabled) {
+    cpu->cache->idle_skip_enabled = enabled;
+}
+
+static int idle_kind(Byte opcode) {
+    Byte mode = IDLE_INFO[opcode].mode;
+    switch (IDLE_INFO[opcode].mnem) {
+        case MN_LDA: case MN_LDX: case MN_LDY: case MN_BIT:
+        case MN_CMP: case MN_CPX: case MN_CPY:
+        case MN_AND: case MN_ORA: case MN_EOR: case MN_ADC: case MN_SBC:
+            return (mode == AM_IMM || mode == AM_ZP0 || mode == AM_ABS) ? IDLE_READ : IDLE_NO;
+        case MN_TAX: case MN_TAY: case MN_TXA: case MN_TYA: case MN_TSX:
+        case MN_CLC: case MN_SEC: case MN_CLV: case MN_CLD: case MN_SED:
+        case MN_NOP:
+            return IDLE_REG;
+        case MN_ASL: case MN_LSR: case MN_ROL: case MN_ROR:
+            return mode == AM_ACC ? IDLE_REG : IDLE_NO;
+        case MN_BPL: case MN_BMI: case MN_BVC: case MN_BVS:
+        case MN_BCC: case MN_BCS: case MN_BNE: case MN_BEQ:
+            return IDLE_BRANCH;
+        case MN_JMP:
+            return mode == AM_ABS ? IDLE_JUMP : IDLE_NO;
+        default:
+            return IDLE_NO;
+    }
 }
 
-/* ------------------------------------------------------------------ */
-/*  Group F — LDX, LDY, STX, STY                                        */
-/* ------------------------------------------------------------------ */
-
-/* LDX */
-static Byte op_LDX(CPU *cpu) {
-    fetch(cpu);
-    cpu->regs.X = cpu->fetched;
-    set_NZ_from(cpu->regs.X, cpu);
-    return 1;
+static void idle_close(CPU *cpu, Word head, Word end, int cycles) {
+    IdleLoop *idle = &cpu->cache->idle;
+    idle->end        = end;
+    idle->max_cycles = (Byte)cycles;
+    idle->ok         = 1;
+    bus_mark_code_page(cpu->bus, head);   /* a write to the body must rescan it */
+}
+
+/* Decide whether the code at head is an idle loop: straight-line
+   qualifying instructions within one page, forward exits only, closed by
+   a branch or JMP back to head. */
+static void idle_scan(CPU *cpu, Word head) {
+    Bus *bus = cpu->bus;
+    IdleLoop *idle = &cpu->cache->idle;
+    idle->head   = head;
+    idle->gen    = bus->page_gen[head >> 8];
+    idle->ok     = 0;
+    idle->misses = 0;
+    if (!bus_page_cacheable(bus, head)) return;
+
+    Word pc = head;
+    int cycles = 0;
+    while ((Word)(pc - head) < IDLE_MAX_BYTES) {
+        Byte opcode = bus_peek(bus, pc);
+        Byte len    = OPERAND_LEN[opcode];
+        Word next   = pc + 1 + len;
+        if (IDLE_INFO[opcode].cycles == 0 || ((next - 1) >> 8) != (head >> 8)) return;
+
+        Word operand = len == 2 ? (Word)(bus_peek(bus, pc + 1) | (bus_peek(bus, pc + 2) << 8))
+                                : bus_peek(bus, pc + 1);
+        cycles += IDLE_INFO[opcode].cycles;
+        switch (idle_kind(opcode)) {
+            case IDLE_READ:
+                if (IDLE_INFO[opcode].mode != AM_IMM && !bus_read_idle_safe(bus, operand)) return;
+                break;
+            case IDLE_REG:
+                break;
+            case IDLE_BRANCH: {
+                Word target = next + (int8_t)operand;
+                cycles += 2;   /* taken across a page, at worst */
+                if (target == head) { idle_close(cpu, head, next, cycles); return; }
+                if (target <= pc) return;
+                break;
+            }
+            case IDLE_JUMP:
+                if (operand == head) idle_close(cpu, head, next, cycles);
+                return;
+            default:
+                return;
+        }
+        pc = next;
+    }
 }
 
-/* LDY */
-static Byte op_LDY(CPU *cpu) {
-    fetch(cpu);
-    cpu->regs.Y = cpu->fetched;
-    set_NZ_from(cpu->regs.Y, cpu);
+/* The single-instruction engine this build dispatches to */
+static void cpu_step_insn(CPU *cpu) {
+#if defined(NES_CPU_FUSED) || defined(NES_CPU_JIT)
+    cpu_step_fused(cpu);
+#else
+    cpu_step_table(cpu);
+#endif
+}
+
+/* Called at the head of the last scanned loop. Runs one pass for real and,
+   if it came back to head unchanged, adds as many identical passes as fit
+   before the idle horizon. Returns 0 to leave the step to the engine. */
+static int cpu_idle_skip(CPU *cpu) {
+    IdleLoop *idle = &cpu->cache->idle;
+    if (cpu->bus->page_gen[idle->head >> 8] != idle->gen) idle_scan(cpu, idle->head);
+    if (!idle->ok || idle->misses >= IDLE_MAX_MISSES) return 0;
+    if (cpu->nmi_pending || (cpu->irq_pending && !cpu_read_flag(I, cpu))) return 0;
+    if (TRACE_ENABLED(TRACE_CPU | TRACE_BUS | TRACE_WATCH)) return 0;
+
+    int budget = bus_idle_cycles(cpu->bus);
+    if (budget > 255) budget = 255;   /* cycles is reported in a Byte */
+    if (budget < 2 * idle->max_cycles) return 0;
+
+    Regs regs  = cpu->regs;
+    Byte flags = lazy_nz_flags(cpu);
+    Byte sp    = cpu->SP;
+    int cycles = 0;
+    do {
+        cpu_step_insn(cpu);
+        cycles += cpu->cycles;
+    } while (cpu->PC > idle->head && cpu->PC < idle->end);
+
+    if (cpu->PC == idle->head) {
+        if (memcmp(&regs, &cpu->regs, sizeof(Regs)) == 0 &&
+            flags == lazy_nz_flags(cpu) && sp == cpu->SP) {
+            cycles += (budget - cycles) / cycles * cycles;
+            idle->misses = 0;
+        } else {
+            idle->misses++;
+        }
+    }
+    cpu->cycles = (Byte)cycles;
     return 1;
 }
 
-/* STX */
-static Byte op_STX(CPU *cpu) {
-    bus_write(cpu->addr_abs, cpu->regs.X);
-    return 0;
-}
-
-/* STY */
-static Byte op_STY(CPU *cpu) {
-    bus_write(cpu->addr_abs, cpu->regs.Y);
-    return 0;
-}
-
-/* ------------------------------------------------------------------ */
-/*  Group G — LSR, ROL, ROR                                            */
-/* ------------------------------------------------------------------ */
-
-/* LSR */
-static Byte op_LSR(CPU *cpu) {
-    fetch(cpu);
-    cpu_set_flag(C, cpu->fetched & 0x01, cpu);
-    Byte result = cpu->fetched >> 1;
-    cpu_set_flag(N, 0, cpu);
-    cpu_set_flag(Z, result == 0, cpu);
-    if (cpu->addr_mode_id == AM_ACC) cpu->regs.A = result;
-    else                             bus_write(cpu->addr_abs, result);
-    return 0;
-}
-
-/* ROL */
-static Byte op_ROL(CPU *cpu) {
-    fetch(cpu);
-    Byte old_c = cpu_read_flag(C, cpu);
-    cpu_set_flag(C, (cpu->fetched >> 7) & 1, cpu);
-    Byte result = (cpu->fetched << 1) | old_c;
-    set_NZ_from(result, cpu);
-    if (cpu->addr_mode_id == AM_ACC) cpu->regs.A = result;
-    else                             bus_write(cpu->addr_abs, result);
-    return 0;
-}
-
-/* ROR */
-static Byte op_ROR(CPU *cpu) {
-    fetch(cpu);
-    Byte old_c = cpu_read_flag(C, cpu);
-    cpu_set_flag(C, cpu->fetched & 0x01, cpu);
-    Byte result = (old_c << 7) | (cpu->fetched >> 1);
-    set_NZ_from(result, cpu);
-    if (cpu->addr_mode_id == AM_ACC) cpu->regs.A = result;
-    else                             bus_write(cpu->addr_abs, result);
-    return 0;
-}
-
-/* ------------------------------------------------------------------ */
-/*  Group H — Stack Ops                                                */
-/* ------------------------------------------------------------------ */
-
-/* PHA */
-static Byte op_PHA(CPU *cpu) {
-    stack_push(cpu->regs.A, cpu);
-    return 0;
-}
-
-/* PHP */
-static Byte op_PHP(CPU *cpu) {
-    stack_push(cpu->flags | 0x30, cpu);
-    return 0;
-}
-
-/* PLA */
-static Byte op_PLA(CPU *cpu) {
-    cpu->regs.A = stack_pop(cpu);
-    set_NZ_flags(cpu);
-    return 0;
-}
-
-/* PLP */
-static Byte op_PLP(CPU *cpu) {
-    cpu->flags = (stack_pop(cpu) & 0xCF) | 0x20;
-    return 0;
-}
-
-/* ------------------------------------------------------------------ */
-/*  Group I — Jumps and Subroutines                                    */
-/* ------------------------------------------------------------------ */
-
-/* JMP */
-static Byte op_JMP(CPU *cpu) {
-    cpu->PC = cpu->addr_abs;
-    return 0;
-}
-
-/* JSR */
-static Byte op_JSR(CPU *cpu) {
-    Word return_addr = cpu->PC - 1;
-    stack_push((return_addr >> 8) & 0xFF, cpu);
-    stack_push(return_addr & 0xFF, cpu);
-    cpu->PC = cpu->addr_abs;
-    return 0;
-}
-
-/* RTS */
-static Byte op_RTS(CPU *cpu) {
-    Byte lo = stack_pop(cpu);
-    Byte hi = stack_pop(cpu);
-    cpu->PC = ((hi << 8) | lo) + 1;
-    return 0;
-}
-
-/* RTI */
-static Byte op_RTI(CPU *cpu) {
-    cpu->flags = (stack_pop(cpu) & 0xCF) | 0x20;
-    Byte lo    = stack_pop(cpu);
-    Byte hi    = stack_pop(cpu);
-    cpu->PC    = (hi << 8) | lo;
-    return 0;
-}
-
-/* ------------------------------------------------------------------ */
-/*  Instruction lookup table                                           */
-/* ------------------------------------------------------------------ */
-
-static const Instruction INSTR_TABLE[256] = {
-    /* BRK */
-    [0x00] = { "BRK", op_BRK, am_IMP, 7 },
-
-    /* AND */
-    [OPC_AND_INDX]  = { "AND", op_AND, am_IZX, 6 },
-    [OPC_AND_ZP]    = { "AND", op_AND, am_ZP0, 3 },
-    [OPC_AND_IM]    = { "AND", op_AND, am_IMM, 2 },
-    [OPC_AND_ABS]   = { "AND", op_AND, am_ABS, 4 },
-    [OPC_AND_ABSY]  = { "AND", op_AND, am_ABY, 4 },
-    [OPC_AND_ZPX]   = { "AND", op_AND, am_ZPX, 4 },
-    [OPC_AND_ABSX]  = { "AND", op_AND, am_ABX, 4 },
-    [OPC_AND_INDY]  = { "AND", op_AND, am_IZY, 5 },
-
-    /* BIT */
-    [OPC_BIT_ZP]    = { "BIT", op_BIT, am_ZP0, 3 },
-    [OPC_BIT_ABS]   = { "BIT", op_BIT, am_ABS, 4 },
-
-    /* Branches (base = 2) */
-    [OPC_BPL_REL]   = { "BPL", op_BPL, am_REL, 2 },
-    [OPC_BMI_REL]   = { "BMI", op_BMI, am_REL, 2 },
-    [OPC_BVC_REL]   = { "BVC", op_BVC, am_REL, 2 },
-    [OPC_BVS_REL]   = { "BVS", op_BVS, am_REL, 2 },
-    [OPC_BCC_REL]   = { "BCC", op_BCC, am_REL, 2 },
-    [OPC_BCS_REL]   = { "BCS", op_BCS, am_REL, 2 },
-    [OPC_BNE_REL]   = { "BNE", op_BNE, am_REL, 2 },
-    [OPC_BEQ_REL]   = { "BEQ", op_BEQ, am_REL, 2 },
-
-    /* ASL */
-    [OPC_ASL_ACC]   = { "ASL", op_ASL, am_ACC, 2 },
-    [OPC_ASL_ZP]    = { "ASL", op_ASL, am_ZP0, 5 },
-    [OPC_ASL_ZPX]   = { "ASL", op_ASL, am_ZPX, 6 },
-    [OPC_ASL_ABS]   = { "ASL", op_ASL, am_ABS, 6 },
-    [OPC_ASL_ABSX]  = { "ASL", op_ASL, am_ABX, 7 },
-
-    /* ADC */
-    [OPC_ADC_IM]    = { "ADC", op_ADC, am_IMM, 2 },
-    [OPC_ADC_ZP]    = { "ADC", op_ADC, am_ZP0, 3 },
-    [OPC_ADC_ZPX]   = { "ADC", op_ADC, am_ZPX, 4 },
-    [OPC_ADC_ABS]   = { "ADC", op_ADC, am_ABS, 4 },
-    [OPC_ADC_ABSX]  = { "ADC", op_ADC, am_ABX, 4 },
-    [OPC_ADC_ABSY]  = { "ADC", op_ADC, am_ABY, 4 },
-    [OPC_ADC_INDX]  = { "ADC", op_ADC, am_IZX, 6 },
-    [OPC_ADC_INDY]  = { "ADC", op_ADC, am_IZY, 5 },
-
-    /* LDA */
-    [OPC_LDA_IM]    = { "LDA", op_LDA, am_IMM, 2 },
-    [OPC_LDA_ZP]    = { "LDA", op_LDA, am_ZP0, 3 },
-    [OPC_LDA_ZPX]   = { "LDA", op_LDA, am_ZPX, 4 },
-    [OPC_LDA_ABS]   = { "LDA", op_LDA, am_ABS, 4 },
-    [OPC_LDA_ABSX]  = { "LDA", op_LDA, am_ABX, 4 },
-    [OPC_LDA_ABSY]  = { "LDA", op_LDA, am_ABY, 4 },
-    [OPC_LDA_INDX]  = { "LDA", op_LDA, am_IZX, 6 },
-    [OPC_LDA_INDY]  = { "LDA", op_LDA, am_IZY, 5 },
-
-    /* STA -- no page-cross penalty, base cycles already account for it */
-    [OPC_STA_ZP]    = { "STA", op_STA, am_ZP0, 3 },
-    [OPC_STA_ZPX]   = { "STA", op_STA, am_ZPX, 4 },
-    [OPC_STA_ABS]   = { "STA", op_STA, am_ABS, 4 },
-    [OPC_STA_ABSX]  = { "STA", op_STA, am_ABX, 5 },
-    [OPC_STA_ABSY]  = { "STA", op_STA, am_ABY, 5 },
-    [OPC_STA_INDX]  = { "STA", op_STA, am_IZX, 6 },
-    [OPC_STA_INDY]  = { "STA", op_STA, am_IZY, 6 },
-
-    /* Clear flags */
-    [OPC_CLC_IMP]   = { "CLC", op_CLC, am_IMP, 2 },
-    [OPC_CLD_IMP]   = { "CLD", op_CLD, am_IMP, 2 },
-    [OPC_CLI_IMP]   = { "CLI", op_CLI, am_IMP, 2 },
-    [OPC_CLV_IMP]   = { "CLV", op_CLV, am_IMP, 2 },
-
-    /* CMP */
-    [OPC_CMP_IM]    = { "CMP", op_CMP, am_IMM, 2 },
-    [OPC_CMP_ZP]    = { "CMP", op_CMP, am_ZP0, 3 },
-    [OPC_CMP_ZPX]   = { "CMP", op_CMP, am_ZPX, 4 },
-    [OPC_CMP_ABS]   = { "CMP", op_CMP, am_ABS, 4 },
-    [OPC_CMP_ABSX]  = { "CMP", op_CMP, am_ABX, 4 },
-    [OPC_CMP_ABSY]  = { "CMP", op_CMP, am_ABY, 4 },
-    [OPC_CMP_INDX]  = { "CMP", op_CMP, am_IZX, 6 },
-    [OPC_CMP_INDY]  = { "CMP", op_CMP, am_IZY, 5 },
-
-    /* CPX */
-    [OPC_CPX_IM]    = { "CPX", op_CPX, am_IMM, 2 },
-    [OPC_CPX_ZP]    = { "CPX", op_CPX, am_ZP0, 3 },
-    [OPC_CPX_ABS]   = { "CPX", op_CPX, am_ABS, 4 },
-
-    /* CPY */
-    [OPC_CPY_IM]    = { "CPY", op_CPY, am_IMM, 2 },
-    [OPC_CPY_ZP]    = { "CPY", op_CPY, am_ZP0, 3 },
-    [OPC_CPY_ABS]   = { "CPY", op_CPY, am_ABS, 4 },
-
-    /* DEC */
-    [OPC_DEC_ZP]    = { "DEC", op_DEC, am_ZP0, 5 },
-    [OPC_DEC_ZPX]   = { "DEC", op_DEC, am_ZPX, 6 },
-    [OPC_DEC_ABS]   = { "DEC", op_DEC, am_ABS, 6 },
-    [OPC_DEC_ABSX]  = { "DEC", op_DEC, am_ABX, 7 },
-
-    /* DEX, DEY */
-    [OPC_DEX_IMP]   = { "DEX", op_DEX, am_IMP, 2 },
-    [OPC_DEY_IMP]   = { "DEY", op_DEY, am_IMP, 2 },
-
-    /* SEC, SED, SEI */
-    [OPC_SEC_IMP]   = { "SEC", op_SEC, am_IMP, 2 },
-    [OPC_SED_IMP]   = { "SED", op_SED, am_IMP, 2 },
-    [OPC_SEI_IMP]   = { "SEI", op_SEI, am_IMP, 2 },
-
-    /* NOP */
-    [OPC_NOP_IMP]   = { "NOP", op_NOP, am_IMP, 2 },
-
-    /* Register transfers */
-    [OPC_TAX_IMP]   = { "TAX", op_TAX, am_IMP, 2 },
-    [OPC_TAY_IMP]   = { "TAY", op_TAY, am_IMP, 2 },
-    [OPC_TXA_IMP]   = { "TXA", op_TXA, am_IMP, 2 },
-    [OPC_TYA_IMP]   = { "TYA", op_TYA, am_IMP, 2 },
-    [OPC_TSX_IMP]   = { "TSX", op_TSX, am_IMP, 2 },
-    [OPC_TXS_IMP]   = { "TXS", op_TXS, am_IMP, 2 },
-
-    /* INC */
-    [OPC_INC_ZP]    = { "INC", op_INC, am_ZP0, 5 },
-    [OPC_INC_ZPX]   = { "INC", op_INC, am_ZPX, 6 },
-    [OPC_INC_ABS]   = { "INC", op_INC, am_ABS, 6 },
-    [OPC_INC_ABSX]  = { "INC", op_INC, am_ABX, 7 },
-
-    /* INX, INY */
-    [OPC_INX_IMP]   = { "INX", op_INX, am_IMP, 2 },
-    [OPC_INY_IMP]   = { "INY", op_INY, am_IMP, 2 },
-
-    /* EOR */
-    [OPC_EOR_INDX]  = { "EOR", op_EOR, am_IZX, 6 },
-    [OPC_EOR_ZP]    = { "EOR", op_EOR, am_ZP0, 3 },
-    [OPC_EOR_IM]    = { "EOR", op_EOR, am_IMM, 2 },
-    [OPC_EOR_ABS]   = { "EOR", op_EOR, am_ABS, 4 },
-    [OPC_EOR_ZPX]   = { "EOR", op_EOR, am_ZPX, 4 },
-    [OPC_EOR_ABSX]  = { "EOR", op_EOR, am_ABX, 4 },
-    [OPC_EOR_ABSY]  = { "EOR", op_EOR, am_ABY, 4 },
-    [OPC_EOR_INDY]  = { "EOR", op_EOR, am_IZY, 5 },
-
-    /* ORA */
-    [OPC_ORA_INDX]  = { "ORA", op_ORA, am_IZX, 6 },
-    [OPC_ORA_ZP]    = { "ORA", op_ORA, am_ZP0, 3 },
-    [OPC_ORA_IM]    = { "ORA", op_ORA, am_IMM, 2 },
-    [OPC_ORA_ABS]   = { "ORA", op_ORA, am_ABS, 4 },
-    [OPC_ORA_ZPX]   = { "ORA", op_ORA, am_ZPX, 4 },
-    [OPC_ORA_ABSX]  = { "ORA", op_ORA, am_ABX, 4 },
-    [OPC_ORA_ABSY]  = { "ORA", op_ORA, am_ABY, 4 },
-    [OPC_ORA_INDY]  = { "ORA", op_ORA, am_IZY, 5 },
-
-    /* SBC */
-    [OPC_SBC_IM]    = { "SBC", op_SBC, am_IMM, 2 },
-    [OPC_SBC_ZP]    = { "SBC", op_SBC, am_ZP0, 3 },
-    [OPC_SBC_ZPX]   = { "SBC", op_SBC, am_ZPX, 4 },
-    [OPC_SBC_ABS]   = { "SBC", op_SBC, am_ABS, 4 },
-    [OPC_SBC_ABSX]  = { "SBC", op_SBC, am_ABX, 4 },
-    [OPC_SBC_ABSY]  = { "SBC", op_SBC, am_ABY, 4 },
-    [OPC_SBC_INDX]  = { "SBC", op_SBC, am_IZX, 6 },
-    [OPC_SBC_INDY]  = { "SBC", op_SBC, am_IZY, 5 },
-
-    /* LDX */
-    [OPC_LDX_IM]    = { "LDX", op_LDX, am_IMM, 2 },
-    [OPC_LDX_ZP]    = { "LDX", op_LDX, am_ZP0, 3 },
-    [OPC_LDX_ZPY]   = { "LDX", op_LDX, am_ZPY, 4 },
-    [OPC_LDX_ABS]   = { "LDX", op_LDX, am_ABS, 4 },
-    [OPC_LDX_ABY]   = { "LDX", op_LDX, am_ABY, 4 },
-
-    /* LDY */
-    [OPC_LDY_IM]    = { "LDY", op_LDY, am_IMM, 2 },
-    [OPC_LDY_ZP]    = { "LDY", op_LDY, am_ZP0, 3 },
-    [OPC_LDY_ZPX]   = { "LDY", op_LDY, am_ZPX, 4 },
-    [OPC_LDY_ABS]   = { "LDY", op_LDY, am_ABS, 4 },
-    [OPC_LDY_ABX]   = { "LDY", op_LDY, am_ABX, 4 },
-
-    /* STX */
-    [OPC_STX_ZP]    = { "STX", op_STX, am_ZP0, 3 },
-    [OPC_STX_ZPY]   = { "STX", op_STX, am_ZPY, 4 },
-    [OPC_STX_ABS]   = { "STX", op_STX, am_ABS, 4 },
-
-    /* STY */
-    [OPC_STY_ZP]    = { "STY", op_STY, am_ZP0, 3 },
-    [OPC_STY_ZPX]   = { "STY", op_STY, am_ZPX, 4 },
-    [OPC_STY_ABS]   = { "STY", op_STY, am_ABS, 4 },
-
-    /* LSR */
-    [OPC_LSR_ACC]   = { "LSR", op_LSR, am_ACC, 2 },
-    [OPC_LSR_ZP]    = { "LSR", op_LSR, am_ZP0, 5 },
-    [OPC_LSR_ZPX]   = { "LSR", op_LSR, am_ZPX, 6 },
-    [OPC_LSR_ABS]   = { "LSR", op_LSR, am_ABS, 6 },
-    [OPC_LSR_ABSX]  = { "LSR", op_LSR, am_ABX, 7 },
-
-    /* ROL */
-    [OPC_ROL_ACC]   = { "ROL", op_ROL, am_ACC, 2 },
-    [OPC_ROL_ZP]    = { "ROL", op_ROL, am_ZP0, 5 },
-    [OPC_ROL_ZPX]   = { "ROL", op_ROL, am_ZPX, 6 },
-    [OPC_ROL_ABS]   = { "ROL", op_ROL, am_ABS, 6 },
-    [OPC_ROL_ABSX]  = { "ROL", op_ROL, am_ABX, 7 },
-
-    /* ROR */
-    [OPC_ROR_ACC]   = { "ROR", op_ROR, am_ACC, 2 },
-    [OPC_ROR_ZP]    = { "ROR", op_ROR, am_ZP0, 5 },
-    [OPC_ROR_ZPX]   = { "ROR", op_ROR, am_ZPX, 6 },
-    [OPC_ROR_ABS]   = { "ROR", op_ROR, am_ABS, 6 },
-    [OPC_ROR_ABSX]  = { "ROR", op_ROR, am_ABX, 7 },
-
-    /* Stack ops */
-    [OPC_PHA_IMP]   = { "PHA", op_PHA, am_IMP, 3 },
-    [OPC_PHP_IMP]   = { "PHP", op_PHP, am_IMP, 3 },
-    [OPC_PLA_IMP]   = { "PLA", op_PLA, am_IMP, 4 },
-    [OPC_PLP_IMP]   = { "PLP", op_PLP, am_IMP, 4 },
-
-    /* Jumps and subroutines */
-    [OPC_JMP_ABS]   = { "JMP", op_JMP, am_ABS, 3 },
-    [OPC_JMP_IND]   = { "JMP", op_JMP, am_IND, 5 },
-    [OPC_JSR_ABS]   = { "JSR", op_JSR, am_ABS, 6 },
-    [OPC_RTS_IMP]   = { "RTS", op_RTS, am_IMP, 6 },
-    [OPC_RTI_IMP]   = { "RTI", op_RTI, am_IMP, 6 },
-};
-
-/* ------------------------------------------------------------------ */
-/*  Dispatch loop                                                      */
-/* ------------------------------------------------------------------ */
-
 void cpu_step(CPU *cpu) {
-    static uint64_t instruction_id = 0;
-    static Word pc_ring[32];
-    static Byte op_ring[32];
-    static int ring_idx = 0;
-    static int trap_fff0_logged = 0;
-
-    if (cpu->PC == 0xFFF0 && !trap_fff0_logged) {
-        fprintf(stderr,
-                "CPU_TRAP_FFF0: A=%02X X=%02X Y=%02X P=%02X SP=%02X | stack_top=%02X %02X %02X %02X %02X %02X\n",
-                cpu->regs.A, cpu->regs.X, cpu->regs.Y, cpu->flags, cpu->SP,
-                bus_read(0x0100 + ((cpu->SP + 1) & 0xFF)),
-                bus_read(0x0100 + ((cpu->SP + 2) & 0xFF)),
-                bus_read(0x0100 + ((cpu->SP + 3) & 0xFF)),
-                bus_read(0x0100 + ((cpu->SP + 4) & 0xFF)),
-                bus_read(0x0100 + ((cpu->SP + 5) & 0xFF)),
-                bus_read(0x0100 + ((cpu->SP + 6) & 0xFF)));
-        fprintf(stderr, "  Recent flow:\n");
-        for (int i = 0; i < 32; i++) {
-            int ri = (ring_idx + i) & 31;
-            fprintf(stderr, "    PC=%04X OP=%02X\n", pc_ring[ri], op_ring[ri]);
-        }
-        trap_fff0_logged = 1;
-    }
-
-    pc_ring[ring_idx & 31] = cpu->PC;
-    op_ring[ring_idx & 31] = bus_read(cpu->PC);
-    ring_idx++;
-
-    bus_set_cpu_instruction_id(++instruction_id);
-    cpu->opcode = fetch_program_byte(cpu);
-    const Instruction *ins = &INSTR_TABLE[cpu->opcode];
-    if (ins->op == NULL) {
-        Word bad_pc = (Word)(cpu->PC - 1);
-        if (bad_pc != 0xFFF0) {
-            fprintf(stderr, "CPU_UNKNOWN_OPCODE: PC=%04X opcode=%02X A=%02X X=%02X Y=%02X P=%02X SP=%02X\n",
-                    bad_pc, cpu->opcode, cpu->regs.A, cpu->regs.X, cpu->regs.Y, cpu->flags, cpu->SP);
-        }
-        cpu->cycles = 2; /* avoid zero-cycle stalls while diagnosing */
+    const struct CpuCache *cache = cpu->cache;
+    Word pc = cpu->PC;
+
+    TRACE_CPU_STEP(cpu);
+    bus_set_cpu_instruction_id(cpu->bus, cpu->bus->instruction_id + 1);
+    if (PROFILE_ACTIVE()) {
+        /* one instruction per step so every PC gets its own cycles */
+        PROFILE_STEP_BEGIN(cpu);
+        cpu_step_insn(cpu);
+        PROFILE_STEP_END(cpu);
         return;
     }
-    cpu->cycles = 0;
-    Byte am_extra = ins->mode(cpu);
-    Byte op_extra = ins->op(cpu);
-    cpu->cycles += ins->cycles + (am_extra & op_extra);
-
-    /* NMI check at end of cpu_step (NMI has priority over IRQ) */
-    if (cpu->nmi_pending) {
-        cpu->nmi_pending = 0;
-        stack_push((cpu->PC >> 8) & 0xFF, cpu);
-        stack_push(cpu->PC & 0xFF, cpu);
-        Byte p = cpu->flags;
-        p &= ~(1 << B);
-        p |=  (1 << U);
-        stack_push(p, cpu);
-        cpu_set_flag(I, 1, cpu);
-        cpu->PC = (Word)bus_read(0xFFFA) | ((Word)bus_read(0xFFFB) << 8);
-        cpu->cycles += 7;
-    } else if (cpu->irq_pending && !cpu_read_flag(I, cpu)) {
-        cpu->irq_pending = 0;
-        stack_push((cpu->PC >> 8) & 0xFF, cpu);
-        stack_push(cpu->PC & 0xFF, cpu);
-        Byte p = cpu->flags;
-        p &= ~(1 << B);
-        p |=  (1 << U);
-        stack_push(p, cpu);
-        cpu_set_flag(I, 1, cpu);
-        cpu->PC = (Word)bus_read(0xFFFE) | ((Word)bus_read(0xFFFF) << 8);
-        cpu->cycles += 7;
-    }
+    if (pc == cache->idle.head && cache->idle_skip_enabled && cpu_idle_skip(cpu)) return;
+#if defined(NES_CPU_JIT)
+    cpu_step_jit(cpu);
+#elif defined(NES_CPU_FUSED)
+    cpu_step_fused(cpu);
+#else
+    cpu_step_table(cpu);
+#endif
+    /* a short jump backwards may have closed an idle loop */
+    if ((Word)(pc - cpu->PC) < IDLE_MAX_BYTES && cpu->PC != cache->idle.head &&
+        cache->idle_skip_enabled)
+        idle_scan(cpu, cpu->PC);
 }
 
 void cpu_execute(Word cycles, CPU *cpu) {
@@ -3,6 +3,9 @@
 
 #include "types.h"
 
+struct Bus;
+struct CpuCache;
+
 typedef struct {
   Byte A;
   Byte X;
@@ -34,13 +37,29 @@ typedef struct {
   /* scratch fields used by the lookup-table dispatcher */
   Byte opcode;
   Word addr_abs;
-  Byte fetched;
   Byte page_crossed;
   Byte addr_mode_id;
   Byte cycles;
 
+  /* lazy N/Z: bit 7 of lazy_n is N, lazy_z == 0 means Z. They stay here
+     between instructions and the N/Z bits of flags are stale; read or
+     replace the whole register with cpu_flags/cpu_load_flags. */
+  Byte lazy_n;
+  Byte lazy_z;
+
+  /* The console this CPU belongs to, and its private decode cache,
+     idle-loop and JIT state (both set up by cpu_init). Copies of a CPU
+     share them. */
+  struct Bus      *bus;
+  struct CpuCache *cache;
+
 } CPU;
 
+/* Attach the CPU to its bus and allocate its caches. Returns 0, or -1 if
+   out of memory. Call cpu_reset afterwards; cpu_free releases the caches. */
+int  cpu_init(CPU *cpu, struct Bus *bus);
+void cpu_free(CPU *cpu);
+
 void cpu_reset(CPU *cpu);
 
 void stack_push(Byte value, CPU *cpu);
@@ -49,6 +68,28 @@ Byte stack_pop(CPU *cpu);
 void cpu_execute(Word cycles, CPU *cpu);
 void cpu_step(CPU *cpu);
 
+/* Single-instruction engines behind cpu_step (selected with NES_CPU_FUSED).
+   Both are always built so they can be cross-checked against each other. */
+void cpu_step_table(CPU *cpu);
+void cpu_step_fused(CPU *cpu);
+
+#ifdef NES_CPU_JIT
+/* Block-at-a-time engine on top of cpu_jit.c (see cpu_jit.h). */
+void cpu_step_jit(CPU *cpu);
+#endif
+
+/* Let cpu_step fast-forward loops that only wait for an interrupt or a
+   PPUSTATUS change (see bus_idle_cycles). On by default. */
+void cpu_set_idle_skip(CPU *cpu, int enabled);
+
+/* Mnemonic for a documented opcode, NULL if the opcode is not implemented. */
+const char *cpu_opcode_name(Byte opcode);
+
+/* The whole status register with N and Z folded in, as PHP pushes it
+   minus B, and its inverse, which sets N and Z too. */
+Byte cpu_flags(const CPU *cpu);
+void cpu_load_flags(CPU *cpu, Byte flags);
+
 Byte cpu_read_flag(Flags flag, CPU *cpu);
 void cpu_set_flag(Flags flag, Byte value, CPU *cpu);
 void cpu_toggle_flag(Flags flag, CPU *cpu);
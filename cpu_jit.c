@@ -0,0 +1,1091 @@
+/* MAP_ANONYMOUS is not part of strict C11/POSIX */
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu_jit.h"
+
+#include "bus.h"
+#include "memory.h"
+#include "opcodes.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------ */
+/*  Opcode info                                                        */
+/* ------------------------------------------------------------------ */
+
+typedef enum {
+#define MODE_ENUM(mode, len) AM_##mode,
+    CPU_ADDR_MODES(MODE_ENUM)
+#undef MODE_ENUM
+} AddrModeId;
+
+typedef enum {
+#define MNEM_ENUM(mnem) MN_##mnem,
+    CPU_MNEMONICS(MNEM_ENUM)
+#undef MNEM_ENUM
+} Mnemonic;
+
+#define MODE_LEN(mode, len) enum { JIT_LEN_##mode = len };
+CPU_ADDR_MODES(MODE_LEN)
+#undef MODE_LEN
+
+typedef struct {
+    Byte mnem;
+    Byte mode;
+    Byte len;      /* operand bytes */
+    Byte cycles;   /* base cycles, 0 for unknown opcodes */
+} OpInfo;
+
+#define INFO_ENTRY(opc, mnem, mode, cyc) [opc] = { MN_##mnem, AM_##mode, JIT_LEN_##mode, cyc },
+static const OpInfo OP_INFO[256] = {
+    CPU_OPCODE_TABLE(INFO_ENTRY)
+};
+#undef INFO_ENTRY
+
+/* ------------------------------------------------------------------ */
+/*  Limits                                                             */
+/* ------------------------------------------------------------------ */
+
+#define JIT_CODE_SIZE     (16u << 20)  /* executable buffer, flushed when full */
+#define JIT_MAX_ENTRIES   65536
+#define JIT_BLOCK_BYTES   8192         /* worst-case native code per block */
+#define JIT_BLOCK_INSNS   32
+/* CPU.cycles is a Byte: static cycles plus one page-cross cycle per
+   instruction, a taken branch and an interrupt must still fit. */
+#define JIT_BLOCK_CYCLES  160
+#define JIT_MAX_EXITS     96
+#define JIT_MAX_FIXUPS    256
+/* A branch or JMP back to the start of its own block loops inside the
+   generated code while the step stays under this many cycles and the
+   interrupt budget. Only loops of at most JIT_LOOP_CYCLES per iteration
+   qualify, so one more pass plus an interrupt still fits. */
+#define JIT_LOOP_BUDGET   128
+#define JIT_LOOP_CYCLES   64
+
+/* ------------------------------------------------------------------ */
+/*  x86-64 emitter                                                     */
+/* ------------------------------------------------------------------ */
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/* Guest state is kept in callee-saved registers for the whole block, and
+   so is the interrupt budget the block was called with.
+   Scratch: EAX operand value, ECX effective address, RDX page pointer,
+   ESI offset in page, R8D page-cross flag, R9D/R10D flag temporaries. */
+#define R_CPU    RBX
+#define R_BUDGET RBP
+#define R_A      R12
+#define R_X      R13
+#define R_Y      R14
+#define R_RAM    R15
+
+/* condition codes */
+enum { CC_O = 0x0, CC_C = 0x2, CC_NC = 0x3, CC_Z = 0x4, CC_NZ = 0x5 };
+
+/* byte-register operands, so REX is emitted for SPL..DIL */
+#define B_REG 1   /* ModRM reg field */
+#define B_RM  2   /* ModRM r/m field */
+
+typedef struct {
+    int     base;
+    int     index;   /* -1 for none */
+    int     scale;   /* log2 */
+    int32_t disp;
+} Mem;
+
+typedef struct {
+    Word  pc;        /* guest PC to resume at */
+    int   cycles;    /* static cycles consumed on this path */
+    Byte *at;        /* stub address once emitted */
+    int   used;
+} JitExit;
+
+typedef struct {
+    Byte *rel;       /* rel32 to patch */
+    int   exit;      /* index into exits, -1 for the epilogue */
+} JitFixup;
+
+typedef struct {
+    Byte    *start, *p, *end;
+    int      overflow;
+    JitExit  exits[JIT_MAX_EXITS];
+    int      n_exits;
+    JitFixup fixups[JIT_MAX_FIXUPS];
+    int      n_fixups;
+    Bus     *bus;        /* whose pages the block addresses */
+    Word     pc;         /* guest PC of the block */
+    Byte    *body;       /* first instruction, target of in-block loops */
+    int      count;      /* instructions translated so far */
+} Jit;
+
+typedef struct {
+    Byte *p;
+    int   n_exits, n_fixups;
+} JitMark;
+
+static Mem mem(int base, int32_t disp) {
+    Mem m = { base, -1, 0, disp };
+    return m;
+}
+
+static Mem mem_idx(int base, int index, int scale, int32_t disp) {
+    Mem m = { base, index, scale, disp };
+    return m;
+}
+
+static Mem cpu_field(size_t offset) {
+    return mem(R_CPU, (int32_t)offset);
+}
+
+#define F_A      cpu_field(offsetof(CPU, regs.A))
+#define F_X      cpu_field(offsetof(CPU, regs.X))
+#define F_Y      cpu_field(offsetof(CPU, regs.Y))
+#define F_SP     cpu_field(offsetof(CPU, SP))
+#define F_PC     cpu_field(offsetof(CPU, PC))
+#define F_FLAGS  cpu_field(offsetof(CPU, flags))
+#define F_CYCLES cpu_field(offsetof(CPU, cycles))
+#define F_LAZY_N cpu_field(offsetof(CPU, lazy_n))
+#define F_LAZY_Z cpu_field(offsetof(CPU, lazy_z))
+
+static void emit8(Jit *j, unsigned v) {
+    if (j->p < j->end) *j->p++ = (Byte)v;
+    else               j->overflow = 1;
+}
+
+static void emit16(Jit *j, unsigned v) {
+    emit8(j, v);
+    emit8(j, v >> 8);
+}
+
+static void emit32(Jit *j, uint32_t v) {
+    for (int i = 0; i < 4; i++) emit8(j, v >> (8 * i));
+}
+
+static void emit64(Jit *j, uint64_t v) {
+    for (int i = 0; i < 8; i++) emit8(j, (unsigned)(v >> (8 * i)));
+}
+
+static void emit_rex(Jit *j, int w, int reg, int index, int base, int force) {
+    Byte rex = 0x40 | (w << 3) | ((reg & 8) >> 1) |
+               (index >= 0 ? (index & 8) >> 2 : 0) | ((base & 8) >> 3);
+    if (rex != 0x40 || force) emit8(j, rex);
+}
+
+/* opcode bytes packed big-endian: 0x0FB6 = 0F B6 */
+static void emit_opcode(Jit *j, unsigned op) {
+    if (op > 0xFFFF) emit8(j, op >> 16);
+    if (op > 0xFF)   emit8(j, op >> 8);
+    emit8(j, op);
+}
+
+static int is_byte_hi(int r) { return r >= RSP && r <= RDI; }
+
+/* op with a register (or /digit) in ModRM.reg and a memory operand */
+static void x_mem(Jit *j, int w, int bytes, unsigned op, int reg, Mem m) {
+    emit_rex(j, w, reg, m.index, m.base, (bytes & B_REG) && is_byte_hi(reg));
+    emit_opcode(j, op);
+
+    int base = m.base & 7;
+    int mod  = (m.disp == 0 && base != RBP) ? 0 :
+               (m.disp >= -128 && m.disp <= 127) ? 1 : 2;
+    if (m.index >= 0 || base == RSP) {
+        emit8(j, (mod << 6) | ((reg & 7) << 3) | 4);
+        emit8(j, (m.scale << 6) | ((m.index >= 0 ? m.index & 7 : 4) << 3) | base);
+    } else {
+        emit8(j, (mod << 6) | ((reg & 7) << 3) | base);
+    }
+    if (mod == 1) emit8(j, (Byte)m.disp);
+    if (mod == 2) emit32(j, (uint32_t)m.disp);
+}
+
+/* op with a register (or /digit) in ModRM.reg and a register in r/m */
+static void x_reg(Jit *j, int w, int bytes, unsigned op, int reg, int rm) {
+    emit_rex(j, w, reg, -1, rm,
+             ((bytes & B_REG) && is_byte_hi(reg)) || ((bytes & B_RM) && is_byte_hi(rm)));
+    emit_opcode(j, op);
+    emit8(j, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* ALU opcode bases for "op r/m, r" and /digit for the immediate forms */
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_ADC = 2, ALU_SBB = 3,
+       ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+
+/* shift/rotate /digit */
+enum { SH_ROL = 0, SH_ROR = 1, SH_RCL = 2, SH_RCR = 3, SH_SHL = 4, SH_SHR = 5 };
+
+static void x_movzx8(Jit *j, int dst, Mem m)        { x_mem(j, 0, 0, 0x0FB6, dst, m); }
+static void x_movzx8_rr(Jit *j, int dst, int src)   { x_reg(j, 0, B_RM, 0x0FB6, dst, src); }
+static void x_store8(Jit *j, Mem m, int src)        { x_mem(j, 0, B_REG, 0x88, src, m); }
+static void x_load64(Jit *j, int dst, Mem m)        { x_mem(j, 1, 0, 0x8B, dst, m); }
+static void x_mov32(Jit *j, int dst, int src)       { x_reg(j, 0, 0, 0x8B, dst, src); }
+static void x_alu8(Jit *j, int alu, int dst, int src) { x_reg(j, 0, B_REG | B_RM, alu << 3, src, dst); }
+static void x_alu8_mem(Jit *j, int alu, Mem m, int src) { x_mem(j, 0, B_REG, alu << 3, src, m); }
+static void x_alu32(Jit *j, int alu, int dst, int src) { x_reg(j, 0, 0, (alu << 3) | 1, src, dst); }
+static void x_shift8(Jit *j, int sh, int reg)       { x_reg(j, 0, B_RM, 0xD0, sh, reg); }
+static void x_setcc(Jit *j, int cc, int reg)        { x_reg(j, 0, B_RM, 0x0F90 + cc, 0, reg); }
+static void x_inc8(Jit *j, int reg)                 { x_reg(j, 0, B_RM, 0xFE, 0, reg); }
+static void x_dec8(Jit *j, int reg)                 { x_reg(j, 0, B_RM, 0xFE, 1, reg); }
+static void x_inc32(Jit *j, int reg)                { x_reg(j, 0, 0, 0xFF, 0, reg); }
+static void x_test64(Jit *j, int a, int b)          { x_reg(j, 1, 0, 0x85, b, a); }
+static void x_cmc(Jit *j)                           { emit8(j, 0xF5); }
+
+static void x_alu8_imm(Jit *j, int alu, int reg, Byte imm) {
+    x_reg(j, 0, B_RM, 0x80, alu, reg);
+    emit8(j, imm);
+}
+
+static void x_alu8_mem_imm(Jit *j, int alu, Mem m, Byte imm) {
+    x_mem(j, 0, 0, 0x80, alu, m);
+    emit8(j, imm);
+}
+
+static void x_alu32_imm(Jit *j, int alu, int reg, uint32_t imm) {
+    x_reg(j, 0, 0, 0x81, alu, reg);
+    emit32(j, imm);
+}
+
+static void x_shift8_imm(Jit *j, int sh, int reg, Byte n) {
+    x_reg(j, 0, B_RM, 0xC0, sh, reg);
+    emit8(j, n);
+}
+
+static void x_shift32_imm(Jit *j, int sh, int reg, Byte n) {
+    x_reg(j, 0, 0, 0xC1, sh, reg);
+    emit8(j, n);
+}
+
+static void x_bt32(Jit *j, int reg, Byte bit) {
+    x_reg(j, 0, 0, 0x0FBA, 4, reg);
+    emit8(j, bit);
+}
+
+static void x_test8_mem_imm(Jit *j, Mem m, Byte imm) {
+    x_mem(j, 0, 0, 0xF6, 0, m);
+    emit8(j, imm);
+}
+
+static void x_store8_imm(Jit *j, Mem m, Byte imm) {
+    x_mem(j, 0, 0, 0xC6, 0, m);
+    emit8(j, imm);
+}
+
+static void x_store16(Jit *j, Mem m, int src) {
+    emit8(j, 0x66);
+    x_mem(j, 0, 0, 0x89, src, m);
+}
+
+static void x_store16_imm(Jit *j, Mem m, Word imm) {
+    emit8(j, 0x66);
+    x_mem(j, 0, 0, 0xC7, 0, m);
+    emit16(j, imm);
+}
+
+static void x_mov32_imm(Jit *j, int dst, uint32_t imm) {
+    emit_rex(j, 0, 0, -1, dst, 0);
+    emit8(j, 0xB8 + (dst & 7));
+    emit32(j, imm);
+}
+
+static void x_mov64_ptr(Jit *j, int dst, const void *ptr) {
+    emit_rex(j, 1, 0, -1, dst, 0);
+    emit8(j, 0xB8 + (dst & 7));
+    emit64(j, (uint64_t)(uintptr_t)ptr);
+}
+
+static void x_push(Jit *j, int reg) {
+    emit_rex(j, 0, 0, -1, reg, 0);
+    emit8(j, 0x50 + (reg & 7));
+}
+
+static void x_pop(Jit *j, int reg) {
+    emit_rex(j, 0, 0, -1, reg, 0);
+    emit8(j, 0x58 + (reg & 7));
+}
+
+/* ------------------------------------------------------------------ */
+/*  Exits                                                              */
+/* ------------------------------------------------------------------ */
+
+/* Every way out of a block goes through a stub that adds its static
+   cycle count and stores the guest PC; runtime extras (page crosses)
+   are added to cpu->cycles as they happen. */
+static int jit_exit(Jit *j, Word pc, int cycles) {
+    for (int i = 0; i < j->n_exits; i++) {
+        if (j->exits[i].pc == pc && j->exits[i].cycles == cycles) return i;
+    }
+    if (j->n_exits == JIT_MAX_EXITS) {
+        j->overflow = 1;
+        return 0;
+    }
+    j->exits[j->n_exits].pc     = pc;
+    j->exits[j->n_exits].cycles = cycles;
+    j->exits[j->n_exits].at     = NULL;
+    j->exits[j->n_exits].used   = 0;
+    return j->n_exits++;
+}
+
+static void jit_fixup(Jit *j, int exit) {
+    if (j->n_fixups == JIT_MAX_FIXUPS) {
+        j->overflow = 1;
+        return;
+    }
+    j->fixups[j->n_fixups].rel  = j->p;
+    j->fixups[j->n_fixups].exit = exit;
+    j->n_fixups++;
+    if (exit >= 0) j->exits[exit].used = 1;
+    emit32(j, 0);
+}
+
+static void jit_jcc(Jit *j, int cc, int exit) {
+    emit8(j, 0x0F);
+    emit8(j, 0x80 + cc);
+    jit_fixup(j, exit);
+}
+
+static void jit_jmp(Jit *j, int exit) {
+    emit8(j, 0xE9);
+    jit_fixup(j, exit);
+}
+
+static JitMark jit_mark(const Jit *j) {
+    JitMark m = { j->p, j->n_exits, j->n_fixups };
+    return m;
+}
+
+static void jit_rollback(Jit *j, JitMark m) {
+    j->p        = m.p;
+    j->n_exits  = m.n_exits;
+    j->n_fixups = m.n_fixups;
+}
+
+/* Leave for exit unless the instruction starting cycles static cycles
+   (plus the page-cross cycles already counted) into the step still comes
+   before the budget runs out */
+static void jit_budget_check(Jit *j, int cycles, int exit) {
+    x_movzx8(j, RAX, F_CYCLES);
+    if (cycles) x_alu32_imm(j, ALU_ADD, RAX, (uint32_t)cycles);
+    x_alu32(j, ALU_CMP, RAX, R_BUDGET);
+    jit_jcc(j, CC_NC, exit);
+}
+
+/* Continue at target after a control transfer that completes with
+   cycles static cycles. Jumps back to the block start loop natively. */
+static void jit_goto(Jit *j, Word target, int cycles) {
+    if (target != j->pc || cycles + j->count + 1 > JIT_LOOP_CYCLES) {
+        jit_jmp(j, jit_exit(j, target, cycles));
+        return;
+    }
+    int leave = jit_exit(j, target, 0);
+    x_alu8_mem_imm(j, ALU_ADD, F_CYCLES, (Byte)cycles);
+    x_alu8_mem_imm(j, ALU_CMP, F_CYCLES, JIT_LOOP_BUDGET);
+    jit_jcc(j, CC_NC, leave);
+    jit_budget_check(j, 0, leave);
+    emit8(j, 0xE9);
+    emit32(j, (uint32_t)(j->body - (j->p + 4)));
+}
+
+/* ------------------------------------------------------------------ */
+/*  Guest memory                                                       */
+/* ------------------------------------------------------------------ */
+
+typedef enum {
+    EA_CONST,   /* addr known at translation time */
+    EA_RAM,     /* ECX = offset into internal RAM (mirrors folded) */
+    EA_DYN      /* ECX = 16-bit address */
+} EaKind;
+
+typedef struct {
+    EaKind kind;
+    Word   addr;
+} Ea;
+
+static int is_io(Word addr) {
+    return addr >= 0x2000 && addr < 0x4020;
+}
+
+/* Resolve the effective address of an indexed/indirect mode into ECX and
+   the page-cross flag into R8D. Zero-page modes wrap within page 0. */
+static Ea jit_ea(Jit *j, int mode, Word operand) {
+    Ea ea = { EA_CONST, operand };
+    switch (mode) {
+        case AM_ZP0:
+            ea.addr = operand & 0xFF;
+            break;
+        case AM_ZPX:
+        case AM_ZPY:
+            x_movzx8_rr(j, RCX, mode == AM_ZPX ? R_X : R_Y);
+            x_alu8_imm(j, ALU_ADD, RCX, (Byte)operand);
+            ea.kind = EA_RAM;
+            break;
+        case AM_ABX:
+        case AM_ABY:
+            x_movzx8_rr(j, RCX, mode == AM_ABX ? R_X : R_Y);
+            x_mov32(j, R8, RCX);
+            x_alu32_imm(j, ALU_ADD, R8, operand & 0xFF);
+            x_shift32_imm(j, SH_SHR, R8, 8);
+            x_alu32_imm(j, ALU_ADD, RCX, operand);
+            if (operand + 0xFF < 0x2000) {
+                x_alu32_imm(j, ALU_AND, RCX, 0x07FF);
+                ea.kind = EA_RAM;
+            } else {
+                x_alu32_imm(j, ALU_AND, RCX, 0xFFFF);
+                ea.kind = EA_DYN;
+            }
+            break;
+        case AM_IZX:
+            x_movzx8_rr(j, RDX, R_X);
+            x_alu8_imm(j, ALU_ADD, RDX, (Byte)operand);
+            x_movzx8(j, RCX, mem_idx(R_RAM, RDX, 0, 0));
+            x_inc8(j, RDX);
+            x_movzx8(j, RAX, mem_idx(R_RAM, RDX, 0, 0));
+            x_shift32_imm(j, SH_SHL, RAX, 8);
+            x_alu32(j, ALU_OR, RCX, RAX);
+            ea.kind = EA_DYN;
+            break;
+        case AM_IZY:
+            x_movzx8(j, RCX, mem(R_RAM, operand & 0xFF));
+            x_movzx8(j, RAX, mem(R_RAM, (operand + 1) & 0xFF));
+            x_shift32_imm(j, SH_SHL, RAX, 8);
+            x_alu32(j, ALU_OR, RCX, RAX);
+            x_movzx8_rr(j, RAX, R_Y);
+            x_movzx8_rr(j, R8, RCX);
+            x_alu32(j, ALU_ADD, R8, RAX);
+            x_shift32_imm(j, SH_SHR, R8, 8);
+            x_alu32(j, ALU_ADD, RCX, RAX);
+            x_alu32_imm(j, ALU_AND, RCX, 0xFFFF);
+            ea.kind = EA_DYN;
+            break;
+        default:
+            break;
+    }
+    return ea;
+}
+
+/* Host location of a readable operand, leaving through exit if the page
+   is not directly mapped. Returns 0 if the access can never be direct. */
+static int jit_read_ref(Jit *j, Ea ea, int exit, Mem *ref) {
+    switch (ea.kind) {
+        case EA_CONST:
+            if (ea.addr < 0x2000) {
+                *ref = mem(R_RAM, ea.addr & 0x07FF);
+                return 1;
+            }
+            if (is_io(ea.addr) || !j->bus->read_page[ea.addr >> 8]) return 0;
+            x_mov64_ptr(j, RAX, &j->bus->read_page[ea.addr >> 8]);
+            x_load64(j, RDX, mem(RAX, 0));
+            x_test64(j, RDX, RDX);
+            jit_jcc(j, CC_Z, exit);
+            *ref = mem(RDX, ea.addr & 0xFF);
+            return 1;
+        case EA_RAM:
+            *ref = mem_idx(R_RAM, RCX, 0, 0);
+            return 1;
+        case EA_DYN:
+            x_mov32(j, RDX, RCX);
+            x_shift32_imm(j, SH_SHR, RDX, 8);
+            x_mov64_ptr(j, RAX, j->bus->read_page);
+            x_load64(j, RDX, mem_idx(RAX, RDX, 3, 0));
+            x_test64(j, RDX, RDX);
+            jit_jcc(j, CC_Z, exit);
+            x_movzx8_rr(j, RSI, RCX);
+            *ref = mem_idx(RDX, RSI, 0, 0);
+            return 1;
+    }
+    return 0;
+}
+
+/* Same for a writable operand (also used to read read-modify-write
+   operands: directly writable pages read back the same memory). Writes to
+   pages holding decoded or translated code leave the block, so the bus
+   invalidates them. */
+static int jit_write_ref(Jit *j, Ea ea, int exit, Mem *ref) {
+    switch (ea.kind) {
+        case EA_CONST:
+            if (is_io(ea.addr)) return 0;
+            if (ea.addr >= 0x2000 && !j->bus->write_page[ea.addr >> 8]) return 0;
+            if (ea.addr >= 0x2000) {
+                x_mov64_ptr(j, RAX, &j->bus->write_page[ea.addr >> 8]);
+                x_load64(j, RDX, mem(RAX, 0));
+                x_test64(j, RDX, RDX);
+                jit_jcc(j, CC_Z, exit);
+                *ref = mem(RDX, ea.addr & 0xFF);
+            } else {
+                *ref = mem(R_RAM, ea.addr & 0x07FF);
+            }
+            x_mov64_ptr(j, RAX, &j->bus->code_page[ea.addr >> 8]);
+            x_alu8_mem_imm(j, ALU_CMP, mem(RAX, 0), 0);
+            jit_jcc(j, CC_NZ, exit);
+            return 1;
+        case EA_RAM:
+            x_mov32(j, RDX, RCX);
+            x_shift32_imm(j, SH_SHR, RDX, 8);
+            x_mov64_ptr(j, RAX, j->bus->code_page);
+            x_alu8_mem_imm(j, ALU_CMP, mem_idx(RAX, RDX, 0, 0), 0);
+            jit_jcc(j, CC_NZ, exit);
+            *ref = mem_idx(R_RAM, RCX, 0, 0);
+            return 1;
+        case EA_DYN:
+            x_mov32(j, RDX, RCX);
+            x_shift32_imm(j, SH_SHR, RDX, 8);
+            x_mov64_ptr(j, RAX, j->bus->code_page);
+            x_alu8_mem_imm(j, ALU_CMP, mem_idx(RAX, RDX, 0, 0), 0);
+            jit_jcc(j, CC_NZ, exit);
+            x_mov64_ptr(j, RAX, j->bus->write_page);
+            x_load64(j, RDX, mem_idx(RAX, RDX, 3, 0));
+            x_test64(j, RDX, RDX);
+            jit_jcc(j, CC_Z, exit);
+            x_movzx8_rr(j, RSI, RCX);
+            *ref = mem_idx(RDX, RSI, 0, 0);
+            return 1;
+    }
+    return 0;
+}
+
+/* Stack pushes go straight to page 1 unless it holds code. */
+static void jit_stack_check(Jit *j, int exit) {
+    x_mov64_ptr(j, RAX, &j->bus->code_page[0x01]);
+    x_alu8_mem_imm(j, ALU_CMP, mem(RAX, 0), 0);
+    jit_jcc(j, CC_NZ, exit);
+}
+
+static Mem stack_slot(void) {
+    return mem_idx(R_RAM, RCX, 0, 0x100);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Flags                                                              */
+/* ------------------------------------------------------------------ */
+
+static void jit_set_nz(Jit *j, int reg) {
+    x_store8(j, F_LAZY_N, reg);
+    x_store8(j, F_LAZY_Z, reg);
+}
+
+/* flags = (flags & ~mask) | src, src holding only bits inside mask */
+static void jit_merge_flags(Jit *j, Byte mask, int src) {
+    x_alu8_mem_imm(j, ALU_AND, F_FLAGS, (Byte)~mask);
+    x_alu8_mem(j, ALU_OR, F_FLAGS, src);
+}
+
+/* host CF = guest C */
+static void jit_load_carry(Jit *j) {
+    x_movzx8(j, R9, F_FLAGS);
+    x_bt32(j, R9, C);
+}
+
+/* guest C = host CF */
+static void jit_store_carry(Jit *j) {
+    x_setcc(j, CC_C, R10);
+    jit_merge_flags(j, 1 << C, R10);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Instructions                                                       */
+/* ------------------------------------------------------------------ */
+
+static int reg_of(int mnem) {
+    switch (mnem) {
+        case MN_LDX: case MN_STX: case MN_CPX: return R_X;
+        case MN_LDY: case MN_STY: case MN_CPY: return R_Y;
+        default:                               return R_A;
+    }
+}
+
+/* page-cross-sensitive reads, matching the do_* kernels in cpu.c */
+static int adds_page_cycle(int mnem) {
+    switch (mnem) {
+        case MN_LDA: case MN_LDX: case MN_LDY: case MN_ADC: case MN_SBC:
+        case MN_AND: case MN_ORA: case MN_EOR: case MN_CMP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Operand value into EAX. */
+static int jit_load_operand(Jit *j, const OpInfo *info, Word operand, int exit) {
+    if (info->mode == AM_IMM) {
+        x_mov32_imm(j, RAX, operand & 0xFF);
+        return 1;
+    }
+    Mem ref;
+    Ea ea = jit_ea(j, info->mode, operand);
+    if (!jit_read_ref(j, ea, exit, &ref)) return 0;
+    if (adds_page_cycle(info->mnem) &&
+        (info->mode == AM_ABX || info->mode == AM_ABY || info->mode == AM_IZY)) {
+        x_alu8_mem(j, ALU_ADD, F_CYCLES, R8);
+    }
+    x_movzx8(j, RAX, ref);
+    return 1;
+}
+
+static int jit_shift(Jit *j, int mnem, int reg) {
+    static const int SHIFT_OF[] = { [MN_ASL] = SH_SHL, [MN_LSR] = SH_SHR,
+                                    [MN_ROL] = SH_RCL, [MN_ROR] = SH_RCR };
+    if (mnem == MN_ROL || mnem == MN_ROR) jit_load_carry(j);
+    x_shift8(j, SHIFT_OF[mnem], reg);
+    return 1;
+}
+
+static int branch_taken_cc(int mnem, Mem *flag, Byte *mask) {
+    switch (mnem) {
+        case MN_BCC: *flag = F_FLAGS;  *mask = 1 << C; return CC_Z;
+        case MN_BCS: *flag = F_FLAGS;  *mask = 1 << C; return CC_NZ;
+        case MN_BVC: *flag = F_FLAGS;  *mask = 1 << V; return CC_Z;
+        case MN_BVS: *flag = F_FLAGS;  *mask = 1 << V; return CC_NZ;
+        case MN_BPL: *flag = F_LAZY_N; *mask = 0x80;   return CC_Z;
+        case MN_BMI: *flag = F_LAZY_N; *mask = 0x80;   return CC_NZ;
+        case MN_BNE: *flag = F_LAZY_Z; *mask = 0xFF;   return CC_NZ;
+        default:     *flag = F_LAZY_Z; *mask = 0xFF;   return CC_Z;  /* BEQ */
+    }
+}
+
+/* Translate one instruction. cycles is the static cycle count of the
+   block before it. Sets *ends for control transfers, which emit their own
+   exits. Returns 0 if the instruction must be left to the interpreter. */
+static int jit_instr(Jit *j, Word pc, Byte opcode, Word operand, int cycles, int *ends) {
+    const OpInfo *info = &OP_INFO[opcode];
+    Word next = pc + 1 + info->len;
+    int  done = cycles + info->cycles;
+    int  bail = jit_exit(j, pc, cycles);
+    int  reg  = reg_of(info->mnem);
+    Mem  ref;
+
+    switch (info->mnem) {
+        case MN_LDA: case MN_LDX: case MN_LDY:
+            if (!jit_load_operand(j, info, operand, bail)) return 0;
+            x_mov32(j, reg, RAX);
+            jit_set_nz(j, reg);
+            break;
+
+        case MN_STA: case MN_STX: case MN_STY:
+            if (!jit_write_ref(j, jit_ea(j, info->mode, operand), bail, &ref)) return 0;
+            x_store8(j, ref, reg);
+            break;
+
+        case MN_AND: case MN_ORA: case MN_EOR:
+            if (!jit_load_operand(j, info, operand, bail)) return 0;
+            x_alu8(j, info->mnem == MN_AND ? ALU_AND : info->mnem == MN_ORA ? ALU_OR : ALU_XOR,
+                   R_A, RAX);
+            jit_set_nz(j, R_A);
+            break;
+
+        case MN_ADC: case MN_SBC:
+            /* x86 ADC/SBB produce the 6502 C and V directly; SBB borrows
+               on CF set, which is the inverse of the 6502 carry */
+            if (!jit_load_operand(j, info, operand, bail)) return 0;
+            jit_load_carry(j);
+            if (info->mnem == MN_SBC) x_cmc(j);
+            x_alu8(j, info->mnem == MN_ADC ? ALU_ADC : ALU_SBB, R_A, RAX);
+            if (info->mnem == MN_SBC) x_cmc(j);
+            x_setcc(j, CC_C, R10);
+            x_setcc(j, CC_O, RAX);
+            x_shift8_imm(j, SH_SHL, RAX, V);
+            x_alu8(j, ALU_OR, R10, RAX);
+            jit_merge_flags(j, (1 << C) | (1 << V), R10);
+            jit_set_nz(j, R_A);
+            break;
+
+        case MN_CMP: case MN_CPX: case MN_CPY:
+            if (!jit_load_operand(j, info, operand, bail)) return 0;
+            x_mov32(j, RDX, reg);
+            x_alu8(j, ALU_SUB, RDX, RAX);
+            x_setcc(j, CC_NC, R10);
+            jit_merge_flags(j, 1 << C, R10);
+            jit_set_nz(j, RDX);
+            break;
+
+        case MN_BIT:
+            if (!jit_load_operand(j, info, operand, bail)) return 0;
+            x_store8(j, F_LAZY_N, RAX);
+            x_mov32(j, RDX, RAX);
+            x_alu8(j, ALU_AND, RDX, R_A);
+            x_store8(j, F_LAZY_Z, RDX);
+            x_alu8_imm(j, ALU_AND, RAX, 1 << V);
+            jit_merge_flags(j, 1 << V, RAX);
+            break;
+
+        case MN_INC: case MN_DEC:
+            if (!jit_write_ref(j, jit_ea(j, info->mode, operand), bail, &ref)) return 0;
+            x_movzx8(j, RAX, ref);
+            if (info->mnem == MN_INC) x_inc8(j, RAX);
+            else                      x_dec8(j, RAX);
+            x_store8(j, ref, RAX);
+            jit_set_nz(j, RAX);
+            break;
+
+        case MN_ASL: case MN_LSR: case MN_ROL: case MN_ROR:
+            if (info->mode == AM_ACC) {
+                jit_shift(j, info->mnem, R_A);
+                jit_store_carry(j);
+                jit_set_nz(j, R_A);
+                break;
+            }
+            if (!jit_write_ref(j, jit_ea(j, info->mode, operand), bail, &ref)) return 0;
+            x_movzx8(j, RAX, ref);
+            jit_shift(j, info->mnem, RAX);
+            x_setcc(j, CC_C, R10);
+            x_store8(j, ref, RAX);
+            jit_merge_flags(j, 1 << C, R10);
+            jit_set_nz(j, RAX);
+            break;
+
+        case MN_INX: x_inc8(j, R_X); jit_set_nz(j, R_X); break;
+        case MN_INY: x_inc8(j, R_Y); jit_set_nz(j, R_Y); break;
+        case MN_DEX: x_dec8(j, R_X); jit_set_nz(j, R_X); break;
+        case MN_DEY: x_dec8(j, R_Y); jit_set_nz(j, R_Y); break;
+
+        case MN_TAX: x_mov32(j, R_X, R_A); jit_set_nz(j, R_X); break;
+        case MN_TAY: x_mov32(j, R_Y, R_A); jit_set_nz(j, R_Y); break;
+        case MN_TXA: x_mov32(j, R_A, R_X); jit_set_nz(j, R_A); break;
+        case MN_TYA: x_mov32(j, R_A, R_Y); jit_set_nz(j, R_A); break;
+        case MN_TSX: x_movzx8(j, R_X, F_SP); jit_set_nz(j, R_X); break;
+        case MN_TXS: x_store8(j, F_SP, R_X); break;
+
+        case MN_CLC: x_alu8_mem_imm(j, ALU_AND, F_FLAGS, (Byte)~(1 << C)); break;
+        case MN_SEC: x_alu8_mem_imm(j, ALU_OR,  F_FLAGS, 1 << C); break;
+        case MN_CLD: x_alu8_mem_imm(j, ALU_AND, F_FLAGS, (Byte)~(1 << D)); break;
+        case MN_SED: x_alu8_mem_imm(j, ALU_OR,  F_FLAGS, 1 << D); break;
+        case MN_CLV: x_alu8_mem_imm(j, ALU_AND, F_FLAGS, (Byte)~(1 << V)); break;
+        case MN_NOP: break;
+
+        case MN_PHA:
+            jit_stack_check(j, bail);
+            x_movzx8(j, RCX, F_SP);
+            x_store8(j, stack_slot(), R_A);
+            x_mem(j, 0, 0, 0xFE, 1, F_SP);   /* dec byte [SP] */
+            break;
+
+        case MN_PLA:
+            x_movzx8(j, RCX, F_SP);
+            x_inc8(j, RCX);
+            x_store8(j, F_SP, RCX);
+            x_movzx8(j, R_A, stack_slot());
+            jit_set_nz(j, R_A);
+            break;
+
+        case MN_JSR: {
+            Word ret = pc + 2;
+            jit_stack_check(j, bail);
+            x_movzx8(j, RCX, F_SP);
+            x_store8_imm(j, stack_slot(), ret >> 8);
+            x_dec8(j, RCX);
+            x_store8_imm(j, stack_slot(), ret & 0xFF);
+            x_dec8(j, RCX);
+            x_store8(j, F_SP, RCX);
+            jit_goto(j, operand, done);
+            *ends = 1;
+            break;
+        }
+
+        case MN_RTS:
+            x_movzx8(j, RCX, F_SP);
+            x_inc8(j, RCX);
+            x_movzx8(j, RAX, stack_slot());
+            x_inc8(j, RCX);
+            x_movzx8(j, RDX, stack_slot());
+            x_store8(j, F_SP, RCX);
+            x_shift32_imm(j, SH_SHL, RDX, 8);
+            x_alu32(j, ALU_OR, RAX, RDX);
+            x_inc32(j, RAX);
+            x_store16(j, F_PC, RAX);
+            x_alu8_mem_imm(j, ALU_ADD, F_CYCLES, (Byte)done);
+            jit_jmp(j, -1);
+            *ends = 1;
+            break;
+
+        case MN_JMP:
+            if (info->mode != AM_ABS) return 0;
+            jit_goto(j, operand, done);
+            *ends = 1;
+            break;
+
+        case MN_BCC: case MN_BCS: case MN_BVC: case MN_BVS:
+        case MN_BPL: case MN_BMI: case MN_BNE: case MN_BEQ: {
+            Mem  flag;
+            Byte mask;
+            int  cc     = branch_taken_cc(info->mnem, &flag, &mask);
+            Word target = next + (int8_t)(operand & 0xFF);
+            int  taken  = done + 1 + ((next & 0xFF00) != (target & 0xFF00));
+            x_test8_mem_imm(j, flag, mask);
+            jit_jcc(j, cc ^ 1, jit_exit(j, next, done));
+            jit_goto(j, target, taken);
+            *ends = 1;
+            break;
+        }
+
+        default:
+            /* BRK, RTI, PHP, PLP, CLI, SEI: interrupt state and full
+               flag images stay with the interpreter */
+            return 0;
+    }
+    return !j->overflow;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Blocks                                                             */
+/* ------------------------------------------------------------------ */
+
+static void jit_prologue(Jit *j) {
+    x_push(j, RBX);
+    x_push(j, RBP);
+    x_push(j, R12);
+    x_push(j, R13);
+    x_push(j, R14);
+    x_push(j, R15);
+    x_reg(j, 1, 0, 0x8B, R_CPU, RDI);
+    x_mov32(j, R_BUDGET, RSI);
+    x_movzx8(j, R_A, F_A);
+    x_movzx8(j, R_X, F_X);
+    x_movzx8(j, R_Y, F_Y);
+    x_mov64_ptr(j, R_RAM, j->bus->ram.data);
+}
+
+/* Epilogue, exit stubs, then patch every jump. */
+static void jit_finish(Jit *j) {
+    Byte *epilogue = j->p;
+    x_store8(j, F_A, R_A);
+    x_store8(j, F_X, R_X);
+    x_store8(j, F_Y, R_Y);
+    x_pop(j, R15);
+    x_pop(j, R14);
+    x_pop(j, R13);
+    x_pop(j, R12);
+    x_pop(j, RBP);
+    x_pop(j, RBX);
+    emit8(j, 0xC3);
+
+    for (int i = 0; i < j->n_exits; i++) {
+        JitExit *x = &j->exits[i];
+        if (!x->used) continue;
+        x->at = j->p;
+        if (x->cycles) x_alu8_mem_imm(j, ALU_ADD, F_CYCLES, (Byte)x->cycles);
+        x_store16_imm(j, F_PC, x->pc);
+        emit8(j, 0xE9);
+        emit32(j, (uint32_t)(epilogue - (j->p + 4)));
+    }
+    if (j->overflow) return;
+
+    for (int i = 0; i < j->n_fixups; i++) {
+        const JitFixup *f = &j->fixups[i];
+        Byte *target = f->exit < 0 ? epilogue : j->exits[f->exit].at;
+        uint32_t rel = (uint32_t)(target - (f->rel + 4));
+        memcpy(f->rel, &rel, 4);
+    }
+}
+
+typedef struct JitEntry {
+    struct JitEntry *next;   /* other blocks at the same guest PC */
+    const Byte      *host;   /* guest bytes the block was translated from */
+    uint32_t         gen;    /* page generation, checked unless rom */
+    Byte             rom;
+    CpuJitBlock      code;   /* NULL: interpret */
+} JitEntry;
+
+struct CpuJit {
+    Bus      *bus;
+    Byte     *code;
+    size_t    code_used;
+    int       state;            /* 0 = not initialised, 1 = ready, -1 = unavailable */
+    JitEntry  entries[JIT_MAX_ENTRIES];
+    int       entry_count;
+    JitEntry *heads[0x10000];
+    uint32_t  epoch;
+};
+
+/* Shared by every instance: perf reads one map per process. */
+static FILE *jit_perf_map;
+
+CpuJit *cpu_jit_create(Bus *bus) {
+    CpuJit *jit = calloc(1, sizeof(*jit));
+    if (!jit) return NULL;
+    jit->bus   = bus;
+    jit->epoch = bus->map_epoch;
+    return jit;
+}
+
+void cpu_jit_destroy(CpuJit *jit) {
+    if (!jit) return;
+    if (jit->code) munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+}
+
+static int jit_init(CpuJit *jit) {
+    if (jit->state != 0) return jit->state > 0;
+    void *buf = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "JIT: cannot map code buffer, interpreting\n");
+        jit->state = -1;
+        return 0;
+    }
+    jit->code  = buf;
+    jit->state = 1;
+    return 1;
+}
+
+/* The buffer is never writable and executable at once: the pages a block
+   is emitted into are made writable while it is translated, then
+   executable again (they may hold the end of the previous block) */
+static int jit_protect(Byte *from, Byte *to, int prot) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t lo   = (uintptr_t)from & ~(page - 1);
+    uintptr_t hi   = ((uintptr_t)to + page - 1) & ~(page - 1);
+    return mprotect((void *)lo, hi - lo, prot);
+}
+
+void cpu_jit_flush(CpuJit *jit) {
+    memset(jit->heads, 0, sizeof(jit->heads));
+    jit->entry_count = 0;
+    jit->code_used   = 0;
+}
+
+static CpuJitBlock jit_compile(CpuJit *jit, Word pc, const Byte *host, int rom) {
+    Jit j;
+    j.start    = jit->code + jit->code_used;
+    j.p        = j.start;
+    j.end      = j.start + JIT_BLOCK_BYTES;
+    j.overflow = 0;
+    j.n_exits  = 0;
+    j.n_fixups = 0;
+    j.bus      = jit->bus;
+    j.pc       = pc;
+    j.count    = 0;
+    if (jit_protect(j.start, j.end, PROT_READ | PROT_WRITE) != 0) return NULL;
+
+    jit_prologue(&j);
+    j.body = j.p;
+
+    Word at = pc;
+    int  count = 0, cycles = 0, ends = 0;
+    while (!ends && count < JIT_BLOCK_INSNS && cycles < JIT_BLOCK_CYCLES) {
+        if ((at >> 8) != (pc >> 8)) break;               /* next page may be another bank */
+        const Byte   *code = host + (at - pc);
+        const OpInfo *info = &OP_INFO[code[0]];
+        if (info->cycles == 0) break;                    /* unknown opcode */
+        if ((at & 0xFF) + info->len > 0xFF) break;       /* operand on the next page */
+
+        Word operand = 0;
+        if (info->len >= 1) operand  = code[1];
+        if (info->len == 2) operand |= code[2] << 8;
+
+        JitMark mark = jit_mark(&j);
+        if (count > 0) jit_budget_check(&j, cycles, jit_exit(&j, at, cycles));
+        if (!jit_instr(&j, at, code[0], operand, cycles, &ends)) {
+            jit_rollback(&j, mark);
+            j.overflow = 0;
+            ends = 0;
+            break;
+        }
+        cycles += info->cycles;
+        at     += 1 + info->len;
+        j.count = ++count;
+    }
+    if (count > 0) {
+        if (!ends) jit_jmp(&j, jit_exit(&j, at, cycles));
+        jit_finish(&j);
+    }
+    if (jit_protect(j.start, j.end, PROT_READ | PROT_EXEC) != 0) {
+        fprintf(stderr, "JIT: cannot make code executable, interpreting\n");
+        jit->state = -1;
+        return NULL;
+    }
+    if (count == 0 || j.overflow) return NULL;
+
+    size_t size = (size_t)(j.p - j.start);
+    jit->code_used += (size + 15) & ~(size_t)15;
+    if (jit_perf_map) {
+        fprintf(jit_perf_map, "%lx %zx 6502_%04X%s\n",
+                (unsigned long)(uintptr_t)j.start, size, pc, rom ? "" : "_ram");
+    }
+    return (CpuJitBlock)(void *)j.start;
+}
+
+CpuJitBlock cpu_jit_block(CpuJit *jit, Word pc) {
+    if (!jit_init(jit)) return NULL;
+    Bus *bus = jit->bus;
+    const Byte *page = bus->read_page[pc >> 8];
+    if (!page) return NULL;
+    if (jit->epoch != bus->map_epoch) {
+        /* different cartridge: ROM-keyed blocks may alias freed memory */
+        cpu_jit_flush(jit);
+        jit->epoch = bus->map_epoch;
+    }
+
+    const Byte *host = page + (pc & 0xFF);
+    JitEntry *e;
+    for (e = jit->heads[pc]; e; e = e->next) {
+        if (e->host != host) continue;
+        if (e->rom || e->gen == bus->page_gen[pc >> 8]) return e->code;
+        break;   /* RAM code changed: translate again in place */
+    }
+
+    if (jit->entry_count == JIT_MAX_ENTRIES ||
+        JIT_CODE_SIZE - jit->code_used < JIT_BLOCK_BYTES) {
+        cpu_jit_flush(jit);
+        e = NULL;
+    }
+    if (!e) {
+        e = &jit->entries[jit->entry_count++];
+        e->next = jit->heads[pc];
+        e->host = host;
+        jit->heads[pc] = e;
+    }
+    e->rom = (Byte)bus_page_rom(bus, pc);
+    if (!e->rom) bus_mark_code_page(bus, pc);
+    e->gen  = bus->page_gen[pc >> 8];
+    e->code = jit_compile(jit, pc, host, e->rom);
+    return e->code;
+}
+
+int cpu_jit_enable_perf_map(void) {
+    char path[64];
+    if (jit_perf_map) return 0;
+    snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+    jit_perf_map = fopen(path, "w");
+    if (!jit_perf_map) return -1;
+    setvbuf(jit_perf_map, NULL, _IOLBF, 0);
+    return 0;
+}
+
+#else
+
+/* No translator on this host: cpu_step_jit interprets everything. */
+
+struct CpuJit {
+    int unused;
+};
+
+CpuJit *cpu_jit_create(Bus *bus) {
+    (void)bus;
+    return calloc(1, sizeof(CpuJit));
+}
+
+void cpu_jit_destroy(CpuJit *jit) {
+    free(jit);
+}
+
+CpuJitBlock cpu_jit_block(CpuJit *jit, Word pc) {
+    (void)jit;
+    (void)pc;
+    return NULL;
+}
+
+void cpu_jit_flush(CpuJit *jit) {
+    (void)jit;
+}
+
+int cpu_jit_enable_perf_map(void) {
+    return -1;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef CPU_JIT_H
+#define CPU_JIT_H
+
+#include "cpu.h"
+#include "bus.h"
+
+/* x86-64 translator for straight-line 6502 code, used by cpu_step when the
+   build defines NES_CPU_JIT (CMake option NES_CPU_JIT).
+
+   A block runs from a PC up to the first branch, jump or subroutine
+   call/return, the end of its 256-byte page, or the first instruction left
+   to the interpreter (BRK/RTI, PHP/PLP, CLI/SEI, JMP indirect). Generated
+   code only touches memory the bus maps directly; any other access (PPU/APU
+   registers, mapper registers, pages holding code) leaves the block before
+   that instruction, so the interpreter performs it at the same cycle it
+   would have without the JIT. */
+
+/* Called with cycles = 0 and budget >= 1, the cycles before an interrupt
+   could become pending. Runs the instructions that start within the
+   budget, so an interrupt is taken after the same instruction as in the
+   interpreter. Returns with PC, registers, flags and lazy_n/lazy_z updated
+   and cycles set to the cycles consumed, which is 0 if the block had to
+   leave before its first instruction. */
+typedef void (*CpuJitBlock)(CPU *cpu, int budget);
+
+/* Translator state for one bus: its block index and executable buffer.
+   Generated code addresses that bus's page tables directly, so a CpuJit
+   must not be shared between consoles. */
+typedef struct CpuJit CpuJit;
+
+/* The code buffer is mapped on first use; its pages are writable only
+   while a block is being translated into them. Returns NULL if out of
+   memory. */
+CpuJit *cpu_jit_create(Bus *bus);
+void    cpu_jit_destroy(CpuJit *jit);
+
+/* Translated block starting at pc, or NULL if the instruction at pc must be
+   interpreted. Blocks in PRG-ROM are keyed by the ROM bytes they came from
+   and survive bank switches; blocks in RAM and PRG-RAM are dropped when the
+   bus bumps their page generation. */
+CpuJitBlock cpu_jit_block(CpuJit *jit, Word pc);
+
+/* Drop every translated block. */
+void cpu_jit_flush(CpuJit *jit);
+
+/* Describe each new block, of every instance, in /tmp/perf-<pid>.map so
+   perf can attribute samples to guest code. Returns 0 on success, -1 otherwise. */
+int  cpu_jit_enable_perf_map(void);
+
+#endif
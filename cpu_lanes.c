@@ -0,0 +1,617 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu_lanes.h"
+
+#include "bus.h"
+#include "memory.h"
+
+/* ------------------------------------------------------------------ */
+/*  Lane memory                                                        */
+/* ------------------------------------------------------------------ */
+
+/* A scalar lane step runs the shared kernels on a scratch CPU embedded
+   here, so memory accesses can find the lane they belong to. */
+typedef struct {
+    CPU       cpu;   /* first member: kernels get &lane_cpu.cpu */
+    CpuLanes *lanes;
+    int       lane;
+} LaneCpu;
+
+static Byte lane_read(CPU *cpu, Word addr) {
+    const LaneCpu *lc = (const LaneCpu *)cpu;
+    if (addr <= 0x1FFF) return lc->lanes->ram[addr & 0x07FF][lc->lane];
+    return bus_read(cpu->bus, addr);
+}
+
+static void lane_write(CPU *cpu, Word addr, Byte value) {
+    LaneCpu *lc = (LaneCpu *)cpu;
+    if (addr <= 0x1FFF) {
+        lc->lanes->ram[addr & 0x07FF][lc->lane] = value;
+        return;
+    }
+    bus_write(cpu->bus, addr, value);
+    if (addr >= 0x4020) lc->lanes->shared_dirty = 1;   /* may have switched banks */
+}
+
+#define CPU_READ(cpu, addr)         lane_read((cpu), (addr))
+#define CPU_WRITE(cpu, addr, value) lane_write((cpu), (addr), (value))
+#include "cpu_ops.h"
+
+/* ------------------------------------------------------------------ */
+/*  Opcode info                                                        */
+/* ------------------------------------------------------------------ */
+
+#define MODE_LEN(mode, len) enum { LANE_LEN_##mode = len };
+CPU_ADDR_MODES(MODE_LEN)
+#undef MODE_LEN
+
+typedef struct {
+    Byte mnem;
+    Byte mode;
+    Byte len;      /* operand bytes */
+    Byte cycles;   /* base cycles, 0 for unknown opcodes */
+} OpInfo;
+
+#define INFO_ENTRY(opc, mnem, mode, cyc) [opc] = { MN_##mnem, AM_##mode, LANE_LEN_##mode, cyc },
+static const OpInfo OP_INFO[256] = {
+    CPU_OPCODE_TABLE(INFO_ENTRY)
+};
+#undef INFO_ENTRY
+
+/* ------------------------------------------------------------------ */
+/*  Lifecycle                                                          */
+/* ------------------------------------------------------------------ */
+
+/* Whether every lane has a cartridge with the same PRG-ROM as lane 0.
+   Lanes normally run copies of one game, each console owning its own. */
+static int lanes_same_prg(const CpuLanes *lanes) {
+    const Mapper *m0 = lanes->bus[0]->mapper;
+    if (!m0 || !m0->cart || !m0->cart->prg_rom) return 0;
+    for (int i = 1; i < lanes->count; i++) {
+        const Mapper *m = lanes->bus[i]->mapper;
+        if (!m || !m->cart || !m->cart->prg_rom || m->cart->prg_size != m0->cart->prg_size)
+            return 0;
+        if (m->cart->prg_rom != m0->cart->prg_rom &&
+            memcmp(m->cart->prg_rom, m0->cart->prg_rom, m0->cart->prg_size) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/* A page is shared when every lane maps it to the same offset of
+   identical PRG-ROM. */
+static void lanes_share_rom(CpuLanes *lanes) {
+    memset(lanes->shared, 0, sizeof(lanes->shared));
+    lanes->shared_dirty = 0;
+    if (!lanes->same_prg) return;
+    for (int p = 0x40; p < 0x100; p++) {
+        long offset = bus_prg_offset(lanes->bus[0], (Word)(p << 8));
+        if (offset < 0) continue;
+        int same = 1;
+        for (int i = 1; i < lanes->count && same; i++) {
+            same = bus_prg_offset(lanes->bus[i], (Word)(p << 8)) == offset;
+        }
+        if (same) lanes->shared[p] = lanes->bus[0]->read_page[p];
+    }
+}
+
+void cpu_lanes_init(CpuLanes *lanes, Bus *const *buses, int count) {
+    memset(lanes, 0, sizeof(*lanes));
+    lanes->count = count;
+    for (int i = 0; i < count; i++) {
+        lanes->bus[i] = buses[i];
+        lanes->SP[i]  = 0xFD;
+        lanes->P[i]   = 0b00100100;
+        lanes->PC[i]  = (Word)bus_read(buses[i], 0xFFFC) | ((Word)bus_read(buses[i], 0xFFFD) << 8);
+    }
+    lanes->same_prg = lanes_same_prg(lanes);
+    lanes_share_rom(lanes);
+}
+
+void cpu_lanes_load(CpuLanes *lanes, int lane, const CPU *cpu) {
+    lanes->PC[lane] = cpu->PC;
+    lanes->A[lane]  = cpu->regs.A;
+    lanes->X[lane]  = cpu->regs.X;
+    lanes->Y[lane]  = cpu->regs.Y;
+    lanes->SP[lane] = cpu->SP;
+    lanes->P[lane]  = cpu_flags(cpu);
+    lanes->nmi_pending[lane] = cpu->nmi_pending;
+    lanes->irq_pending[lane] = cpu->irq_pending;
+    for (int addr = 0; addr < MEM_SIZE; addr++) {
+        lanes->ram[addr][lane] = mem_read(&cpu->bus->ram, (Word)addr);
+    }
+}
+
+void cpu_lanes_store(const CpuLanes *lanes, int lane, CPU *cpu) {
+    cpu->PC      = lanes->PC[lane];
+    cpu->regs.A  = lanes->A[lane];
+    cpu->regs.X  = lanes->X[lane];
+    cpu->regs.Y  = lanes->Y[lane];
+    cpu->SP      = lanes->SP[lane];
+    cpu_load_flags(cpu, lanes->P[lane]);
+    cpu->cycles  = lanes->cycles[lane];
+    cpu->nmi_pending = lanes->nmi_pending[lane];
+    cpu->irq_pending = lanes->irq_pending[lane];
+    /* through the bus, so decoded code in RAM is invalidated */
+    for (int addr = 0; addr < MEM_SIZE; addr++) {
+        bus_write(cpu->bus, (Word)addr, lanes->ram[addr][lane]);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Scalar path                                                        */
+/* ------------------------------------------------------------------ */
+
+/* One lane, one instruction: the fused engine's dispatch, with operands
+   fetched through the lane's memory instead of a decode cache. */
+static void lanes_step_scalar(CpuLanes *lanes, int lane) {
+    LaneCpu lc = { .lanes = lanes, .lane = lane };
+    CPU *cpu = &lc.cpu;
+    cpu->bus         = lanes->bus[lane];
+    cpu->PC          = lanes->PC[lane];
+    cpu->regs.A      = lanes->A[lane];
+    cpu->regs.X      = lanes->X[lane];
+    cpu->regs.Y      = lanes->Y[lane];
+    cpu->SP          = lanes->SP[lane];
+    cpu_load_flags(cpu, lanes->P[lane]);
+    cpu->nmi_pending = lanes->nmi_pending[lane];
+    cpu->irq_pending = lanes->irq_pending[lane];
+
+    bus_set_cpu_instruction_id(cpu->bus, cpu->bus->instruction_id + 1);
+    cpu->opcode = CPU_READ(cpu, cpu->PC);
+    const OpInfo *info = &OP_INFO[cpu->opcode];
+    Word operand = 0;
+    if (info->len >= 1) operand  = CPU_READ(cpu, (Word)(cpu->PC + 1));
+    if (info->len == 2) operand |= CPU_READ(cpu, (Word)(cpu->PC + 2)) << 8;
+    cpu->PC    += 1 + info->len;
+    cpu->cycles = 0;
+    switch (cpu->opcode) {
+#define LANE_CASE(opc, mnem, mode, cyc)                                    \
+        case opc: {                                                        \
+            Word addr;                                                     \
+            Byte am_extra = ea_##mode(cpu, operand, &addr);                \
+            Byte op_extra = do_##mnem(cpu, AM_##mode, addr);               \
+            cpu->cycles += cyc + (am_extra & op_extra);                    \
+            break;                                                         \
+        }
+        CPU_OPCODE_TABLE(LANE_CASE)
+#undef LANE_CASE
+        default:
+            cpu_unknown_opcode(cpu);
+            goto done;
+    }
+    cpu_service_interrupts(cpu);
+
+done:
+    lanes->PC[lane] = cpu->PC;
+    lanes->A[lane]  = cpu->regs.A;
+    lanes->X[lane]  = cpu->regs.X;
+    lanes->Y[lane]  = cpu->regs.Y;
+    lanes->SP[lane] = cpu->SP;
+    lanes->P[lane]  = cpu_flags(cpu);
+    lanes->nmi_pending[lane] = cpu->nmi_pending;
+    lanes->irq_pending[lane] = cpu->irq_pending;
+    lanes->cycles[lane]      = cpu->cycles;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Vector path                                                        */
+/* ------------------------------------------------------------------ */
+
+#if defined(__GNUC__)
+
+/* One byte per lane. Comparisons yield 0x00/0xFF per lane. */
+typedef Byte LaneVec __attribute__((vector_size(CPU_LANES)));
+
+#define FLAG_BIT(f) ((Byte)(1 << (f)))
+
+enum { ACCESS_NONE, ACCESS_READ, ACCESS_WRITE, ACCESS_RMW };
+
+static int op_access(const OpInfo *info) {
+    if (info->mode == AM_IMP || info->mode == AM_ACC || info->mode == AM_IMM ||
+        info->mode == AM_REL) return ACCESS_NONE;
+    switch (info->mnem) {
+        case MN_STA: case MN_STX: case MN_STY:
+            return ACCESS_WRITE;
+        case MN_ASL: case MN_LSR: case MN_ROL: case MN_ROR: case MN_INC: case MN_DEC:
+            return ACCESS_RMW;
+        case MN_JMP: case MN_JSR: case MN_NOP:
+            return ACCESS_NONE;
+        default:
+            return ACCESS_READ;
+    }
+}
+
+/* Instructions whose index page cross costs a cycle (do_* returning 1) */
+static int op_page_penalty(Byte mnem) {
+    switch (mnem) {
+        case MN_LDA: case MN_LDX: case MN_LDY: case MN_ADC: case MN_SBC:
+        case MN_AND: case MN_ORA: case MN_EOR: case MN_CMP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static LaneVec vec_load(const Byte *p) {
+    LaneVec v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void vec_store(Byte *p, LaneVec v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+/* Replace N and Z in p with those of v */
+static LaneVec vec_nz(LaneVec p, LaneVec v) {
+    return (p & (Byte)~(FLAG_BIT(N) | FLAG_BIT(Z))) | (v & FLAG_BIT(N)) |
+           ((LaneVec)(v == 0) & FLAG_BIT(Z));
+}
+
+/* Replace C in p with the lanes set in cond */
+static LaneVec vec_carry(LaneVec p, LaneVec cond) {
+    return (p & (Byte)~FLAG_BIT(C)) | (cond & FLAG_BIT(C));
+}
+
+static const Byte *lanes_shared_byte(const CpuLanes *lanes, Word addr) {
+    const Byte *page = lanes->shared[addr >> 8];
+    return page ? page + (addr & 0xFF) : NULL;
+}
+
+/* Lanes taking part in a vector step are marked 0xFF in sel[]. Per-lane
+   work loops over every lane and tests sel, so the loops have a constant
+   trip count the compiler can unroll. */
+#define FOR_EACH_LANE(i, sel) \
+    for (int i = 0; i < CPU_LANES; i++) if (sel[i])
+
+/* Run the instruction at pc on the lanes marked in sel at once. Returns
+   VECTOR_SPLIT if the lanes may have ended up at different PCs, or 0,
+   having changed nothing, if it has to go through the scalar path: the
+   instruction is not fetched from shared ROM, is BRK/RTI/JMP indirect,
+   or some lane's access leaves internal RAM and shared ROM. */
+enum { VECTOR_NONE, VECTOR_TOGETHER, VECTOR_SPLIT };
+
+static int lanes_step_vector(CpuLanes *lanes, const Byte *sel, Word pc) {
+    const Byte *code = lanes_shared_byte(lanes, pc);
+    if (!code) return 0;
+    const OpInfo *info = &OP_INFO[*code];
+    if (info->cycles == 0 || info->mnem == MN_BRK || info->mnem == MN_RTI ||
+        info->mode == AM_IND) return 0;
+    Word operand = 0;
+    for (int k = 1; k <= info->len; k++) {
+        const Byte *b = lanes_shared_byte(lanes, (Word)(pc + k));
+        if (!b) return 0;
+        operand |= *b << (8 * (k - 1));
+    }
+
+    /* Effective addresses: one for all lanes in ZP0/ABS, per lane for
+       indexed modes, whose pointers always come from zero page. */
+    Word ea[CPU_LANES];
+    Byte crossed[CPU_LANES] = { 0 };
+    int  uniform = info->mode == AM_ZP0 || info->mode == AM_ABS;
+    Word addr    = info->mode == AM_ZP0 ? (operand & 0xFF) : operand;
+    if (!uniform) {
+        for (int i = 0; i < CPU_LANES; i++) {
+            Byte zp;
+            Word base;
+            switch (info->mode) {
+                case AM_ZPX: ea[i] = (operand + lanes->X[i]) & 0xFF; base = ea[i]; break;
+                case AM_ZPY: ea[i] = (operand + lanes->Y[i]) & 0xFF; base = ea[i]; break;
+                case AM_ABX: base = operand; ea[i] = base + lanes->X[i]; break;
+                case AM_ABY: base = operand; ea[i] = base + lanes->Y[i]; break;
+                case AM_IZX:
+                    zp    = (operand + lanes->X[i]) & 0xFF;
+                    ea[i] = lanes->ram[zp][i] | (lanes->ram[(zp + 1) & 0xFF][i] << 8);
+                    base  = ea[i];
+                    break;
+                case AM_IZY:
+                    zp    = operand & 0xFF;
+                    base  = lanes->ram[zp][i] | (lanes->ram[(zp + 1) & 0xFF][i] << 8);
+                    ea[i] = base + lanes->Y[i];
+                    break;
+                default:
+                    ea[i] = base = 0;
+                    break;
+            }
+            crossed[i] = (ea[i] & 0xFF00) != (base & 0xFF00);
+        }
+    }
+
+    /* Every access must stay in internal RAM, or shared ROM for reads */
+    int access = op_access(info);
+    if (access != ACCESS_NONE) {
+        if (uniform) {
+            if (addr > 0x1FFF && (access != ACCESS_READ || !lanes_shared_byte(lanes, addr)))
+                return 0;
+        } else {
+            FOR_EACH_LANE(i, sel) {
+                if (ea[i] > 0x1FFF && (access != ACCESS_READ || !lanes_shared_byte(lanes, ea[i])))
+                    return 0;
+            }
+        }
+    }
+
+    LaneVec m  = vec_load(sel);
+    LaneVec a  = vec_load(lanes->A),  x = vec_load(lanes->X), y = vec_load(lanes->Y);
+    LaneVec sp = vec_load(lanes->SP), p = vec_load(lanes->P);
+
+    /* Operand value for every lane */
+    LaneVec v = { 0 };
+    if (info->mode == AM_IMM) {
+        v += (Byte)operand;
+    } else if (info->mode == AM_ACC) {
+        v = a;
+    } else if (access == ACCESS_READ || access == ACCESS_RMW) {
+        if (uniform && addr <= 0x1FFF) {
+            v = vec_load(lanes->ram[addr & 0x07FF]);
+        } else if (uniform) {
+            v += *lanes_shared_byte(lanes, addr);
+        } else {
+            Byte gathered[CPU_LANES] = { 0 };
+            FOR_EACH_LANE(i, sel) {
+                gathered[i] = ea[i] <= 0x1FFF ? lanes->ram[ea[i] & 0x07FF][i]
+                                              : *lanes_shared_byte(lanes, ea[i]);
+            }
+            v = vec_load(gathered);
+        }
+    }
+
+    Word next    = pc + 1 + info->len;
+    Byte penalty = uniform ? 0 : op_page_penalty(info->mnem);
+    for (int i = 0; i < CPU_LANES; i++) {
+        lanes->PC[i]     = sel[i] ? next : lanes->PC[i];
+        lanes->cycles[i] = sel[i] ? info->cycles + (penalty & crossed[i]) : lanes->cycles[i];
+    }
+
+    LaneVec r     = v;   /* value an RMW or store writes back */
+    LaneVec taken = { 0 };
+    int     split = 0;
+    switch (info->mnem) {
+        case MN_LDA: a = v; p = vec_nz(p, v); break;
+        case MN_LDX: x = v; p = vec_nz(p, v); break;
+        case MN_LDY: y = v; p = vec_nz(p, v); break;
+        case MN_STA: r = a; break;
+        case MN_STX: r = x; break;
+        case MN_STY: r = y; break;
+
+        case MN_SBC:
+            v = ~v;
+            /* fall through */
+        case MN_ADC: {
+            LaneVec t = a + v;
+            LaneVec s = t + (p & FLAG_BIT(C));
+            LaneVec o = (a ^ s) & (v ^ s) & 0x80;
+            p = vec_carry(p, (LaneVec)(t < a) | (LaneVec)(s < t));
+            p = (p & (Byte)~FLAG_BIT(V)) | (o >> 1);
+            a = s;
+            p = vec_nz(p, a);
+            break;
+        }
+        case MN_AND: a &= v; p = vec_nz(p, a); break;
+        case MN_ORA: a |= v; p = vec_nz(p, a); break;
+        case MN_EOR: a ^= v; p = vec_nz(p, a); break;
+
+        case MN_CMP: p = vec_carry(vec_nz(p, a - v), (LaneVec)(a >= v)); break;
+        case MN_CPX: p = vec_carry(vec_nz(p, x - v), (LaneVec)(x >= v)); break;
+        case MN_CPY: p = vec_carry(vec_nz(p, y - v), (LaneVec)(y >= v)); break;
+        case MN_BIT:
+            p = (p & (Byte)~(FLAG_BIT(N) | FLAG_BIT(V) | FLAG_BIT(Z))) |
+                (v & (FLAG_BIT(N) | FLAG_BIT(V))) | ((LaneVec)((a & v) == 0) & FLAG_BIT(Z));
+            break;
+
+        case MN_ASL: r = v << 1; p = vec_carry(p, v >> 7); break;
+        case MN_LSR: r = v >> 1; p = vec_carry(p, v);      break;
+        case MN_ROL: r = (v << 1) | (p & FLAG_BIT(C));        p = vec_carry(p, v >> 7); break;
+        case MN_ROR: r = (v >> 1) | ((p & FLAG_BIT(C)) << 7); p = vec_carry(p, v);      break;
+        case MN_INC: r = v + 1; break;
+        case MN_DEC: r = v - 1; break;
+
+        case MN_INX: x += 1; p = vec_nz(p, x); break;
+        case MN_INY: y += 1; p = vec_nz(p, y); break;
+        case MN_DEX: x -= 1; p = vec_nz(p, x); break;
+        case MN_DEY: y -= 1; p = vec_nz(p, y); break;
+        case MN_TAX: x = a;  p = vec_nz(p, x); break;
+        case MN_TAY: y = a;  p = vec_nz(p, y); break;
+        case MN_TXA: a = x;  p = vec_nz(p, a); break;
+        case MN_TYA: a = y;  p = vec_nz(p, a); break;
+        case MN_TSX: x = sp; p = vec_nz(p, x); break;
+        case MN_TXS: sp = x; break;
+
+        case MN_CLC: p &= (Byte)~FLAG_BIT(C); break;
+        case MN_CLD: p &= (Byte)~FLAG_BIT(D); break;
+        case MN_CLI: p &= (Byte)~FLAG_BIT(I); break;
+        case MN_CLV: p &= (Byte)~FLAG_BIT(V); break;
+        case MN_SEC: p |= FLAG_BIT(C); break;
+        case MN_SED: p |= FLAG_BIT(D); break;
+        case MN_SEI: p |= FLAG_BIT(I); break;
+        case MN_NOP: break;
+
+        case MN_BCC: taken = (LaneVec)((p & FLAG_BIT(C)) == 0); break;
+        case MN_BCS: taken = (LaneVec)((p & FLAG_BIT(C)) != 0); break;
+        case MN_BNE: taken = (LaneVec)((p & FLAG_BIT(Z)) == 0); break;
+        case MN_BEQ: taken = (LaneVec)((p & FLAG_BIT(Z)) != 0); break;
+        case MN_BPL: taken = (LaneVec)((p & FLAG_BIT(N)) == 0); break;
+        case MN_BMI: taken = (LaneVec)((p & FLAG_BIT(N)) != 0); break;
+        case MN_BVC: taken = (LaneVec)((p & FLAG_BIT(V)) == 0); break;
+        case MN_BVS: taken = (LaneVec)((p & FLAG_BIT(V)) != 0); break;
+
+        case MN_JMP:
+            FOR_EACH_LANE(i, sel) lanes->PC[i] = operand;
+            break;
+
+        /* The stack is in internal RAM, but each lane's SP picks its own
+           row, so stack traffic goes lane by lane. */
+        case MN_JSR:
+            FOR_EACH_LANE(i, sel) {
+                Word ret = next - 1;
+                lanes->ram[0x100 + lanes->SP[i]--][i] = ret >> 8;
+                lanes->ram[0x100 + lanes->SP[i]--][i] = ret & 0xFF;
+                lanes->PC[i] = operand;
+            }
+            sp = vec_load(lanes->SP);
+            break;
+        case MN_RTS:
+            FOR_EACH_LANE(i, sel) {
+                Byte lo = lanes->ram[0x100 + ++lanes->SP[i]][i];
+                Byte hi = lanes->ram[0x100 + ++lanes->SP[i]][i];
+                lanes->PC[i] = ((hi << 8) | lo) + 1;
+            }
+            sp    = vec_load(lanes->SP);
+            split = 1;
+            break;
+        case MN_PHA:
+        case MN_PHP: {
+            Byte pushed[CPU_LANES];
+            vec_store(pushed, info->mnem == MN_PHA ? a : (p | 0x30));
+            FOR_EACH_LANE(i, sel) lanes->ram[0x100 + lanes->SP[i]--][i] = pushed[i];
+            sp = vec_load(lanes->SP);
+            break;
+        }
+        case MN_PLA:
+        case MN_PLP: {
+            Byte pulled[CPU_LANES] = { 0 };
+            FOR_EACH_LANE(i, sel) pulled[i] = lanes->ram[0x100 + ++lanes->SP[i]][i];
+            sp = vec_load(lanes->SP);
+            if (info->mnem == MN_PLA) {
+                a = vec_load(pulled);
+                p = vec_nz(p, a);
+            } else {
+                p = (vec_load(pulled) & 0xCF) | 0x20;
+            }
+            break;
+        }
+
+        default:
+            return 0;
+    }
+
+    if (info->mode == AM_REL) {
+        Word target = next + (int8_t)(operand & 0xFF);
+        Byte extra  = 1 + ((next & 0xFF00) != (target & 0xFF00));
+        Byte jump[CPU_LANES];
+        int  jumps = 0, lanes_in = 0;
+        vec_store(jump, taken & m);
+        for (int i = 0; i < CPU_LANES; i++) {
+            lanes->PC[i]      = jump[i] ? target : lanes->PC[i];
+            lanes->cycles[i] += jump[i] ? extra : 0;
+            jumps            += jump[i] != 0;
+            lanes_in         += sel[i] != 0;
+        }
+        split = jumps != 0 && jumps != lanes_in;
+    }
+
+    if (access == ACCESS_RMW) p = vec_nz(p, r);
+    if (info->mode == AM_ACC) {
+        a = r;
+        p = vec_nz(p, r);
+    } else if (access == ACCESS_WRITE || access == ACCESS_RMW) {
+        if (uniform) {
+            Byte *row = lanes->ram[addr & 0x07FF];
+            vec_store(row, (r & m) | (vec_load(row) & ~m));
+        } else {
+            Byte result[CPU_LANES];
+            vec_store(result, r);
+            FOR_EACH_LANE(i, sel) lanes->ram[ea[i] & 0x07FF][i] = result[i];
+        }
+    }
+
+    /* Lanes outside sel keep their registers */
+    vec_store(lanes->A,  (a  & m) | (vec_load(lanes->A)  & ~m));
+    vec_store(lanes->X,  (x  & m) | (vec_load(lanes->X)  & ~m));
+    vec_store(lanes->Y,  (y  & m) | (vec_load(lanes->Y)  & ~m));
+    vec_store(lanes->SP, (sp & m) | (vec_load(lanes->SP) & ~m));
+    vec_store(lanes->P,  (p  & m) | (vec_load(lanes->P)  & ~m));
+    return split ? VECTOR_SPLIT : VECTOR_TOGETHER;
+}
+
+#endif /* __GNUC__ */
+
+/* ------------------------------------------------------------------ */
+/*  Dispatch                                                           */
+/* ------------------------------------------------------------------ */
+
+/* Most cycles one lane can take in one step: a 7-cycle instruction
+   followed by an interrupt entry */
+#define LANE_MAX_STEP_CYCLES 14
+
+void cpu_lanes_run(CpuLanes *lanes, int cycles) {
+    Byte live[CPU_LANES]  = { 0 };   /* budget left */
+    Byte spent[CPU_LANES] = { 0 };   /* cycles not yet taken off budget */
+    for (int i = 0; i < lanes->count; i++) lanes->budget[i] += cycles;
+
+    /* The per-lane loops below are written without data-dependent
+       branches: which lanes take part changes from step to step. */
+    Byte sel[CPU_LANES] = { 0 };
+    int  lead     = 0;
+    int  left     = 0;
+    int  safe     = 0;   /* steps no live lane can run out of budget in */
+    int  together = 0;   /* sel holds every live lane, all at one PC */
+    for (;;) {
+        if (safe == 0) {
+            /* Settle the cycles spent so far and see who is still running */
+            int low = INT32_MAX;
+            left = 0;
+            for (int i = 0; i < CPU_LANES; i++) {
+                lanes->budget[i] -= spent[i];
+                spent[i] = 0;
+                live[i]  = i < lanes->count && lanes->budget[i] > 0;
+                sel[i]  &= live[i] ? 0xFF : 0;
+                lead     = sel[i] ? i : lead;
+                left    += live[i];
+                low      = live[i] && lanes->budget[i] < low ? lanes->budget[i] : low;
+            }
+            if (left == 0) break;
+            /* the next step always runs; after it, each further step
+               must leave every lane's budget positive and spent[] must
+               not overflow */
+            safe = (low - 1) / LANE_MAX_STEP_CYCLES;
+            if (safe > 255 / LANE_MAX_STEP_CYCLES - 1) safe = 255 / LANE_MAX_STEP_CYCLES - 1;
+        } else {
+            safe--;
+        }
+
+        int size = left;
+        if (!together) {
+            /* Leader: deepest stack (lowest SP), then lowest PC */
+            uint32_t best = UINT32_MAX;
+            for (int i = 0; i < CPU_LANES; i++) {
+                uint32_t key = live[i] ? ((uint32_t)lanes->SP[i] << 16) | lanes->PC[i] : UINT32_MAX;
+                lead = key < best ? i : lead;
+                best = key < best ? key : best;
+            }
+
+            /* Everyone else at the same PC joins in; lanes with an
+               interrupt pending take it one by one */
+            Word pc  = lanes->PC[lead];
+            int lone = lanes->nmi_pending[lead] | lanes->irq_pending[lead];
+            size = 0;
+            for (int i = 0; i < CPU_LANES; i++) {
+                int busy = lanes->nmi_pending[i] | lanes->irq_pending[i];
+                int join = (i == lead) |
+                           ((lone == 0) & live[i] & (lanes->PC[i] == pc) & (busy == 0));
+                sel[i] = join ? 0xFF : 0;
+                size  += join;
+            }
+        }
+
+        int ran = VECTOR_NONE;
+#if defined(__GNUC__)
+        if (size >= 2) {
+            if (lanes->shared_dirty) lanes_share_rom(lanes);
+            ran = lanes_step_vector(lanes, sel, lanes->PC[lead]);
+            if (ran) lanes->vector_steps += size;
+        }
+#endif
+        if (!ran) {
+            for (int i = 0; i < CPU_LANES; i++) {
+                if (sel[i]) lanes_step_scalar(lanes, i);
+            }
+        }
+        together = ran == VECTOR_TOGETHER && size == left;
+        lanes->steps += size;
+        for (int i = 0; i < CPU_LANES; i++) spent[i] += sel[i] & lanes->cycles[i];
+    }
+    if (lanes->shared_dirty) lanes_share_rom(lanes);
+}
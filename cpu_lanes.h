@@ -0,0 +1,84 @@
+#ifndef CPU_LANES_H
+#define CPU_LANES_H
+
+#include <stdint.h>
+#include "types.h"
+#include "cpu.h"
+#include "bus.h"
+
+/* Experimental lockstep engine: up to CPU_LANES 6502s running the same
+   program, e.g. one game forked into many consoles that only differ in
+   their input or RAM, for search and fuzzing workloads.
+
+   Registers and internal RAM are kept structure-of-arrays, one byte per
+   lane side by side, so lanes sitting at the same PC run the instruction
+   together as byte-vector operations (GCC vector extensions: SSE2 for 16
+   lanes, AVX2 for 32 when the target has it). Lanes at different PCs,
+   lanes with an interrupt pending, and any instruction that touches
+   memory other than internal RAM or PRG-ROM pages that every lane maps
+   identically run one lane at a time through the same kernels as
+   cpu_step_fused (cpu_ops.h), so results match cpu_step instruction for
+   instruction.
+
+   Each lane still has its own Bus for everything outside internal RAM
+   (PPU and APU registers, mappers, PRG-RAM). The engine only runs the
+   CPU: nothing ticks the PPU or APU, and there is no decode cache,
+   idle-loop skip or JIT. */
+
+#ifndef CPU_LANES
+#define CPU_LANES 16   /* power of two, 32 at most */
+#endif
+
+typedef struct CpuLanes {
+    int  count;                  /* lanes in use, 1..CPU_LANES */
+
+    Word PC[CPU_LANES];
+    Byte A[CPU_LANES];
+    Byte X[CPU_LANES];
+    Byte Y[CPU_LANES];
+    Byte SP[CPU_LANES];
+    Byte P[CPU_LANES];           /* status register, as CPU.flags */
+    Byte nmi_pending[CPU_LANES]; /* as in CPU, set by the caller */
+    Byte irq_pending[CPU_LANES];
+    Byte cycles[CPU_LANES];      /* cycles taken by each lane's last instruction */
+    int  budget[CPU_LANES];      /* cycles left to run; an instruction that
+                                    overshoots leaves it negative, and the
+                                    next cpu_lanes_run pays that back */
+
+    /* Internal RAM, address-major: ram[addr] holds every lane's copy of
+       that byte, so one vector load reads it for all lanes. */
+    Byte ram[MEM_SIZE][CPU_LANES];
+
+    Bus *bus[CPU_LANES];
+
+    /* PRG-ROM pages mapped to the same bytes in every lane, NULL
+       elsewhere. Refreshed after a lane writes to cartridge space. Only
+       lanes whose cartridges hold identical PRG-ROM share anything. */
+    const Byte *shared[256];
+    int         shared_dirty;
+    int         same_prg;
+
+    /* Lane-instructions executed, and how many of them were vectorised */
+    uint64_t steps;
+    uint64_t vector_steps;
+} CpuLanes;
+
+/* Power on count lanes with zeroed RAM, lane i using buses[i] for
+   everything outside internal RAM. Each PC comes from its bus's reset
+   vector. */
+void cpu_lanes_init(CpuLanes *lanes, Bus *const *buses, int count);
+
+/* Copy a CPU's registers, flags, pending interrupts and its bus's
+   internal RAM into a lane, or a lane back out into a CPU and its bus. */
+void cpu_lanes_load(CpuLanes *lanes, int lane, const CPU *cpu);
+void cpu_lanes_store(const CpuLanes *lanes, int lane, CPU *cpu);
+
+/* Give every lane cycles more CPU cycles and run each until its budget is
+   used up, stopping at the first instruction boundary at or past it (an
+   interrupt entry counts as part of the instruction before it). Lanes
+   that branched apart wait for each other: the lanes deepest in the
+   stack, then lowest in memory, go first, so they line up again after an
+   if/else or a subroutine only some of them called. */
+void cpu_lanes_run(CpuLanes *lanes, int cycles);
+
+#endif
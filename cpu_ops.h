@@ -0,0 +1,635 @@
+#ifndef CPU_OPS_H
+#define CPU_OPS_H
+
+/* 6502 instruction semantics shared by the interpreters in cpu.c and
+   cpu_lanes.c. The including file decides where memory lives by defining
+   CPU_READ(cpu, addr) and CPU_WRITE(cpu, addr, value) first; everything
+   else works on a plain CPU. */
+
+#include <stdio.h>
+
+#include "cpu.h"
+#include "opcodes.h"
+#include "util.h"
+
+#if !defined(CPU_READ) || !defined(CPU_WRITE)
+#error "define CPU_READ and CPU_WRITE before including cpu_ops.h"
+#endif
+
+typedef enum {
+    AM_IMP, AM_ACC, AM_IMM, AM_ZP0, AM_ZPX, AM_ZPY,
+    AM_REL, AM_ABS, AM_ABX, AM_ABY, AM_IZX, AM_IZY,
+    AM_IND
+} AddrModeId;
+
+/* Kernels shared by every dispatcher; forced inline so the fused
+   engines can specialise them per opcode. */
+#if defined(__GNUC__)
+#define CPU_INLINE static inline __attribute__((always_inline))
+#else
+#define CPU_INLINE static inline
+#endif
+
+/* MN_ADC, MN_AND, ...: one id per mnemonic, for per-opcode info tables */
+#define MNEM_ID(mnem) MN_##mnem,
+enum { CPU_MNEMONICS(MNEM_ID) };
+#undef MNEM_ID
+
+/* ------------------------------------------------------------------ */
+/*  Stack                                                              */
+/* ------------------------------------------------------------------ */
+
+CPU_INLINE void push_byte(Byte value, CPU *cpu) {
+    CPU_WRITE(cpu, 0x100 + cpu->SP, value);
+    cpu->SP -= 1;
+}
+
+CPU_INLINE Byte pop_byte(CPU *cpu) {
+    cpu->SP += 1;
+    return CPU_READ(cpu, 0x100 + cpu->SP);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Addressing modes                                                   */
+/* ------------------------------------------------------------------ */
+
+/* Each ea_* kernel resolves the effective address of the current
+   instruction into *addr and returns 1 if an index crossed a page.
+   operand holds the instruction's operand bytes (little-endian) and PC
+   already points past them; the table dispatcher fetches them through
+   the am_* wrappers in cpu.c, the fused dispatchers take them from the
+   decode cache or straight from memory. */
+
+CPU_INLINE Byte ea_IMP(CPU *cpu, Word operand, Word *addr) {
+    (void)cpu; (void)operand;
+    *addr = 0;
+    return 0;
+}
+
+CPU_INLINE Byte ea_ACC(CPU *cpu, Word operand, Word *addr) {
+    (void)cpu; (void)operand;
+    *addr = 0;
+    return 0;
+}
+
+CPU_INLINE Byte ea_IMM(CPU *cpu, Word operand, Word *addr) {
+    (void)operand;
+    *addr = cpu->PC - 1;
+    return 0;
+}
+
+CPU_INLINE Byte ea_ZP0(CPU *cpu, Word operand, Word *addr) {
+    (void)cpu;
+    *addr = operand & 0xFF;
+    return 0;
+}
+
+CPU_INLINE Byte ea_ZPX(CPU *cpu, Word operand, Word *addr) {
+    *addr = (operand + cpu->regs.X) & 0xFF;
+    return 0;
+}
+
+CPU_INLINE Byte ea_ZPY(CPU *cpu, Word operand, Word *addr) {
+    *addr = (operand + cpu->regs.Y) & 0xFF;
+    return 0;
+}
+
+CPU_INLINE Byte ea_REL(CPU *cpu, Word operand, Word *addr) {
+    (void)cpu;
+    *addr = (Word)(int8_t)(operand & 0xFF);
+    return 0;
+}
+
+CPU_INLINE Byte ea_ABS(CPU *cpu, Word operand, Word *addr) {
+    (void)cpu;
+    *addr = operand;
+    return 0;
+}
+
+CPU_INLINE Byte ea_ABX(CPU *cpu, Word operand, Word *addr) {
+    *addr = operand + cpu->regs.X;
+    return (*addr & 0xFF00) != (operand & 0xFF00) ? 1 : 0;
+}
+
+CPU_INLINE Byte ea_ABY(CPU *cpu, Word operand, Word *addr) {
+    *addr = operand + cpu->regs.Y;
+    return (*addr & 0xFF00) != (operand & 0xFF00) ? 1 : 0;
+}
+
+CPU_INLINE Byte ea_IZX(CPU *cpu, Word operand, Word *addr) {
+    Byte zp = (operand + cpu->regs.X) & 0xFF;
+    *addr   = CPU_READ(cpu, zp) | (CPU_READ(cpu, (zp + 1) & 0xFF) << 8);
+    return 0;
+}
+
+CPU_INLINE Byte ea_IZY(CPU *cpu, Word operand, Word *addr) {
+    Byte zp   = operand & 0xFF;
+    Word base = CPU_READ(cpu, zp) | (CPU_READ(cpu, (zp + 1) & 0xFF) << 8);
+    *addr     = base + cpu->regs.Y;
+    return (*addr & 0xFF00) != (base & 0xFF00) ? 1 : 0;
+}
+
+CPU_INLINE Byte ea_IND(CPU *cpu, Word operand, Word *addr) {
+    (void)cpu;
+    Word ptr = operand;
+    /* 6502 page-wrap bug: if low byte of ptr is 0xFF, high byte wraps within
+       the same page instead of crossing to the next page. */
+    Byte lo = CPU_READ(cpu, ptr);
+    Byte hi = CPU_READ(cpu, (ptr & 0xFF00) | ((ptr + 1) & 0xFF));
+    *addr   = lo | (hi << 8);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Operand access                                                     */
+/* ------------------------------------------------------------------ */
+
+/* mode is a compile-time constant in the fused dispatcher, so the
+   accumulator test folds away there. */
+CPU_INLINE Byte read_operand(CPU *cpu, AddrModeId mode, Word addr) {
+    if (mode == AM_ACC) return cpu->regs.A;
+    return CPU_READ(cpu, addr);
+}
+
+CPU_INLINE void write_result(CPU *cpu, AddrModeId mode, Word addr, Byte value) {
+    if (mode == AM_ACC) cpu->regs.A = value;
+    else                CPU_WRITE(cpu, addr, value);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Flag helpers                                                       */
+/* ------------------------------------------------------------------ */
+
+/* N and Z are evaluated lazily: lazy_n holds the byte whose bit 7 is N and
+   lazy_z the byte that is zero when Z is set. They are folded into the
+   status byte only where the whole of it is needed (PHP, BRK, interrupt
+   entry, cpu_flags) and loaded back from it after PLP and RTI. */
+
+CPU_INLINE void lazy_nz_load(CPU *cpu) {
+    cpu->lazy_n = cpu->flags;
+    cpu->lazy_z = ~cpu->flags & (1 << Z);
+}
+
+CPU_INLINE Byte lazy_nz_flags(const CPU *cpu) {
+    return (cpu->flags & ~((1 << N) | (1 << Z))) | (1 << U) |
+           (cpu->lazy_n & (1 << N)) | (cpu->lazy_z == 0 ? (1 << Z) : 0);
+}
+
+CPU_INLINE Byte flag_N(const CPU *cpu) { return cpu->lazy_n >> 7; }
+CPU_INLINE Byte flag_Z(const CPU *cpu) { return cpu->lazy_z == 0; }
+
+CPU_INLINE void set_NZ_from(Byte v, CPU *cpu) {
+    cpu->lazy_n = v;
+    cpu->lazy_z = v;
+}
+
+CPU_INLINE void set_NZ_flags(CPU *cpu) {
+    set_NZ_from(cpu->regs.A, cpu);
+}
+
+CPU_INLINE void set_CMP_flags(Word result, CPU *cpu) {
+    set_NZ_from(result & 0xFF, cpu);
+    cpu_set_flag(C, result <= 0xFF, cpu);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Branch helper                                                      */
+/* ------------------------------------------------------------------ */
+
+CPU_INLINE void branch_if(CPU *cpu, Byte cond, Word offset) {
+    if (!cond) return;
+    Word new_pc = cpu->PC + (int8_t)(offset & 0xFF);
+    /* +1 for taken, +1 more for page cross */
+    cpu->cycles += 1 + ((cpu->PC & 0xFF00) != (new_pc & 0xFF00));
+    cpu->PC = new_pc;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Opcode implementations                                             */
+/* ------------------------------------------------------------------ */
+
+/* Each do_* kernel receives the addressing mode and the effective
+   address resolved by the matching ea_* kernel, and returns 1 if the
+   operation takes the extra cycle on an index page cross. */
+
+/* --- LDA --- */
+CPU_INLINE Byte do_LDA(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.A = read_operand(cpu, mode, addr);
+    set_NZ_flags(cpu);
+    return 1; /* page-cross-sensitive */
+}
+
+/* --- STA --- */
+CPU_INLINE Byte do_STA(CPU *cpu, AddrModeId mode, Word addr) {
+    CPU_WRITE(cpu, addr, cpu->regs.A);
+    return 0;
+}
+
+/* --- ADC --- */
+CPU_INLINE Byte do_ADC(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte operand = read_operand(cpu, mode, addr);
+    Word result  = cpu->regs.A + operand + cpu_read_flag(C, cpu);
+    cpu_set_flag(C, result > 0xFF, cpu);
+    cpu_set_flag(V, ((cpu->regs.A ^ result) & (operand ^ result) & 0x80) != 0, cpu);
+    cpu->regs.A = result & 0xFF;
+    set_NZ_flags(cpu);
+    return 1;
+}
+
+/* --- AND --- */
+CPU_INLINE Byte do_AND(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.A &= read_operand(cpu, mode, addr);
+    set_NZ_flags(cpu);
+    return 1;
+}
+
+/* --- ASL --- */
+CPU_INLINE Byte do_ASL(CPU *cpu, AddrModeId mode, Word addr) {
+    Word shifted = read_operand(cpu, mode, addr) << 1;
+    cpu_set_flag(C, shifted > 0xFF, cpu);
+    set_NZ_from(shifted & 0xFF, cpu);
+    write_result(cpu, mode, addr, shifted & 0xFF);
+    return 0;
+}
+
+/* --- Branches --- */
+CPU_INLINE Byte do_BCC(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, cpu_read_flag(C, cpu) == 0, addr); return 0; }
+CPU_INLINE Byte do_BCS(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, cpu_read_flag(C, cpu) == 1, addr); return 0; }
+CPU_INLINE Byte do_BNE(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, flag_Z(cpu) == 0, addr); return 0; }
+CPU_INLINE Byte do_BEQ(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, flag_Z(cpu) == 1, addr); return 0; }
+CPU_INLINE Byte do_BPL(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, flag_N(cpu) == 0, addr); return 0; }
+CPU_INLINE Byte do_BMI(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, flag_N(cpu) == 1, addr); return 0; }
+CPU_INLINE Byte do_BVC(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, cpu_read_flag(V, cpu) == 0, addr); return 0; }
+CPU_INLINE Byte do_BVS(CPU *cpu, AddrModeId mode, Word addr) { branch_if(cpu, cpu_read_flag(V, cpu) == 1, addr); return 0; }
+
+/* --- BIT --- */
+CPU_INLINE Byte do_BIT(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte value = read_operand(cpu, mode, addr);
+    cpu->lazy_z = cpu->regs.A & value;
+    cpu->lazy_n = value;
+    cpu_set_flag(V, read_bit(value, 6), cpu);
+    return 0;
+}
+
+/* --- BRK --- */
+CPU_INLINE Byte do_BRK(CPU *cpu, AddrModeId mode, Word addr) {
+    /* After dispatch fetched opcode, PC = BRK_addr+1.
+       Push PC+1 to skip the padding byte; RTI returns to BRK_addr+2. */
+    Word stack_PC    = cpu->PC + 1;
+    Byte stack_PC_lo = stack_PC & 0xFF;
+    Byte stack_PC_hi = (stack_PC >> 8) & 0xFF;
+    push_byte(stack_PC_hi, cpu);
+    push_byte(stack_PC_lo, cpu);
+
+    cpu_set_flag(I, 1, cpu);
+    push_byte(lazy_nz_flags(cpu) | (1 << B), cpu);
+
+    Byte lo = CPU_READ(cpu, 0xFFFE);
+    Byte hi = CPU_READ(cpu, 0xFFFF);
+    cpu->PC = lo | (hi << 8);
+    return 0;
+}
+
+/* --- Clear flags --- */
+CPU_INLINE Byte do_CLC(CPU *cpu, AddrModeId mode, Word addr) { cpu_set_flag(C, 0, cpu); return 0; }
+CPU_INLINE Byte do_CLD(CPU *cpu, AddrModeId mode, Word addr) { cpu_set_flag(D, 0, cpu); return 0; }
+CPU_INLINE Byte do_CLI(CPU *cpu, AddrModeId mode, Word addr) { cpu_set_flag(I, 0, cpu); return 0; }
+CPU_INLINE Byte do_CLV(CPU *cpu, AddrModeId mode, Word addr) { cpu_set_flag(V, 0, cpu); return 0; }
+
+/* --- CMP --- */
+CPU_INLINE Byte do_CMP(CPU *cpu, AddrModeId mode, Word addr) {
+    Word result = cpu->regs.A - read_operand(cpu, mode, addr);
+    set_CMP_flags(result, cpu);
+    return 1;
+}
+
+/* --- CPX --- */
+CPU_INLINE Byte do_CPX(CPU *cpu, AddrModeId mode, Word addr) {
+    Word result = cpu->regs.X - read_operand(cpu, mode, addr);
+    set_CMP_flags(result, cpu);
+    return 0;
+}
+
+/* --- CPY --- */
+CPU_INLINE Byte do_CPY(CPU *cpu, AddrModeId mode, Word addr) {
+    Word result = cpu->regs.Y - read_operand(cpu, mode, addr);
+    set_CMP_flags(result, cpu);
+    return 0;
+}
+
+/* --- DEC --- */
+CPU_INLINE Byte do_DEC(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte result = read_operand(cpu, mode, addr) - 1;
+    CPU_WRITE(cpu, addr, result);
+    set_NZ_from(result, cpu);
+    return 0;
+}
+
+/* --- DEX --- */
+CPU_INLINE Byte do_DEX(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.X--;
+    set_NZ_from(cpu->regs.X, cpu);
+    return 0;
+}
+
+/* --- DEY --- */
+CPU_INLINE Byte do_DEY(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.Y--;
+    set_NZ_from(cpu->regs.Y, cpu);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Group A — Flag Sets                                                */
+/* ------------------------------------------------------------------ */
+
+/* SEC */
+CPU_INLINE Byte do_SEC(CPU *cpu, AddrModeId mode, Word addr) { cpu_set_flag(C, 1, cpu); return 0; }
+
+/* SED */
+CPU_INLINE Byte do_SED(CPU *cpu, AddrModeId mode, Word addr) { cpu_set_flag(D, 1, cpu); return 0; }
+
+/* SEI */
+CPU_INLINE Byte do_SEI(CPU *cpu, AddrModeId mode, Word addr) { cpu_set_flag(I, 1, cpu); return 0; }
+
+/* ------------------------------------------------------------------ */
+/*  Group B — NOP                                                      */
+/* ------------------------------------------------------------------ */
+
+/* NOP */
+CPU_INLINE Byte do_NOP(CPU *cpu, AddrModeId mode, Word addr) { (void)cpu; return 0; }
+
+/* ------------------------------------------------------------------ */
+/*  Group C — Register Transfers                                       */
+/* ------------------------------------------------------------------ */
+
+/* TAX */
+CPU_INLINE Byte do_TAX(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.X = cpu->regs.A;
+    set_NZ_from(cpu->regs.X, cpu);
+    return 0;
+}
+
+/* TAY */
+CPU_INLINE Byte do_TAY(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.Y = cpu->regs.A;
+    set_NZ_from(cpu->regs.Y, cpu);
+    return 0;
+}
+
+/* TXA */
+CPU_INLINE Byte do_TXA(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.A = cpu->regs.X;
+    set_NZ_from(cpu->regs.A, cpu);
+    return 0;
+}
+
+/* TYA */
+CPU_INLINE Byte do_TYA(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.A = cpu->regs.Y;
+    set_NZ_from(cpu->regs.A, cpu);
+    return 0;
+}
+
+/* TSX */
+CPU_INLINE Byte do_TSX(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.X = cpu->SP;
+    set_NZ_from(cpu->regs.X, cpu);
+    return 0;
+}
+
+/* TXS */
+CPU_INLINE Byte do_TXS(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->SP = cpu->regs.X;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Group D — INC/INX/INY                                              */
+/* ------------------------------------------------------------------ */
+
+/* INC */
+CPU_INLINE Byte do_INC(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte result = read_operand(cpu, mode, addr) + 1;
+    CPU_WRITE(cpu, addr, result);
+    set_NZ_from(result, cpu);
+    return 0;
+}
+
+/* INX */
+CPU_INLINE Byte do_INX(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.X++;
+    set_NZ_from(cpu->regs.X, cpu);
+    return 0;
+}
+
+/* INY */
+CPU_INLINE Byte do_INY(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.Y++;
+    set_NZ_from(cpu->regs.Y, cpu);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Group E — EOR, ORA, SBC                                            */
+/* ------------------------------------------------------------------ */
+
+/* EOR */
+CPU_INLINE Byte do_EOR(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.A ^= read_operand(cpu, mode, addr);
+    set_NZ_flags(cpu);
+    return 1;
+}
+
+/* ORA */
+CPU_INLINE Byte do_ORA(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.A |= read_operand(cpu, mode, addr);
+    set_NZ_flags(cpu);
+    return 1;
+}
+
+/* SBC */
+CPU_INLINE Byte do_SBC(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte operand = read_operand(cpu, mode, addr) ^ 0xFF;
+    Word result  = cpu->regs.A + operand + cpu_read_flag(C, cpu);
+    cpu_set_flag(C, result > 0xFF, cpu);
+    cpu_set_flag(V, ((cpu->regs.A ^ result) & (operand ^ result) & 0x80) != 0, cpu);
+    cpu->regs.A = result & 0xFF;
+    set_NZ_flags(cpu);
+    return 1;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Group F — LDX, LDY, STX, STY                                        */
+/* ------------------------------------------------------------------ */
+
+/* LDX */
+CPU_INLINE Byte do_LDX(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.X = read_operand(cpu, mode, addr);
+    set_NZ_from(cpu->regs.X, cpu);
+    return 1;
+}
+
+/* LDY */
+CPU_INLINE Byte do_LDY(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.Y = read_operand(cpu, mode, addr);
+    set_NZ_from(cpu->regs.Y, cpu);
+    return 1;
+}
+
+/* STX */
+CPU_INLINE Byte do_STX(CPU *cpu, AddrModeId mode, Word addr) {
+    CPU_WRITE(cpu, addr, cpu->regs.X);
+    return 0;
+}
+
+/* STY */
+CPU_INLINE Byte do_STY(CPU *cpu, AddrModeId mode, Word addr) {
+    CPU_WRITE(cpu, addr, cpu->regs.Y);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Group G — LSR, ROL, ROR                                            */
+/* ------------------------------------------------------------------ */
+
+/* LSR */
+CPU_INLINE Byte do_LSR(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte value = read_operand(cpu, mode, addr);
+    cpu_set_flag(C, value & 0x01, cpu);
+    Byte result = value >> 1;
+    set_NZ_from(result, cpu);  /* bit 7 is clear, so N = 0 */
+    write_result(cpu, mode, addr, result);
+    return 0;
+}
+
+/* ROL */
+CPU_INLINE Byte do_ROL(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte value = read_operand(cpu, mode, addr);
+    Byte old_c = cpu_read_flag(C, cpu);
+    cpu_set_flag(C, (value >> 7) & 1, cpu);
+    Byte result = (value << 1) | old_c;
+    set_NZ_from(result, cpu);
+    write_result(cpu, mode, addr, result);
+    return 0;
+}
+
+/* ROR */
+CPU_INLINE Byte do_ROR(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte value = read_operand(cpu, mode, addr);
+    Byte old_c = cpu_read_flag(C, cpu);
+    cpu_set_flag(C, value & 0x01, cpu);
+    Byte result = (old_c << 7) | (value >> 1);
+    set_NZ_from(result, cpu);
+    write_result(cpu, mode, addr, result);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Group H — Stack Ops                                                */
+/* ------------------------------------------------------------------ */
+
+/* PHA */
+CPU_INLINE Byte do_PHA(CPU *cpu, AddrModeId mode, Word addr) {
+    push_byte(cpu->regs.A, cpu);
+    return 0;
+}
+
+/* PHP */
+CPU_INLINE Byte do_PHP(CPU *cpu, AddrModeId mode, Word addr) {
+    push_byte(lazy_nz_flags(cpu) | 0x30, cpu);
+    return 0;
+}
+
+/* PLA */
+CPU_INLINE Byte do_PLA(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->regs.A = pop_byte(cpu);
+    set_NZ_flags(cpu);
+    return 0;
+}
+
+/* PLP */
+CPU_INLINE Byte do_PLP(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->flags = (pop_byte(cpu) & 0xCF) | 0x20;
+    lazy_nz_load(cpu);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Group I — Jumps and Subroutines                                    */
+/* ------------------------------------------------------------------ */
+
+/* JMP */
+CPU_INLINE Byte do_JMP(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->PC = addr;
+    return 0;
+}
+
+/* JSR */
+CPU_INLINE Byte do_JSR(CPU *cpu, AddrModeId mode, Word addr) {
+    Word return_addr = cpu->PC - 1;
+    push_byte((return_addr >> 8) & 0xFF, cpu);
+    push_byte(return_addr & 0xFF, cpu);
+    cpu->PC = addr;
+    return 0;
+}
+
+/* RTS */
+CPU_INLINE Byte do_RTS(CPU *cpu, AddrModeId mode, Word addr) {
+    Byte lo = pop_byte(cpu);
+    Byte hi = pop_byte(cpu);
+    cpu->PC = ((hi << 8) | lo) + 1;
+    return 0;
+}
+
+/* RTI */
+CPU_INLINE Byte do_RTI(CPU *cpu, AddrModeId mode, Word addr) {
+    cpu->flags = (pop_byte(cpu) & 0xCF) | 0x20;
+    lazy_nz_load(cpu);
+    Byte lo    = pop_byte(cpu);
+    Byte hi    = pop_byte(cpu);
+    cpu->PC    = (hi << 8) | lo;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Interrupts and unknown opcodes                                     */
+/* ------------------------------------------------------------------ */
+
+static inline void cpu_unknown_opcode(CPU *cpu) {
+    Word bad_pc = (Word)(cpu->PC - 1);
+    if (bad_pc != 0xFFF0) {
+        fprintf(stderr, "CPU_UNKNOWN_OPCODE: PC=%04X opcode=%02X A=%02X X=%02X Y=%02X P=%02X SP=%02X\n",
+                bad_pc, cpu->opcode, cpu->regs.A, cpu->regs.X, cpu->regs.Y, lazy_nz_flags(cpu), cpu->SP);
+    }
+    cpu->cycles = 2; /* avoid zero-cycle stalls while diagnosing */
+}
+
+/* NMI check at end of each instruction (NMI has priority over IRQ) */
+static inline void cpu_service_interrupts(CPU *cpu) {
+    if (cpu->nmi_pending) {
+        cpu->nmi_pending = 0;
+        push_byte((cpu->PC >> 8) & 0xFF, cpu);
+        push_byte(cpu->PC & 0xFF, cpu);
+        Byte p = lazy_nz_flags(cpu);
+        p &= ~(1 << B);
+        p |=  (1 << U);
+        push_byte(p, cpu);
+        cpu_set_flag(I, 1, cpu);
+        cpu->PC = (Word)CPU_READ(cpu, 0xFFFA) | ((Word)CPU_READ(cpu, 0xFFFB) << 8);
+        cpu->cycles += 7;
+    } else if (cpu->irq_pending && !cpu_read_flag(I, cpu)) {
+        cpu->irq_pending = 0;
+        push_byte((cpu->PC >> 8) & 0xFF, cpu);
+        push_byte(cpu->PC & 0xFF, cpu);
+        Byte p = lazy_nz_flags(cpu);
+        p &= ~(1 << B);
+        p |=  (1 << U);
+        push_byte(p, cpu);
+        cpu_set_flag(I, 1, cpu);
+        cpu->PC = (Word)CPU_READ(cpu, 0xFFFE) | ((Word)CPU_READ(cpu, 0xFFFF) << 8);
+        cpu->cycles += 7;
+    }
+}
+
+#endif
@@ -1,15 +1,18 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <SDL2/SDL.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include "types.h"
-#include "cpu.h"
-#include "bus.h"
-#include "cartridge.h"
-#include "mapper.h"
-#include "ppu.h"
-#include "controller.h"
-#include "apu.h"
+#include "nes.h"
+#include "ntsc.h"
+#include "scale.h"
+#include "trace.h"
+#include "profiler.h"
+#ifdef NES_CPU_JIT
+#include "cpu_jit.h"
+#endif
 
 /* SDL audio callback */
 static void apu_sdl_callback(void *userdata, Uint8 *stream, int len) {
@@ -21,17 +24,245 @@ static void apu_sdl_callback(void *userdata, Uint8 *stream, int len) {
     }
 }
 
-int main(int argc, char **argv) {
-    CPU cpu;
-    Controller ctrl1;
-    controller_reset(&ctrl1);
+/* NES NTSC: 60.0988 Hz → ~16639 µs per frame */
+#define FRAME_TICKS_US 16639
+
+/* Finished frames go from the emulation thread to the presenter through
+   three buffers: the one being drawn, the newest finished one (middle)
+   and the one on screen. Publishing swaps the drawn buffer for the middle
+   one and taking swaps the shown one for it, so neither side ever waits
+   and the presenter always gets the newest frame. */
+#define FRAME_FRESH 4   /* in middle: it holds a frame not taken yet */
+
+typedef struct {
+    uint16_t   buffer[3][256 * 240];
+    int        phase[3];   /* NTSC subcarrier phase of each buffer's frame */
+    atomic_int middle;   /* buffer index | FRAME_FRESH */
+    int        back;     /* emulation thread's */
+    int        front;    /* presenter's */
+} FrameMailbox;
+
+static void frame_publish(FrameMailbox *m) {
+    m->back = atomic_exchange(&m->middle, m->back | FRAME_FRESH) & 3;
+}
+
+/* Returns 1 and moves front to the newest frame if there is one */
+static int frame_take(FrameMailbox *m) {
+    if (!(atomic_load(&m->middle) & FRAME_FRESH)) return 0;
+    m->front = atomic_exchange(&m->middle, m->front) & 3;
+    return 1;
+}
+
+/* Frames in a row the emulation thread may leave undrawn while it is
+   behind before it shows one anyway */
+#define MAX_FRAME_SKIP 4
+
+typedef struct {
+    NES         *nes;
+    FrameMailbox frames;
+    int          frame_skip;   /* skip drawing frames to keep up */
+    atomic_uint  buttons;   /* controller 1 (BTN_* bits), set by the presenter */
+    atomic_int   running;
+} Emulator;
+
+/* Post-processing (the NTSC filter or a scaler) works in row bands: the
+   presenter does the first band and a few worker threads the others */
+#define MAX_BAND_WORKERS 3
+
+typedef void (*BandJob)(void *ctx, int first, int count);
+
+typedef struct BandPool BandPool;
+
+typedef struct {
+    BandPool   *pool;
+    int         band;
+    SDL_Thread *thread;
+    SDL_sem    *start;
+} BandWorker;
+
+struct BandPool {
+    int        workers;
+    BandWorker worker[MAX_BAND_WORKERS];
+    SDL_sem   *done;
+    /* written by the presenter before it posts the workers' start */
+    BandJob    job;
+    void      *ctx;
+    int        quit;
+};
+
+static void band_run(BandPool *pool, int band) {
+    int bands = pool->workers + 1;
+    int first = 240 * band / bands;
+    pool->job(pool->ctx, first, 240 * (band + 1) / bands - first);
+}
+
+static int band_worker(void *arg) {
+    BandWorker *w = (BandWorker *)arg;
+    for (;;) {
+        SDL_SemWait(w->start);
+        if (w->pool->quit) return 0;
+        band_run(w->pool, w->band);
+        SDL_SemPost(w->pool->done);
+    }
+}
+
+/* Start up to `workers` threads; with none, the presenter does it all */
+static void band_pool_start(BandPool *pool, int workers) {
+    memset(pool, 0, sizeof(*pool));
+    if (workers > MAX_BAND_WORKERS) workers = MAX_BAND_WORKERS;
+    pool->done = workers > 0 ? SDL_CreateSemaphore(0) : NULL;
+    if (!pool->done) return;
+    for (int i = 0; i < workers; i++) {
+        BandWorker *w = &pool->worker[i];
+        w->pool  = pool;
+        w->band  = i + 1;
+        w->start = SDL_CreateSemaphore(0);
+        w->thread = w->start ? SDL_CreateThread(band_worker, "band", w) : NULL;
+        if (!w->thread) {
+            if (w->start) SDL_DestroySemaphore(w->start);
+            break;
+        }
+        pool->workers++;
+    }
+}
+
+static void band_pool_run(BandPool *pool, BandJob job, void *ctx) {
+    pool->job = job;
+    pool->ctx = ctx;
+    for (int i = 0; i < pool->workers; i++) SDL_SemPost(pool->worker[i].start);
+    band_run(pool, 0);
+    for (int i = 0; i < pool->workers; i++) SDL_SemWait(pool->done);
+}
+
+static void band_pool_stop(BandPool *pool) {
+    pool->quit = 1;
+    for (int i = 0; i < pool->workers; i++) {
+        SDL_SemPost(pool->worker[i].start);
+        SDL_WaitThread(pool->worker[i].thread, NULL);
+        SDL_DestroySemaphore(pool->worker[i].start);
+    }
+    if (pool->done) SDL_DestroySemaphore(pool->done);
+    pool->workers = 0;
+}
+
+/* One finished frame on its way into the texture */
+typedef struct {
+    const uint16_t   *frame;
+    int               phase;
+    const NtscFilter *ntsc;
+    const uint32_t   *argb;    /* frame through the palette, for scalers */
+    ScalerKind        scaler;
+    int               scale;
+    uint32_t         *dst;
+    int               pitch;   /* in pixels */
+} PresentJob;
 
+static void ntsc_band(void *ctx, int first, int count) {
+    PresentJob *job = (PresentJob *)ctx;
+    ntsc_filter_rows(job->ntsc, job->frame, job->phase, job->dst, job->pitch, first, count);
+}
+
+static void scale_band(void *ctx, int first, int count) {
+    PresentJob *job = (PresentJob *)ctx;
+    scale_rows(job->scaler, job->scale, job->argb, 256, 240, job->dst, job->pitch, first, count);
+}
+
+/* Runs the console at the NES frame rate, whatever the display does */
+static int emulation_thread(void *arg) {
+    Emulator *emu = (Emulator *)arg;
+    Uint64 perf_freq   = SDL_GetPerformanceFrequency();
+    Uint64 frame_ticks = perf_freq * FRAME_TICKS_US / 1000000;
+    Uint64 deadline    = SDL_GetPerformanceCounter();
+    int behind = 0, skipped = 0;
+
+    while (atomic_load(&emu->running)) {
+        /* Behind real time: work out only what the game can see (sprite-0
+           hit) and leave the frame unshown, up to MAX_FRAME_SKIP in a row */
+        int show = !behind || skipped >= MAX_FRAME_SKIP;
+        emu->nes->ppu.output = show ? PPU_OUTPUT_FULL : PPU_OUTPUT_COLLISION;
+
+        controller_set_state(&emu->nes->ctrl1, (uint8_t)atomic_load(&emu->buttons));
+        nes_run_frame(emu->nes);
+        if (show) {
+            memcpy(emu->frames.buffer[emu->frames.back], emu->nes->ppu.framebuffer,
+                   sizeof(emu->nes->ppu.framebuffer));
+            emu->frames.phase[emu->frames.back] = ntsc_frame_phase(emu->nes->ppu.frame);
+            frame_publish(&emu->frames);
+            skipped = 0;
+        } else {
+            skipped++;
+        }
+
+        /* Throttle against a running deadline, so sleeps rounded to a
+           millisecond do not add up; when late, skip frames to catch up,
+           but after a long stall start afresh rather than rush */
+        deadline += frame_ticks;
+        Uint64 now = SDL_GetPerformanceCounter();
+        behind = 0;
+        if (now < deadline) {
+            SDL_Delay((Uint32)((deadline - now) * 1000 / perf_freq));
+        } else if (now - deadline > frame_ticks * (MAX_FRAME_SKIP + 1)) {
+            deadline = now;
+        } else {
+            /* more than a late wake-up */
+            behind = emu->frame_skip && now - deadline > frame_ticks / 4;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
     int apu_enabled = 1;
+    int idle_skip = 1;
+    int line_renderer = 1;
+    int frame_skip = 1;
+    int ntsc_scale = 0;   /* 0: plain palette lookup */
+    int scaler = SCALER_NEAREST;
+    int scale = 1;        /* above 1, scaled on the CPU rather than by SDL */
     const char *rom_path = NULL;
+    const char *profile_prefix = NULL;
+    const char *palette_path = NULL;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--no-apu") == 0) {
             apu_enabled = 0;
             fprintf(stderr, "APU disabled\n");
+        } else if (strcmp(argv[i], "--no-idle-skip") == 0) {
+            idle_skip = 0;
+        } else if (strcmp(argv[i], "--no-frame-skip") == 0) {
+            frame_skip = 0;
+        } else if (strcmp(argv[i], "--dot-renderer") == 0) {
+            line_renderer = 0;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            if (trace_configure(argv[i] + 8) != 0) return 1;
+        } else if (strcmp(argv[i], "--ntsc") == 0) {
+            ntsc_scale = 2;
+        } else if (strncmp(argv[i], "--ntsc=", 7) == 0) {
+            ntsc_scale = strcmp(argv[i] + 7, "3") == 0 ? 3 : 2;
+        } else if (strncmp(argv[i], "--scaler=", 9) == 0) {
+            scaler = scaler_from_name(argv[i] + 9);
+            if (scaler < 0) {
+                fprintf(stderr, "Unknown scaler: %s (nearest, scalenx, xbr)\n", argv[i] + 9);
+                return 1;
+            }
+            if (scale == 1) scale = 2;
+        } else if (strncmp(argv[i], "--scale=", 8) == 0) {
+            scale = atoi(argv[i] + 8);
+            if (scale < 1 || scale > SCALE_MAX_FACTOR) {
+                fprintf(stderr, "Scale must be 1 to %d\n", SCALE_MAX_FACTOR);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--palette=", 10) == 0) {
+            palette_path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile_prefix = argv[i] + 10;
+        } else if (strncmp(argv[i], "--trace-watch=", 14) == 0) {
+            if (trace_set_watch(argv[i] + 14) != 0) return 1;
+#ifdef NES_CPU_JIT
+        } else if (strcmp(argv[i], "--jit-perf-map") == 0) {
+            if (cpu_jit_enable_perf_map() != 0) {
+                fprintf(stderr, "Cannot write perf map\n");
+            }
+#endif
         } else if (!rom_path) {
             rom_path = argv[i];
         }
@@ -43,33 +274,51 @@ int main(int argc, char **argv) {
             fprintf(stderr, "Failed to load ROM: %s\n", argv[1]);
             return 1;
         }
-        Mapper *m = mapper_create(cart);
-        if (!m) {
+        NES *nes = nes_create(cart);
+        if (!nes) {
             fprintf(stderr, "Unsupported mapper %d\n", cart->mapper_id);
             cartridge_free(cart);
             return 1;
         }
-        bus_set_mapper(m);
+        nes_set_apu_enabled(nes, apu_enabled);
+        cpu_set_idle_skip(&nes->cpu, idle_skip);
+        nes->ppu.line_renderer = (Byte)line_renderer;
+        TRACE_CONNECT_PPU(&nes->ppu);
+
+        if (profile_prefix && profiler_start(profile_prefix, cart->prg_size) != 0) {
+            nes_destroy(nes);
+            return 1;
+        }
+
+        static uint32_t colors[PPU_COLORS];
+        static uint32_t pixels[256 * 240];
+        static NtscFilter ntsc;
+        int width = 256 * scale, height = 240 * scale;
+        if (ntsc_scale) {
+            ntsc_init(&ntsc, ntsc_scale);
+            width  = 256 * ntsc.scale;
+            height = 240;
+        }
+        ppu_default_colors(colors);
+        if (palette_path && ppu_load_palette(colors, palette_path) != 0) {
+            fprintf(stderr, "Failed to load palette: %s\n", palette_path);
+            nes_destroy(nes);
+            return 1;
+        }
 
         /* SDL init */
         SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
         SDL_Window *window = SDL_CreateWindow("NES", SDL_WINDOWPOS_CENTERED,
-            SDL_WINDOWPOS_CENTERED, 512, 480, 0);
+            SDL_WINDOWPOS_CENTERED, 256 * (scale > 2 ? scale : 2), 240 * (scale > 2 ? scale : 2), 0);
         SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
-            SDL_RENDERER_ACCELERATED);
+            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
         SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-            SDL_TEXTUREACCESS_STREAMING, 256, 240);
-
-        PPU ppu;
-        ppu_init(&ppu, m);
-        bus_connect_ppu(&ppu);
-        bus_connect_controllers(&ctrl1, NULL); /* controller 2 not wired */
+            SDL_TEXTUREACCESS_STREAMING, width, height);
 
-        /* Initialize APU */
-        APU apu;
-        apu_init(&apu);
-        apu_reset(&apu);
-        if (apu_enabled) bus_connect_apu(&apu);
+        /* the presenter and the emulation thread keep two cores busy */
+        static BandPool bands;
+        int cpus = SDL_GetCPUCount();
+        band_pool_start(&bands, (ntsc_scale || scale > 1) && cpus > 2 ? cpus - 2 : 0);
 
         /* Setup SDL audio */
         SDL_AudioDeviceID audio_dev = 0;
@@ -80,7 +329,7 @@ int main(int argc, char **argv) {
             want.channels = 1;
             want.samples  = 512;
             want.callback = apu_sdl_callback;
-            want.userdata = &apu;
+            want.userdata = &nes->apu;
             SDL_AudioSpec got;
             audio_dev = SDL_OpenAudioDevice(
                 NULL, 0, &want, &got,
@@ -96,23 +345,26 @@ int main(int argc, char **argv) {
             }
         }
 
-        cpu_reset(&cpu);
+        /* The console runs on a thread of its own; this one only handles
+           events and puts the newest finished frame on screen */
+        static Emulator emu;
+        emu.nes          = nes;
+        emu.frame_skip   = frame_skip;
+        emu.frames.back  = 0;
+        emu.frames.front = 1;
+        atomic_init(&emu.frames.middle, 2);
+        atomic_init(&emu.buttons, 0);
+        atomic_init(&emu.running, 1);
+        SDL_Thread *emu_thread = SDL_CreateThread(emulation_thread, "emulation", &emu);
+        if (!emu_thread) {
+            fprintf(stderr, "Failed to start emulation thread: %s\n", SDL_GetError());
+            atomic_store(&emu.running, 0);
+        }
 
-        int running = 1;
+        int running = emu_thread != NULL;
         SDL_Event event;
 
-        /* NES NTSC: 60.0988 Hz → ~16639 µs per frame */
-        const Uint64 FRAME_TICKS_US = 16639;
-        Uint64 perf_freq = SDL_GetPerformanceFrequency();
-
-        /* New tick-loop architecture */
-        uint64_t system_clock = 0;
-        uint64_t last_frame_sig = 0;
-        int same_frame_sig_count = 0;
-        int frame_stall_logged = 0;
-
         while (running) {
-            Uint64 frame_start = SDL_GetPerformanceCounter();
             /* SDL event polling */
             while (SDL_PollEvent(&event)) {
                 if (event.type == SDL_QUIT) running = 0;
@@ -131,220 +383,54 @@ int main(int argc, char **argv) {
                 if (keys[SDL_SCANCODE_DOWN])  buttons |= BTN_DOWN;
                 if (keys[SDL_SCANCODE_LEFT])  buttons |= BTN_LEFT;
                 if (keys[SDL_SCANCODE_RIGHT]) buttons |= BTN_RIGHT;
-                controller_set_state(&ctrl1, buttons);
+                atomic_store(&emu.buttons, buttons);
             }
 
-            /* Run until one full frame is complete */
-            long cpu_steps_this_frame = 0;
-            int watchdog_fired = 0;
-            Word pc_ring[8] = {0};
-            int ring_idx = 0;
-            enum { INS_TRACE_RING = 32 };
-            Word ins_pc_ring[INS_TRACE_RING];
-            Byte ins_op_ring[INS_TRACE_RING];
-            Byte ins_b1_ring[INS_TRACE_RING];
-            Byte ins_b2_ring[INS_TRACE_RING];
-            Byte ins_a_ring[INS_TRACE_RING];
-            Byte ins_x_ring[INS_TRACE_RING];
-            Byte ins_y_ring[INS_TRACE_RING];
-            Byte ins_p_ring[INS_TRACE_RING];
-            Byte ins_sp_ring[INS_TRACE_RING];
-            Word ins_v_ring[INS_TRACE_RING];
-            Byte ins_status_ring[INS_TRACE_RING];
-            int ins_ring_idx = 0;
-            int loop80_count = 0;
-            long ppu_ticks_this_frame = 0;
-            int ppu_watchdog_fired = 0;
-            bus_reset_debug_stats();
-            while (!ppu_frame_complete(&ppu)) {
-                /* 1. Tick the PPU every system clock */
-                ppu_tick(&ppu);
-                ppu_ticks_this_frame++;
-                if (ppu_ticks_this_frame > 2000000 && !ppu_watchdog_fired) {
-                    fprintf(stderr,
-                            "PPU_WATCHDOG: frame exceeded 2M PPU ticks | sl=%d dot=%d frame=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X x=%d w=%d nmi=%d\n",
-                            ppu.scanline, ppu.dot, ppu.frame, ppu.status, ppu.ctrl, ppu.mask,
-                            ppu.v, ppu.t, ppu.x, ppu.w, ppu.nmi_output);
-                    ppu_watchdog_fired = 1;
-                }
-
-                /* 2. NMI propagation — check after every PPU dot */
-                if (ppu.nmi_output) {
-                    ppu.nmi_output  = 0;
-                    cpu.nmi_pending = 1;
-                }
-
-                /* 3. Mapper IRQ propagation — check after every PPU dot */
-                if (mapper_irq_pending(ppu.mapper)) {
-                    cpu.irq_pending = 1;
-                }
-
-                /* 4. CPU/DMA and APU run at 1/3 the rate */
-                if (system_clock % 3 == 0) {
-                    if (apu_enabled) apu_tick(&apu);  /* APU ticks at CPU rate */
-                    if (bus_dma_active()) {
-                        bus_dma_tick(system_clock);
-                    } else if (cpu.cycles_remaining > 0) {
-                        cpu.cycles_remaining--;
-                    } else {
-                        /* Frame watchdog: detect hang by counting CPU steps per frame */
-                        cpu_steps_this_frame++;
-                        
-                        pc_ring[ring_idx & 7] = cpu.PC;
-                        ring_idx++;
-
-                        {
-                            int wi = ins_ring_idx & (INS_TRACE_RING - 1);
-                            ins_pc_ring[wi] = cpu.PC;
-                            ins_op_ring[wi] = bus_read(cpu.PC);
-                            ins_b1_ring[wi] = bus_read(cpu.PC + 1);
-                            ins_b2_ring[wi] = bus_read(cpu.PC + 2);
-                            ins_a_ring[wi] = cpu.regs.A;
-                            ins_x_ring[wi] = cpu.regs.X;
-                            ins_y_ring[wi] = cpu.regs.Y;
-                            ins_p_ring[wi] = cpu.flags;
-                            ins_sp_ring[wi] = cpu.SP;
-                            ins_v_ring[wi] = ppu.v;
-                            ins_status_ring[wi] = ppu.status;
-                            ins_ring_idx++;
-                        }
-
-                        if (cpu.PC >= 0x80D9 && cpu.PC <= 0x80F5) {
-                            loop80_count++;
-                            if (loop80_count <= 64 ||
-                                loop80_count == 100 || loop80_count == 250 ||
-                                loop80_count == 500 || loop80_count == 1000 ||
-                                loop80_count == 5000) {
-                                BusDebugStats bus_stats;
-                                bus_get_debug_stats(&bus_stats);
-                                fprintf(stderr,
-                                        "LOOP80: pc=%04X count=%d op=%02X %02X %02X | A=%02X X=%02X Y=%02X P=%02X SP=%02X | ZP[00..07]=%02X %02X %02X %02X %02X %02X %02X %02X | PPU sl=%d dot=%d status=%02X v=%04X t=%04X | $2002 reads=%llu sp0=%llu oamdma=%llu page=%02X\n",
-                                        cpu.PC, loop80_count,
-                                        bus_read(cpu.PC), bus_read(cpu.PC + 1), bus_read(cpu.PC + 2),
-                                        cpu.regs.A, cpu.regs.X, cpu.regs.Y, cpu.flags, cpu.SP,
-                                        bus_read(0x0000), bus_read(0x0001), bus_read(0x0002), bus_read(0x0003),
-                                        bus_read(0x0004), bus_read(0x0005), bus_read(0x0006), bus_read(0x0007),
-                                        ppu.scanline, ppu.dot, ppu.status, ppu.v, ppu.t,
-                                        (unsigned long long)bus_stats.ppustatus_reads,
-                                        (unsigned long long)bus_stats.ppustatus_sprite0_set_reads,
-                                        (unsigned long long)bus_stats.oamdma_starts,
-                                        bus_stats.last_oamdma_page);
-                            }
-                        }
-
-                        if (cpu_steps_this_frame > 200000 && !watchdog_fired) {
-                            BusDebugStats bus_stats;
-                            bus_get_debug_stats(&bus_stats);
-                            fprintf(stderr, "WATCHDOG: frame exceeded 200k CPU steps! PC=0x%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X | PPU sl=%d dot=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X\n",
-                                    cpu.PC, cpu.regs.A, cpu.regs.X, cpu.regs.Y, cpu.flags, cpu.SP,
-                                    ppu.scanline, ppu.dot, ppu.status, ppu.ctrl, ppu.mask, ppu.v, ppu.t);
-                            fprintf(stderr, "  Recent PCs: ");
-                            for (int i = 0; i < 8; i++)
-                                fprintf(stderr, "%04X ", pc_ring[(ring_idx + i) & 7]);
-                            fprintf(stderr, "\n");
-                            /* Dump sprite 0 OAM entry */
-                            fprintf(stderr, "  OAM[0]: Y=%d tile=%02X attr=%02X X=%d | sprite_zero_on_line=%d sprite_count=%d\n",
-                                    ppu.oam[0], ppu.oam[1], ppu.oam[2], ppu.oam[3],
-                                    ppu.sprite_zero_on_line, ppu.sprite_count);
-                            /* Check what BG pixel is at sprite 0's X position on its expected scanline */
-                            fprintf(stderr, "  PPU fine_x=%d bg_shift_lo=%04X bg_shift_hi=%04X\n",
-                                    ppu.x, ppu.bg_shift_lo, ppu.bg_shift_hi);
-                            fprintf(stderr, "  Sprite0 debug: eval_count=%d hit_count=%d\n",
-                                    ppu.dbg_sp0_eval_count, ppu.dbg_sp0_hit_count);
-                            fprintf(stderr, "  Bus debug: $2002 reads=%llu (vblank=%llu, sp0=%llu, last=%02X) | $4014 starts=%llu last_page=%02X | $2003 writes=%llu last=%02X | $2004=%llu $2005=%llu $2006=%llu $2007=%llu\n",
-                                    (unsigned long long)bus_stats.ppustatus_reads,
-                                    (unsigned long long)bus_stats.ppustatus_vblank_set_reads,
-                                    (unsigned long long)bus_stats.ppustatus_sprite0_set_reads,
-                                    bus_stats.last_ppustatus_value,
-                                    (unsigned long long)bus_stats.oamdma_starts,
-                                    bus_stats.last_oamdma_page,
-                                    (unsigned long long)bus_stats.oamaddr_writes,
-                                    bus_stats.last_oamaddr_value,
-                                    (unsigned long long)bus_stats.oamdata_writes,
-                                    (unsigned long long)bus_stats.ppuscroll_writes,
-                                    (unsigned long long)bus_stats.ppuaddr_writes,
-                                    (unsigned long long)bus_stats.ppudata_writes);
-                            fprintf(stderr, "  Recent instructions:\n");
-                            for (int i = 0; i < INS_TRACE_RING; i++) {
-                                int ri = (ins_ring_idx + i) & (INS_TRACE_RING - 1);
-                                fprintf(stderr, "    PC=%04X OP=%02X %02X %02X | A=%02X X=%02X Y=%02X P=%02X SP=%02X | PPU status=%02X v=%04X\n",
-                                        ins_pc_ring[ri], ins_op_ring[ri], ins_b1_ring[ri], ins_b2_ring[ri],
-                                        ins_a_ring[ri], ins_x_ring[ri], ins_y_ring[ri], ins_p_ring[ri], ins_sp_ring[ri],
-                                        ins_status_ring[ri], ins_v_ring[ri]);
-                            }
-                            fprintf(stderr, "  Loop bytes @80D9: ");
-                            for (Word a = 0x80D9; a <= 0x80E6; a++) {
-                                fprintf(stderr, "%02X ", bus_read(a));
-                            }
-                            fprintf(stderr, "\n");
-                            watchdog_fired = 1;
-                        }
-                        cpu_step(&cpu);
-                        cpu.cycles_remaining = cpu.cycles - 1;
-                    }
-                }
-
-                system_clock++;
+            if (!frame_take(&emu.frames)) {
+                SDL_Delay(1);
+                continue;
             }
 
-            {
-                uint64_t sig = 1469598103934665603ULL;
-                for (int i = 0; i < 64; i++) {
-                    int x = (i * 37) & 255;
-                    int y = (i * 53) % 240;
-                    uint32_t px = ppu.framebuffer[y * 256 + x];
-                    sig ^= (uint64_t)px + ((uint64_t)x << 8) + ((uint64_t)y << 16);
-                    sig *= 1099511628211ULL;
-                }
-                if (sig == last_frame_sig) {
-                    same_frame_sig_count++;
-                    if (!frame_stall_logged &&
-                        same_frame_sig_count >= 120) {
-                        BusDebugStats bus_stats;
-                        bus_get_debug_stats(&bus_stats);
-                        fprintf(stderr,
-                                "FRAME_STALL: same_sig_frames=%d sig=%016llX | CPU PC=%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X | PPU sl=%d dot=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X x=%d w=%d frame=%d | $2002 reads=%llu sp0=%llu oamdma=%llu\n",
-                                same_frame_sig_count, (unsigned long long)sig,
-                                cpu.PC, cpu.regs.A, cpu.regs.X, cpu.regs.Y, cpu.flags, cpu.SP,
-                                ppu.scanline, ppu.dot, ppu.status, ppu.ctrl, ppu.mask, ppu.v, ppu.t, ppu.x, ppu.w, ppu.frame,
-                                (unsigned long long)bus_stats.ppustatus_reads,
-                                (unsigned long long)bus_stats.ppustatus_sprite0_set_reads,
-                                (unsigned long long)bus_stats.oamdma_starts);
-                        frame_stall_logged = 1;
-                    }
+            /* Filter or scale the frame straight into the texture */
+            void *tex_pixels;
+            int tex_pitch;
+            if (SDL_LockTexture(texture, NULL, &tex_pixels, &tex_pitch) == 0) {
+                PresentJob job = {0};
+                job.frame  = emu.frames.buffer[emu.frames.front];
+                job.phase  = emu.frames.phase[emu.frames.front];
+                job.ntsc   = &ntsc;
+                job.argb   = pixels;
+                job.scaler = (ScalerKind)scaler;
+                job.scale  = scale;
+                job.dst    = (uint32_t *)tex_pixels;
+                job.pitch  = tex_pitch / (int)sizeof(uint32_t);
+                if (ntsc_scale) {
+                    band_pool_run(&bands, ntsc_band, &job);
                 } else {
-                    last_frame_sig = sig;
-                    same_frame_sig_count = 0;
-                    frame_stall_logged = 0;
+                    ppu_convert_frame(job.frame, pixels, colors);
+                    band_pool_run(&bands, scale_band, &job);
                 }
+                SDL_UnlockTexture(texture);
             }
-
-            /* Blit framebuffer */
-            SDL_UpdateTexture(texture, NULL, ppu.framebuffer, 256 * sizeof(uint32_t));
             SDL_RenderClear(renderer);
             SDL_RenderCopy(renderer, texture, NULL, NULL);
             SDL_RenderPresent(renderer);
-
-            /* Throttle to NES frame rate */
-            Uint64 frame_end = SDL_GetPerformanceCounter();
-            Uint64 elapsed_us = (frame_end - frame_start) * 1000000 / perf_freq;
-            if (elapsed_us < FRAME_TICKS_US) {
-                SDL_Delay((Uint32)((FRAME_TICKS_US - elapsed_us) / 1000));
-            }
         }
 
+        atomic_store(&emu.running, 0);
+        if (emu_thread) SDL_WaitThread(emu_thread, NULL);
+        band_pool_stop(&bands);
+
         SDL_DestroyTexture(texture);
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         SDL_CloseAudioDevice(audio_dev);
         SDL_Quit();
 
-        bus_set_mapper(NULL);
-        bus_connect_ppu(NULL);
-        mapper_destroy(m);
-        cartridge_free(cart);
+        profiler_finish();
+        nes_destroy(nes);
     } else {
-        cpu_reset(&cpu);
+        fprintf(stderr, "Usage: %s [options] <rom.nes>\n", argv[0]);
     }
 
     return 0;
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "mapper.h"
 #include "mapper0.h"
 #include "mapper1.h"
@@ -17,5 +18,78 @@ Mapper *mapper_create(Cartridge *cart) {
 
 void mapper_destroy(Mapper *m) {
     if (!m) return;
+    free(m->chr_decoded);
     m->ops->destroy(m);
-}
\ No newline at end of file
+}
+
+void mapper_init_base(Mapper *m, const MapperOps *ops, Cartridge *cart) {
+    memset(m, 0, sizeof(*m));
+    m->ops  = ops;
+    m->cart = cart;
+}
+
+void mapper_map_prg_rom(Mapper *m, int window, size_t offset) {
+    Cartridge *cart = m->cart;
+    m->prg_write_map[window] = NULL;
+    if (!cart || !cart->prg_rom || cart->prg_size == 0 ||
+        cart->prg_size % MAPPER_PRG_WINDOW_SIZE != 0) {
+        m->prg_read_map[window] = NULL;
+        return;
+    }
+    /* offset is 8KB aligned and prg_size a multiple of 8KB, so the whole
+       window wraps as one block — same bytes as offset % prg_size per access */
+    m->prg_read_map[window] = cart->prg_rom + (offset % cart->prg_size);
+}
+
+void mapper_map_prg_ram(Mapper *m, int window, Byte *ram, int writable) {
+    m->prg_read_map[window]  = ram;
+    m->prg_write_map[window] = writable ? ram : NULL;
+}
+
+void mapper_prg_map_changed(Mapper *m) {
+    if (m->prg_map_listener) {
+        m->prg_map_listener(m, m->prg_map_ctx);
+    }
+}
+
+int mapper_set_chr_memory(Mapper *m, Byte *mem, size_t size) {
+    size_t rows = size / 16 * 8;
+    ChrRow *decoded = rows ? malloc(rows * sizeof(ChrRow)) : NULL;
+    if (rows && !decoded) return -1;
+    free(m->chr_decoded);
+    m->chr_mem      = mem;
+    m->chr_mem_size = size;
+    m->chr_decoded  = decoded;
+    for (size_t n = 0; n < rows; n++) {
+        const Byte *p = mem + n / 8 * 16 + n % 8;
+        chr_decode_row(&decoded[n], p[0], p[8]);
+    }
+    return 0;
+}
+
+void mapper_map_chr(Mapper *m, int window, size_t offset) {
+    if (!m->chr_mem || m->chr_mem_size == 0 ||
+        m->chr_mem_size % MAPPER_CHR_WINDOW_SIZE != 0) {
+        m->chr_map[window]  = NULL;
+        m->chr_rows[window] = NULL;
+        return;
+    }
+    offset %= m->chr_mem_size;
+    m->chr_map[window]  = m->chr_mem + offset;
+    m->chr_rows[window] = m->chr_decoded + offset / 16 * 8;
+}
+
+void mapper_chr_written(Mapper *m, Word addr) {
+    int window = (addr >> 10) & (MAPPER_CHR_WINDOWS - 1);
+    const Byte *bank = m->chr_map[window];
+    if (!bank) return;
+    Word row = addr & 0x03F7;   /* low plane byte of the row */
+    size_t n = (size_t)(bank - m->chr_mem + row) / 16 * 8 + (row & 7);
+    chr_decode_row(&m->chr_decoded[n], bank[row], bank[row + 8]);
+}
+
+void mapper_mirroring_changed(Mapper *m) {
+    if (m->mirroring_listener) {
+        m->mirroring_listener(m, m->mirroring_ctx);
+    }
+}
@@ -19,9 +19,56 @@ typedef struct {
     void (*irq_ack)(Mapper *m);
 } MapperOps;
 
+/* CPU address space in 8KB windows, indexed by addr >> 13.
+   Only windows 3..7 ($6000-$FFFF) are ever mapped. */
+#define MAPPER_PRG_WINDOWS 8
+#define MAPPER_PRG_WINDOW_SIZE 0x2000
+
+/* PPU pattern space in 1KB windows, indexed by addr >> 10 */
+#define MAPPER_CHR_WINDOWS 8
+#define MAPPER_CHR_WINDOW_SIZE 0x400
+
+/* One pattern row decoded to a pixel value (0-3) per byte, left to right */
+typedef struct {
+    Byte pixel[8];
+} ChrRow;
+
+typedef void (*MapperPrgMapListener)(Mapper *m, void *ctx);
+typedef void (*MapperMirroringListener)(Mapper *m, void *ctx);
+
 struct Mapper {
     const MapperOps *ops;
     Cartridge *cart;
+
+    /* Direct pointers to the memory behind each 8KB CPU window, NULL where
+       accesses must go through prg_read/prg_write (registers, open bus,
+       write-protected RAM). Kept current by the mapper on every bank switch. */
+    Byte *prg_read_map[MAPPER_PRG_WINDOWS];
+    Byte *prg_write_map[MAPPER_PRG_WINDOWS];
+
+    /* Notified after the PRG maps change (the bus rebuilds its page table) */
+    MapperPrgMapListener prg_map_listener;
+    void *prg_map_ctx;
+
+    /* Notified after get_mirroring's answer changes (the PPU rebuilds its
+       nametable pages). Mappers with fixed mirroring never call it. */
+    MapperMirroringListener mirroring_listener;
+    void *mirroring_ctx;
+
+    /* CHR memory (CHR-ROM, or the mapper's CHR-RAM) and all its pattern
+       rows decoded up front: chr_decoded[n] is the row in bytes
+       16 * (n / 8) + n % 8 and 8 on. Decoding goes by bytes rather than
+       banks, so bank switches cost nothing and a CHR-RAM write redoes
+       one row. */
+    Byte   *chr_mem;
+    size_t  chr_mem_size;
+    ChrRow *chr_decoded;
+
+    /* Direct pointers to the CHR memory behind each 1KB PPU window and to
+       its decoded rows, NULL where reads must go through chr_read. Kept
+       current by the mapper on every bank switch. */
+    const Byte   *chr_map[MAPPER_CHR_WINDOWS];
+    const ChrRow *chr_rows[MAPPER_CHR_WINDOWS];
     /* mapper-specific state follows in subtype structs */
 };
 
@@ -31,6 +78,38 @@ Mapper *mapper_create(Cartridge *cart);
 
 void mapper_destroy(Mapper *m);
 
+/* Common base setup for subtype constructors: ops, cart, empty PRG maps. */
+void mapper_init_base(Mapper *m, const MapperOps *ops, Cartridge *cart);
+
+/* Map an 8KB CPU window onto PRG-ROM at offset (wrapped to prg_size) for
+   reads; writes keep going through prg_write. Leaves the window unmapped
+   if the ROM size is not a multiple of 8KB. */
+void mapper_map_prg_rom(Mapper *m, int window, size_t offset);
+
+/* Map an 8KB CPU window onto RAM; writable selects the write map too. */
+void mapper_map_prg_ram(Mapper *m, int window, Byte *ram, int writable);
+
+void mapper_prg_map_changed(Mapper *m);
+
+void mapper_mirroring_changed(Mapper *m);
+
+/* Make size bytes at mem the CHR memory that mapper_map_chr maps, and
+   decode it. Returns -1 if out of memory. */
+int mapper_set_chr_memory(Mapper *m, Byte *mem, size_t size);
+
+/* Map a 1KB PPU window onto CHR memory at offset (wrapped to its size).
+   Leaves the window unmapped if there is no CHR memory or its size is
+   not a multiple of 1KB. */
+void mapper_map_chr(Mapper *m, int window, size_t offset);
+
+/* Decode the pattern row holding PPU address addr again, after a write */
+void mapper_chr_written(Mapper *m, Word addr);
+
+static inline void chr_decode_row(ChrRow *row, Byte lo, Byte hi) {
+    for (int i = 0; i < 8; i++)
+        row->pixel[i] = ((lo >> (7 - i)) & 1) | (((hi >> (7 - i)) & 1) << 1);
+}
+
 /* Inline wrappers — call these everywhere instead of ops directly */
 static inline Byte mapper_prg_read(Mapper *m, Word addr) {
     return m->ops->prg_read(m, addr);
@@ -43,6 +122,7 @@ static inline Byte mapper_chr_read(Mapper *m, Word addr) {
 }
 static inline void mapper_chr_write(Mapper *m, Word addr, Byte data) {
     m->ops->chr_write(m, addr, data);
+    mapper_chr_written(m, addr);
 }
 static inline Byte mapper_get_mirroring(Mapper *m) {
     if (m->ops->get_mirroring) {
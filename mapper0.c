@@ -47,7 +47,22 @@ static const MapperOps MAPPER0_OPS = {
 Mapper *mapper0_create(Cartridge *cart) {
     Mapper0 *m = malloc(sizeof(Mapper0));
     if (!m) return NULL;
-    m->base.ops  = &MAPPER0_OPS;
-    m->base.cart = cart;
+    mapper_init_base(&m->base, &MAPPER0_OPS, cart);
+
+    /* Fixed PRG: $8000-$FFFF, 16KB images mirror into the upper half */
+    for (int w = 4; w < 8; w++) {
+        mapper_map_prg_rom(&m->base, w, (size_t)(w - 4) * MAPPER_PRG_WINDOW_SIZE);
+    }
+
+    /* Fixed CHR-ROM; without it pattern reads stay 0 through m0_chr_read */
+    if (cart->chr_rom && cart->chr_size) {
+        if (mapper_set_chr_memory(&m->base, cart->chr_rom, cart->chr_size) != 0) {
+            free(m);
+            return NULL;
+        }
+        for (int w = 0; w < MAPPER_CHR_WINDOWS; w++) {
+            mapper_map_chr(&m->base, w, (size_t)w * MAPPER_CHR_WINDOW_SIZE);
+        }
+    }
     return (Mapper *)m;
 }
\ No newline at end of file
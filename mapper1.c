@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "mapper1.h"
+#include "trace.h"
 
 // The Mapper1 state struct that will be allocated as part of a larger structure
 typedef struct {
@@ -37,11 +38,11 @@ typedef struct {
 static void m1_write_register(Mapper1 *m, Word addr, Byte data);
 static void m1_update_banks(Mapper1 *m);
 static void m1_set_control(Mapper1 *m, Byte value);
-static int m1_trace_enabled = 0;
 
+#ifdef NES_TRACE
 static int m1_trace_count = 0;
 static void m1_trace_state(Mapper1 *m, const char *event, Word addr, Byte data, Byte target) {
-    if (!m1_trace_enabled) return;
+    if (!TRACE_ENABLED(TRACE_MMC1)) return;
     if (m1_trace_count >= 1024) return;
     /* PRG-bank commits are extremely frequent in LoZ; sample them sparsely. */
     if (target == 3 && (m1_trace_count % 64) != 0) {
@@ -56,6 +57,10 @@ static void m1_trace_state(Mapper1 *m, const char *event, Word addr, Byte data,
             (unsigned)m->chr_bank_0_offset, (unsigned)m->chr_bank_1_offset);
     m1_trace_count++;
 }
+#define M1_TRACE(m, event, addr, data, target) m1_trace_state(m, event, addr, data, target)
+#else
+#define M1_TRACE(m, event, addr, data, target) ((void)0)
+#endif
 
 // PRG read: 16KB/32KB banking + PRG RAM
 static Byte m1_prg_read(Mapper *m, Word addr) {
@@ -143,7 +148,7 @@ static void m1_write_register(Mapper1 *m, Word addr, Byte data) {
         // Reset forces PRG mode to 3 (fix last bank at $C000).
         m->control |= 0x0C;
         m1_update_banks(m);
-        m1_trace_state(m, "reset", addr, data, 0xFF);
+        M1_TRACE(m, "reset", addr, data, 0xFF);
         return;
     }
 
@@ -176,7 +181,7 @@ static void m1_write_register(Mapper1 *m, Word addr, Byte data) {
         m->shift_register = 0;
         m->shift_count = 0;
         m1_update_banks(m);
-        m1_trace_state(m, "commit", addr, reg_value, target);
+        M1_TRACE(m, "commit", addr, reg_value, target);
     }
 }
 
@@ -185,7 +190,10 @@ static void m1_set_control(Mapper1 *m, Byte value) {
     m->control = value & 0x1F;
 
     // Update mirroring
-    m->mirroring = value & 0x03;
+    if (m->mirroring != (value & 0x03)) {
+        m->mirroring = value & 0x03;
+        mapper_mirroring_changed(&m->base);
+    }
 }
 
 // Recalculate all bank offsets based on current register values
@@ -229,6 +237,34 @@ static void m1_update_banks(Mapper1 *m) {
         m->chr_bank_0_offset = (DWord)m->chr_bank_0 * 0x1000;
         m->chr_bank_1_offset = m->chr_bank_0_offset + 0x1000;
     }
+
+    // PPU pattern windows: RAM is not banked, ROM in two 4KB halves
+    for (int w = 0; w < MAPPER_CHR_WINDOWS; w++) {
+        DWord offset;
+        if (cart->chr_size == 0) {
+            offset = w * MAPPER_CHR_WINDOW_SIZE;
+        } else if (w < 4) {
+            offset = m->chr_bank_0_offset + w * MAPPER_CHR_WINDOW_SIZE;
+        } else {
+            offset = m->chr_bank_1_offset + (w - 4) * MAPPER_CHR_WINDOW_SIZE;
+        }
+        mapper_map_chr(&m->base, w, offset);
+    }
+
+    // CPU page maps: PRG RAM at $6000, two 16KB halves at $8000/$C000.
+    // ROM writes stay unmapped so they reach the shift register.
+    mapper_map_prg_ram(&m->base, 3, m->prg_ram, 1);
+    for (int w = 0; w < 4; w++) {
+        DWord offset;
+        if (m->control & 0x08) {
+            offset = ((w < 2) ? m->prg_bank_0_offset : m->prg_bank_1_offset)
+                   + (w & 1) * MAPPER_PRG_WINDOW_SIZE;
+        } else {
+            offset = m->prg_bank_0_offset + w * MAPPER_PRG_WINDOW_SIZE;
+        }
+        mapper_map_prg_rom(&m->base, 4 + w, offset);
+    }
+    mapper_prg_map_changed(&m->base);
 }
 
 // Translate MMC1 control bits 1:0 to PPU MirrorMode constants
@@ -262,8 +298,14 @@ Mapper *mapper1_create(Cartridge *cart) {
     memset(m1, 0, sizeof(Mapper1));  // Zero all including CHR RAM
 
     // Set up base mapper
-    m1->base.ops = &MAPPER1_OPS;
-    m1->base.cart = cart;
+    mapper_init_base(&m1->base, &MAPPER1_OPS, cart);
+    int chr_ok = cart->chr_size
+        ? mapper_set_chr_memory(&m1->base, cart->chr_rom, cart->chr_size)
+        : mapper_set_chr_memory(&m1->base, m1->chr_ram, sizeof(m1->chr_ram));
+    if (chr_ok != 0) {
+        free(m1);
+        return NULL;
+    }
 
     // Initial state: control = 0x1C (PRG mode 3, CHR 4KB, one-screen-low)
     m1->control = 0x1C;  // Reference uses 0x1C on reset
@@ -277,8 +319,9 @@ Mapper *mapper1_create(Cartridge *cart) {
 
     // Calculate initial banks
     m1_update_banks(m1);
+#ifdef NES_TRACE
     m1_trace_count = 0;
-    m1_trace_enabled = 0;
+#endif
 
     return (Mapper*)m1;
 }
\ No newline at end of file
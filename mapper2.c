@@ -10,6 +10,17 @@ typedef struct {
     Byte   chr_ram[8192];       /* used when cart->chr_size == 0 */
 } Mapper2;
 
+/* CPU page maps: switchable bank at $8000-$BFFF, fixed bank at $C000-$FFFF.
+   $6000-$7FFF stays unmapped (reads as 0 through m2_prg_read). */
+static void m2_update_prg_map(Mapper2 *m2) {
+    size_t switchable = (size_t)m2->bank_select * 0x4000;
+    mapper_map_prg_rom(&m2->base, 4, switchable);
+    mapper_map_prg_rom(&m2->base, 5, switchable + MAPPER_PRG_WINDOW_SIZE);
+    mapper_map_prg_rom(&m2->base, 6, m2->fixed_bank_offset);
+    mapper_map_prg_rom(&m2->base, 7, m2->fixed_bank_offset + MAPPER_PRG_WINDOW_SIZE);
+    mapper_prg_map_changed(&m2->base);
+}
+
 /* PRG read: 16KB switchable bank at $8000-$BFFF, fixed last bank at $C000-$FFFF */
 static Byte m2_prg_read(Mapper *m, Word addr) {
     Mapper2 *m2 = (Mapper2*)m;
@@ -38,6 +49,7 @@ static void m2_prg_write(Mapper *m, Word addr, Byte data) {
     if (addr >= 0x8000 && addr <= 0xFFFF) {
         /* Update bank select (only low bits) */
         m2->bank_select = data % m2->prg_bank_count_16k;
+        m2_update_prg_map(m2);
     }
 }
 
@@ -92,8 +104,7 @@ Mapper *mapper2_create(Cartridge *cart) {
     if (!m2) return NULL;
     memset(m2, 0, sizeof(*m2));
 
-    m2->base.ops = &MAPPER2_OPS;
-    m2->base.cart = cart;
+    mapper_init_base(&m2->base, &MAPPER2_OPS, cart);
 
     m2->prg_bank_count_16k = cart->prg_size / 0x4000;
     if (m2->prg_bank_count_16k == 0) {
@@ -103,6 +114,19 @@ Mapper *mapper2_create(Cartridge *cart) {
 
     m2->fixed_bank_offset = (m2->prg_bank_count_16k - 1) * 0x4000;
     m2->bank_select = 0;
+    m2_update_prg_map(m2);
+
+    /* Fixed 8KB of CHR, ROM or RAM */
+    int chr_ok = cart->chr_size
+        ? mapper_set_chr_memory(&m2->base, cart->chr_rom, cart->chr_size)
+        : mapper_set_chr_memory(&m2->base, m2->chr_ram, sizeof(m2->chr_ram));
+    if (chr_ok != 0) {
+        free(m2);
+        return NULL;
+    }
+    for (int w = 0; w < MAPPER_CHR_WINDOWS; w++) {
+        mapper_map_chr(&m2->base, w, (size_t)w * MAPPER_CHR_WINDOW_SIZE);
+    }
 
     return (Mapper *)m2;
 }
\ No newline at end of file
@@ -7,8 +7,9 @@
 #define MMC3_CHR_RAM_SIZE 0x2000
 
 /* PPU mirror mode values used by ppu.c */
-#define MIRROR_HORIZONTAL 0
-#define MIRROR_VERTICAL   1
+#define MIRROR_HORIZONTAL  0
+#define MIRROR_VERTICAL    1
+#define MIRROR_FOUR_SCREEN 4
 
 typedef struct {
     Mapper base;
@@ -50,6 +51,7 @@ typedef struct {
 
 static void m4_update_prg_banks(Mapper4 *m);
 static void m4_update_chr_banks(Mapper4 *m);
+static void m4_update_prg_ram_map(Mapper4 *m);
 
 static size_t m4_prg_bank_index(Mapper4 *m, size_t raw_bank) {
     return raw_bank % m->prg_bank_count_8k;
@@ -66,6 +68,7 @@ static size_t m4_chr_offset_for_bank(Mapper4 *m, size_t raw_bank) {
 
 static void m4_set_chr_slot(Mapper4 *m, int slot, size_t raw_bank) {
     m->chr_offsets[slot] = m4_chr_offset_for_bank(m, raw_bank);
+    mapper_map_chr(&m->base, slot, m->chr_offsets[slot]);
 }
 
 static Byte m4_prg_read(Mapper *base, Word addr) {
@@ -116,14 +119,19 @@ static void m4_prg_write(Mapper *base, Word addr, Byte data) {
         }
 
         case 0xA000:
-            /* MMC3: 0 = vertical, 1 = horizontal */
-            m->mirror_mode = (data & 0x01) ? MIRROR_HORIZONTAL : MIRROR_VERTICAL;
+            /* MMC3: 0 = vertical, 1 = horizontal; four-screen boards ignore it */
+            if (m->mirror_mode != MIRROR_FOUR_SCREEN) {
+                m->mirror_mode = (data & 0x01) ? MIRROR_HORIZONTAL : MIRROR_VERTICAL;
+                mapper_mirroring_changed(&m->base);
+            }
             break;
 
         case 0xA001:
             /* MMC3 PRG RAM protect register: bit7 enable, bit6 write-protect */
             m->prg_ram_enable = (data >> 7) & 0x01;
             m->prg_ram_write_protect = (data >> 6) & 0x01;
+            m4_update_prg_ram_map(m);
+            mapper_prg_map_changed(&m->base);
             break;
 
         case 0xC000:
@@ -240,6 +248,18 @@ static void m4_update_prg_banks(Mapper4 *m) {
         m->prg_offsets[2] = b6 * 0x2000;
     }
     m->prg_offsets[3] = last * 0x2000;
+
+    for (int slot = 0; slot < 4; slot++) {
+        mapper_map_prg_rom(&m->base, 4 + slot, m->prg_offsets[slot]);
+    }
+    mapper_prg_map_changed(&m->base);
+}
+
+/* PRG RAM always reads back; writes are direct only while enabled and
+   not write-protected, otherwise m4_prg_write drops them. */
+static void m4_update_prg_ram_map(Mapper4 *m) {
+    mapper_map_prg_ram(&m->base, 3, m->prg_ram,
+                       m->prg_ram_enable && !m->prg_ram_write_protect);
 }
 
 static void m4_update_chr_banks(Mapper4 *m) {
@@ -286,13 +306,20 @@ Mapper *mapper4_create(Cartridge *cart) {
     }
 
     m->chr_bank_count_1k = cart->chr_size / 0x400;
-    m->base.ops = &MAPPER4_OPS;
-    m->base.cart = cart;
+    mapper_init_base(&m->base, &MAPPER4_OPS, cart);
+    int chr_ok = m->chr_bank_count_1k
+        ? mapper_set_chr_memory(&m->base, cart->chr_rom, cart->chr_size)
+        : mapper_set_chr_memory(&m->base, m->chr_ram, sizeof(m->chr_ram));
+    if (chr_ok != 0) {
+        free(m);
+        return NULL;
+    }
 
-    m->mirror_mode = cart->mirroring ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
+    m->mirror_mode = cart->mirroring;
     m->prg_ram_enable = 1;
     m->prg_ram_write_protect = 0;
 
+    m4_update_prg_ram_map(m);
     m4_update_prg_banks(m);
     m4_update_chr_banks(m);
 
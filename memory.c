@@ -2,16 +2,14 @@
 
 #include "memory.h"
 
-static Byte mem[MEM_SIZE];
-
-void mem_reset() {
-    memset(mem, 0, sizeof(mem));
+void mem_reset(Memory *mem) {
+    memset(mem->data, 0, sizeof(mem->data));
 }
 
-Byte mem_read(Word addr) {
-    return mem[addr];
+Byte mem_read(const Memory *mem, Word addr) {
+    return mem->data[addr];
 }
 
-void mem_write(Word addr, Byte data) {
-    mem[addr] = data;
+void mem_write(Memory *mem, Word addr, Byte data) {
+    mem->data[addr] = data;
 }
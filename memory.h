@@ -5,9 +5,13 @@
 
 #define MEM_SIZE (2 * 1024)   /* 0x0800 — NES internal RAM */
 
-void mem_reset();
+typedef struct {
+    Byte data[MEM_SIZE];   /* also the backing store for the bus page tables */
+} Memory;
 
-Byte mem_read(Word addr);
-void mem_write(Word addr, Byte data);
+void mem_reset(Memory *mem);
+
+Byte mem_read(const Memory *mem, Word addr);
+void mem_write(Memory *mem, Word addr, Byte data);
 
 #endif
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include "nes.h"
+#include "trace.h"
+
+NES *nes_create(Cartridge *cart) {
+    NES *nes = calloc(1, sizeof(*nes));
+    if (!nes) return NULL;
+
+    bus_init(&nes->bus);
+    if (cpu_init(&nes->cpu, &nes->bus) != 0) {
+        free(nes);
+        return NULL;
+    }
+    nes->apu_enabled = 1;
+    if (nes_load_cartridge(nes, cart) != 0) {
+        cpu_free(&nes->cpu);
+        free(nes);
+        return NULL;
+    }
+    return nes;
+}
+
+int nes_load_cartridge(NES *nes, Cartridge *cart) {
+    Mapper *m = mapper_create(cart);
+    if (!m) return -1;
+
+    bus_set_mapper(&nes->bus, m);
+    if (nes->mapper) mapper_destroy(nes->mapper);
+    if (nes->cart) cartridge_free(nes->cart);
+    nes->mapper = m;
+    nes->cart   = cart;
+
+    ppu_init(&nes->ppu, m);
+    bus_connect_ppu(&nes->bus, &nes->ppu);
+
+    controller_reset(&nes->ctrl1);
+    controller_reset(&nes->ctrl2);
+    bus_connect_controllers(&nes->bus, &nes->ctrl1, NULL); /* controller 2 not wired */
+
+    apu_init(&nes->apu);
+    apu_reset(&nes->apu);
+    nes_set_apu_enabled(nes, nes->apu_enabled);
+
+    nes->system_clock = 0;
+    cpu_reset(&nes->cpu);
+    return 0;
+}
+
+void nes_destroy(NES *nes) {
+    if (!nes) return;
+    bus_set_mapper(&nes->bus, NULL);
+    cpu_free(&nes->cpu);
+    mapper_destroy(nes->mapper);
+    cartridge_free(nes->cart);
+    free(nes);
+}
+
+void nes_reset(NES *nes) {
+    cpu_reset(&nes->cpu);
+}
+
+void nes_set_apu_enabled(NES *nes, int enabled) {
+    nes->apu_enabled = enabled;
+    bus_connect_apu(&nes->bus, enabled ? &nes->apu : NULL);
+}
+
+/* Tick the PPU through clock, or until it completes the frame */
+static void ppu_catch_up(NES *nes, uint64_t clock) {
+    PPU *ppu = &nes->ppu;
+    CPU *cpu = &nes->cpu;
+
+    while (nes->ppu_clock <= clock && !ppu->frame_done) {
+        /* stretches with nothing to do (VBlank, forced blank, the rest of
+           a line drawn ahead) go by at once unless tracing wants every dot */
+        int idle = 0;
+        if (!TRACE_ENABLED(TRACE_ALL)) {
+            int max = (int)(clock - nes->ppu_clock) + 1;
+            idle = ppu_skip_blank_lines(ppu, max);
+            if (!idle) idle = ppu_skip_idle_dots(ppu, max);
+        }
+        if (idle) {
+            nes->ppu_clock += (uint64_t)idle;
+        } else {
+            ppu_tick(ppu);
+            TRACE_PPU_TICK();
+            nes->ppu_clock++;
+        }
+
+        /* NMI and mapper IRQ propagation — checked after every PPU dot */
+        if (ppu->nmi_output) {
+            ppu->nmi_output  = 0;
+            cpu->nmi_pending = 1;
+        }
+        if (mapper_irq_pending(ppu->mapper)) {
+            cpu->irq_pending = 1;
+        }
+    }
+}
+
+/* Bus hook: the CPU is about to touch the PPU, so bring it up to now */
+static void ppu_catch_up_hook(void *ctx) {
+    NES *nes = ctx;
+    ppu_catch_up(nes, nes->system_clock);
+    nes->ppu_horizon = 0;
+}
+
+void nes_run_frame(NES *nes) {
+    CPU *cpu = &nes->cpu;
+    PPU *ppu = &nes->ppu;
+    Bus *bus = &nes->bus;
+
+    TRACE_FRAME_BEGIN();
+    if (ppu_frame_complete(ppu)) {
+        TRACE_FRAME_END(cpu);
+        return;
+    }
+
+    /* The frame ends on this clock at the latest; the odd-frame skip can
+       end it one dot sooner, so the PPU is kept current over the last two */
+    uint64_t end = nes->system_clock + (uint64_t)ppu_frame_dots_left(ppu) - 1;
+    uint64_t c   = nes->system_clock + (3 - nes->system_clock % 3) % 3;
+    nes->ppu_clock   = nes->system_clock;
+    nes->ppu_horizon = 0;
+    bus_set_ppu_catch_up(bus, ppu_catch_up_hook, nes);
+
+    for (;; c += 3) {
+        if (c + 2 >= end) {
+            ppu_catch_up(nes, c);
+            if (ppu->frame_done && nes->ppu_clock <= c) {
+                /* completed between CPU cycles */
+                nes->system_clock = nes->ppu_clock;
+                break;
+            }
+        }
+
+        /* CPU/DMA and APU run at 1/3 the rate, after the PPU's dot */
+        nes->system_clock = c;
+        if (nes->apu_enabled) apu_tick(&nes->apu);  /* APU ticks at CPU rate */
+        if (bus_dma_active(bus)) {
+            ppu_catch_up(nes, c);
+            bus_dma_tick(bus, c);
+            nes->ppu_horizon = 0;
+        } else if (cpu->cycles_remaining > 0) {
+            cpu->cycles_remaining--;
+        } else {
+            if (c >= nes->ppu_horizon || TRACE_ENABLED(TRACE_ALL)) {
+                ppu_catch_up(nes, c);
+                nes->ppu_horizon = nes->ppu_clock + (uint64_t)ppu_quiet_dots(ppu);
+            }
+            /* a mapper IRQ stays asserted until acknowledged, so it is
+               raised again after the CPU takes it, PPU dots or not */
+            if (mapper_irq_pending(ppu->mapper)) {
+                cpu->irq_pending = 1;
+            }
+            cpu_step(cpu);
+            cpu->cycles_remaining = cpu->cycles - 1;
+        }
+
+        if (ppu->frame_done) {
+            nes->system_clock = c + 1;
+            break;
+        }
+    }
+
+    bus_set_ppu_catch_up(bus, NULL, NULL);
+    ppu_frame_complete(ppu);
+    TRACE_FRAME_END(cpu);
+}
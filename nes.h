@@ -0,0 +1,62 @@
+#ifndef NES_H
+#define NES_H
+
+#include <stdint.h>
+#include "types.h"
+#include "cpu.h"
+#include "bus.h"
+#include "cartridge.h"
+#include "mapper.h"
+#include "ppu.h"
+#include "apu.h"
+#include "controller.h"
+
+/* One console: everything a running game touches lives here, so any number
+   of NES instances can run side by side, each on its own thread. Only the
+   diagnostics (trace.h, profiler.h) and the JIT's perf map are shared. */
+typedef struct NES {
+    CPU        cpu;
+    Bus        bus;
+    PPU        ppu;
+    APU        apu;
+    Controller ctrl1;
+    Controller ctrl2;        /* not wired to the bus yet */
+    Cartridge *cart;
+    Mapper    *mapper;
+    uint64_t   system_clock; /* PPU dots since power-on */
+    /* Inside nes_run_frame the PPU lags the CPU and catches up on demand:
+       ppu_clock is the system clock of its next dot, ppu_horizon the clock
+       before which it has nothing the CPU could notice. */
+    uint64_t   ppu_clock;
+    uint64_t   ppu_horizon;
+    int        apu_enabled;
+} NES;
+
+/* Power on a console with cart inserted; the NES owns cart from then on.
+   Returns NULL if the cartridge's mapper is not supported or memory runs
+   out, in which case cart stays with the caller. */
+NES *nes_create(Cartridge *cart);
+
+/* Swap in another cartridge and power-cycle, keeping the console's
+   allocations (CPU caches, JIT buffer) for the next game. The previous
+   cartridge is freed. Returns -1 if the mapper is not supported, in which
+   case nothing changes and cart stays with the caller. */
+int  nes_load_cartridge(NES *nes, Cartridge *cart);
+
+/* Free the console, its mapper and its cartridge. */
+void nes_destroy(NES *nes);
+
+/* Reset button: CPU, RAM and DMA restart, the cartridge stays inserted. */
+void nes_reset(NES *nes);
+
+/* Run the APU (and let the CPU see it at $4000-$4017). On by default. */
+void nes_set_apu_enabled(NES *nes, int enabled);
+
+/* Advance the whole system until the PPU completes a frame. The CPU runs
+   ahead and the PPU only catches up when the CPU reaches a PPU register,
+   OAM DMA or a mapper register, or a dot it could notice (VBlank, sprite 0,
+   a scanline IRQ, the end of the frame); the result is the same as ticking
+   both in lockstep. */
+void nes_run_frame(NES *nes);
+
+#endif
@@ -0,0 +1,440 @@
+/* pthread_setaffinity_np and CPU_SET are GNU extensions */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "types.h"
+#include "nes.h"
+#include "memory.h"
+
+/* Headless batch runner.
+
+   Reads a job list, one job per line:
+
+     <rom> <frames> [movie=FILE] [ram=FILE] [hashes=FILE] [draw=last]
+
+   movie   controller-1 input, one line per frame holding the BTN_* bits as
+           a hex byte; frames past the end of the movie keep the last state
+   ram     write the 2KB of internal RAM after the last frame
+   hashes  write the framebuffer hash of every frame, one per line (the
+           framebuffer holds palette indices, so no colours are worked out)
+   draw    "last" draws only the last frame; the others work out just what
+           the game can see (sprite-0 hit), so last= holds and all= covers
+           the last frame alone. Cannot go with hashes.
+
+   Blank lines and lines starting with '#' are skipped. Jobs run on a pool
+   of worker threads, each with its own NES that is reused from job to job.
+   Work is dealt round-robin to per-worker queues; an idle worker steals
+   from the others, so a few long jobs do not leave cores waiting. When
+   everything is done, one result line per job is printed in job-list
+   order: final framebuffer hash, hash over all frames, and timing. */
+
+#define BATCH_MAX_PATH 1024
+
+typedef struct {
+    char  rom[BATCH_MAX_PATH];
+    int   frames;
+    char *movie;
+    char *ram;
+    char *hashes;
+    int   draw_last;
+
+    /* results */
+    int      ok;
+    char     error[128];
+    uint64_t last_hash;
+    uint64_t all_hash;
+    double   seconds;
+    int      worker;
+} BatchJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int            *queue;   /* job indices; owner pops the back, thieves the front */
+    int             head;
+    int             tail;
+} JobQueue;
+
+typedef struct Batch Batch;
+
+typedef struct {
+    Batch    *batch;
+    int       id;
+    pthread_t thread;
+    NES      *nes;       /* created by the first job, reused after that */
+    JobQueue  jobs;
+    int       stolen;
+} Worker;
+
+struct Batch {
+    BatchJob *jobs;
+    int       job_count;
+    Worker   *workers;
+    int       worker_count;
+    int       pin;
+};
+
+/* ------------------------------------------------------------------ */
+/*  Job list                                                           */
+/* ------------------------------------------------------------------ */
+
+static char *batch_strdup(const char *s) {
+    size_t n = strlen(s) + 1;
+    char *d = malloc(n);
+    if (d) memcpy(d, s, n);
+    return d;
+}
+
+static int batch_parse_line(char *line, BatchJob *job, int line_no) {
+    char *save = NULL;
+    char *rom    = strtok_r(line, " \t\r\n", &save);
+    char *frames = strtok_r(NULL, " \t\r\n", &save);
+    if (!rom || !frames || atoi(frames) <= 0 || strlen(rom) >= BATCH_MAX_PATH) {
+        fprintf(stderr, "line %d: expected \"<rom> <frames> [options]\"\n", line_no);
+        return -1;
+    }
+    memset(job, 0, sizeof(*job));
+    strcpy(job->rom, rom);
+    job->frames = atoi(frames);
+
+    for (char *opt; (opt = strtok_r(NULL, " \t\r\n", &save)) != NULL; ) {
+        if (strcmp(opt, "draw=last") == 0) {
+            job->draw_last = 1;
+            continue;
+        }
+        char **dst = NULL;
+        const char *value = opt;
+        if      (strncmp(opt, "movie=", 6) == 0)  { dst = &job->movie;  value += 6; }
+        else if (strncmp(opt, "ram=", 4) == 0)    { dst = &job->ram;    value += 4; }
+        else if (strncmp(opt, "hashes=", 7) == 0) { dst = &job->hashes; value += 7; }
+        if (!dst || !*value) {
+            fprintf(stderr, "line %d: unknown option \"%s\"\n", line_no, opt);
+            return -1;
+        }
+        free(*dst);
+        *dst = batch_strdup(value);
+    }
+    if (job->draw_last && job->hashes) {
+        fprintf(stderr, "line %d: draw=last leaves no frame hashes to write\n", line_no);
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns the number of jobs, or -1 on error. */
+static int batch_read_jobs(const char *path, BatchJob **out) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open job list %s\n", path);
+        return -1;
+    }
+    BatchJob *jobs = NULL;
+    int count = 0, cap = 0, line_no = 0;
+    char line[4 * BATCH_MAX_PATH];
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            BatchJob *grown = realloc(jobs, (size_t)cap * sizeof(*jobs));
+            if (!grown) {
+                count = -1;
+                break;
+            }
+            jobs = grown;
+        }
+        if (batch_parse_line(p, &jobs[count], line_no) != 0) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    if (f != stdin) fclose(f);
+    if (count < 0) {
+        free(jobs);
+        return -1;
+    }
+    *out = jobs;
+    return count;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Running one job                                                    */
+/* ------------------------------------------------------------------ */
+
+static uint64_t fnv1a(const void *data, size_t len) {
+    const Byte *b = data;
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= b[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Controller-1 state per frame; NULL with *len 0 if there is no movie. */
+static Byte *batch_load_movie(const char *path, int *len, char *error, size_t error_size) {
+    *len = 0;
+    if (!path) return NULL;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        snprintf(error, error_size, "cannot open movie %s", path);
+        return NULL;
+    }
+    Byte *frames = NULL;
+    int cap = 0;
+    char line[64];
+    while (fgets(line, sizeof(line), f)) {
+        if (*len == cap) {
+            cap = cap ? cap * 2 : 1024;
+            Byte *grown = realloc(frames, (size_t)cap);
+            if (!grown) break;
+            frames = grown;
+        }
+        frames[(*len)++] = (Byte)strtoul(line, NULL, 16);
+    }
+    fclose(f);
+    return frames;
+}
+
+static void batch_run_job(Worker *w, BatchJob *job) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    job->worker = w->id;
+
+    Cartridge *cart = cartridge_load(job->rom);
+    if (!cart) {
+        snprintf(job->error, sizeof(job->error), "cannot load ROM");
+        return;
+    }
+    if (w->nes ? nes_load_cartridge(w->nes, cart) != 0
+               : (w->nes = nes_create(cart)) == NULL) {
+        snprintf(job->error, sizeof(job->error), "unsupported mapper %d", cart->mapper_id);
+        cartridge_free(cart);
+        return;
+    }
+    NES *nes = w->nes;
+
+    int movie_len = 0;
+    Byte *movie = batch_load_movie(job->movie, &movie_len, job->error, sizeof(job->error));
+    if (job->error[0]) return;
+
+    FILE *hashes = NULL;
+    if (job->hashes && !(hashes = fopen(job->hashes, "w"))) {
+        snprintf(job->error, sizeof(job->error), "cannot write %s", job->hashes);
+        free(movie);
+        return;
+    }
+
+    uint64_t all = 1469598103934665603ULL;
+    uint64_t h = 0;
+    for (int f = 0; f < job->frames; f++) {
+        if (movie_len > 0) {
+            controller_set_state(&nes->ctrl1, movie[f < movie_len ? f : movie_len - 1]);
+        }
+        int draw = !job->draw_last || f == job->frames - 1;
+        nes->ppu.output = draw ? PPU_OUTPUT_FULL : PPU_OUTPUT_COLLISION;
+        nes_run_frame(nes);
+        if (!draw) continue;
+        h = fnv1a(nes->ppu.framebuffer, sizeof(nes->ppu.framebuffer));
+        all = (all ^ h) * 1099511628211ULL;
+        if (hashes) fprintf(hashes, "%016llx\n", (unsigned long long)h);
+    }
+    if (hashes) fclose(hashes);
+    free(movie);
+
+    if (job->ram) {
+        FILE *f = fopen(job->ram, "wb");
+        if (!f || fwrite(nes->bus.ram.data, 1, MEM_SIZE, f) != MEM_SIZE) {
+            snprintf(job->error, sizeof(job->error), "cannot write %s", job->ram);
+            if (f) fclose(f);
+            return;
+        }
+        fclose(f);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    job->last_hash = h;
+    job->all_hash  = all;
+    job->seconds   = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    job->ok        = 1;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Work-stealing pool                                                 */
+/* ------------------------------------------------------------------ */
+
+static int queue_pop(JobQueue *q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) job = q->queue[--q->tail];
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static int queue_steal(JobQueue *q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) job = q->queue[q->head++];
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+/* Nothing is queued after the workers start, so once every queue has
+   been seen empty there is no work left. */
+static int batch_next_job(Worker *w) {
+    int job = queue_pop(&w->jobs);
+    if (job >= 0) return job;
+    Batch *b = w->batch;
+    for (int i = 1; i < b->worker_count; i++) {
+        job = queue_steal(&b->workers[(w->id + i) % b->worker_count].jobs);
+        if (job >= 0) {
+            w->stolen++;
+            return job;
+        }
+    }
+    return -1;
+}
+
+static void batch_pin(Worker *w) {
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return;
+    /* the n-th worker takes the n-th CPU this process may run on */
+    int n = w->id % CPU_COUNT(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set) || n-- > 0) continue;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+        return;
+    }
+#else
+    (void)w;
+#endif
+}
+
+static void *batch_worker(void *arg) {
+    Worker *w = arg;
+    if (w->batch->pin) batch_pin(w);
+    for (int job; (job = batch_next_job(w)) >= 0; ) {
+        batch_run_job(w, &w->batch->jobs[job]);
+    }
+    return NULL;
+}
+
+static int batch_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-j THREADS] [--no-pin] JOBLIST\n"
+            "  JOBLIST lines: <rom> <frames> [movie=FILE] [ram=FILE] [hashes=FILE] [draw=last]\n"
+            "  (\"-\" reads the job list from stdin)\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    Batch batch = { 0 };
+    batch.worker_count = batch_default_threads();
+    batch.pin = 1;
+    const char *list = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            batch.worker_count = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2]) {
+            batch.worker_count = atoi(argv[i] + 2);
+        } else if (strcmp(argv[i], "--no-pin") == 0) {
+            batch.pin = 0;
+        } else if (!list) {
+            list = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!list || batch.worker_count <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    batch.job_count = batch_read_jobs(list, &batch.jobs);
+    if (batch.job_count < 0) return 1;
+    if (batch.worker_count > batch.job_count) batch.worker_count = batch.job_count;
+    if (batch.worker_count == 0) return 0;
+
+    batch.workers = calloc((size_t)batch.worker_count, sizeof(Worker));
+    if (!batch.workers) return 1;
+    for (int i = 0; i < batch.worker_count; i++) {
+        Worker *w = &batch.workers[i];
+        w->batch = &batch;
+        w->id    = i;
+        w->jobs.queue = malloc((size_t)batch.job_count * sizeof(int));
+        if (!w->jobs.queue) return 1;
+        pthread_mutex_init(&w->jobs.lock, NULL);
+    }
+    /* deal in reverse so each owner pops its jobs in list order */
+    for (int j = batch.job_count - 1; j >= 0; j--) {
+        JobQueue *q = &batch.workers[j % batch.worker_count].jobs;
+        q->queue[q->tail++] = j;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int started = 0;
+    for (int i = 1; i < batch.worker_count; i++) {
+        if (pthread_create(&batch.workers[i].thread, NULL, batch_worker, &batch.workers[i]) != 0) break;
+        started = i;
+    }
+    batch_worker(&batch.workers[0]);   /* the main thread is worker 0 */
+    for (int i = 1; i <= started; i++) pthread_join(batch.workers[i].thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int failed = 0;
+    long long frames = 0;
+    for (int j = 0; j < batch.job_count; j++) {
+        const BatchJob *job = &batch.jobs[j];
+        if (!job->ok) {
+            printf("%s: FAILED (%s)\n", job->rom, job->error);
+            failed++;
+            continue;
+        }
+        frames += job->frames;
+        printf("%s: frames=%d last=%016llx all=%016llx %.3fs (%.1f fps) worker=%d\n",
+               job->rom, job->frames,
+               (unsigned long long)job->last_hash, (unsigned long long)job->all_hash,
+               job->seconds, job->seconds > 0 ? job->frames / job->seconds : 0.0,
+               job->worker);
+    }
+
+    int stolen = 0;
+    for (int i = 0; i < batch.worker_count; i++) {
+        stolen += batch.workers[i].stolen;
+        nes_destroy(batch.workers[i].nes);
+        pthread_mutex_destroy(&batch.workers[i].jobs.lock);
+        free(batch.workers[i].jobs.queue);
+    }
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%d jobs (%d failed) on %d threads, %d stolen: %lld frames in %.3fs (%.1f fps)\n",
+            batch.job_count, failed, batch.worker_count, stolen, frames, wall,
+            wall > 0 ? frames / wall : 0.0);
+
+    for (int j = 0; j < batch.job_count; j++) {
+        free(batch.jobs[j].movie);
+        free(batch.jobs[j].ram);
+        free(batch.jobs[j].hashes);
+    }
+    free(batch.jobs);
+    free(batch.workers);
+    return failed ? 1 : 0;
+}
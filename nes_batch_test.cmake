@@ -0,0 +1,48 @@
+# Runs nes_batch over one job list on one and on two threads and fails
+# unless every job reports the same hashes both times. Which worker ran a
+# job, and how long it took, are the only things allowed to differ.
+#
+#   cmake -DBATCH=<nes_batch> -DROMS=<dir of .nes files> -DWORK=<scratch dir> -P nes_batch_test.cmake
+
+file(GLOB roms "${ROMS}/*.nes")
+list(SORT roms)
+if(NOT roms)
+    message(FATAL_ERROR "no ROMs in ${ROMS}")
+endif()
+
+# Uneven frame counts so the jobs finish out of order and get stolen
+set(jobs "")
+foreach(rom ${roms})
+    string(APPEND jobs "${rom} 30\n${rom} 120\n${rom} 120 draw=last\n")
+endforeach()
+set(joblist "${WORK}/nes_batch_test.jobs")
+file(WRITE "${joblist}" "${jobs}")
+
+foreach(threads 1 2)
+    execute_process(COMMAND "${BATCH}" -j ${threads} --no-pin "${joblist}"
+                    OUTPUT_VARIABLE out
+                    RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "nes_batch -j ${threads} exited with ${status}:\n${out}")
+    endif()
+    string(REGEX REPLACE " [0-9.]+s \\([0-9.]+ fps\\) worker=[0-9]+" "" out "${out}")
+    set(out_${threads} "${out}")
+endforeach()
+
+if(NOT out_1 STREQUAL out_2)
+    message(FATAL_ERROR "nes_batch -j1 and -j2 disagree:\n-j1:\n${out_1}-j2:\n${out_2}")
+endif()
+
+# draw=last skips drawing the earlier frames but must not change the last one
+string(REGEX MATCHALL "frames=120 last=[0-9a-f]+" last "${out_1}")
+list(LENGTH last count)
+math(EXPR pairs "${count} / 2")
+foreach(i RANGE 1 ${pairs})
+    math(EXPR full "2 * ${i} - 2")
+    math(EXPR skip "2 * ${i} - 1")
+    list(GET last ${full} a)
+    list(GET last ${skip} b)
+    if(NOT a STREQUAL b)
+        message(FATAL_ERROR "draw=last changed the last frame: ${a} vs ${b}")
+    endif()
+endforeach()
@@ -0,0 +1,177 @@
+#include "ntsc.h"
+#include <math.h>
+#include <string.h>
+
+/* ── Signal model ─────────────────────────────────────────────────────────── */
+
+/* Composite levels (volts) of the four luma rows, while the colour
+   waveform is low and high */
+static const float LEVEL_LOW[4]  = { 0.350f, 0.518f, 0.962f, 1.550f };
+static const float LEVEL_HIGH[4] = { 1.094f, 1.506f, 1.962f, 1.962f };
+#define LEVEL_BLACK 0.518f
+#define LEVEL_WHITE 1.962f
+#define EMPHASIS_ATTENUATION 0.746f
+
+/* Where the TV's colour reference sits against colour 0's waveform, in
+   samples; picked to match the built-in palette's hues */
+#define HUE_OFFSET 8.2f
+
+/* Luma and chroma are averaged over one and two subcarrier cycles around
+   each output pixel: luma loses the carrier, chroma picks up whatever luma
+   edges fall inside its window, which is the fringing a TV shows */
+#define LUMA_WINDOW   NTSC_PHASES
+#define CHROMA_WINDOW (2 * NTSC_PHASES)
+#define PAD           CHROMA_WINDOW   /* black samples either side of a line */
+
+/* Colour hue (1-12) is a square wave: high for half of each cycle */
+static int in_color_phase(int hue, int phase) {
+    return (hue + phase) % 12 < 6;
+}
+
+static float signal_level(int value, int phase) {
+    int hue = value & 0x0F;
+    int row = (value >> 4) & 3;
+    int emph = value >> 6;
+    if (hue > 13) row = 1;   /* $xE/$xF output black */
+
+    float low = LEVEL_LOW[row], high = LEVEL_HIGH[row];
+    if (hue == 0) low = high;
+    if (hue > 12) high = low;
+    float v = in_color_phase(hue, phase) ? high : low;
+
+    /* emphasis darkens the part of the cycle belonging to its colour */
+    if (hue < 14 && (((emph & 1) && in_color_phase(0xC, phase)) ||
+                     ((emph & 2) && in_color_phase(0x4, phase)) ||
+                     ((emph & 4) && in_color_phase(0x8, phase))))
+        v *= EMPHASIS_ATTENUATION;
+    return (v - LEVEL_BLACK) / (LEVEL_WHITE - LEVEL_BLACK);
+}
+
+void ntsc_init(NtscFilter *f, int scale) {
+    if (scale < 2) scale = 2;
+    if (scale > NTSC_MAX_SCALE) scale = NTSC_MAX_SCALE;
+    f->scale = scale;
+
+    for (int v = 0; v < PPU_COLORS; v++)
+        for (int p = 0; p < NTSC_PHASES; p++) f->signal[v][p] = signal_level(v, p);
+
+    const float pi = 3.14159265f;
+    for (int p = 0; p < NTSC_PHASES; p++) {
+        float angle = pi * ((float)p - HUE_OFFSET) / 6.0f;
+        f->carrier[p][0] = 1.0f;
+        f->carrier[p][1] = cosf(angle);
+        f->carrier[p][2] = sinf(angle);
+        f->carrier[p][3] = 0.0f;
+    }
+
+    for (int col = 0; col < 256 * scale; col++) {
+        int center = PAD + ((2 * col + 1) * 8 + scale) / (2 * scale);
+        f->luma_start[col]   = center - LUMA_WINDOW / 2;
+        f->chroma_start[col] = center - CHROMA_WINDOW / 2;
+    }
+
+    /* the NES palette is made for a TV's 2.2 gamma, close to 1.8 today */
+    for (int i = 0; i < 1024; i++)
+        f->gamma[i] = (Byte)(255.0f * powf(i / 1023.0f, 2.2f / 1.8f) + 0.5f);
+}
+
+int ntsc_frame_phase(int frame) {
+    return (frame & 1) * 4;
+}
+
+/* ── Decoding ─────────────────────────────────────────────────────────────── */
+
+/* One sample, or a sum of them, as (Y, I, Q, unused). Four lanes of float
+   map onto one SSE register where GCC vector extensions are available. */
+#if defined(__GNUC__)
+typedef float Yiq __attribute__((vector_size(16)));
+
+static inline Yiq yiq_load(const float *p) {
+    Yiq v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+static inline Yiq yiq_add(Yiq a, Yiq b)       { return a + b; }
+static inline Yiq yiq_sub(Yiq a, Yiq b)       { return a - b; }
+static inline Yiq yiq_scale(Yiq a, float s)   { return a * s; }
+#define YIQ_LANE(v, i) ((v)[i])
+#else
+typedef struct { float lane[4]; } Yiq;
+
+static inline Yiq yiq_load(const float *p) {
+    Yiq v;
+    memcpy(v.lane, p, sizeof(v.lane));
+    return v;
+}
+static inline Yiq yiq_add(Yiq a, Yiq b) {
+    for (int i = 0; i < 4; i++) a.lane[i] += b.lane[i];
+    return a;
+}
+static inline Yiq yiq_sub(Yiq a, Yiq b) {
+    for (int i = 0; i < 4; i++) a.lane[i] -= b.lane[i];
+    return a;
+}
+static inline Yiq yiq_scale(Yiq a, float s) {
+    for (int i = 0; i < 4; i++) a.lane[i] *= s;
+    return a;
+}
+#define YIQ_LANE(v, i) ((v).lane[i])
+#endif
+
+static inline uint32_t gamma_channel(const NtscFilter *f, float v) {
+    int i = (int)(v * 1023.0f + 0.5f);
+    if (i < 0) i = 0;
+    if (i > 1023) i = 1023;
+    return f->gamma[i];
+}
+
+static void filter_row(const NtscFilter *f, const uint16_t *line, int phase, uint32_t *out) {
+    /* running sums of the demodulated signal: sum[n] covers samples
+       0..n-1 of the padded line, so any window is one subtraction */
+    Yiq sum[PAD + NTSC_SAMPLES + PAD + 1];
+    Yiq carrier[NTSC_PHASES];
+    Yiq acc = yiq_scale(yiq_load(f->carrier[0]), 0.0f);
+    for (int p = 0; p < NTSC_PHASES; p++) carrier[p] = yiq_load(f->carrier[p]);
+
+    for (int n = 0; n <= PAD; n++) sum[n] = acc;
+    Yiq *s = &sum[PAD + 1];
+    for (int x = 0; x < 256; x++) {
+        const float *level = f->signal[line[x] & (PPU_COLORS - 1)];
+        int p = (phase + x * 8) % NTSC_PHASES;
+        for (int k = 0; k < 8; k++) {
+            acc = yiq_add(acc, yiq_scale(carrier[p], level[p]));
+            *s++ = acc;
+            if (++p == NTSC_PHASES) p = 0;
+        }
+    }
+    for (int n = 0; n < PAD; n++) *s++ = acc;
+
+    const float luma_gain   = 1.0f / LUMA_WINDOW;
+    const float chroma_gain = 2.0f / CHROMA_WINDOW;
+    for (int col = 0; col < 256 * f->scale; col++) {
+        int l = f->luma_start[col], c = f->chroma_start[col];
+        float y = YIQ_LANE(yiq_sub(sum[l + LUMA_WINDOW], sum[l]), 0) * luma_gain;
+        Yiq iq  = yiq_scale(yiq_sub(sum[c + CHROMA_WINDOW], sum[c]), chroma_gain);
+        float i = YIQ_LANE(iq, 1), q = YIQ_LANE(iq, 2);
+
+        float r = y + 0.946882f * i + 0.623557f * q;
+        float g = y - 0.274788f * i - 0.635691f * q;
+        float b = y - 1.108545f * i + 1.709007f * q;
+        out[col] = 0xFF000000 | gamma_channel(f, r) << 16 |
+                   gamma_channel(f, g) << 8 | gamma_channel(f, b);
+    }
+}
+
+void ntsc_filter_rows(const NtscFilter *f, const uint16_t *frame, int phase,
+                      uint32_t *argb, int pitch, int first, int count) {
+    for (int row = first; row < first + count && row < 240; row++) {
+        /* each line is 341 dots of 8 samples, a third of a cycle on */
+        int line_phase = (phase + row * 4) % NTSC_PHASES;
+        filter_row(f, &frame[row * 256], line_phase, &argb[row * pitch]);
+    }
+}
+
+void ntsc_filter_frame(const NtscFilter *f, const uint16_t *frame, int phase,
+                       uint32_t *argb, int pitch) {
+    ntsc_filter_rows(f, frame, phase, argb, pitch, 0, 240);
+}
@@ -0,0 +1,47 @@
+#ifndef NTSC_H
+#define NTSC_H
+
+#include <stdint.h>
+#include "ppu.h"
+
+/* Composite video filter: turns a finished PPU frame (palette indices and
+   emphasis, see PPU.framebuffer) into ARGB8888 the way a TV decodes the
+   NES's NTSC signal, colour fringing, dot crawl and all. Each NES pixel is
+   8 samples of the signal; the output has scale (2 or 3) pixels per NES
+   pixel across and the same 240 lines. */
+
+#define NTSC_MAX_SCALE 3
+#define NTSC_SAMPLES   (256 * 8)   /* signal samples per line */
+#define NTSC_PHASES    12          /* samples per colour subcarrier cycle */
+
+typedef struct {
+    int   scale;
+    /* Level of each framebuffer value at each subcarrier phase, black 0
+       and white 1, and the I/Q reference carrier at each phase */
+    float signal[PPU_COLORS][NTSC_PHASES];
+    float carrier[NTSC_PHASES][4];
+    /* First sample of the luma and chroma windows around each column */
+    int   luma_start[256 * NTSC_MAX_SCALE];
+    int   chroma_start[256 * NTSC_MAX_SCALE];
+    Byte  gamma[1024];   /* decoded level (0-1 in 1/1023 steps) to 0-255 */
+} NtscFilter;
+
+/* Build the tables for an output of 256 * scale pixels across; scale is
+   clamped to 2..NTSC_MAX_SCALE. */
+void ntsc_init(NtscFilter *f, int scale);
+
+/* Subcarrier phase (in samples) the frame numbered frame starts on. A
+   frame moves it on by a third of a cycle, and odd frames skip a dot,
+   which takes it back again: it alternates between two phases. */
+int ntsc_frame_phase(int frame);
+
+/* Decode rows first..first+count-1 of frame into argb, pitch pixels per
+   row. Rows are independent, so bands of a frame can be filtered on
+   separate threads. */
+void ntsc_filter_rows(const NtscFilter *f, const uint16_t *frame, int phase,
+                      uint32_t *argb, int pitch, int first, int count);
+
+void ntsc_filter_frame(const NtscFilter *f, const uint16_t *frame, int phase,
+                       uint32_t *argb, int pitch);
+
+#endif
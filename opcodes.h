@@ -200,4 +200,237 @@
 #define OPC_RTS_IMP     0x60
 #define OPC_RTI_IMP     0x40
 
+/* ------------------------------------------------------------------ */
+/*  Instruction table                                                  */
+/* ------------------------------------------------------------------ */
+
+/* X(opcode, mnemonic, addressing mode, base cycles).
+   The CPU dispatchers and the JIT translator are generated from this list. */
+#define CPU_OPCODE_TABLE(X)                                                \
+    /* BRK */                                                              \
+    X(0x00,          BRK, IMP, 7)                                          \
+                                                                           \
+    /* AND */                                                              \
+    X(OPC_AND_INDX,  AND, IZX, 6)                                          \
+    X(OPC_AND_ZP,    AND, ZP0, 3)                                          \
+    X(OPC_AND_IM,    AND, IMM, 2)                                          \
+    X(OPC_AND_ABS,   AND, ABS, 4)                                          \
+    X(OPC_AND_ABSY,  AND, ABY, 4)                                          \
+    X(OPC_AND_ZPX,   AND, ZPX, 4)                                          \
+    X(OPC_AND_ABSX,  AND, ABX, 4)                                          \
+    X(OPC_AND_INDY,  AND, IZY, 5)                                          \
+                                                                           \
+    /* BIT */                                                              \
+    X(OPC_BIT_ZP,    BIT, ZP0, 3)                                          \
+    X(OPC_BIT_ABS,   BIT, ABS, 4)                                          \
+                                                                           \
+    /* Branches (base = 2) */                                              \
+    X(OPC_BPL_REL,   BPL, REL, 2)                                          \
+    X(OPC_BMI_REL,   BMI, REL, 2)                                          \
+    X(OPC_BVC_REL,   BVC, REL, 2)                                          \
+    X(OPC_BVS_REL,   BVS, REL, 2)                                          \
+    X(OPC_BCC_REL,   BCC, REL, 2)                                          \
+    X(OPC_BCS_REL,   BCS, REL, 2)                                          \
+    X(OPC_BNE_REL,   BNE, REL, 2)                                          \
+    X(OPC_BEQ_REL,   BEQ, REL, 2)                                          \
+                                                                           \
+    /* ASL */                                                              \
+    X(OPC_ASL_ACC,   ASL, ACC, 2)                                          \
+    X(OPC_ASL_ZP,    ASL, ZP0, 5)                                          \
+    X(OPC_ASL_ZPX,   ASL, ZPX, 6)                                          \
+    X(OPC_ASL_ABS,   ASL, ABS, 6)                                          \
+    X(OPC_ASL_ABSX,  ASL, ABX, 7)                                          \
+                                                                           \
+    /* ADC */                                                              \
+    X(OPC_ADC_IM,    ADC, IMM, 2)                                          \
+    X(OPC_ADC_ZP,    ADC, ZP0, 3)                                          \
+    X(OPC_ADC_ZPX,   ADC, ZPX, 4)                                          \
+    X(OPC_ADC_ABS,   ADC, ABS, 4)                                          \
+    X(OPC_ADC_ABSX,  ADC, ABX, 4)                                          \
+    X(OPC_ADC_ABSY,  ADC, ABY, 4)                                          \
+    X(OPC_ADC_INDX,  ADC, IZX, 6)                                          \
+    X(OPC_ADC_INDY,  ADC, IZY, 5)                                          \
+                                                                           \
+    /* LDA */                                                              \
+    X(OPC_LDA_IM,    LDA, IMM, 2)                                          \
+    X(OPC_LDA_ZP,    LDA, ZP0, 3)                                          \
+    X(OPC_LDA_ZPX,   LDA, ZPX, 4)                                          \
+    X(OPC_LDA_ABS,   LDA, ABS, 4)                                          \
+    X(OPC_LDA_ABSX,  LDA, ABX, 4)                                          \
+    X(OPC_LDA_ABSY,  LDA, ABY, 4)                                          \
+    X(OPC_LDA_INDX,  LDA, IZX, 6)                                          \
+    X(OPC_LDA_INDY,  LDA, IZY, 5)                                          \
+                                                                           \
+    /* STA -- no page-cross penalty, base cycles already account for it */ \
+    X(OPC_STA_ZP,    STA, ZP0, 3)                                          \
+    X(OPC_STA_ZPX,   STA, ZPX, 4)                                          \
+    X(OPC_STA_ABS,   STA, ABS, 4)                                          \
+    X(OPC_STA_ABSX,  STA, ABX, 5)                                          \
+    X(OPC_STA_ABSY,  STA, ABY, 5)                                          \
+    X(OPC_STA_INDX,  STA, IZX, 6)                                          \
+    X(OPC_STA_INDY,  STA, IZY, 6)                                          \
+                                                                           \
+    /* Clear flags */                                                      \
+    X(OPC_CLC_IMP,   CLC, IMP, 2)                                          \
+    X(OPC_CLD_IMP,   CLD, IMP, 2)                                          \
+    X(OPC_CLI_IMP,   CLI, IMP, 2)                                          \
+    X(OPC_CLV_IMP,   CLV, IMP, 2)                                          \
+                                                                           \
+    /* CMP */                                                              \
+    X(OPC_CMP_IM,    CMP, IMM, 2)                                          \
+    X(OPC_CMP_ZP,    CMP, ZP0, 3)                                          \
+    X(OPC_CMP_ZPX,   CMP, ZPX, 4)                                          \
+    X(OPC_CMP_ABS,   CMP, ABS, 4)                                          \
+    X(OPC_CMP_ABSX,  CMP, ABX, 4)                                          \
+    X(OPC_CMP_ABSY,  CMP, ABY, 4)                                          \
+    X(OPC_CMP_INDX,  CMP, IZX, 6)                                          \
+    X(OPC_CMP_INDY,  CMP, IZY, 5)                                          \
+                                                                           \
+    /* CPX */                                                              \
+    X(OPC_CPX_IM,    CPX, IMM, 2)                                          \
+    X(OPC_CPX_ZP,    CPX, ZP0, 3)                                          \
+    X(OPC_CPX_ABS,   CPX, ABS, 4)                                          \
+                                                                           \
+    /* CPY */                                                              \
+    X(OPC_CPY_IM,    CPY, IMM, 2)                                          \
+    X(OPC_CPY_ZP,    CPY, ZP0, 3)                                          \
+    X(OPC_CPY_ABS,   CPY, ABS, 4)                                          \
+                                                                           \
+    /* DEC */                                                              \
+    X(OPC_DEC_ZP,    DEC, ZP0, 5)                                          \
+    X(OPC_DEC_ZPX,   DEC, ZPX, 6)                                          \
+    X(OPC_DEC_ABS,   DEC, ABS, 6)                                          \
+    X(OPC_DEC_ABSX,  DEC, ABX, 7)                                          \
+                                                                           \
+    /* DEX, DEY */                                                         \
+    X(OPC_DEX_IMP,   DEX, IMP, 2)                                          \
+    X(OPC_DEY_IMP,   DEY, IMP, 2)                                          \
+                                                                           \
+    /* SEC, SED, SEI */                                                    \
+    X(OPC_SEC_IMP,   SEC, IMP, 2)                                          \
+    X(OPC_SED_IMP,   SED, IMP, 2)                                          \
+    X(OPC_SEI_IMP,   SEI, IMP, 2)                                          \
+                                                                           \
+    /* NOP */                                                              \
+    X(OPC_NOP_IMP,   NOP, IMP, 2)                                          \
+                                                                           \
+    /* Register transfers */                                               \
+    X(OPC_TAX_IMP,   TAX, IMP, 2)                                          \
+    X(OPC_TAY_IMP,   TAY, IMP, 2)                                          \
+    X(OPC_TXA_IMP,   TXA, IMP, 2)                                          \
+    X(OPC_TYA_IMP,   TYA, IMP, 2)                                          \
+    X(OPC_TSX_IMP,   TSX, IMP, 2)                                          \
+    X(OPC_TXS_IMP,   TXS, IMP, 2)                                          \
+                                                                           \
+    /* INC */                                                              \
+    X(OPC_INC_ZP,    INC, ZP0, 5)                                          \
+    X(OPC_INC_ZPX,   INC, ZPX, 6)                                          \
+    X(OPC_INC_ABS,   INC, ABS, 6)                                          \
+    X(OPC_INC_ABSX,  INC, ABX, 7)                                          \
+                                                                           \
+    /* INX, INY */                                                         \
+    X(OPC_INX_IMP,   INX, IMP, 2)                                          \
+    X(OPC_INY_IMP,   INY, IMP, 2)                                          \
+                                                                           \
+    /* EOR */                                                              \
+    X(OPC_EOR_INDX,  EOR, IZX, 6)                                          \
+    X(OPC_EOR_ZP,    EOR, ZP0, 3)                                          \
+    X(OPC_EOR_IM,    EOR, IMM, 2)                                          \
+    X(OPC_EOR_ABS,   EOR, ABS, 4)                                          \
+    X(OPC_EOR_ZPX,   EOR, ZPX, 4)                                          \
+    X(OPC_EOR_ABSX,  EOR, ABX, 4)                                          \
+    X(OPC_EOR_ABSY,  EOR, ABY, 4)                                          \
+    X(OPC_EOR_INDY,  EOR, IZY, 5)                                          \
+                                                                           \
+    /* ORA */                                                              \
+    X(OPC_ORA_INDX,  ORA, IZX, 6)                                          \
+    X(OPC_ORA_ZP,    ORA, ZP0, 3)                                          \
+    X(OPC_ORA_IM,    ORA, IMM, 2)                                          \
+    X(OPC_ORA_ABS,   ORA, ABS, 4)                                          \
+    X(OPC_ORA_ZPX,   ORA, ZPX, 4)                                          \
+    X(OPC_ORA_ABSX,  ORA, ABX, 4)                                          \
+    X(OPC_ORA_ABSY,  ORA, ABY, 4)                                          \
+    X(OPC_ORA_INDY,  ORA, IZY, 5)                                          \
+                                                                           \
+    /* SBC */                                                              \
+    X(OPC_SBC_IM,    SBC, IMM, 2)                                          \
+    X(OPC_SBC_ZP,    SBC, ZP0, 3)                                          \
+    X(OPC_SBC_ZPX,   SBC, ZPX, 4)                                          \
+    X(OPC_SBC_ABS,   SBC, ABS, 4)                                          \
+    X(OPC_SBC_ABSX,  SBC, ABX, 4)                                          \
+    X(OPC_SBC_ABSY,  SBC, ABY, 4)                                          \
+    X(OPC_SBC_INDX,  SBC, IZX, 6)                                          \
+    X(OPC_SBC_INDY,  SBC, IZY, 5)                                          \
+                                                                           \
+    /* LDX */                                                              \
+    X(OPC_LDX_IM,    LDX, IMM, 2)                                          \
+    X(OPC_LDX_ZP,    LDX, ZP0, 3)                                          \
+    X(OPC_LDX_ZPY,   LDX, ZPY, 4)                                          \
+    X(OPC_LDX_ABS,   LDX, ABS, 4)                                          \
+    X(OPC_LDX_ABY,   LDX, ABY, 4)                                          \
+                                                                           \
+    /* LDY */                                                              \
+    X(OPC_LDY_IM,    LDY, IMM, 2)                                          \
+    X(OPC_LDY_ZP,    LDY, ZP0, 3)                                          \
+    X(OPC_LDY_ZPX,   LDY, ZPX, 4)                                          \
+    X(OPC_LDY_ABS,   LDY, ABS, 4)                                          \
+    X(OPC_LDY_ABX,   LDY, ABX, 4)                                          \
+                                                                           \
+    /* STX */                                                              \
+    X(OPC_STX_ZP,    STX, ZP0, 3)                                          \
+    X(OPC_STX_ZPY,   STX, ZPY, 4)                                          \
+    X(OPC_STX_ABS,   STX, ABS, 4)                                          \
+                                                                           \
+    /* STY */                                                              \
+    X(OPC_STY_ZP,    STY, ZP0, 3)                                          \
+    X(OPC_STY_ZPX,   STY, ZPX, 4)                                          \
+    X(OPC_STY_ABS,   STY, ABS, 4)                                          \
+                                                                           \
+    /* LSR */                                                              \
+    X(OPC_LSR_ACC,   LSR, ACC, 2)                                          \
+    X(OPC_LSR_ZP,    LSR, ZP0, 5)                                          \
+    X(OPC_LSR_ZPX,   LSR, ZPX, 6)                                          \
+    X(OPC_LSR_ABS,   LSR, ABS, 6)                                          \
+    X(OPC_LSR_ABSX,  LSR, ABX, 7)                                          \
+                                                                           \
+    /* ROL */                                                              \
+    X(OPC_ROL_ACC,   ROL, ACC, 2)                                          \
+    X(OPC_ROL_ZP,    ROL, ZP0, 5)                                          \
+    X(OPC_ROL_ZPX,   ROL, ZPX, 6)                                          \
+    X(OPC_ROL_ABS,   ROL, ABS, 6)                                          \
+    X(OPC_ROL_ABSX,  ROL, ABX, 7)                                          \
+                                                                           \
+    /* ROR */                                                              \
+    X(OPC_ROR_ACC,   ROR, ACC, 2)                                          \
+    X(OPC_ROR_ZP,    ROR, ZP0, 5)                                          \
+    X(OPC_ROR_ZPX,   ROR, ZPX, 6)                                          \
+    X(OPC_ROR_ABS,   ROR, ABS, 6)                                          \
+    X(OPC_ROR_ABSX,  ROR, ABX, 7)                                          \
+                                                                           \
+    /* Stack ops */                                                        \
+    X(OPC_PHA_IMP,   PHA, IMP, 3)                                          \
+    X(OPC_PHP_IMP,   PHP, IMP, 3)                                          \
+    X(OPC_PLA_IMP,   PLA, IMP, 4)                                          \
+    X(OPC_PLP_IMP,   PLP, IMP, 4)                                          \
+                                                                           \
+    /* Jumps and subroutines */                                            \
+    X(OPC_JMP_ABS,   JMP, ABS, 3)                                          \
+    X(OPC_JMP_IND,   JMP, IND, 5)                                          \
+    X(OPC_JSR_ABS,   JSR, ABS, 6)                                          \
+    X(OPC_RTS_IMP,   RTS, IMP, 6)                                          \
+    X(OPC_RTI_IMP,   RTI, IMP, 6)
+
+/* X(mode, operand bytes) */
+#define CPU_ADDR_MODES(X)                                                  \
+    X(IMP, 0) X(ACC, 0) X(IMM, 1) X(ZP0, 1) X(ZPX, 1) X(ZPY, 1) X(REL, 1)  \
+    X(ABS, 2) X(ABX, 2) X(ABY, 2) X(IZX, 1) X(IZY, 1) X(IND, 2)
+
+#define CPU_MNEMONICS(X)                                                   \
+    X(ADC) X(AND) X(ASL) X(BCC) X(BCS) X(BEQ) X(BIT) X(BMI) X(BNE) X(BPL) \
+    X(BRK) X(BVC) X(BVS) X(CLC) X(CLD) X(CLI) X(CLV) X(CMP) X(CPX) X(CPY) \
+    X(DEC) X(DEX) X(DEY) X(EOR) X(INC) X(INX) X(INY) X(JMP) X(JSR) X(LDA) \
+    X(LDX) X(LDY) X(LSR) X(NOP) X(ORA) X(PHA) X(PHP) X(PLA) X(PLP) X(ROL) \
+    X(ROR) X(RTI) X(RTS) X(SBC) X(SEC) X(SED) X(SEI) X(STA) X(STX) X(STY) \
+    X(TAX) X(TAY) X(TSX) X(TXA) X(TXS) X(TYA)
+
 #endif
@@ -1,4 +1,6 @@
 #include "ppu.h"
+#include "trace.h"
+#include <stdio.h>
 #include <string.h>
 
 /* ── NES Palette ──────────────────────────────────────────────────────────── */
@@ -22,28 +24,89 @@ static const uint32_t NES_PALETTE[64] = {
     0xFFA9F0F6, 0xFFB8B8B8, 0xFF000000, 0xFF000000,
 };
 
+/* ── Colour conversion ────────────────────────────────────────────────────── */
+
+/* Fill colors[64..511] from the 64 base colours: each emphasis bit set
+   darkens the two channels it does not name to about 3/4 */
+static void emphasize_colors(uint32_t colors[PPU_COLORS]) {
+    for (int emph = 1; emph < 8; emph++) {
+        for (int i = 0; i < 64; i++) {
+            uint32_t c = colors[i];
+            uint32_t r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+            if (emph & 6) r = r * 191 >> 8;   /* green or blue */
+            if (emph & 5) g = g * 191 >> 8;   /* red or blue */
+            if (emph & 3) b = b * 191 >> 8;   /* red or green */
+            colors[emph << 6 | i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        }
+    }
+}
+
+void ppu_default_colors(uint32_t colors[PPU_COLORS]) {
+    memcpy(colors, NES_PALETTE, sizeof(NES_PALETTE));
+    emphasize_colors(colors);
+}
+
+int ppu_load_palette(uint32_t colors[PPU_COLORS], const char *path) {
+    Byte rgb[PPU_COLORS * 3];
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    size_t n = fread(rgb, 1, sizeof(rgb), f);
+    fclose(f);
+    if (n != 64 * 3 && n != sizeof(rgb)) return -1;
+
+    for (size_t i = 0; i < n / 3; i++)
+        colors[i] = 0xFF000000 | (uint32_t)rgb[i * 3] << 16 |
+                    (uint32_t)rgb[i * 3 + 1] << 8 | rgb[i * 3 + 2];
+    if (n == 64 * 3) emphasize_colors(colors);
+    return 0;
+}
+
+void ppu_convert_frame(const uint16_t *frame, uint32_t *argb,
+                       const uint32_t colors[PPU_COLORS]) {
+    for (int i = 0; i < 256 * 240; i++)
+        argb[i] = colors[frame[i] & (PPU_COLORS - 1)];
+}
+
 /* ── Nametable mirroring ──────────────────────────────────────────────────── */
+
+/* Point the four nametable slots at physical pages for the mapper's
+   current mirroring. Registered as the mapper's mirroring listener. */
+static void update_mirroring(Mapper *mapper, void *ctx) {
+    PPU *ppu = ctx;
+    ppu->mirror = (MirrorMode)mapper_get_mirroring(mapper);
+
+    for (int slot = 0; slot < 4; slot++) {
+        int phys;
+        switch (ppu->mirror) {
+            case MIRROR_HORIZONTAL:  phys = (slot >= 2) ? 1 : 0;  break;
+            case MIRROR_VERTICAL:    phys = slot & 1;              break;
+            case MIRROR_SINGLE_A:    phys = 0;                     break;
+            case MIRROR_SINGLE_B:    phys = 1;                     break;
+            case MIRROR_FOUR_SCREEN: phys = slot;                  break;
+            default:                 phys = slot & 1;              break;
+        }
+        ppu->nt_page[slot] = ppu->nametable[phys];
+    }
+}
+
 /*
  * Maps a PPU nametable address (0x2000–0x2FFF, already masked to 12-bit
- * offset from 0x2000) to a byte index into ppu->nametable[2][0x400].
- * Returns a pointer to the target byte.
+ * offset from 0x2000) to the byte it selects in ppu->nametable.
  */
 static Byte *nt_mirror(PPU *ppu, Word addr) {
-    /* addr is already in 0x0000–0x0FFF (offset from 0x2000) */
-    int slot = (addr >> 10) & 0x03;   /* nametable slot 0–3 */
-    Word offset = addr & 0x03FF;       /* byte within nametable */
+    return &ppu->nt_page[(addr >> 10) & 0x03][addr & 0x03FF];
+}
 
-    int phys;
-    // Get mirroring mode from mapper instead of static ppu->mirror
-    Byte mirror_mode = mapper_get_mirroring(ppu->mapper);
-    switch (mirror_mode) {
-        case MIRROR_HORIZONTAL: phys = (slot >= 2) ? 1 : 0;  break;
-        case MIRROR_VERTICAL:   phys = slot & 1;              break;
-        case MIRROR_SINGLE_A:   phys = 0;                     break;
-        case MIRROR_SINGLE_B:   phys = 1;                     break;
-        default:                phys = slot & 1;              break;
-    }
-    return &ppu->nametable[phys][offset];
+/* ── Resolved palette ─────────────────────────────────────────────────────── */
+
+static void update_palette_entry(PPU *ppu, int i) {
+    Byte grey = (ppu->mask & 0x01) ? 0x30 : 0x3F;
+    Byte value = ppu->palette[(i & 0x13) == 0x10 ? i & 0x0F : i];
+    ppu->palette_out[i] = (uint16_t)((value & grey) | (ppu->mask & 0xE0) << 1);
+}
+
+void ppu_update_palette(PPU *ppu) {
+    for (int i = 0; i < 32; i++) update_palette_entry(ppu, i);
 }
 
 /* ── VRAM read/write ──────────────────────────────────────────────────────── */
@@ -53,7 +116,8 @@ Byte ppu_vram_read(PPU *ppu, Word addr) {
 
     if (addr <= 0x1FFF) {
         mapper_ppu_a12_tick(ppu->mapper, addr);
-        return mapper_chr_read(ppu->mapper, addr);
+        const Byte *bank = ppu->mapper->chr_map[addr >> 10];
+        return bank ? bank[addr & 0x03FF] : mapper_chr_read(ppu->mapper, addr);
     }
     if (addr <= 0x2FFF) {
         return *nt_mirror(ppu, addr - 0x2000);
@@ -90,6 +154,8 @@ void ppu_vram_write(PPU *ppu, Word addr, Byte data) {
     if (addr == 0x10 || addr == 0x14 || addr == 0x18 || addr == 0x1C)
         addr &= 0x0F;
     ppu->palette[addr] = data;
+    update_palette_entry(ppu, addr);
+    if ((addr & 0x03) == 0) update_palette_entry(ppu, addr | 0x10);   /* its mirror */
 }
 
 /* ── Register I/O ─────────────────────────────────────────────────────────── */
@@ -105,6 +171,7 @@ Byte ppu_reg_read(PPU *ppu, Byte reg) {
         case 0x04:  /* OAMDATA */
             return ppu->oam[ppu->oam_addr];
         case 0x07: { /* PPUDATA */
+            ppu_sync(ppu);   /* moves v */
             Byte val = ppu->data_buf;
             ppu->data_buf = ppu_vram_read(ppu, ppu->v);
             if ((ppu->v & 0x3FFF) >= 0x3F00) val = ppu->data_buf; /* palette: no delay */
@@ -117,6 +184,7 @@ Byte ppu_reg_read(PPU *ppu, Byte reg) {
 }
 
 void ppu_reg_write(PPU *ppu, Byte reg, Byte data) {
+    ppu_sync(ppu);
     switch (reg) {
         case 0x00: /* PPUCTRL */
             ppu->ctrl = data;
@@ -127,13 +195,17 @@ void ppu_reg_write(PPU *ppu, Byte reg, Byte data) {
                 ppu->nmi_output = 1;
             }
             break;
-        case 0x01: /* PPUMASK */
+        case 0x01: { /* PPUMASK */
+            Byte changed = ppu->mask ^ data;
             ppu->mask = data;
+            if (changed & 0xE1) ppu_update_palette(ppu);   /* emphasis, greyscale */
             break;
+        }
         case 0x03: /* OAMADDR */
             ppu->oam_addr = data;
             break;
         case 0x04: /* OAMDATA */
+            if ((ppu->oam_addr & 3) == 0) ppu->oam_dirty = 1;
             ppu->oam[ppu->oam_addr++] = data;
             break;
         case 0x05: /* PPUSCROLL */
@@ -262,6 +334,16 @@ static void compose_pixel(PPU *ppu) {
     Byte sp_pal    = 0;
     Byte sp_priority = 0;
 
+    /* Collision only, and sprite 0 cannot hit on this line: nothing is
+       needed but sprite_zero_rendered, which is slot 0's pixel */
+    if (ppu->output == PPU_OUTPUT_COLLISION &&
+        !(ppu->sprite_zero_on_line && (ppu->mask & 0x18) == 0x18)) {
+        if (ppu->mask & 0x10)
+            ppu->sprite_zero_rendered = ppu->sprite_count > 0 && ppu->sprite_x[0] == 0 &&
+                ((ppu->sprite_shift_lo[0] | ppu->sprite_shift_hi[0]) & 0x80);
+        return;
+    }
+
     if (ppu->mask & 0x08) {   /* background enabled */
         Word mux = 0x8000 >> ppu->x;
         Byte p0 = (ppu->bg_shift_lo & mux) ? 1 : 0;
@@ -311,14 +393,16 @@ static void compose_pixel(PPU *ppu) {
         if (!(ppu->mask & 0x06)) {
             if (ppu->dot >= 9) {
                 ppu->status |= 0x40;
-                ppu->dbg_sp0_hit_count++;
+                TRACE_SP0_HIT();
             }
         } else {
             ppu->status |= 0x40;
-            ppu->dbg_sp0_hit_count++;
+            TRACE_SP0_HIT();
         }
     }
 
+    if (ppu->output != PPU_OUTPUT_FULL) return;
+
     /* Pixel priority */
     Byte pixel, pal;
     if (bg_pixel == 0 && sp_pixel == 0) { pixel = 0; pal = 0; }
@@ -327,38 +411,44 @@ static void compose_pixel(PPU *ppu) {
     else if (sp_priority)               { pixel = sp_pixel; pal = sp_pal; }
     else                                { pixel = bg_pixel; pal = bg_pal; }
 
-    Byte color_idx = ppu_vram_read(ppu, 0x3F00 + (pal << 2) + pixel) & 0x3F;
-    if (ppu->mask & 0x01) color_idx &= 0x30;   /* greyscale */
-
     int fb_x = ppu->dot - 1;
     int fb_y = ppu->scanline;
     if (fb_x >= 0 && fb_x < 256 && fb_y >= 0 && fb_y < 240)
-        ppu->framebuffer[fb_y * 256 + fb_x] = NES_PALETTE[color_idx];
+        ppu->framebuffer[fb_y * 256 + fb_x] = ppu->palette_out[(pal << 2) + pixel];
 }
 
 /* ── Sprite evaluation ────────────────────────────────────────────────────── */
 
+static void index_sprites(PPU *ppu, int height) {
+    memset(ppu->sprite_line_count, 0, sizeof(ppu->sprite_line_count));
+    for (int i = 0; i < 64; i++) {
+        int y = (int)ppu->oam[i * 4];   /* Y position (sprite drawn on scanlines y+1..y+height) */
+        for (int line = y + 1; line <= y + height && line <= 240; line++) {
+            Byte *n = &ppu->sprite_line_count[line];
+            if (*n < 9) ppu->sprite_line_oam[line][(*n)++] = (Byte)i;
+        }
+    }
+    ppu->sprite_index_height = (Byte)height;
+    ppu->oam_dirty = 0;
+}
+
 static void evaluate_sprites(PPU *ppu, int target_scanline) {
     memset(ppu->secondary_oam, 0xFF, 32);
     ppu->sprite_count = 0;
     ppu->sprite_zero_on_line = 0;
 
     int height = (ppu->ctrl & 0x20) ? 16 : 8;
+    if (ppu->oam_dirty || ppu->sprite_index_height != height) index_sprites(ppu, height);
 
-    for (int i = 0; i < 64; i++) {
-        int y = (int)ppu->oam[i * 4];   /* Y position (sprite drawn on scanlines y+1..y+height) */
-        int diff = target_scanline - (y + 1);
-        if (diff >= 0 && diff < height) {
-            if (ppu->sprite_count < 8) {
-                memcpy(&ppu->secondary_oam[ppu->sprite_count * 4], &ppu->oam[i * 4], 4);
-                if (i == 0) { ppu->sprite_zero_on_line = 1; ppu->dbg_sp0_eval_count++; }
-                ppu->sprite_count++;
-            } else {
-                ppu->status |= 0x20;   /* sprite overflow */
-                break;
-            }
-        }
+    int found = ppu->sprite_line_count[target_scanline];
+    const Byte *oam_index = ppu->sprite_line_oam[target_scanline];
+    for (int n = 0; n < found && n < 8; n++) {
+        int i = oam_index[n];
+        memcpy(&ppu->secondary_oam[n * 4], &ppu->oam[i * 4], 4);
+        if (i == 0) { ppu->sprite_zero_on_line = 1; TRACE_SP0_EVAL(); }
     }
+    ppu->sprite_count = found < 8 ? found : 8;
+    if (found > 8) ppu->status |= 0x20;   /* sprite overflow */
 }
 
 static void fetch_sprites(PPU *ppu, int target_scanline) {
@@ -389,11 +479,21 @@ static void fetch_sprites(PPU *ppu, int target_scanline) {
         Byte lo = ppu_vram_read(ppu, pat_addr);
         Byte hi = ppu_vram_read(ppu, pat_addr + 8);
 
+        ChrRow decoded;
+        const ChrRow *bank = ppu->mapper->chr_rows[pat_addr >> 10];
+        if (bank) decoded = bank[((pat_addr & 0x03FF) >> 4) * 8 + (pat_addr & 7)];
+        else      chr_decode_row(&decoded, lo, hi);
+
         if (attr & 0x40) {   /* horizontal flip */
             /* Reverse bits */
             lo = (Byte)(((lo * 0x0802LU & 0x22110LU) | (lo * 0x8020LU & 0x88440LU)) * 0x10101LU >> 16);
             hi = (Byte)(((hi * 0x0802LU & 0x22110LU) | (hi * 0x8020LU & 0x88440LU)) * 0x10101LU >> 16);
+            for (int c = 0; c < 8; c++) ppu->sprite_row[i].pixel[c] = decoded.pixel[7 - c];
+        } else {
+            ppu->sprite_row[i] = decoded;
         }
+        ppu->sprite_row_lo[i] = lo;
+        ppu->sprite_row_hi[i] = hi;
 
         ppu->sprite_shift_lo[i] = lo;
         ppu->sprite_shift_hi[i] = hi;
@@ -402,77 +502,458 @@ static void fetch_sprites(PPU *ppu, int target_scanline) {
     }
 }
 
-/* ── Main tick ────────────────────────────────────────────────────────────── */
+/* ── Dot schedule ─────────────────────────────────────────────────────────── */
 
-void ppu_tick(PPU *ppu) {
-    int sl  = ppu->scanline;
-    int dot = ppu->dot;
-    int rendering = (ppu->mask & 0x18) != 0;  /* BG or sprite enabled */
+/* Scanlines fall into five classes, each with the same work on the same
+   dots every time */
+enum {
+    LINE_VISIBLE,        /* 0-239 */
+    LINE_POST_RENDER,    /* 240 */
+    LINE_VBLANK_START,   /* 241 */
+    LINE_VBLANK,         /* 242-260 */
+    LINE_PRE_RENDER,     /* 261 */
+};
 
-    /* ── Pre-render scanline (261) ── */
-    if (sl == 261) {
-        if (dot == 1) {
-            ppu->status &= ~0xE0;   /* clear vblank, sprite-0, overflow */
-            memset(ppu->sprite_shift_lo, 0, 8);
-            memset(ppu->sprite_shift_hi, 0, 8);
-            ppu->dbg_sp0_eval_count = 0;
-            ppu->dbg_sp0_hit_count = 0;
-        }
-        if (rendering && dot >= 280 && dot <= 304) {
-            copy_vertical(ppu);
+/* Per-dot actions, in the order ppu_tick and render_dot carry them out */
+#define PPU_ACT_CLEAR_FLAGS    0x0001   /* pre-render dot 1: PPUSTATUS bits 7-5 */
+#define PPU_ACT_COPY_V         0x0002
+#define PPU_ACT_DRAW_LINE      0x0004   /* scanline renderer's chance at the line */
+#define PPU_ACT_SHIFT_BG       0x0008
+#define PPU_ACT_SHIFT_SPRITES  0x0010
+#define PPU_ACT_FETCH_NT       0x0020   /* with the shifter reload */
+#define PPU_ACT_FETCH_AT       0x0040
+#define PPU_ACT_FETCH_LO       0x0080
+#define PPU_ACT_FETCH_HI       0x0100
+#define PPU_ACT_INC_X          0x0200
+#define PPU_ACT_INC_Y          0x0400
+#define PPU_ACT_COPY_H         0x0800   /* with the shifter reload */
+#define PPU_ACT_EVAL_SPRITES   0x1000
+#define PPU_ACT_FETCH_SPRITES  0x2000
+#define PPU_ACT_PIXEL          0x4000
+#define PPU_ACT_SET_VBLANK     0x8000
+#define PPU_ACT_RENDER         0x7FF8   /* render_dot's share */
+
+static int line_class(int sl) {
+    if (sl < 240)  return LINE_VISIBLE;
+    if (sl == 261) return LINE_PRE_RENDER;
+    if (sl == 241) return LINE_VBLANK_START;
+    return sl == 240 ? LINE_POST_RENDER : LINE_VBLANK;
+}
+
+/* What a dot of a line class does. The scroll updates (INC_X, INC_Y,
+   COPY_H, COPY_V) only happen while rendering is on. */
+static Word dot_actions(int cls, int dot) {
+    Word act = 0;
+    if (cls != LINE_VISIBLE && cls != LINE_PRE_RENDER) {
+        if (cls == LINE_VBLANK_START && dot == 1) act |= PPU_ACT_SET_VBLANK;
+        return act;
+    }
+    int visible = cls == LINE_VISIBLE;
+
+    if (!visible && dot == 1) act |= PPU_ACT_CLEAR_FLAGS;
+    if (!visible && dot >= 280 && dot <= 304) act |= PPU_ACT_COPY_V;
+    if (visible && dot == 1) act |= PPU_ACT_DRAW_LINE;
+
+    /* Shift registers and tile fetches (dots 2–257, 322–337) */
+    if ((dot >= 2 && dot <= 257) || (dot >= 321 && dot <= 337)) {
+        act |= PPU_ACT_SHIFT_BG;
+        /* sprite X counters/shifters only during visible pixel output */
+        if (visible && dot <= 257) act |= PPU_ACT_SHIFT_SPRITES;
+        switch (dot & 0x07) {
+            case 1: act |= PPU_ACT_FETCH_NT; break;
+            case 3: act |= PPU_ACT_FETCH_AT; break;
+            case 5: act |= PPU_ACT_FETCH_LO; break;
+            case 7: act |= PPU_ACT_FETCH_HI; break;
+            case 0: act |= PPU_ACT_INC_X;    break;
         }
     }
+    if (dot == 256) act |= PPU_ACT_INC_Y;
+    if (dot == 257) act |= PPU_ACT_COPY_H;
 
-    /* ── Visible scanlines (0–239) ── */
-    if (sl <= 239 || sl == 261) {
-        /* Shift registers (dots 2–257, 322–337) */
-        if ((dot >= 2 && dot <= 257) || (dot >= 321 && dot <= 337)) {
-            shift_bg(ppu);
-
-            /* Sprite X counters/shifters only during visible pixel output */
-            if (sl < 240 && dot <= 257) {
-                for (int i = 0; i < ppu->sprite_count; i++) {
-                    if (ppu->sprite_x[i] > 0) {
-                        ppu->sprite_x[i]--;
-                    } else {
-                        ppu->sprite_shift_lo[i] <<= 1;
-                        ppu->sprite_shift_hi[i] <<= 1;
-                    }
-                }
-            }
+    /* sprite evaluation / fetch for the next line at the end of this one */
+    if (visible && dot == 257) act |= PPU_ACT_EVAL_SPRITES;
+    if (visible && dot == 320) act |= PPU_ACT_FETCH_SPRITES;
+    if (visible && dot >= 1 && dot <= 256) act |= PPU_ACT_PIXEL;
+    return act;
+}
+
+static void build_schedule(PPU *ppu) {
+    for (int cls = 0; cls < PPU_LINE_CLASSES; cls++) {
+        for (int dot = 0; dot < 341; dot++) ppu->schedule[cls][dot] = dot_actions(cls, dot);
+        /* runs of dots with nothing to do, stopping short of dot 340,
+           whose tick moves on to the next line */
+        ppu->idle_run[cls][340] = 0;
+        for (int dot = 339; dot >= 0; dot--)
+            ppu->idle_run[cls][dot] = ppu->schedule[cls][dot] ? 0 : ppu->idle_run[cls][dot + 1] + 1;
+    }
+}
+
+/* ── Dot renderer ─────────────────────────────────────────────────────────── */
 
-            switch (dot & 0x07) {
-                case 1: load_bg_shifters(ppu);  fetch_nt(ppu);    break;
-                case 3: fetch_at(ppu);                             break;
-                case 5: fetch_bg_lo(ppu);                         break;
-                case 7: fetch_bg_hi(ppu);                         break;
-                case 0: if (rendering) increment_coarse_x(ppu);   break;
+/* Background, sprite and pixel work for one dot of a visible or pre-render
+   scanline, act being its schedule entry */
+static void render_dot(PPU *ppu, Word act, int rendering) {
+    if (act & PPU_ACT_SHIFT_BG) shift_bg(ppu);
+    if (act & PPU_ACT_SHIFT_SPRITES) {
+        for (int i = 0; i < ppu->sprite_count; i++) {
+            if (ppu->sprite_x[i] > 0) {
+                ppu->sprite_x[i]--;
+            } else {
+                ppu->sprite_shift_lo[i] <<= 1;
+                ppu->sprite_shift_hi[i] <<= 1;
             }
         }
+    }
 
-        if (dot == 256 && rendering) increment_y(ppu);
-        if (dot == 257 && rendering) {
+    if (act & PPU_ACT_FETCH_NT) { load_bg_shifters(ppu); fetch_nt(ppu); }
+    if (act & PPU_ACT_FETCH_AT) fetch_at(ppu);
+    if (act & PPU_ACT_FETCH_LO) fetch_bg_lo(ppu);
+    if (act & PPU_ACT_FETCH_HI) fetch_bg_hi(ppu);
+    if (rendering) {
+        if (act & PPU_ACT_INC_X) increment_coarse_x(ppu);
+        if (act & PPU_ACT_INC_Y) increment_y(ppu);
+        if (act & PPU_ACT_COPY_H) {
             copy_horizontal(ppu);
             load_bg_shifters(ppu);
         }
+    }
 
-        /* Sprite evaluation / fetch at end of visible scanline */
-        if (sl < 240) {
-            if (dot == 257) evaluate_sprites(ppu, sl + 1);  /* prepare next scanline */
-            if (dot == 320) fetch_sprites(ppu, sl + 1);
+    if (act & PPU_ACT_EVAL_SPRITES)  evaluate_sprites(ppu, ppu->scanline + 1);
+    if (act & PPU_ACT_FETCH_SPRITES) fetch_sprites(ppu, ppu->scanline + 1);
+    if (act & PPU_ACT_PIXEL)         compose_pixel(ppu);
+}
+
+/* ── Scanline renderer ────────────────────────────────────────────────────── */
+
+static void save_pipeline(const PPU *ppu, PpuPipeline *p) {
+    p->v           = ppu->v;
+    p->nt_latch    = ppu->nt_latch;
+    p->at_latch    = ppu->at_latch;
+    p->bg_lo_latch = ppu->bg_lo_latch;
+    p->bg_hi_latch = ppu->bg_hi_latch;
+    p->bg_shift_lo = ppu->bg_shift_lo;
+    p->bg_shift_hi = ppu->bg_shift_hi;
+    p->at_shift_lo = ppu->at_shift_lo;
+    p->at_shift_hi = ppu->at_shift_hi;
+    p->at_latch_lo = ppu->at_latch_lo;
+    p->at_latch_hi = ppu->at_latch_hi;
+    memcpy(p->sprite_shift_lo, ppu->sprite_shift_lo, 8);
+    memcpy(p->sprite_shift_hi, ppu->sprite_shift_hi, 8);
+    memcpy(p->sprite_x, ppu->sprite_x, 8);
+    p->sprite_zero_rendered = ppu->sprite_zero_rendered;
+}
+
+static void load_pipeline(PPU *ppu, const PpuPipeline *p) {
+    ppu->v           = p->v;
+    ppu->nt_latch    = p->nt_latch;
+    ppu->at_latch    = p->at_latch;
+    ppu->bg_lo_latch = p->bg_lo_latch;
+    ppu->bg_hi_latch = p->bg_hi_latch;
+    ppu->bg_shift_lo = p->bg_shift_lo;
+    ppu->bg_shift_hi = p->bg_shift_hi;
+    ppu->at_shift_lo = p->at_shift_lo;
+    ppu->at_shift_hi = p->at_shift_hi;
+    ppu->at_latch_lo = p->at_latch_lo;
+    ppu->at_latch_hi = p->at_latch_hi;
+    memcpy(ppu->sprite_shift_lo, p->sprite_shift_lo, 8);
+    memcpy(ppu->sprite_shift_hi, p->sprite_shift_hi, 8);
+    memcpy(ppu->sprite_x, p->sprite_x, 8);
+    ppu->sprite_zero_rendered = p->sprite_zero_rendered;
+}
+
+#if defined(__GNUC__)
+#if defined(__AVX2__)
+#define PIXEL_VEC 32
+#else
+#define PIXEL_VEC 16
+#endif
+/* One byte per pixel. Comparisons yield 0x00/0xFF per pixel. */
+typedef Byte PixelVec __attribute__((vector_size(PIXEL_VEC)));
+
+static PixelVec pixel_load(const Byte *p) {
+    PixelVec v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Index of the first pixel set in m, -1 if none */
+static int pixel_first(PixelVec m) {
+    uint64_t w[PIXEL_VEC / 8];
+    memcpy(w, &m, sizeof(w));
+    uint64_t any = 0;
+    for (int i = 0; i < PIXEL_VEC / 8; i++) any |= w[i];
+    if (!any) return -1;
+    Byte b[PIXEL_VEC];
+    memcpy(b, &m, sizeof(b));
+    for (int i = 0; ; i++)
+        if (b[i]) return i;
+}
+#endif
+
+/* Composite a line as compose_pixel would dot by dot, from the background
+   pixels (0-3) and palettes (0-3) under dots 1-256 and the sprite buffer
+   draw_line builds. Returns the dot of the sprite-0 hit, 0 if none. The
+   palette indices are worked out PIXEL_VEC pixels at a time, then looked
+   up in palette_out; with row NULL only the hit is worked out. */
+static int compose_line(PPU *ppu, const Byte *bg_px, const Byte *bg_pal,
+                        const Byte *sp, uint16_t *row) {
+    Byte bg_on = ppu->mask & 0x08;
+    Byte sp_on = ppu->mask & 0x10;
+    int hit_ok = ppu->sprite_zero_on_line && bg_on && sp_on;
+    int hit_dot = 0;
+
+    Byte idx[256];
+#if defined(__GNUC__)
+    /* What each pixel keeps: left-edge clipping only touches the first 8 */
+    PixelVec keep_bg, keep_sp, keep_hit;
+    for (int i = 0; i < PIXEL_VEC; i++) {
+        keep_bg[i]  = bg_on && (i >= 8 || (ppu->mask & 0x02)) ? 0xFF : 0x00;
+        keep_sp[i]  = sp_on && (i >= 8 || (ppu->mask & 0x04)) ? 0xFF : 0x00;
+        keep_hit[i] = hit_ok && (i >= 8 || (ppu->mask & 0x06)) ? 0xFF : 0x00;
+    }
+    for (int col = 0; col < 256; col += PIXEL_VEC) {
+        PixelVec b  = pixel_load(&bg_px[col]);
+        PixelVec bg = (b | ((PixelVec)(b != 0) & (pixel_load(&bg_pal[col]) << 2))) & keep_bg;
+        PixelVec s  = pixel_load(&sp[col]) & keep_sp;
+        PixelVec front = (PixelVec)(s != 0) &
+                         ((PixelVec)(bg == 0) | (PixelVec)((s & 0x20) == 0));
+        PixelVec out = (front & ((s & 0x0F) | 0x10)) | (~front & bg);
+        memcpy(&idx[col], &out, sizeof(out));
+
+        if (!hit_dot) {
+            int first = pixel_first((PixelVec)((s & 0x80) != 0) & (PixelVec)(bg != 0) & keep_hit);
+            if (first >= 0) hit_dot = col + first + 1;
+        }
+        if (col == 0) {   /* the rest of the line is unclipped */
+            for (int i = 0; i < 8; i++) {
+                keep_bg[i]  = keep_bg[8];
+                keep_sp[i]  = keep_sp[8];
+                keep_hit[i] = keep_hit[8];
+            }
         }
     }
+#else
+    for (int col = 0; col < 256; col++) {
+        int dot = col + 1;
+        Byte bg = 0;
+        if (bg_on && (dot > 8 || (ppu->mask & 0x02))) {
+            bg = bg_px[col];
+            if (bg) bg |= bg_pal[col] << 2;
+        }
+        Byte s = 0;
+        if (sp_on && (dot > 8 || (ppu->mask & 0x04))) s = sp[col];
+
+        if ((s & 0x80) && bg && hit_ok && (dot >= 9 || (ppu->mask & 0x06)) && !hit_dot)
+            hit_dot = dot;
 
-    /* ── Pixel output (visible scanlines, dots 1–256) ── */
-    if (sl < 240 && dot >= 1 && dot <= 256) {
-        compose_pixel(ppu);
+        if (s && (!bg || !(s & 0x20))) idx[col] = 0x10 | (s & 0x0F);
+        else                            idx[col] = bg;
     }
+#endif
+    if (!row) return hit_dot;
+
+    for (int col = 0; col < 256; col++) row[col] = ppu->palette_out[idx[col]];
+    return hit_dot;
+}
+
+/* Forced blank shows the backdrop across the whole line */
+static void fill_line(uint16_t *row, uint16_t value) {
+#if defined(__GNUC__)
+    typedef uint16_t FillVec __attribute__((vector_size(32)));
+    FillVec v = { 0 };
+    v += value;
+    for (int col = 0; col < 256; col += 16) memcpy(&row[col], &v, sizeof(v));
+#else
+    for (int col = 0; col < 256; col++) row[col] = value;
+#endif
+}
+
+/* Moves v on by n coarse X steps (n < 32), as n increment_coarse_x calls */
+static void advance_coarse_x(PPU *ppu, int n) {
+    int coarse = (ppu->v & 0x001F) + n;
+    if (coarse > 31) ppu->v ^= 0x0400;
+    ppu->v = (Word)((ppu->v & ~0x001F) | (coarse & 0x1F));
+}
 
-    /* ── VBlank ── */
-    if (sl == 241 && dot == 1) {
-        ppu->status |= 0x80;   /* set vblank flag */
-        if (ppu->ctrl & 0x80) {
-            ppu->nmi_output = 1;
+/*
+ * Draws dots 1–256 of the current visible line in one go, as render_dot
+ * would given that nothing changes meanwhile: same fetches in the same
+ * order, same pixels, and the pipeline left as it is after dot 256.
+ * Sprite-0 hit is only recorded in line_hit_dot for ppu_tick to set on
+ * time. Returns 0 without drawing when the mapper counts CHR fetches,
+ * which have to happen at their own dots. Lines in forced blank, and
+ * collision-only lines sprite 0 cannot hit, skip the pixels and fetch
+ * just the last three tiles, the only ones the pipeline keeps; nothing
+ * else sees the fetches.
+ */
+static int draw_line(PPU *ppu, int rendering) {
+    if (ppu->mapper->ops->ppu_a12_tick) return 0;
+
+    save_pipeline(ppu, &ppu->line_start);
+
+    int collision = ppu->output == PPU_OUTPUT_COLLISION;
+    int pixels = rendering &&
+                 (!collision || (ppu->sprite_zero_on_line && (ppu->mask & 0x18) == 0x18));
+
+    /* Background bit planes as one stream: the two tiles already in the
+       shifters, then the 31 loaded at dots 9, 17, ..., 249 from the
+       latches fetched the 8 dots before. Dot d shows bit d - 1 + x.
+       The same stream is laid out a pixel (0-3) and a palette per byte
+       in px/pal, the fetched tiles copied from the mapper's decoded rows. */
+    Byte lo[33], hi[33], at_lo[33], at_hi[33];
+    Byte px[33 * 8], pal[33 * 8];
+    lo[0]    = ppu->bg_shift_lo >> 8;  lo[1]    = ppu->bg_shift_lo & 0xFF;
+    hi[0]    = ppu->bg_shift_hi >> 8;  hi[1]    = ppu->bg_shift_hi & 0xFF;
+    at_lo[0] = ppu->at_shift_lo >> 8;  at_lo[1] = ppu->at_shift_lo & 0xFF;
+    at_hi[0] = ppu->at_shift_hi >> 8;  at_hi[1] = ppu->at_shift_hi & 0xFF;
+    for (int p = 0; pixels && p < 16; p++) {
+        int bit = 7 - (p & 7);
+        px[p]  = ((lo[p >> 3] >> bit) & 1) | (((hi[p >> 3] >> bit) & 1) << 1);
+        pal[p] = ((at_lo[p >> 3] >> bit) & 1) | (((at_hi[p >> 3] >> bit) & 1) << 1);
+    }
+    const ChrRow *const *rows = ppu->mapper->chr_rows;
+    Word base = (ppu->ctrl & 0x10) ? 0x1000 : 0x0000;
+    Word fine_y = (ppu->v >> 12) & 0x07;
+    int k = 0;
+    if (!pixels) {
+        k = 29;
+        if (rendering) advance_coarse_x(ppu, k);
+    }
+    for (; k < 32; k++) {
+        if (k > 0) {   /* dot 1 skips the nametable fetch */
+            lo[k + 1]    = ppu->bg_lo_latch;
+            hi[k + 1]    = ppu->bg_hi_latch;
+            at_lo[k + 1] = (ppu->at_latch & 1) ? 0xFF : 0x00;
+            at_hi[k + 1] = (ppu->at_latch & 2) ? 0xFF : 0x00;
+            fetch_nt(ppu);
+        }
+        fetch_at(ppu);
+        fetch_bg_lo(ppu);
+        fetch_bg_hi(ppu);
+        if (rendering) increment_coarse_x(ppu);
+
+        if (pixels && k < 31) {   /* the tile just fetched, shown from position k + 2 */
+            Byte *out = &px[(k + 2) * 8];
+            Word addr = base + ((Word)ppu->nt_latch << 4) + fine_y;
+            const ChrRow *bank = rows[addr >> 10];
+            if (bank) {
+                memcpy(out, bank[((addr & 0x03FF) >> 4) * 8 + fine_y].pixel, 8);
+            } else {
+                ChrRow row;
+                chr_decode_row(&row, ppu->bg_lo_latch, ppu->bg_hi_latch);
+                memcpy(out, row.pixel, 8);
+            }
+            memset(&pal[(k + 2) * 8], ppu->at_latch, 8);
+        }
+    }
+    if (rendering) increment_y(ppu);
+
+    /* Shifters after dot 256: loaded at 249, then shifted 7 more times
+       if the background is on */
+    ppu->at_latch_lo = at_lo[32];
+    ppu->at_latch_hi = at_hi[32];
+    if (ppu->mask & 0x08) {
+        ppu->bg_shift_lo = (Word)(((lo[31] << 8) | lo[32]) << 7);
+        ppu->bg_shift_hi = (Word)(((hi[31] << 8) | hi[32]) << 7);
+        ppu->at_shift_lo = (Word)(((at_lo[31] << 8) | at_lo[32]) << 7);
+        ppu->at_shift_hi = (Word)(((at_hi[31] << 8) | at_hi[32]) << 7);
+    } else {
+        ppu->bg_shift_lo = (Word)((lo[0] << 8) | lo[32]);
+        ppu->bg_shift_hi = (Word)((hi[0] << 8) | hi[32]);
+        ppu->at_shift_lo = (Word)((at_lo[0] << 8) | at_lo[32]);
+        ppu->at_shift_hi = (Word)((at_hi[0] << 8) | at_hi[32]);
+    }
+
+    /* Sprites, lowest slot on top: bits 0-1 pixel, 2-3 palette,
+       5 behind background, 7 slot 0. Collision only needs slot 0. */
+    Byte sp[256];
+    memset(sp, 0, sizeof(sp));
+    for (int i = ppu->sprite_count - 1; i >= 0; i--) {
+        int x0 = ppu->sprite_x[i];
+        Byte s_lo = ppu->sprite_shift_lo[i];
+        Byte s_hi = ppu->sprite_shift_hi[i];
+        Byte tag = ((ppu->sprite_attr[i] & 0x03) << 2) | (ppu->sprite_attr[i] & 0x20) |
+                   (i == 0 ? 0x80 : 0x00);
+        if (rendering && (!collision || i == 0)) {
+            /* The row fetch_sprites decoded, unless the shifters have
+               moved on since (rendering was off when this line's sprites
+               would have been fetched) */
+            ChrRow row;
+            if (s_lo == ppu->sprite_row_lo[i] && s_hi == ppu->sprite_row_hi[i])
+                row = ppu->sprite_row[i];
+            else
+                chr_decode_row(&row, s_lo, s_hi);
+            for (int col = x0; col < x0 + 8 && col < 256; col++) {
+                Byte pixel = row.pixel[col - x0];
+                if (pixel) sp[col] = tag | pixel;
+            }
+        }
+
+        /* counters run out after dot x0 + 1, then the shifters move */
+        int shifts = 255 - x0;
+        ppu->sprite_shift_lo[i] = shifts >= 8 ? 0 : (Byte)(s_lo << shifts);
+        ppu->sprite_shift_hi[i] = shifts >= 8 ? 0 : (Byte)(s_hi << shifts);
+        ppu->sprite_x[i] = 0;
+    }
+
+    uint16_t *row = ppu->output == PPU_OUTPUT_FULL ? &ppu->framebuffer[ppu->scanline * 256] : NULL;
+    ppu->line_hit_dot = pixels ? compose_line(ppu, &px[ppu->x], &pal[ppu->x], sp, row) : 0;
+    if (!rendering && row) fill_line(row, ppu->palette_out[0]);
+    Byte sp_on = ppu->mask & 0x10;
+    if (sp_on) ppu->sprite_zero_rendered = (sp[255] & 0x80) != 0;
+
+    return 1;
+}
+
+void ppu_sync(PPU *ppu) {
+    if (!ppu->line_fast) return;
+    ppu->line_fast = 0;
+
+    /* Rewind and redo the dots already ticked; the pixels from here on
+       get drawn again as the line goes on */
+    int rendering = (ppu->mask & 0x18) != 0;
+    const Word *act = ppu->schedule[LINE_VISIBLE];
+    load_pipeline(ppu, &ppu->line_start);
+    for (int dot = 1; dot < ppu->dot; dot++)
+        render_dot(ppu, act[dot], rendering);
+}
+
+/* ── Main tick ────────────────────────────────────────────────────────────── */
+
+void ppu_tick(PPU *ppu) {
+    int sl  = ppu->scanline;
+    int dot = ppu->dot;
+    int rendering = (ppu->mask & 0x18) != 0;  /* BG or sprite enabled */
+    Word act = ppu->schedule[line_class(sl)][dot];
+
+    if (act) {
+        if (act & PPU_ACT_CLEAR_FLAGS) {
+            ppu->status &= ~0xE0;   /* clear vblank, sprite-0, overflow */
+            memset(ppu->sprite_shift_lo, 0, 8);
+            memset(ppu->sprite_shift_hi, 0, 8);
+            TRACE_SP0_RESET();
+        }
+        if ((act & PPU_ACT_COPY_V) && rendering) copy_vertical(ppu);
+
+        if ((act & PPU_ACT_DRAW_LINE) && ppu->line_renderer)
+            ppu->line_fast = draw_line(ppu, rendering);
+
+        if (ppu->line_fast) {
+            /* already drawn; only the sprite-0 hit has a dot of its own */
+            if (dot == ppu->line_hit_dot) {
+                ppu->status |= 0x40;
+                TRACE_SP0_HIT();
+            }
+            if (dot == 256) ppu->line_fast = 0;
+        } else if (act & PPU_ACT_RENDER) {
+            render_dot(ppu, act, rendering);
+        }
+
+        if (act & PPU_ACT_SET_VBLANK) {
+            ppu->status |= 0x80;   /* set vblank flag */
+            if (ppu->ctrl & 0x80) {
+                ppu->nmi_output = 1;
+            }
         }
     }
 
@@ -496,16 +977,180 @@ void ppu_tick(PPU *ppu) {
     ppu->scanline = sl;
 }
 
+/* ── Idle horizon ─────────────────────────────────────────────────────────── */
+
+/* Ticks a visible line from dot 0 to 340 would leave things, given that
+   rendering stays off and the mapper does not watch CHR fetches: every
+   fetch is from the same v, the shifters only take their low bytes from
+   the latches, and the sprite counters run out before evaluation and
+   fetches for the next line */
+static void blank_line(PPU *ppu) {
+    if (ppu->output == PPU_OUTPUT_FULL)
+        fill_line(&ppu->framebuffer[ppu->scanline * 256], ppu->palette_out[0]);
+
+    fetch_nt(ppu);
+    fetch_at(ppu);
+    fetch_bg_lo(ppu);
+    fetch_bg_hi(ppu);
+    load_bg_shifters(ppu);
+
+    for (int i = 0; i < ppu->sprite_count; i++) {
+        int shifts = 256 - ppu->sprite_x[i];
+        ppu->sprite_shift_lo[i] = shifts >= 8 ? 0 : (Byte)(ppu->sprite_shift_lo[i] << shifts);
+        ppu->sprite_shift_hi[i] = shifts >= 8 ? 0 : (Byte)(ppu->sprite_shift_hi[i] << shifts);
+        ppu->sprite_x[i] = 0;
+    }
+    evaluate_sprites(ppu, ppu->scanline + 1);
+    fetch_sprites(ppu, ppu->scanline + 1);
+}
+
+int ppu_skip_blank_lines(PPU *ppu, int max) {
+    int done = 0;
+    for (;;) {
+        int sl  = ppu->scanline;
+        int dot = ppu->dot;
+        int left = 341 - dot;   /* ticks to the start of the next line */
+        if (left > max - done) break;
+
+        if (sl < 240) {
+            if (dot != 0 || (ppu->mask & 0x18) || ppu->mapper->ops->ppu_a12_tick) break;
+            blank_line(ppu);
+        } else if (sl == 261 || (sl == 241 && dot <= 1)) {
+            break;   /* pre-render clear, VBlank start */
+        }
+        /* line 240 and the rest of VBlank have nothing to do */
+        ppu->dot = 0;
+        ppu->scanline = sl + 1;
+        done += left;
+    }
+    return done;
+}
+
+int ppu_skip_idle_dots(PPU *ppu, int max) {
+    int dot = ppu->dot;
+    int n = ppu->idle_run[line_class(ppu->scanline)][dot];
+
+    /* the rest of a line drawn ahead only waits on sprite-0 hit and dot 256 */
+    if (ppu->line_fast && dot >= 2 && dot < 256) {
+        int end = 256;
+        if (ppu->line_hit_dot >= dot && ppu->line_hit_dot < end) end = ppu->line_hit_dot;
+        n = end - dot;
+    }
+
+    if (n > max) n = max;
+    if (n <= 0) return 0;
+    ppu->dot += n;
+    return n;
+}
+
+#define DOTS_PER_FRAME (262 * 341)
+
+/* Ticks from the current position until the tick that processes (sl, dot) */
+static int dots_until(const PPU *ppu, int sl, int dot) {
+    int d = (sl * 341 + dot) - (ppu->scanline * 341 + ppu->dot);
+    return d < 0 ? d + DOTS_PER_FRAME : d;
+}
+
+int ppu_frame_dots_left(const PPU *ppu) {
+    return dots_until(ppu, 261, 340) + 1;
+}
+
+int ppu_interrupt_dots(const PPU *ppu) {
+    int quiet = dots_until(ppu, 241, 1);   /* VBlank NMI */
+
+    /* MMC3-style IRQ counters are clocked by pattern fetches */
+    if (ppu->mapper && ppu->mapper->ops->ppu_a12_tick) {
+        if (ppu->scanline < 240 || ppu->scanline == 261) return 0;
+        int d = dots_until(ppu, 261, 0);
+        if (d < quiet) quiet = d;
+    }
+    return quiet;
+}
+
+int ppu_quiet_dots(const PPU *ppu) {
+    int sl  = ppu->scanline;
+    int dot = ppu->dot;
+
+    /* MMC3-style counters are clocked by pattern fetches, which run on
+       every visible and pre-render scanline */
+    if (ppu->mapper && ppu->mapper->ops->ppu_a12_tick && (sl < 240 || sl == 261))
+        return 0;
+
+    /* VBlank set (and NMI), then the pre-render clear of bits 7-5 */
+    int quiet = dots_until(ppu, 241, 1);
+    int d = dots_until(ppu, 261, 1);
+    if (d < quiet) quiet = d;
+
+    int height = (ppu->ctrl & 0x20) ? 16 : 8;
+
+    /* Sprite-0 hit. sprite_zero_on_line describes the line being drawn, or
+       after dot 257 the next one (line 0 once the frame's output is done);
+       later lines follow from sprite 0's Y. */
+    if (!(ppu->status & 0x40) && (ppu->mask & 0x18) == 0x18) {
+        int line = (sl < 240 && dot <= 257) ? sl : (sl < 239 ? sl + 1 : 0);
+        if (ppu->sprite_zero_on_line) {
+            if (line == sl) return 0;
+            d = dots_until(ppu, line, 1);
+            if (d < quiet) quiet = d;
+        }
+        int first = (int)ppu->oam[0] + 1;
+        if (first <= line) first = line + 1;
+        if (first <= 239 && first <= (int)ppu->oam[0] + height) {
+            d = dots_until(ppu, first, 1);
+            if (d < quiet) quiet = d;
+        }
+    }
+
+    /* Sprite overflow, set by the evaluation at dot 257 of the line before
+       one with more than eight sprites */
+    if (!(ppu->status & 0x20)) {
+        Byte own_count[241];
+        const Byte *count = ppu->sprite_line_count;
+        int visible = 9;
+        if (ppu->oam_dirty || ppu->sprite_index_height != height) {
+            /* the sprite index is out of date until the next evaluation */
+            visible = 0;
+            for (int i = 0; i < 64; i++) visible += ppu->oam[i * 4] < 240;
+            memset(own_count, 0, sizeof(own_count));
+            for (int i = 0; visible > 8 && i < 64; i++) {
+                int y = ppu->oam[i * 4];
+                for (int row = y + 1; row <= y + height && row <= 240; row++)
+                    own_count[row]++;
+            }
+            count = own_count;
+        }
+        if (visible > 8) {
+            int eval = (sl < 240 && dot <= 257) ? sl : (sl < 239 ? sl + 1 : 0);
+            for (; eval < 240; eval++) {
+                if (count[eval + 1] > 8) {
+                    d = dots_until(ppu, eval, 257);
+                    if (d < quiet) quiet = d;
+                    break;
+                }
+            }
+        }
+    }
+
+    /* one dot of slack for the odd-frame skip at the start of line 0 */
+    return quiet > 0 ? quiet - 1 : 0;
+}
+
 /* ── Lifecycle ────────────────────────────────────────────────────────────── */
 
 void ppu_init(PPU *ppu, Mapper *mapper) {
     memset(ppu, 0, sizeof(PPU));
     ppu->mapper = mapper;
-    ppu->mirror = (MirrorMode)mapper->cart->mirroring;
+    mapper->mirroring_listener = update_mirroring;
+    mapper->mirroring_ctx      = ppu;
+    update_mirroring(mapper, ppu);
     ppu->scanline = 0;
     ppu->dot = 0;
     ppu->frame = 0;
     ppu->frame_done = 0;
+    ppu->line_renderer = 1;
+    ppu->oam_dirty = 1;
+    ppu_update_palette(ppu);
+    build_schedule(ppu);
 }
 
 void ppu_reset(PPU *ppu) {
@@ -517,8 +1162,13 @@ void ppu_reset(PPU *ppu) {
     ppu->scanline = 0;
     ppu->dot = 0;
     ppu->frame_done = 0;
+    ppu->line_fast = 0;
     memset(ppu->sprite_shift_lo, 0, 8);
     memset(ppu->sprite_shift_hi, 0, 8);
+    memset(ppu->sprite_row, 0, sizeof(ppu->sprite_row));
+    memset(ppu->sprite_row_lo, 0, 8);
+    memset(ppu->sprite_row_hi, 0, 8);
+    ppu_update_palette(ppu);
 }
 
 int ppu_frame_complete(PPU *ppu) {
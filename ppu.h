@@ -13,6 +13,32 @@ typedef enum {
     MIRROR_FOUR_SCREEN  = 4,
 } MirrorMode;
 
+/* Visible, post-render, VBlank start, VBlank and pre-render lines */
+#define PPU_LINE_CLASSES 5
+
+/* Background and sprite pipeline: everything drawing dots 1-256 of a
+   visible line changes, apart from PPUSTATUS and the framebuffer */
+typedef struct {
+    Word v;
+    Byte nt_latch, at_latch, bg_lo_latch, bg_hi_latch;
+    Word bg_shift_lo, bg_shift_hi;
+    Word at_shift_lo, at_shift_hi;
+    Byte at_latch_lo, at_latch_hi;
+    Byte sprite_shift_lo[8];
+    Byte sprite_shift_hi[8];
+    Byte sprite_x[8];
+    Byte sprite_zero_rendered;
+} PpuPipeline;
+
+/* How much of a frame's picture to work out. Anything a game can see
+   (PPUSTATUS, NMI, mapper counters, VRAM and the pipeline) comes out the
+   same under every policy; only the framebuffer differs. */
+typedef enum {
+    PPU_OUTPUT_FULL      = 0,   /* draw every pixel */
+    PPU_OUTPUT_COLLISION = 1,   /* draw nothing, work out only what
+                                   sprite-0 hit needs: for skipped frames */
+} PpuOutput;
+
 typedef struct {
     /* CPU-facing registers */
     Byte ctrl;        /* 0x2000 PPUCTRL  (write-only) */
@@ -30,8 +56,14 @@ typedef struct {
     Byte data_buf;
 
     /* Internal VRAM */
-    Byte nametable[2][0x0400];   /* 2KB physical nametable RAM */
+    Byte nametable[4][0x0400];   /* 2KB console VRAM, then 2KB on four-screen carts */
+    Byte *nt_page[4];            /* $2000/$2400/$2800/$2C00 as mirrored */
     Byte palette[32];            /* palette RAM */
+    /* Framebuffer value for each palette entry as compositing reads it:
+       mirrors resolved, PPUMASK greyscale and emphasis applied. Palette
+       writes and PPUMASK keep it current; anything writing palette[] or
+       mask directly calls ppu_update_palette. */
+    uint16_t palette_out[32];
     Byte oam[256];               /* primary OAM: 64 sprites × 4 bytes */
 
     /* Scanline/dot position */
@@ -62,39 +94,123 @@ typedef struct {
     Byte sprite_shift_hi[8];
     Byte sprite_attr[8];             /* attribute byte per sprite slot */
     Byte sprite_x[8];                /* X counter per sprite slot */
+    /* Each slot's pattern row as fetched, a pixel per byte and already
+       flipped, and the shifter bytes it was fetched as: draw_line takes
+       the row while the shifters still hold those bytes. */
+    ChrRow sprite_row[8];
+    Byte sprite_row_lo[8];
+    Byte sprite_row_hi[8];
     Byte sprite_zero_on_line;        /* sprite 0 is in secondary OAM this scanline */
     Byte sprite_zero_rendered;       /* sprite 0 pixel is being composited this dot */
 
+    /* Sprites covering each line up to 240 (evaluated on line 239, never
+       drawn), by OAM index in OAM order, as far as the 9th (which only sets
+       overflow). Rebuilt before the next evaluation once oam_dirty is set
+       or the sprite height changes; anything writing a Y byte in oam[]
+       directly sets oam_dirty. */
+    Byte sprite_line_count[241];
+    Byte sprite_line_oam[241][9];
+    Byte sprite_index_height;
+    Byte oam_dirty;
+
     /* NMI output latch (read by CPU as nmi_pending) */
     Byte nmi_output;
 
-    /* Framebuffer: ARGB8888, 256×240, row-major */
-    uint32_t framebuffer[256 * 240];
+    /* Framebuffer: 256×240, row-major, one colour per pixel as the PPU
+       outputs it: palette index in bits 0-5 and the PPUMASK emphasis bits
+       (red, green, blue) in bits 6-8. ppu_convert_frame turns it into
+       ARGB8888 for display. */
+    uint16_t framebuffer[256 * 240];
 
     /* Mapper reference for CHR access */
     Mapper *mapper;
 
-    /* Mirroring mode (derived from mapper/cart at init) */
+    /* Mirroring mode, kept in step with the mapper along with nt_page */
     MirrorMode mirror;
 
     /* Internal flag: frame just completed (cleared after ppu_frame_complete) */
     Byte frame_done;
 
-    /* Debug: count scanlines where sprite 0 was found this frame */
-    int dbg_sp0_eval_count;
-    int dbg_sp0_hit_count;
+    /* Scanline renderer: at dot 1 of a visible line, draw the whole line
+       at once and leave the pipeline as dot 256 would. Anything that could
+       change the picture before then (see ppu_sync) rewinds to line_start
+       and finishes the line dot by dot. */
+    Byte line_renderer;      /* on by default; 0 draws every line dot by dot */
+    Byte line_fast;          /* dots 1-256 of this line were drawn ahead */
+    int  line_hit_dot;       /* dot that sets sprite-0 hit on it, 0 if none */
+    PpuPipeline line_start;  /* pipeline as it was at dot 1 */
+
+    /* Dot schedule, built by ppu_init: what each dot of each class of
+       scanline does (a mask of PPU_ACT_* in ppu.c), and how many dots
+       from there on in the line do nothing at all */
+    Word schedule[PPU_LINE_CLASSES][341];
+    Word idle_run[PPU_LINE_CLASSES][341];
+
+    /* Render policy (PpuOutput), read at every line and dot, so set it
+       between frames. With anything but PPU_OUTPUT_FULL the framebuffer
+       keeps whatever it held; the next full frame redraws all of it. */
+    Byte output;
 } PPU;
 
 /* Lifecycle */
 void ppu_init(PPU *ppu, Mapper *mapper);
 void ppu_reset(PPU *ppu);
 
+/* Rebuild palette_out from palette[] and mask */
+void ppu_update_palette(PPU *ppu);
+
 /* Advance one PPU dot */
 void ppu_tick(PPU *ppu);
 
 /* Returns 1 (and clears flag) if a frame just completed. Call after every tick. */
 int ppu_frame_complete(PPU *ppu);
 
+/* Number of upcoming ticks that cannot change PPUSTATUS, raise NMI or clock
+   a mapper's scanline counter, as long as the CPU touches nothing but $2002
+   meanwhile. Lets the CPU fast-forward loops that only wait on those. */
+int ppu_quiet_dots(const PPU *ppu);
+
+/* Number of upcoming ticks that cannot raise NMI or clock a mapper's
+   scanline counter (and so its IRQ), as long as the CPU does not touch
+   the PPU meanwhile. */
+int ppu_interrupt_dots(const PPU *ppu);
+
+/* Move on by up to max dots in which ppu_tick would do nothing but count,
+   without leaving the current line. Returns how many; 0 if the next tick
+   has work. */
+int ppu_skip_idle_dots(PPU *ppu, int max);
+
+/* Move on by whole lines, up to max dots, while ticking through them needs
+   nothing more than a few fetches: visible lines in forced blank (from
+   dot 0, on a mapper that does not count CHR fetches), line 240 and
+   VBlank, stopping short of the VBlank flag and the pre-render line.
+   Returns how many dots; 0 if the current line does not qualify. */
+int ppu_skip_blank_lines(PPU *ppu, int max);
+
+/* Ticks left in the current frame, counting the one that completes it */
+int ppu_frame_dots_left(const PPU *ppu);
+
+/* Hand the current line back to the dot renderer before a change the
+   scanline renderer cannot have seen coming. PPU register accesses do this
+   themselves; the bus calls it before mapper writes, which may switch CHR
+   banks or mirroring. */
+void ppu_sync(PPU *ppu);
+
+/* Colour tables for ppu_convert_frame: ARGB8888 for every framebuffer
+   value, i.e. 64 colours for each of the 8 emphasis settings */
+#define PPU_COLORS 512
+
+/* The built-in palette, with emphasis applied to it */
+void ppu_default_colors(uint32_t colors[PPU_COLORS]);
+
+/* Load a .pal file: 64 RGB triplets, emphasis then worked out as for the
+   built-in palette, or all 512. Returns -1 if the file cannot be read or
+   is neither size, leaving colors as it was. */
+int ppu_load_palette(uint32_t colors[PPU_COLORS], const char *path);
+
+void ppu_convert_frame(const uint16_t *frame, uint32_t *argb,
+                       const uint32_t colors[PPU_COLORS]);
+
 /* CPU-facing register I/O — called by bus.c */
 Byte ppu_reg_read (PPU *ppu, Byte reg);   /* reg = addr & 0x07 */
 void ppu_reg_write(PPU *ppu, Byte reg, Byte data);
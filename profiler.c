@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler.h"
+#include "bus.h"
+#include "opcodes.h"
+
+#ifndef NES_PROFILE
+
+int profiler_start(const char *prefix, size_t prg_size) {
+    (void)prefix;
+    (void)prg_size;
+    fprintf(stderr, "Profiler not built in (configure with -DNES_PROFILE=ON)\n");
+    return -1;
+}
+
+void profiler_finish(void) {}
+
+#else
+
+/* ------------------------------------------------------------------ */
+/*  State                                                              */
+/* ------------------------------------------------------------------ */
+
+/* A location is a CPU address (0x0000-0xFFFF) for anything that is not
+   PRG-ROM, or 0x10000 + PRG-ROM offset, so code in different banks at
+   the same address is counted separately. */
+#define LOC_ROM           0x10000u
+#define PROF_BANK_SIZE    0x2000     /* banks are reported in 8KB units */
+#define PROF_TOP_N        20
+#define PROF_MAX_LOOP     0x1000     /* longest loop body summed up */
+#define PROF_MAX_NODES    65536      /* distinct call paths */
+#define PROF_NODE_HASH    (PROF_MAX_NODES * 2)
+#define PROF_MAX_DEPTH    256
+#define FRAME_CYCLES      29781      /* NTSC, rounded up */
+
+enum { NODE_ROOT, NODE_CALL, NODE_BRK, NODE_NMI, NODE_IRQ };
+
+typedef struct {
+    uint32_t parent;
+    uint32_t loc;      /* entry point */
+    Word     addr;     /* entry point CPU address */
+    Byte     kind;
+    uint64_t cycles;   /* self cycles */
+} ProfNode;
+
+typedef struct {
+    uint32_t caller;   /* node to return to */
+    Byte     sp;       /* SP before the call pushed anything */
+} ProfFrame;
+
+int profiler_active = 0;
+
+static char     *out_prefix;
+static size_t    rom_size;
+static size_t    loc_count;
+static uint64_t *loc_cycles;
+static uint32_t *loc_insns;
+static Word     *loc_addr;          /* CPU address a location last ran at */
+static Byte     *loc_opcode;
+static uint32_t *loc_back_target;   /* target of a backward jump from here, +1 */
+static uint32_t *loc_back_taken;
+
+static ProfNode *nodes;
+static uint32_t  node_count;
+static uint32_t *node_hash;         /* node index + 1, 0 = empty */
+
+static ProfFrame stack[PROF_MAX_DEPTH];
+static int       depth;
+static uint32_t  cur_node;
+
+static uint64_t  total_cycles;
+static uint64_t  total_insns;
+
+/* the instruction being profiled, and the bus it was fetched from */
+static const Bus *step_bus;
+static Word      step_pc;
+static Byte      step_sp;
+static Byte      step_nmi;
+static Byte      step_irq;
+static uint32_t  step_loc;
+
+/* ------------------------------------------------------------------ */
+/*  Lifecycle                                                          */
+/* ------------------------------------------------------------------ */
+
+static void prof_free(void) {
+    free(out_prefix);      out_prefix = NULL;
+    free(loc_cycles);      loc_cycles = NULL;
+    free(loc_insns);       loc_insns = NULL;
+    free(loc_addr);        loc_addr = NULL;
+    free(loc_opcode);      loc_opcode = NULL;
+    free(loc_back_target); loc_back_target = NULL;
+    free(loc_back_taken);  loc_back_taken = NULL;
+    free(nodes);           nodes = NULL;
+    free(node_hash);       node_hash = NULL;
+}
+
+int profiler_start(const char *prefix, size_t prg_size) {
+    prof_free();
+    rom_size  = prg_size;
+    loc_count = LOC_ROM + prg_size;
+
+    out_prefix      = malloc(strlen(prefix) + 1);
+    loc_cycles      = calloc(loc_count, sizeof(*loc_cycles));
+    loc_insns       = calloc(loc_count, sizeof(*loc_insns));
+    loc_addr        = calloc(loc_count, sizeof(*loc_addr));
+    loc_opcode      = calloc(loc_count, sizeof(*loc_opcode));
+    loc_back_target = calloc(loc_count, sizeof(*loc_back_target));
+    loc_back_taken  = calloc(loc_count, sizeof(*loc_back_taken));
+    nodes           = calloc(PROF_MAX_NODES, sizeof(*nodes));
+    node_hash       = calloc(PROF_NODE_HASH, sizeof(*node_hash));
+    if (!out_prefix || !loc_cycles || !loc_insns || !loc_addr || !loc_opcode ||
+        !loc_back_target || !loc_back_taken || !nodes || !node_hash) {
+        fprintf(stderr, "Profiler: out of memory\n");
+        prof_free();
+        return -1;
+    }
+    strcpy(out_prefix, prefix);
+
+    nodes[0].parent = UINT32_MAX;
+    nodes[0].kind   = NODE_ROOT;
+    node_count   = 1;
+    cur_node     = 0;
+    depth        = 0;
+    total_cycles = 0;
+    total_insns  = 0;
+    profiler_active = 1;
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Per-instruction accounting                                         */
+/* ------------------------------------------------------------------ */
+
+static uint32_t prof_locate(Word addr) {
+    long off = bus_prg_offset(step_bus, addr);
+    return (off >= 0 && (size_t)off < rom_size) ? LOC_ROM + (uint32_t)off : addr;
+}
+
+static uint32_t prof_child(uint32_t parent, Byte kind, Word addr) {
+    uint32_t loc = prof_locate(addr);
+    uint32_t h = (parent * 2654435761u ^ loc * 40503u ^ kind) & (PROF_NODE_HASH - 1);
+    for (;;) {
+        uint32_t n = node_hash[h];
+        if (n == 0) break;
+        const ProfNode *node = &nodes[n - 1];
+        if (node->parent == parent && node->loc == loc && node->kind == kind) return n - 1;
+        h = (h + 1) & (PROF_NODE_HASH - 1);
+    }
+    if (node_count == PROF_MAX_NODES) return parent;   /* full: charge the caller */
+
+    ProfNode *node = &nodes[node_count];
+    node->parent = parent;
+    node->loc    = loc;
+    node->addr   = addr;
+    node->kind   = kind;
+    node_hash[h] = ++node_count;
+    return node_count - 1;
+}
+
+static void prof_push(Byte kind, Word addr, Byte sp) {
+    if (depth == PROF_MAX_DEPTH) return;
+    stack[depth].caller = cur_node;
+    stack[depth].sp     = sp;
+    depth++;
+    cur_node = prof_child(cur_node, kind, addr);
+}
+
+/* Drop every frame the stack pointer has unwound past. A PHA/PHA/RTS
+   jump inside a routine leaves SP below the routine's own frame, so it
+   does not count as a return. */
+static void prof_unwind(Byte sp) {
+    while (depth > 0 && stack[depth - 1].sp <= sp) {
+        cur_node = stack[--depth].caller;
+    }
+}
+
+void profiler_step_begin(const CPU *cpu) {
+    step_bus = cpu->bus;
+    step_pc  = cpu->PC;
+    step_sp  = cpu->SP;
+    step_nmi = cpu->nmi_pending;
+    step_irq = cpu->irq_pending;
+    step_loc = prof_locate(cpu->PC);
+}
+
+void profiler_step_end(const CPU *cpu) {
+    uint32_t loc = step_loc;
+    loc_insns[loc]++;
+    loc_cycles[loc] += cpu->cycles;
+    loc_addr[loc] = step_pc;
+    loc_opcode[loc] = cpu->opcode;
+    nodes[cur_node].cycles += cpu->cycles;
+    total_insns++;
+    total_cycles += cpu->cycles;
+
+    /* an interrupt taken after the instruction pushed 3 more bytes */
+    Byte entry = (step_nmi && !cpu->nmi_pending) ? NODE_NMI :
+                 (step_irq && !cpu->irq_pending) ? NODE_IRQ : NODE_ROOT;
+    Byte sp = entry != NODE_ROOT ? (Byte)(cpu->SP + 3) : cpu->SP;
+
+    switch (cpu->opcode) {
+        case OPC_JSR_ABS:
+            prof_push(NODE_CALL, (Word)(bus_peek(step_bus, step_pc + 1) | (bus_peek(step_bus, step_pc + 2) << 8)),
+                      step_sp);
+            break;
+        case OPC_BRK_IMP:
+            prof_push(NODE_BRK, (Word)(bus_peek(step_bus, 0xFFFE) | (bus_peek(step_bus, 0xFFFF) << 8)), step_sp);
+            break;
+        case OPC_RTS_IMP:
+        case OPC_RTI_IMP:
+        case OPC_TXS_IMP:
+            prof_unwind(sp);
+            break;
+        default:
+            if (entry == NODE_ROOT && cpu->PC <= step_pc) {
+                loc_back_taken[loc]++;
+                loc_back_target[loc] = prof_locate(cpu->PC) + 1;
+            }
+            break;
+    }
+    if (entry != NODE_ROOT) prof_push(entry, cpu->PC, sp);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Reports                                                            */
+/* ------------------------------------------------------------------ */
+
+static void loc_name(char *buf, size_t size, uint32_t loc, Word addr) {
+    if (loc >= LOC_ROM && rom_size > 0x8000)
+        snprintf(buf, size, "$%04X@b%02X", addr, (unsigned)((loc - LOC_ROM) / PROF_BANK_SIZE));
+    else
+        snprintf(buf, size, "$%04X", addr);
+}
+
+static void node_name(char *buf, size_t size, const ProfNode *node) {
+    static const char *const KIND[] = { "reset", "", "brk:", "nmi:", "irq:" };
+    char where[16];
+    if (node->kind == NODE_ROOT) {
+        snprintf(buf, size, "%s", KIND[NODE_ROOT]);
+        return;
+    }
+    loc_name(where, sizeof(where), node->loc, node->addr);
+    snprintf(buf, size, "%s%s", KIND[node->kind], where);
+}
+
+static void write_folded(FILE *f) {
+    uint32_t path[PROF_MAX_DEPTH + 2];
+    char name[32];
+    for (uint32_t i = 0; i < node_count; i++) {
+        if (nodes[i].cycles == 0) continue;
+        int n = 0;
+        for (uint32_t k = i; k != UINT32_MAX && n < PROF_MAX_DEPTH + 2; k = nodes[k].parent)
+            path[n++] = k;
+        while (n-- > 0) {
+            node_name(name, sizeof(name), &nodes[path[n]]);
+            fprintf(f, "%s%c", name, n ? ';' : ' ');
+        }
+        fprintf(f, "%llu\n", (unsigned long long)nodes[i].cycles);
+    }
+}
+
+/* Insert (key, value) into a descending top-N list of `count` entries */
+static int top_insert(uint32_t *keys, uint64_t *values, int count, uint32_t key, uint64_t value) {
+    if (value == 0 || (count == PROF_TOP_N && value <= values[count - 1])) return count;
+    int i = count < PROF_TOP_N ? count++ : count - 1;
+    while (i > 0 && values[i - 1] < value) {
+        keys[i]   = keys[i - 1];
+        values[i] = values[i - 1];
+        i--;
+    }
+    keys[i]   = key;
+    values[i] = value;
+    return count;
+}
+
+static double pct(uint64_t part) {
+    return total_cycles ? 100.0 * (double)part / (double)total_cycles : 0.0;
+}
+
+/* Cycles spent between a backward jump's target and the jump itself */
+static uint64_t loop_cycles(uint32_t from, uint32_t to) {
+    if (from > to || to - from > PROF_MAX_LOOP) return 0;
+    if ((from >= LOC_ROM) != (to >= LOC_ROM)) return 0;
+    uint64_t sum = 0;
+    for (uint32_t l = from; l <= to; l++) sum += loc_cycles[l];
+    return sum;
+}
+
+static void write_report(FILE *f) {
+    char a[16], b[16];
+
+    fprintf(f, "Guest profile: %llu instructions, %llu cycles (%.1f frames)\n",
+            (unsigned long long)total_insns, (unsigned long long)total_cycles,
+            (double)total_cycles / FRAME_CYCLES);
+
+    fprintf(f, "\n--- Cycles by region ---\n");
+    static const struct { const char *name; Word lo, hi; } REGIONS[] = {
+        { "RAM $0000-$1FFF",     0x0000, 0x1FFF },
+        { "I/O $2000-$5FFF",     0x2000, 0x5FFF },
+        { "PRG-RAM $6000-$7FFF", 0x6000, 0x7FFF },
+        { "unbanked $8000-$FFFF", 0x8000, 0xFFFF },
+    };
+    for (size_t r = 0; r < sizeof(REGIONS) / sizeof(REGIONS[0]); r++) {
+        uint64_t cyc = 0, ins = 0;
+        for (uint32_t l = REGIONS[r].lo; l <= REGIONS[r].hi; l++) {
+            cyc += loc_cycles[l];
+            ins += loc_insns[l];
+        }
+        if (ins) fprintf(f, "  %-22s %12llu cycles %6.2f%%  %10llu instructions\n", REGIONS[r].name,
+                         (unsigned long long)cyc, pct(cyc), (unsigned long long)ins);
+    }
+    for (size_t bank = 0; bank * PROF_BANK_SIZE < rom_size; bank++) {
+        uint64_t cyc = 0, ins = 0;
+        for (size_t l = LOC_ROM + bank * PROF_BANK_SIZE;
+             l < LOC_ROM + (bank + 1) * PROF_BANK_SIZE && l < loc_count; l++) {
+            cyc += loc_cycles[l];
+            ins += loc_insns[l];
+        }
+        if (ins) fprintf(f, "  PRG bank %02X (8KB)       %12llu cycles %6.2f%%  %10llu instructions\n",
+                         (unsigned)bank, (unsigned long long)cyc, pct(cyc), (unsigned long long)ins);
+    }
+
+    uint32_t keys[PROF_TOP_N];
+    uint64_t values[PROF_TOP_N];
+    int count = 0;
+    for (uint32_t l = 0; l < loc_count; l++)
+        count = top_insert(keys, values, count, l, loc_cycles[l]);
+    fprintf(f, "\n--- Top %d PCs by cycles ---\n", PROF_TOP_N);
+    for (int i = 0; i < count; i++) {
+        uint32_t l = keys[i];
+        loc_name(a, sizeof(a), l, loc_addr[l]);
+        const char *mnem = cpu_opcode_name(loc_opcode[l]);
+        fprintf(f, "  %-10s %-4s %12llu cycles %6.2f%%  %10u instructions\n", a,
+                mnem ? mnem : "???",
+                (unsigned long long)loc_cycles[l], pct(loc_cycles[l]), loc_insns[l]);
+    }
+
+    count = 0;
+    for (uint32_t l = 0; l < loc_count; l++) {
+        if (loc_back_taken[l])
+            count = top_insert(keys, values, count, l, loop_cycles(loc_back_target[l] - 1, l));
+    }
+    fprintf(f, "\n--- Top %d loops by cycles (backward jump target .. jump) ---\n", PROF_TOP_N);
+    for (int i = 0; i < count; i++) {
+        uint32_t l = keys[i];
+        uint32_t t = loc_back_target[l] - 1;
+        loc_name(a, sizeof(a), t, loc_addr[t]);
+        loc_name(b, sizeof(b), l, loc_addr[l]);
+        fprintf(f, "  %-10s .. %-10s %12llu cycles %6.2f%%  %10u iterations  %6.1f cycles/iteration\n",
+                a, b, (unsigned long long)values[i], pct(values[i]), loc_back_taken[l],
+                (double)values[i] / loc_back_taken[l]);
+    }
+}
+
+void profiler_finish(void) {
+    if (!profiler_active) return;
+    profiler_active = 0;
+
+    size_t len = strlen(out_prefix);
+    char *path = malloc(len + 8);
+    if (path) {
+        FILE *f;
+        snprintf(path, len + 8, "%s.folded", out_prefix);
+        if ((f = fopen(path, "w")) != NULL) {
+            write_folded(f);
+            fclose(f);
+        } else {
+            fprintf(stderr, "Profiler: cannot write %s\n", path);
+        }
+        snprintf(path, len + 8, "%s.txt", out_prefix);
+        if ((f = fopen(path, "w")) != NULL) {
+            write_report(f);
+            fclose(f);
+        } else {
+            fprintf(stderr, "Profiler: cannot write %s\n", path);
+        }
+        fprintf(stderr, "Profile written to %s.folded and %s.txt\n", out_prefix, out_prefix);
+        free(path);
+    }
+    prof_free();
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h>
+#include "types.h"
+#include "cpu.h"
+
+/* Guest-code profiler.
+   The hooks below compile to nothing unless the build defines NES_PROFILE
+   (CMake option NES_PROFILE). In a profiling build, profiler_start() makes
+   cpu_step run one instruction at a time (no JIT blocks, no idle-loop
+   skipping) and charge its cycles to the PC, to the PRG-ROM bank the PC
+   was fetched from, and to a shadow call stack driven by JSR/RTS, BRK/RTI
+   and NMI/IRQ entry. profiler_finish() writes:
+
+     <prefix>.folded  one "frame;frame;... cycles" line per call path,
+                      input for flamegraph.pl / speedscope / inferno
+     <prefix>.txt     cycles per PRG bank, hottest PCs, hottest loops
+
+   All counters live in flat arrays allocated by profiler_start(). Like
+   tracing, the profiler is process-wide: it follows whichever console's
+   CPU runs cpu_step while it is active, so profile one NES at a time. */
+
+/* Start profiling. prg_size is the cartridge's PRG-ROM size, so ROM code
+   can be counted per bank. Returns 0 on success, -1 on allocation failure
+   or when profiling is not built in. */
+int  profiler_start(const char *prefix, size_t prg_size);
+
+/* Write the reports and stop. No-op if the profiler is not running. */
+void profiler_finish(void);
+
+#ifdef NES_PROFILE
+
+extern int profiler_active;
+
+void profiler_step_begin(const CPU *cpu);
+void profiler_step_end(const CPU *cpu);
+
+#define PROFILE_ACTIVE()         (profiler_active)
+#define PROFILE_STEP_BEGIN(cpu)  profiler_step_begin(cpu)
+#define PROFILE_STEP_END(cpu)    profiler_step_end(cpu)
+
+#else
+
+#define PROFILE_ACTIVE()         0
+#define PROFILE_STEP_BEGIN(cpu)  ((void)0)
+#define PROFILE_STEP_END(cpu)    ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,311 @@
+#include "scale.h"
+#include <string.h>
+
+int scaler_from_name(const char *name) {
+    if (strcmp(name, "nearest") == 0) return SCALER_NEAREST;
+    if (strcmp(name, "scalenx") == 0) return SCALER_SCALENX;
+    if (strcmp(name, "xbr") == 0)     return SCALER_XBR;
+    return -1;
+}
+
+/* ── Nearest ──────────────────────────────────────────────────────────────── */
+
+static void nearest_rows(int factor, const uint32_t *src, int width,
+                         uint32_t *dst, int pitch, int first, int count) {
+    for (int y = first; y < first + count; y++) {
+        const uint32_t *in = &src[y * width];
+        uint32_t *out = &dst[(size_t)y * factor * pitch];
+        for (int x = 0; x < width; x++)
+            for (int k = 0; k < factor; k++) out[x * factor + k] = in[x];
+        /* the other rows of the block are copies of the first */
+        for (int r = 1; r < factor; r++)
+            memcpy(&out[r * pitch], out, (size_t)width * factor * sizeof(uint32_t));
+    }
+}
+
+/* ── Scale2x / Scale3x / Scale4x ──────────────────────────────────────────── */
+
+/* The rules only compare and select, so they run on PX_LANES pixels at a
+   time where GCC vector extensions are available, one otherwise. Masks
+   are all ones for true. */
+#if defined(__GNUC__)
+#define PX_LANES 4
+typedef uint32_t Px __attribute__((vector_size(16)));
+#define PX_EQ(a, b)   ((Px)((a) == (b)))
+#define PX_LANE(v, i) ((v)[i])
+
+static inline Px px_load(const uint32_t *p) {
+    Px v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+#else
+#define PX_LANES 1
+typedef uint32_t Px;
+#define PX_EQ(a, b)   ((Px)0 - (Px)((a) == (b)))
+#define PX_LANE(v, i) (v)
+
+static inline Px px_load(const uint32_t *p) {
+    return *p;
+}
+#endif
+
+static inline Px px_pick(Px mask, Px a, Px b) {
+    return (mask & a) | (~mask & b);
+}
+
+/* Rows handed to the ScaleNx kernels carry one copy of the edge pixel
+   either side, and enough after it for a full vector load */
+#define PAD_ROW (SCALE_MAX_WIDTH * 2 + 2 + PX_LANES)
+
+static void pad_ends(uint32_t *row, int width) {
+    row[0] = row[1];
+    for (int i = 0; i <= PX_LANES; i++) row[width + 1 + i] = row[width];
+}
+
+static void pad_row(uint32_t *row, const uint32_t *src, int width) {
+    memcpy(&row[1], src, (size_t)width * sizeof(uint32_t));
+    pad_ends(row, width);
+}
+
+/* One row of Scale2x: up/mid/down are padded rows, pixel x at index x + 1 */
+static void scale2x_row(const uint32_t *up, const uint32_t *mid, const uint32_t *down,
+                        int width, uint32_t *out0, uint32_t *out1) {
+    for (int x = 0; x < width; x += PX_LANES) {
+        Px B = px_load(&up[x + 1]), H = px_load(&down[x + 1]);
+        Px D = px_load(&mid[x]), E = px_load(&mid[x + 1]), F = px_load(&mid[x + 2]);
+        Px edge = ~PX_EQ(B, H) & ~PX_EQ(D, F);
+        Px e0 = px_pick(edge & PX_EQ(D, B), D, E);
+        Px e1 = px_pick(edge & PX_EQ(B, F), F, E);
+        Px e2 = px_pick(edge & PX_EQ(D, H), D, E);
+        Px e3 = px_pick(edge & PX_EQ(H, F), F, E);
+        for (int k = 0; k < PX_LANES && x + k < width; k++) {
+            out0[(x + k) * 2]     = PX_LANE(e0, k);
+            out0[(x + k) * 2 + 1] = PX_LANE(e1, k);
+            out1[(x + k) * 2]     = PX_LANE(e2, k);
+            out1[(x + k) * 2 + 1] = PX_LANE(e3, k);
+        }
+    }
+}
+
+static void scale3x_row(const uint32_t *up, const uint32_t *mid, const uint32_t *down,
+                        int width, uint32_t *out0, uint32_t *out1, uint32_t *out2) {
+    for (int x = 0; x < width; x += PX_LANES) {
+        Px A = px_load(&up[x]),   B = px_load(&up[x + 1]),   C = px_load(&up[x + 2]);
+        Px D = px_load(&mid[x]),  E = px_load(&mid[x + 1]),  F = px_load(&mid[x + 2]);
+        Px G = px_load(&down[x]), H = px_load(&down[x + 1]), I = px_load(&down[x + 2]);
+        Px edge = ~PX_EQ(B, H) & ~PX_EQ(D, F);
+        Px db = edge & PX_EQ(D, B), bf = edge & PX_EQ(B, F);
+        Px dh = edge & PX_EQ(D, H), hf = edge & PX_EQ(H, F);
+        Px e[9];
+        e[0] = px_pick(db, D, E);
+        e[1] = px_pick((db & ~PX_EQ(E, C)) | (bf & ~PX_EQ(E, A)), B, E);
+        e[2] = px_pick(bf, F, E);
+        e[3] = px_pick((db & ~PX_EQ(E, G)) | (dh & ~PX_EQ(E, A)), D, E);
+        e[4] = E;
+        e[5] = px_pick((bf & ~PX_EQ(E, I)) | (hf & ~PX_EQ(E, C)), F, E);
+        e[6] = px_pick(dh, D, E);
+        e[7] = px_pick((dh & ~PX_EQ(E, I)) | (hf & ~PX_EQ(E, G)), H, E);
+        e[8] = px_pick(hf, F, E);
+        uint32_t *out[3] = { out0, out1, out2 };
+        for (int k = 0; k < PX_LANES && x + k < width; k++)
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++) out[r][(x + k) * 3 + c] = PX_LANE(e[r * 3 + c], k);
+    }
+}
+
+static const uint32_t *clamped_row(const uint32_t *src, int width, int height, int y) {
+    if (y < 0) y = 0;
+    if (y >= height) y = height - 1;
+    return &src[y * width];
+}
+
+/* Scale2x of source row y into two padded rows */
+static void scale2x_padded(const uint32_t *src, int width, int height, int y,
+                           uint32_t *wide0, uint32_t *wide1) {
+    uint32_t rows[3][PAD_ROW];
+    for (int i = 0; i < 3; i++) pad_row(rows[i], clamped_row(src, width, height, y - 1 + i), width);
+    scale2x_row(rows[0], rows[1], rows[2], width, &wide0[1], &wide1[1]);
+    pad_ends(wide0, width * 2);
+    pad_ends(wide1, width * 2);
+}
+
+static void scalenx_rows(int factor, const uint32_t *src, int width, int height,
+                         uint32_t *dst, int pitch, int first, int count) {
+    for (int y = first; y < first + count; y++) {
+        uint32_t *out = &dst[(size_t)y * factor * pitch];
+        if (factor == 4) {
+            /* Scale2x of the Scale2x image: the two wide rows of this
+               line plus the wide rows either side of them */
+            uint32_t wide[6][PAD_ROW];
+            scale2x_padded(src, width, height, y, wide[2], wide[3]);
+            if (y > 0) scale2x_padded(src, width, height, y - 1, wide[0], wide[1]);
+            if (y < height - 1) scale2x_padded(src, width, height, y + 1, wide[4], wide[5]);
+            const uint32_t *above = y > 0 ? wide[1] : wide[2];
+            const uint32_t *below = y < height - 1 ? wide[4] : wide[3];
+            scale2x_row(above, wide[2], wide[3], width * 2, out, &out[pitch]);
+            scale2x_row(wide[2], wide[3], below, width * 2, &out[2 * pitch], &out[3 * pitch]);
+            continue;
+        }
+
+        uint32_t rows[3][PAD_ROW];
+        for (int i = 0; i < 3; i++) pad_row(rows[i], clamped_row(src, width, height, y - 1 + i), width);
+        if (factor == 2)
+            scale2x_row(rows[0], rows[1], rows[2], width, out, &out[pitch]);
+        else
+            scale3x_row(rows[0], rows[1], rows[2], width, out, &out[pitch], &out[2 * pitch]);
+    }
+}
+
+/* ── xBR ──────────────────────────────────────────────────────────────────── */
+
+/* YUV with the weights xBR gives each channel's difference folded in */
+typedef struct {
+    int y, u, v;
+} Yuv;
+
+static Yuv to_yuv(uint32_t c) {
+    int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+    Yuv q;
+    q.y = 48 * ((77 * r + 150 * g + 29 * b) >> 8);
+    q.u = 7 * ((-43 * r - 85 * g + 128 * b) >> 8);
+    q.v = 6 * ((128 * r - 107 * g - 21 * b) >> 8);
+    return q;
+}
+
+static inline int yuv_dist(Yuv a, Yuv b) {
+    int dy = a.y - b.y, du = a.u - b.u, dv = a.v - b.v;
+    return (dy < 0 ? -dy : dy) + (du < 0 ? -du : du) + (dv < 0 ? -dv : dv);
+}
+
+/* Source rows y-2..y+2 with two copies of the edge pixel either side */
+#define XBR_ROW (SCALE_MAX_WIDTH + 4)
+
+typedef struct {
+    uint32_t *px[5];
+    Yuv      *yuv[5];
+} XbrWindow;
+
+static void xbr_load(uint32_t *px, Yuv *yuv, const uint32_t *src, int width) {
+    memcpy(&px[2], src, (size_t)width * sizeof(uint32_t));
+    px[0] = px[1] = px[2];
+    px[width + 2] = px[width + 3] = px[width + 1];
+    for (int i = 0; i < width + 4; i++) yuv[i] = to_yuv(px[i]);
+}
+
+/* Neighbour (dx, dy) of pixel x, mirrored towards corner (sx, sy) */
+#define XBR_PX(dx, dy)  (w->px[2 + (dy) * sy][x + 2 + (dx) * sx])
+#define XBR_YUV(dx, dy) (w->yuv[2 + (dy) * sy][x + 2 + (dx) * sx])
+#define XBR_DIST(ax, ay, bx, by) yuv_dist(XBR_YUV(ax, ay), XBR_YUV(bx, by))
+
+/* Whether the edge through the (sx, sy) corner of pixel x runs across it
+   diagonally, and which colour the corner takes if so. The two diagonals
+   are weighed by the colour differences along them over the 5x5 window;
+   the corner is cut only when the anti-diagonal one is the smoother. */
+static int xbr_corner(const XbrWindow *w, int x, int sx, int sy, uint32_t *colour) {
+    uint32_t e = XBR_PX(0, 0), f = XBR_PX(1, 0), h = XBR_PX(0, 1);
+    if (e == f || e == h) return 0;
+    int along  = XBR_DIST(0, 0, 1, -1) + XBR_DIST(0, 0, -1, 1) + XBR_DIST(1, 1, 2, 0) +
+                 XBR_DIST(1, 1, 0, 2) + 4 * XBR_DIST(0, 1, 1, 0);
+    int across = XBR_DIST(0, 1, -1, 0) + XBR_DIST(0, 1, 1, 2) + XBR_DIST(1, 0, 2, 1) +
+                 XBR_DIST(1, 0, 0, -1) + 4 * XBR_DIST(0, 0, 1, 1);
+    if (along >= across) return 0;
+    *colour = XBR_DIST(0, 0, 1, 0) <= XBR_DIST(0, 0, 0, 1) ? f : h;
+    return 1;
+}
+
+/* c1 over c0 at alpha quarters */
+static inline uint32_t mix_quarters(uint32_t c0, uint32_t c1, int alpha) {
+    uint32_t rb = ((c0 & 0xFF00FF) * (4 - alpha) + (c1 & 0xFF00FF) * alpha) >> 2;
+    uint32_t g  = ((c0 & 0x00FF00) * (4 - alpha) + (c1 & 0x00FF00) * alpha) >> 2;
+    return 0xFF000000 | (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+static void xbr_rows(int factor, const uint32_t *src, int width, int height,
+                     uint32_t *dst, int pitch, int first, int count) {
+    /* A cut corner is the part of the pixel beyond the line through the
+       middles of its two sides there. cover[a][b] is how much of output
+       pixel (a, b) of the block, counted from the opposite corner, lies
+       beyond it, in quarters (2x2 samples). */
+    int cover[SCALE_MAX_FACTOR][SCALE_MAX_FACTOR];
+    for (int a = 0; a < factor; a++) {
+        for (int b = 0; b < factor; b++) {
+            cover[a][b] = 0;
+            for (int u = 0; u < 2; u++)
+                for (int v = 0; v < 2; v++)
+                    cover[a][b] += 4 * (a + b) + 2 * (u + v) + 2 > 6 * factor;
+        }
+    }
+
+    uint32_t px[5][XBR_ROW];
+    Yuv      yuv[5][XBR_ROW];
+    XbrWindow win, *w = &win;
+    for (int i = 0; i < 5; i++) {
+        w->px[i]  = px[i];
+        w->yuv[i] = yuv[i];
+        xbr_load(px[i], yuv[i], clamped_row(src, width, height, first - 2 + i), width);
+    }
+
+    for (int y = first; y < first + count; y++) {
+        if (y > first) {
+            /* slide the window down a row, reusing the oldest buffers */
+            uint32_t *p = w->px[0];
+            Yuv      *q = w->yuv[0];
+            for (int i = 0; i < 4; i++) {
+                w->px[i]  = w->px[i + 1];
+                w->yuv[i] = w->yuv[i + 1];
+            }
+            w->px[4]  = p;
+            w->yuv[4] = q;
+            xbr_load(p, q, clamped_row(src, width, height, y + 2), width);
+        }
+
+        uint32_t *out = &dst[(size_t)y * factor * pitch];
+        for (int x = 0; x < width; x++) {
+            uint32_t e = w->px[2][x + 2];
+            for (int j = 0; j < factor; j++)
+                for (int i = 0; i < factor; i++) out[j * pitch + x * factor + i] = e;
+
+            /* a cut corner takes the colour across the edge */
+            for (int corner = 0; corner < 4; corner++) {
+                int sx = (corner & 1) ? 1 : -1, sy = (corner & 2) ? 1 : -1;
+                uint32_t c;
+                if (!xbr_corner(w, x, sx, sy, &c)) continue;
+                for (int j = 0; j < factor; j++) {
+                    for (int i = 0; i < factor; i++) {
+                        int alpha = cover[sx > 0 ? i : factor - 1 - i][sy > 0 ? j : factor - 1 - j];
+                        uint32_t *o = &out[j * pitch + x * factor + i];
+                        if (alpha) *o = mix_quarters(*o, c, alpha);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* ── Entry points ─────────────────────────────────────────────────────────── */
+
+void scale_rows(ScalerKind kind, int factor, const uint32_t *src, int width, int height,
+                uint32_t *dst, int pitch, int first, int count) {
+    if (factor < 1) factor = 1;
+    if (factor > SCALE_MAX_FACTOR) factor = SCALE_MAX_FACTOR;
+    if (width > SCALE_MAX_WIDTH) return;
+    if (first < 0) {
+        count += first;
+        first = 0;
+    }
+    if (first + count > height) count = height - first;
+    if (count <= 0) return;
+
+    if (kind == SCALER_SCALENX && factor >= 2)
+        scalenx_rows(factor, src, width, height, dst, pitch, first, count);
+    else if (kind == SCALER_XBR && factor >= 2)
+        xbr_rows(factor, src, width, height, dst, pitch, first, count);
+    else
+        nearest_rows(factor, src, width, dst, pitch, first, count);
+}
+
+void scale_frame(ScalerKind kind, int factor, const uint32_t *src, int width, int height,
+                 uint32_t *dst, int pitch) {
+    scale_rows(kind, factor, src, width, height, dst, pitch, 0, height);
+}
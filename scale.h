@@ -0,0 +1,37 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdint.h>
+
+/* Pixel-art scalers for ARGB8888 frames (ppu_convert_frame's output),
+   by a whole factor from 1 to SCALE_MAX_FACTOR:
+     nearest  - every pixel becomes a factor x factor block
+     scalenx  - Scale2x/Scale3x (EPX), Scale4x being Scale2x twice
+     xbr      - edge-directed: corners along a diagonal edge take the
+                colour across it, decided as xBR does from colour
+                distances in a 5x5 neighbourhood */
+
+#define SCALE_MAX_FACTOR 4
+#define SCALE_MAX_WIDTH  1024   /* source pixels per row */
+
+typedef enum {
+    SCALER_NEAREST,
+    SCALER_SCALENX,
+    SCALER_XBR,
+} ScalerKind;
+
+/* Name as on the command line ("nearest", "scalenx", "xbr"), -1 if unknown */
+int scaler_from_name(const char *name);
+
+/* Scale source rows first..first+count-1 of a width x height frame into
+   dst, pitch pixels per row; they land on dst rows first * factor on.
+   Rows read their neighbours but write only their own output, so bands of
+   a frame can be scaled on separate threads. Factors the scaler has no
+   rule for fall back to nearest. */
+void scale_rows(ScalerKind kind, int factor, const uint32_t *src, int width, int height,
+                uint32_t *dst, int pitch, int first, int count);
+
+void scale_frame(ScalerKind kind, int factor, const uint32_t *src, int width, int height,
+                 uint32_t *dst, int pitch);
+
+#endif
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <string.h>     /* memset — only if not already included */
 #include <assert.h>     /* assert for tests */
+#include <time.h>       /* clock for the dispatcher benchmark */
+#include <stdlib.h>     /* abs */
+#include <math.h>       /* sqrt for the NTSC filter test */
 
 #include "types.h"
 #include "bus.h"
@@ -9,6 +12,14 @@
 #include "opcodes.h"
 #include "cartridge.h"
 #include "mapper.h"
+#include "nes.h"
+#include "ntsc.h"
+#include "scale.h"
+#include "cpu_lanes.h"
+#include "profiler.h"
+#ifdef NES_CPU_JIT
+#include "cpu_jit.h"
+#endif
 
 // --- Test config ---
 // Program area: 0x0200-0x02FF (page 2)
@@ -17,6 +28,7 @@
 #define PRG_START 0x0200
 #define DATA_PAGE 0x0300
 
+static Bus test_bus;
 static CPU cpu;
 static int test_pass = 0;
 static int test_fail = 0;
@@ -28,11 +40,11 @@ void print_flags(CPU *c) {
     // NV-BDIZC
     char names[] = "CZIDBUVN";  // bit 0 to bit 7
     for (int i = 7; i >= 0; i--) {
-        printf("%c=%d ", names[i], (c->flags >> i) & 1);
+        printf("%c=%d ", names[i], (cpu_flags(c) >> i) & 1);
     }
     printf(" [0b");
     for (int i = 7; i >= 0; i--) {
-        printf("%d", (c->flags >> i) & 1);
+        printf("%d", (cpu_flags(c) >> i) & 1);
     }
     printf("]\n");
 }
@@ -48,7 +60,7 @@ void print_regs(CPU *c) {
 void print_mem_range(Word start, Word len) {
     printf("  Mem [0x%04X - 0x%04X]: ", start, start + len - 1);
     for (Word i = 0; i < len; i++) {
-        printf("%02X ", bus_read(start + i));
+        printf("%02X ", bus_read(&test_bus, start + i));
     }
     printf("\n");
 }
@@ -56,7 +68,7 @@ void print_mem_range(Word start, Word len) {
 void print_program(Word start, Word len) {
     printf("  Program bytes: ");
     for (Word i = 0; i < len; i++) {
-        printf("%02X ", bus_read(start + i));
+        printf("%02X ", bus_read(&test_bus, start + i));
     }
     printf("\n");
 }
@@ -82,8 +94,8 @@ void check(const char *desc, int condition) {
 
 // helper to write a word (little-endian) via bus
 void bus_write_word(Word addr, Word value) {
-    bus_write(addr, value & 0xFF);
-    bus_write(addr + 1, value >> 8);
+    bus_write(&test_bus, addr, value & 0xFF);
+    bus_write(&test_bus, addr + 1, value >> 8);
 }
 
 // --- LDA Tests ---
@@ -95,8 +107,8 @@ void test_lda() {
     {
         test_reset();
         test_header("LDA IM - load 0x42");
-        bus_write(PRG_START, OPC_LDA_IM);
-        bus_write(PRG_START + 1, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDA_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x42);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -116,8 +128,8 @@ void test_lda() {
     {
         test_reset();
         test_header("LDA IM - load 0x00 (zero flag)");
-        bus_write(PRG_START, OPC_LDA_IM);
-        bus_write(PRG_START + 1, 0x00);
+        bus_write(&test_bus, PRG_START, OPC_LDA_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x00);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -134,8 +146,8 @@ void test_lda() {
     {
         test_reset();
         test_header("LDA IM - load 0x80 (negative flag, signed = -128)");
-        bus_write(PRG_START, OPC_LDA_IM);
-        bus_write(PRG_START + 1, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_LDA_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x80);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -152,9 +164,9 @@ void test_lda() {
     {
         test_reset();
         test_header("LDA ZP - load from ZP addr 0x10");
-        bus_write(0x10, 0xAB);
-        bus_write(PRG_START, OPC_LDA_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0xAB);
+        bus_write(&test_bus, PRG_START, OPC_LDA_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_mem_range(0x10, 1);
@@ -174,9 +186,9 @@ void test_lda() {
         test_reset();
         test_header("LDA ZP,X - wrap around ZP (addr 0xFF + X=0x02 -> 0x01)");
         cpu.regs.X = 0x02;
-        bus_write(0x01, 0x77);  // wrapped target
-        bus_write(PRG_START, OPC_LDA_ZPX);
-        bus_write(PRG_START + 1, 0xFF);
+        bus_write(&test_bus, 0x01, 0x77);  // wrapped target
+        bus_write(&test_bus, PRG_START, OPC_LDA_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0xFF);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         printf("  X=0x%02X, ZP operand=0xFF, effective=(0xFF+0x02)&0xFF=0x01\n", cpu.regs.X);
@@ -193,8 +205,8 @@ void test_lda() {
     {
         test_reset();
         test_header("LDA ABS - load from 0x0300");
-        bus_write(DATA_PAGE, 0xDE);
-        bus_write(PRG_START, OPC_LDA_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0xDE);
+        bus_write(&test_bus, PRG_START, OPC_LDA_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
         printf(" Before:\n");
@@ -212,8 +224,8 @@ void test_lda() {
         test_reset();
         test_header("LDA ABS,X - no page cross (0x0300 + X=0x05)");
         cpu.regs.X = 0x05;
-        bus_write(DATA_PAGE + 0x05, 0xBB);
-        bus_write(PRG_START, OPC_LDA_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x05, 0xBB);
+        bus_write(&test_bus, PRG_START, OPC_LDA_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -229,8 +241,8 @@ void test_lda() {
         test_reset();
         test_header("LDA ABS,X - page cross (0x03FF + X=0x01 -> 0x0400)");
         cpu.regs.X = 0x01;
-        bus_write(0x0400, 0xCC);
-        bus_write(PRG_START, OPC_LDA_ABSX);
+        bus_write(&test_bus, 0x0400, 0xCC);
+        bus_write(&test_bus, PRG_START, OPC_LDA_ABSX);
         bus_write_word(PRG_START + 1, 0x03FF);
         print_program(PRG_START, 3);
         printf("  Base=0x03FF, X=0x01 -> effective=0x0400 (page cross!)\n");
@@ -247,8 +259,8 @@ void test_lda() {
         test_reset();
         test_header("LDA ABS,Y - page cross (0x03FE + Y=0x05 -> 0x0403)");
         cpu.regs.Y = 0x05;
-        bus_write(0x0403, 0xDD);
-        bus_write(PRG_START, OPC_LDA_ABSY);
+        bus_write(&test_bus, 0x0403, 0xDD);
+        bus_write(&test_bus, PRG_START, OPC_LDA_ABSY);
         bus_write_word(PRG_START + 1, 0x03FE);
         print_program(PRG_START, 3);
 
@@ -265,11 +277,11 @@ void test_lda() {
         test_header("LDA (IND,X) - ptr at ZP (0x20+X=0x04) -> 0x0300, val=0xEE");
         cpu.regs.X = 0x04;
         // pointer at ZP 0x24 -> points to 0x0300
-        bus_write(0x24, 0x00);  // lo
-        bus_write(0x25, 0x03);  // hi
-        bus_write(DATA_PAGE, 0xEE);
-        bus_write(PRG_START, OPC_LDA_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);  // lo
+        bus_write(&test_bus, 0x25, 0x03);  // hi
+        bus_write(&test_bus, DATA_PAGE, 0xEE);
+        bus_write(&test_bus, PRG_START, OPC_LDA_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
         printf("  ZP operand=0x20, X=0x04 -> wrapped=0x24\n");
         print_mem_range(0x24, 2);
@@ -287,11 +299,11 @@ void test_lda() {
         test_reset();
         test_header("LDA (IND,X) - ZP wrap: operand=0xFE, X=0x01 -> ptr at 0xFF/0x00");
         cpu.regs.X = 0x01;
-        bus_write(0xFF, 0x10);  // lo byte of pointer
-        bus_write(0x00, 0x03);  // hi byte wraps to 0x00
-        bus_write(0x0310, 0x55);
-        bus_write(PRG_START, OPC_LDA_INDX);
-        bus_write(PRG_START + 1, 0xFE);
+        bus_write(&test_bus, 0xFF, 0x10);  // lo byte of pointer
+        bus_write(&test_bus, 0x00, 0x03);  // hi byte wraps to 0x00
+        bus_write(&test_bus, 0x0310, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_LDA_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0xFE);
         print_program(PRG_START, 2);
         printf("  (0xFE + 0x01) & 0xFF = 0xFF -> ptr at ZP 0xFF,0x00 -> 0x0310\n");
 
@@ -307,12 +319,12 @@ void test_lda() {
         test_reset();
         test_header("LDA (IND),Y - no page cross");
         // pointer at ZP 0x30 -> 0x0300
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
         cpu.regs.Y = 0x05;
-        bus_write(0x0305, 0x99);
-        bus_write(PRG_START, OPC_LDA_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x0305, 0x99);
+        bus_write(&test_bus, PRG_START, OPC_LDA_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         print_program(PRG_START, 2);
 
         cpu_execute(5, &cpu);
@@ -326,12 +338,12 @@ void test_lda() {
     {
         test_reset();
         test_header("LDA (IND),Y - page cross (base=0x03FE + Y=0x05 -> 0x0403)");
-        bus_write(0x40, 0xFE);  // lo
-        bus_write(0x41, 0x03);  // hi -> base = 0x03FE
+        bus_write(&test_bus, 0x40, 0xFE);  // lo
+        bus_write(&test_bus, 0x41, 0x03);  // hi -> base = 0x03FE
         cpu.regs.Y = 0x05;
-        bus_write(0x0403, 0x11);
-        bus_write(PRG_START, OPC_LDA_INDY);
-        bus_write(PRG_START + 1, 0x40);
+        bus_write(&test_bus, 0x0403, 0x11);
+        bus_write(&test_bus, PRG_START, OPC_LDA_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x40);
         print_program(PRG_START, 2);
         printf("  Base=0x03FE, Y=0x05 -> 0x0403 (page cross!)\n");
 
@@ -353,8 +365,8 @@ void test_sta() {
         test_reset();
         test_header("STA ZP - store 0x42 to ZP 0x10");
         cpu.regs.A = 0x42;
-        bus_write(PRG_START, OPC_STA_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_STA_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -364,7 +376,7 @@ void test_sta() {
 
         printf(" After:\n");
         print_mem_range(0x10, 1);
-        check("ZP[0x10] == 0x42", bus_read(0x10) == 0x42);
+        check("ZP[0x10] == 0x42", bus_read(&test_bus, 0x10) == 0x42);
     }
 
     // STA Zero Page,X - with wrap
@@ -373,15 +385,15 @@ void test_sta() {
         test_header("STA ZP,X - wrap (addr=0xFF + X=0x03 -> 0x02)");
         cpu.regs.A = 0xBE;
         cpu.regs.X = 0x03;
-        bus_write(PRG_START, OPC_STA_ZPX);
-        bus_write(PRG_START + 1, 0xFF);
+        bus_write(&test_bus, PRG_START, OPC_STA_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0xFF);
         print_program(PRG_START, 2);
 
         cpu_execute(4, &cpu);
 
         printf(" After:\n");
         print_mem_range(0x00, 4);
-        check("ZP[0x02] == 0xBE (wrapped)", bus_read(0x02) == 0xBE);
+        check("ZP[0x02] == 0xBE (wrapped)", bus_read(&test_bus, 0x02) == 0xBE);
     }
 
     // STA Absolute
@@ -389,7 +401,7 @@ void test_sta() {
         test_reset();
         test_header("STA ABS - store to 0x0300");
         cpu.regs.A = 0xAA;
-        bus_write(PRG_START, OPC_STA_ABS);
+        bus_write(&test_bus, PRG_START, OPC_STA_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -397,7 +409,7 @@ void test_sta() {
 
         printf(" After:\n");
         print_mem_range(DATA_PAGE, 1);
-        check("mem[0x0300] == 0xAA", bus_read(DATA_PAGE) == 0xAA);
+        check("mem[0x0300] == 0xAA", bus_read(&test_bus, DATA_PAGE) == 0xAA);
     }
 
     // STA Absolute,X
@@ -406,7 +418,7 @@ void test_sta() {
         test_header("STA ABS,X - store to 0x0300 + X=0x10 -> 0x0310");
         cpu.regs.A = 0x55;
         cpu.regs.X = 0x10;
-        bus_write(PRG_START, OPC_STA_ABSX);
+        bus_write(&test_bus, PRG_START, OPC_STA_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -414,7 +426,7 @@ void test_sta() {
 
         printf(" After:\n");
         print_mem_range(0x0310, 1);
-        check("mem[0x0310] == 0x55", bus_read(0x0310) == 0x55);
+        check("mem[0x0310] == 0x55", bus_read(&test_bus, 0x0310) == 0x55);
     }
 
     // STA Absolute,Y
@@ -423,7 +435,7 @@ void test_sta() {
         test_header("STA ABS,Y - store to 0x0300 + Y=0x20 -> 0x0320");
         cpu.regs.A = 0x66;
         cpu.regs.Y = 0x20;
-        bus_write(PRG_START, OPC_STA_ABSY);
+        bus_write(&test_bus, PRG_START, OPC_STA_ABSY);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -431,7 +443,7 @@ void test_sta() {
 
         printf(" After:\n");
         print_mem_range(0x0320, 1);
-        check("mem[0x0320] == 0x66", bus_read(0x0320) == 0x66);
+        check("mem[0x0320] == 0x66", bus_read(&test_bus, 0x0320) == 0x66);
     }
 
     // STA (Indirect,X)
@@ -440,17 +452,17 @@ void test_sta() {
         test_header("STA (IND,X) - ptr at ZP (0x20+X=0x04)=0x24 -> 0x0300");
         cpu.regs.A = 0x77;
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x00);
-        bus_write(0x25, 0x03);
-        bus_write(PRG_START, OPC_STA_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);
+        bus_write(&test_bus, 0x25, 0x03);
+        bus_write(&test_bus, PRG_START, OPC_STA_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
 
         cpu_execute(6, &cpu);
 
         printf(" After:\n");
         print_mem_range(DATA_PAGE, 1);
-        check("mem[0x0300] == 0x77", bus_read(DATA_PAGE) == 0x77);
+        check("mem[0x0300] == 0x77", bus_read(&test_bus, DATA_PAGE) == 0x77);
     }
 
     // STA (Indirect),Y
@@ -459,17 +471,17 @@ void test_sta() {
         test_header("STA (IND),Y - ptr at ZP 0x30 -> 0x0300 + Y=0x08 -> 0x0308");
         cpu.regs.A = 0x88;
         cpu.regs.Y = 0x08;
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
-        bus_write(PRG_START, OPC_STA_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
+        bus_write(&test_bus, PRG_START, OPC_STA_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         print_program(PRG_START, 2);
 
         cpu_execute(6, &cpu);
 
         printf(" After:\n");
         print_mem_range(0x0308, 1);
-        check("mem[0x0308] == 0x88", bus_read(0x0308) == 0x88);
+        check("mem[0x0308] == 0x88", bus_read(&test_bus, 0x0308) == 0x88);
     }
 
     // STA should not affect flags
@@ -480,9 +492,9 @@ void test_sta() {
         // set some known flags first
         cpu_set_flag(Z, 0, &cpu);
         cpu_set_flag(N, 1, &cpu);
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_STA_ZP);
-        bus_write(PRG_START + 1, 0x50);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_STA_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x50);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_flags(&cpu);
@@ -491,7 +503,7 @@ void test_sta() {
 
         printf(" After:\n");
         print_flags(&cpu);
-        check("Flags unchanged after STA", cpu.flags == flags_before);
+        check("Flags unchanged after STA", cpu_flags(&cpu) == flags_before);
     }
 }
 
@@ -506,8 +518,8 @@ void test_adc() {
         test_header("ADC IM - 0x10 + 0x20 = 0x30, no carry");
         cpu.regs.A = 0x10;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -531,8 +543,8 @@ void test_adc() {
         test_header("ADC IM - 0x10 + 0x20 + C=1 = 0x31");
         cpu.regs.A = 0x10;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -553,8 +565,8 @@ void test_adc() {
         test_header("ADC IM - 0xFF + 0x01 = 0x00, C=1 (unsigned overflow)");
         cpu.regs.A = 0xFF;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0x01);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x01);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         printf("  A=0xFF (unsigned: 255, signed: %d)\n", (int8_t)0xFF);
@@ -577,8 +589,8 @@ void test_adc() {
         test_header("ADC IM - signed overflow: 0x7F + 0x01 (127 + 1 = -128)");
         cpu.regs.A = 0x7F;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0x01);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x01);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         printf("  A=0x7F (signed: +127), operand=0x01 (signed: +1)\n");
@@ -602,8 +614,8 @@ void test_adc() {
         test_header("ADC IM - signed overflow: 0x80 + 0xFF (-128 + -1 = wraps)");
         cpu.regs.A = 0x80;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0xFF);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0xFF);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         printf("  A=0x80 (signed: %d), operand=0xFF (signed: %d)\n", (int8_t)0x80, (int8_t)0xFF);
@@ -626,8 +638,8 @@ void test_adc() {
         test_header("ADC IM - no overflow: 0x50 + 0xD0 (+80 + -48 = +32)");
         cpu.regs.A = 0x50;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0xD0);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0xD0);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         printf("  A=0x50 (signed: %d), operand=0xD0 (signed: %d)\n", (int8_t)0x50, (int8_t)0xD0);
@@ -649,8 +661,8 @@ void test_adc() {
         test_header("ADC IM - 0x01 + 0xFF = 0x00 (zero result, carry out)");
         cpu.regs.A = 0x01;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0xFF);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0xFF);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -670,8 +682,8 @@ void test_adc() {
         test_header("ADC IM - 0x00 + 0x00 + C=0 = 0x00 (all zeros)");
         cpu.regs.A = 0x00;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0x00);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x00);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -692,8 +704,8 @@ void test_adc() {
         test_header("ADC IM - carry triggers overflow: 0x7F + 0x00 + C=1 = 0x80");
         cpu.regs.A = 0x7F;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_ADC_IM);
-        bus_write(PRG_START + 1, 0x00);
+        bus_write(&test_bus, PRG_START, OPC_ADC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x00);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         printf("  A=0x7F (+127) + 0x00 + C=1 -> 0x80 (%d)\n", (int8_t)0x80);
@@ -719,8 +731,8 @@ void test_and() {
         test_reset();
         test_header("AND IM - 0xFF & 0x0F = 0x0F");
         cpu.regs.A = 0xFF;
-        bus_write(PRG_START, OPC_AND_IM);
-        bus_write(PRG_START + 1, 0x0F);
+        bus_write(&test_bus, PRG_START, OPC_AND_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x0F);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -740,8 +752,8 @@ void test_and() {
         test_reset();
         test_header("AND IM - 0xAA & 0x55 = 0x00 (zero flag)");
         cpu.regs.A = 0xAA;
-        bus_write(PRG_START, OPC_AND_IM);
-        bus_write(PRG_START + 1, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_AND_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x55);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -759,8 +771,8 @@ void test_and() {
         test_reset();
         test_header("AND IM - 0xFF & 0x80 = 0x80 (negative flag)");
         cpu.regs.A = 0xFF;
-        bus_write(PRG_START, OPC_AND_IM);
-        bus_write(PRG_START + 1, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_AND_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x80);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -778,9 +790,9 @@ void test_and() {
         test_reset();
         test_header("AND ZP - A=0xF0 & ZP[0x10]=0x33 = 0x30");
         cpu.regs.A = 0xF0;
-        bus_write(0x10, 0x33);
-        bus_write(PRG_START, OPC_AND_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x33);
+        bus_write(&test_bus, PRG_START, OPC_AND_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
 
         cpu_execute(3, &cpu);
@@ -796,9 +808,9 @@ void test_and() {
         test_header("AND ZP,X - wrap (addr=0xFF + X=0x02 -> 0x01)");
         cpu.regs.A = 0xFF;
         cpu.regs.X = 0x02;
-        bus_write(0x01, 0x5A);
-        bus_write(PRG_START, OPC_AND_ZPX);
-        bus_write(PRG_START + 1, 0xFF);
+        bus_write(&test_bus, 0x01, 0x5A);
+        bus_write(&test_bus, PRG_START, OPC_AND_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0xFF);
         print_program(PRG_START, 2);
 
         cpu_execute(4, &cpu);
@@ -813,8 +825,8 @@ void test_and() {
         test_reset();
         test_header("AND ABS - A=0xCC & mem[0x0300]=0x0F = 0x0C");
         cpu.regs.A = 0xCC;
-        bus_write(DATA_PAGE, 0x0F);
-        bus_write(PRG_START, OPC_AND_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x0F);
+        bus_write(&test_bus, PRG_START, OPC_AND_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -831,8 +843,8 @@ void test_and() {
         test_header("AND ABS,X - no page cross (0x0300 + X=0x05)");
         cpu.regs.A = 0xFF;
         cpu.regs.X = 0x05;
-        bus_write(DATA_PAGE + 0x05, 0x3C);
-        bus_write(PRG_START, OPC_AND_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x05, 0x3C);
+        bus_write(&test_bus, PRG_START, OPC_AND_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -849,8 +861,8 @@ void test_and() {
         test_header("AND ABS,Y - page cross (0x03FE + Y=0x05 -> 0x0403)");
         cpu.regs.A = 0xFF;
         cpu.regs.Y = 0x05;
-        bus_write(0x0403, 0x71);
-        bus_write(PRG_START, OPC_AND_ABSY);
+        bus_write(&test_bus, 0x0403, 0x71);
+        bus_write(&test_bus, PRG_START, OPC_AND_ABSY);
         bus_write_word(PRG_START + 1, 0x03FE);
         print_program(PRG_START, 3);
         printf("  Base=0x03FE, Y=0x05 -> 0x0403 (page cross!)\n");
@@ -868,11 +880,11 @@ void test_and() {
         test_header("AND (IND,X) - ptr at ZP (0x20+X=0x04)=0x24 -> 0x0300");
         cpu.regs.A = 0xFF;
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x00);
-        bus_write(0x25, 0x03);
-        bus_write(DATA_PAGE, 0xAB);
-        bus_write(PRG_START, OPC_AND_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);
+        bus_write(&test_bus, 0x25, 0x03);
+        bus_write(&test_bus, DATA_PAGE, 0xAB);
+        bus_write(&test_bus, PRG_START, OPC_AND_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
 
         cpu_execute(6, &cpu);
@@ -888,11 +900,11 @@ void test_and() {
         test_header("AND (IND),Y - no page cross, ptr at ZP 0x30 -> 0x0300 + Y=0x05");
         cpu.regs.A = 0xFF;
         cpu.regs.Y = 0x05;
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
-        bus_write(0x0305, 0xC3);
-        bus_write(PRG_START, OPC_AND_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
+        bus_write(&test_bus, 0x0305, 0xC3);
+        bus_write(&test_bus, PRG_START, OPC_AND_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         print_program(PRG_START, 2);
 
         cpu_execute(5, &cpu);
@@ -913,7 +925,7 @@ void test_asl() {
         test_reset();
         test_header("ASL ACC - 0x01 << 1 = 0x02, C=0");
         cpu.regs.A = 0x01;
-        bus_write(PRG_START, OPC_ASL_ACC);
+        bus_write(&test_bus, PRG_START, OPC_ASL_ACC);
         print_program(PRG_START, 1);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -934,7 +946,7 @@ void test_asl() {
         test_reset();
         test_header("ASL ACC - 0x80 << 1 = 0x00 (carry out, zero flag)");
         cpu.regs.A = 0x80;
-        bus_write(PRG_START, OPC_ASL_ACC);
+        bus_write(&test_bus, PRG_START, OPC_ASL_ACC);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -952,7 +964,7 @@ void test_asl() {
         test_reset();
         test_header("ASL ACC - 0x40 << 1 = 0x80 (negative flag)");
         cpu.regs.A = 0x40;
-        bus_write(PRG_START, OPC_ASL_ACC);
+        bus_write(&test_bus, PRG_START, OPC_ASL_ACC);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -969,9 +981,9 @@ void test_asl() {
     {
         test_reset();
         test_header("ASL ZP - ZP[0x10]=0x21 << 1 = 0x42");
-        bus_write(0x10, 0x21);
-        bus_write(PRG_START, OPC_ASL_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x21);
+        bus_write(&test_bus, PRG_START, OPC_ASL_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_mem_range(0x10, 1);
@@ -980,7 +992,7 @@ void test_asl() {
 
         printf(" After:\n");
         print_mem_range(0x10, 1);
-        check("ZP[0x10] == 0x42", bus_read(0x10) == 0x42);
+        check("ZP[0x10] == 0x42", bus_read(&test_bus, 0x10) == 0x42);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
     }
 
@@ -989,9 +1001,9 @@ void test_asl() {
         test_reset();
         test_header("ASL ZP,X - ZP[0x10+X=0x04]=0x14 (addr 0x14), val=0x08 << 1 = 0x10");
         cpu.regs.X = 0x04;
-        bus_write(0x14, 0x08);
-        bus_write(PRG_START, OPC_ASL_ZPX);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x14, 0x08);
+        bus_write(&test_bus, PRG_START, OPC_ASL_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
         printf("  operand=0x10, X=0x04 -> effective addr=0x14\n");
         printf(" Before:\n");
@@ -1001,15 +1013,15 @@ void test_asl() {
 
         printf(" After:\n");
         print_mem_range(0x14, 1);
-        check("ZP[0x14] == 0x10", bus_read(0x14) == 0x10);
+        check("ZP[0x14] == 0x10", bus_read(&test_bus, 0x14) == 0x10);
     }
 
     // ASL Absolute
     {
         test_reset();
         test_header("ASL ABS - mem[0x0300]=0x40 << 1 = 0x80 (N flag)");
-        bus_write(DATA_PAGE, 0x40);
-        bus_write(PRG_START, OPC_ASL_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x40);
+        bus_write(&test_bus, PRG_START, OPC_ASL_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
         printf(" Before:\n");
@@ -1020,7 +1032,7 @@ void test_asl() {
         printf(" After:\n");
         print_mem_range(DATA_PAGE, 1);
         print_flags(&cpu);
-        check("mem[0x0300] == 0x80", bus_read(DATA_PAGE) == 0x80);
+        check("mem[0x0300] == 0x80", bus_read(&test_bus, DATA_PAGE) == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
     }
 
@@ -1029,8 +1041,8 @@ void test_asl() {
         test_reset();
         test_header("ASL ABS,X - mem[0x0300+X=0x02]=0x02 (addr 0x0302), val=0x80 -> carry");
         cpu.regs.X = 0x02;
-        bus_write(DATA_PAGE + 0x02, 0x80);
-        bus_write(PRG_START, OPC_ASL_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x02, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_ASL_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
         printf("  base=0x0300, X=0x02 -> addr=0x0302, val=0x80 -> 0x00 carry out\n");
@@ -1042,7 +1054,7 @@ void test_asl() {
         printf(" After:\n");
         print_mem_range(DATA_PAGE + 0x02, 1);
         print_flags(&cpu);
-        check("mem[0x0302] == 0x00", bus_read(DATA_PAGE + 0x02) == 0x00);
+        check("mem[0x0302] == 0x00", bus_read(&test_bus, DATA_PAGE + 0x02) == 0x00);
         check("C == 1 (carry out)", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -1058,8 +1070,8 @@ void test_branches() {
         test_reset();
         test_header("BCC - not taken (C=1), PC unchanged");
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_BCC_REL);
-        bus_write(PRG_START + 1, 0x10);  // offset +16
+        bus_write(&test_bus, PRG_START, OPC_BCC_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);  // offset +16
         print_program(PRG_START, 2);
         Word expected_pc = PRG_START + 2;
 
@@ -1075,8 +1087,8 @@ void test_branches() {
         test_reset();
         test_header("BCC - taken (C=0), forward offset +0x10");
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_BCC_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BCC_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
         // After fetch opcode+operand, PC=0x0202, then +0x10 = 0x0212
         Word expected_pc = PRG_START + 2 + 0x10;
@@ -1097,8 +1109,8 @@ void test_branches() {
         Word branch_addr = 0x02FD;
         cpu.PC = branch_addr;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(branch_addr, OPC_BCC_REL);
-        bus_write(branch_addr + 1, 0x01);
+        bus_write(&test_bus, branch_addr, OPC_BCC_REL);
+        bus_write(&test_bus, branch_addr + 1, 0x01);
         print_program(branch_addr, 2);
         test_header("BCC - taken, page cross (0x02FD+2+0x01=0x0300)");
         printf("  Branch at 0x02FD, offset=+1 -> 0x02FF+1=0x0300 (page cross!)\n");
@@ -1115,8 +1127,8 @@ void test_branches() {
         test_reset();
         test_header("BCS - not taken (C=0)");
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_BCS_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BCS_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         Word expected_pc = PRG_START + 2;
 
         cpu_execute(2, &cpu);
@@ -1129,8 +1141,8 @@ void test_branches() {
         test_reset();
         test_header("BCS - taken (C=1), offset +0x08");
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_BCS_REL);
-        bus_write(PRG_START + 1, 0x08);
+        bus_write(&test_bus, PRG_START, OPC_BCS_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x08);
         Word expected_pc = PRG_START + 2 + 0x08;
 
         cpu_execute(3, &cpu);
@@ -1145,8 +1157,8 @@ void test_branches() {
         test_reset();
         test_header("BNE - not taken (Z=1)");
         cpu_set_flag(Z, 1, &cpu);
-        bus_write(PRG_START, OPC_BNE_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BNE_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         Word expected_pc = PRG_START + 2;
 
         cpu_execute(2, &cpu);
@@ -1159,8 +1171,8 @@ void test_branches() {
         test_reset();
         test_header("BNE - taken (Z=0), offset +0x05");
         cpu_set_flag(Z, 0, &cpu);
-        bus_write(PRG_START, OPC_BNE_REL);
-        bus_write(PRG_START + 1, 0x05);
+        bus_write(&test_bus, PRG_START, OPC_BNE_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x05);
         Word expected_pc = PRG_START + 2 + 0x05;
 
         cpu_execute(3, &cpu);
@@ -1173,8 +1185,8 @@ void test_branches() {
         test_reset();
         test_header("BEQ - not taken (Z=0)");
         cpu_set_flag(Z, 0, &cpu);
-        bus_write(PRG_START, OPC_BEQ_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BEQ_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         Word expected_pc = PRG_START + 2;
 
         cpu_execute(2, &cpu);
@@ -1187,8 +1199,8 @@ void test_branches() {
         test_reset();
         test_header("BEQ - taken (Z=1), offset +0x05");
         cpu_set_flag(Z, 1, &cpu);
-        bus_write(PRG_START, OPC_BEQ_REL);
-        bus_write(PRG_START + 1, 0x05);
+        bus_write(&test_bus, PRG_START, OPC_BEQ_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x05);
         Word expected_pc = PRG_START + 2 + 0x05;
 
         cpu_execute(3, &cpu);
@@ -1201,8 +1213,8 @@ void test_branches() {
         test_reset();
         test_header("BPL - not taken (N=1)");
         cpu_set_flag(N, 1, &cpu);
-        bus_write(PRG_START, OPC_BPL_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BPL_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         Word expected_pc = PRG_START + 2;
 
         cpu_execute(2, &cpu);
@@ -1215,8 +1227,8 @@ void test_branches() {
         test_reset();
         test_header("BPL - taken (N=0), backward offset -0x10 (0xF0)");
         cpu_set_flag(N, 0, &cpu);
-        bus_write(PRG_START, OPC_BPL_REL);
-        bus_write(PRG_START + 1, 0xF0);  // signed: -16
+        bus_write(&test_bus, PRG_START, OPC_BPL_REL);
+        bus_write(&test_bus, PRG_START + 1, 0xF0);  // signed: -16
         // After fetch: PC=0x0202, +(-16) = 0x01F2; page cross 0x02xx->0x01xx = +1 cycle
         Word expected_pc = (Word)(PRG_START + 2 + (int8_t)0xF0);
 
@@ -1233,8 +1245,8 @@ void test_branches() {
         test_reset();
         test_header("BMI - not taken (N=0)");
         cpu_set_flag(N, 0, &cpu);
-        bus_write(PRG_START, OPC_BMI_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BMI_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         Word expected_pc = PRG_START + 2;
 
         cpu_execute(2, &cpu);
@@ -1247,8 +1259,8 @@ void test_branches() {
         test_reset();
         test_header("BMI - taken (N=1), offset +0x06");
         cpu_set_flag(N, 1, &cpu);
-        bus_write(PRG_START, OPC_BMI_REL);
-        bus_write(PRG_START + 1, 0x06);
+        bus_write(&test_bus, PRG_START, OPC_BMI_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x06);
         Word expected_pc = PRG_START + 2 + 0x06;
 
         cpu_execute(3, &cpu);
@@ -1261,8 +1273,8 @@ void test_branches() {
         test_reset();
         test_header("BVC - not taken (V=1)");
         cpu_set_flag(V, 1, &cpu);
-        bus_write(PRG_START, OPC_BVC_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BVC_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         Word expected_pc = PRG_START + 2;
 
         cpu_execute(2, &cpu);
@@ -1275,8 +1287,8 @@ void test_branches() {
         test_reset();
         test_header("BVC - taken (V=0), offset +0x04");
         cpu_set_flag(V, 0, &cpu);
-        bus_write(PRG_START, OPC_BVC_REL);
-        bus_write(PRG_START + 1, 0x04);
+        bus_write(&test_bus, PRG_START, OPC_BVC_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x04);
         Word expected_pc = PRG_START + 2 + 0x04;
 
         cpu_execute(3, &cpu);
@@ -1289,8 +1301,8 @@ void test_branches() {
         test_reset();
         test_header("BVS - not taken (V=0)");
         cpu_set_flag(V, 0, &cpu);
-        bus_write(PRG_START, OPC_BVS_REL);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_BVS_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         Word expected_pc = PRG_START + 2;
 
         cpu_execute(2, &cpu);
@@ -1303,8 +1315,8 @@ void test_branches() {
         test_reset();
         test_header("BVS - taken (V=1), offset +0x04");
         cpu_set_flag(V, 1, &cpu);
-        bus_write(PRG_START, OPC_BVS_REL);
-        bus_write(PRG_START + 1, 0x04);
+        bus_write(&test_bus, PRG_START, OPC_BVS_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x04);
         Word expected_pc = PRG_START + 2 + 0x04;
 
         cpu_execute(3, &cpu);
@@ -1323,9 +1335,9 @@ void test_bit() {
         test_reset();
         test_header("BIT ZP - A=0x0F & ZP[0x10]=0xF0 -> Z=1 (no bits in common)");
         cpu.regs.A = 0x0F;
-        bus_write(0x10, 0xF0);
-        bus_write(PRG_START, OPC_BIT_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_BIT_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -1347,9 +1359,9 @@ void test_bit() {
         test_reset();
         test_header("BIT ZP - A=0xFF & ZP[0x20]=0x7F -> Z=0, N=0, V=1");
         cpu.regs.A = 0xFF;
-        bus_write(0x20, 0x7F);  // 0111 1111: bit7=0, bit6=1
-        bus_write(PRG_START, OPC_BIT_ZP);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x20, 0x7F);  // 0111 1111: bit7=0, bit6=1
+        bus_write(&test_bus, PRG_START, OPC_BIT_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
 
         cpu_execute(3, &cpu);
@@ -1367,9 +1379,9 @@ void test_bit() {
         test_reset();
         test_header("BIT ZP - A=0xFF & ZP[0x30]=0x01 -> Z=0, N=0, V=0");
         cpu.regs.A = 0xFF;
-        bus_write(0x30, 0x01);  // bit7=0, bit6=0
-        bus_write(PRG_START, OPC_BIT_ZP);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x01);  // bit7=0, bit6=0
+        bus_write(&test_bus, PRG_START, OPC_BIT_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
 
         cpu_execute(3, &cpu);
 
@@ -1384,8 +1396,8 @@ void test_bit() {
         test_reset();
         test_header("BIT ABS - A=0x00 & mem[0x0300]=0xC0 -> Z=1, N=1, V=1");
         cpu.regs.A = 0x00;
-        bus_write(DATA_PAGE, 0xC0);  // bit7=1, bit6=1
-        bus_write(PRG_START, OPC_BIT_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0xC0);  // bit7=1, bit6=1
+        bus_write(&test_bus, PRG_START, OPC_BIT_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -1412,11 +1424,11 @@ void test_brk() {
         test_header("BRK - push PC, push flags w/ B set, jump to IRQ vector");
 
         // Set IRQ vector at 0xFFFE/0xFFFF -> 0x1234
-        bus_write(0xFFFE, 0x34);
-        bus_write(0xFFFF, 0x12);
+        bus_write(&test_bus, 0xFFFE, 0x34);
+        bus_write(&test_bus, 0xFFFF, 0x12);
 
         // BRK at PRG_START (0x0200)
-        bus_write(PRG_START, OPC_BRK_IMP);
+        bus_write(&test_bus, PRG_START, OPC_BRK_IMP);
         print_program(PRG_START, 1);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -1425,7 +1437,7 @@ void test_brk() {
         printf("  IRQ vector -> 0x1234\n");
 
         // After fetching opcode PC=0x0201, stack_PC = 0x0201+1 = 0x0202 (skip padding byte)
-        Byte flags_before = cpu.flags;
+        Byte flags_before = cpu_flags(&cpu);
         cpu_execute(7, &cpu);
 
         printf(" After:\n");
@@ -1433,19 +1445,19 @@ void test_brk() {
         print_flags(&cpu);
         printf("  SP=0x%02X\n", cpu.SP);
         printf("  Stack[0x1FF]=0x%02X (PC hi), Stack[0x1FE]=0x%02X (PC lo)\n",
-               bus_read(0x1FF), bus_read(0x1FE));
-        printf("  Stack[0x1FD]=0x%02X (pushed flags)\n", bus_read(0x1FD));
+               bus_read(&test_bus, 0x1FF), bus_read(&test_bus, 0x1FE));
+        printf("  Stack[0x1FD]=0x%02X (pushed flags)\n", bus_read(&test_bus, 0x1FD));
 
         // PC after fetch opcode = 0x0201; stack_PC = 0x0201 + 1 = 0x0202 (skip padding byte)
-        Word pushed_pc = ((Word)bus_read(0x1FF) << 8) | bus_read(0x1FE);
-        Byte pushed_flags = bus_read(0x1FD);
+        Word pushed_pc = ((Word)bus_read(&test_bus, 0x1FF) << 8) | bus_read(&test_bus, 0x1FE);
+        Byte pushed_flags = bus_read(&test_bus, 0x1FD);
 
         check("PC == 0x1234 (IRQ vector)", cpu.PC == 0x1234);
         check("SP == 0xFC (3 bytes pushed)", cpu.SP == 0xFC);
         check("Pushed PC == 0x0202", pushed_pc == 0x0202);
         check("Pushed flags has B set (bit4)", (pushed_flags >> 4) & 1);
         check("I flag set after BRK", cpu_read_flag(I, &cpu) == 1);
-        check("B flag cleared after BRK (not in cpu.flags)", cpu_read_flag(B, &cpu) == 0);
+        check("B flag cleared after BRK (not in cpu_flags(&cpu))", cpu_read_flag(B, &cpu) == 0);
     }
 }
 
@@ -1458,65 +1470,65 @@ void test_mem_rw() {
     {
         test_reset();
         test_header("MEM RW - write 0xAB to 0x0400, read it back");
-        mem_write(0x0400, 0xAB);
-        printf("  mem[0x0400] = 0x%02X\n", mem_read(0x0400));
-        check("mem_read == 0xAB after mem_write", mem_read(0x0400) == 0xAB);
+        mem_write(&test_bus.ram, 0x0400, 0xAB);
+        printf("  mem[0x0400] = 0x%02X\n", mem_read(&test_bus.ram, 0x0400));
+        check("mem_read == 0xAB after mem_write", mem_read(&test_bus.ram, 0x0400) == 0xAB);
     }
 
     // Zero page write/read
     {
         test_reset();
         test_header("MEM RW - zero page 0x0042");
-        mem_write(0x0042, 0x55);
-        check("ZP mem_read == 0x55", mem_read(0x0042) == 0x55);
+        mem_write(&test_bus.ram, 0x0042, 0x55);
+        check("ZP mem_read == 0x55", mem_read(&test_bus.ram, 0x0042) == 0x55);
     }
 
     // Overwrite same address
     {
         test_reset();
         test_header("MEM RW - overwrite 0x0010: 0xAA -> 0xBB");
-        mem_write(0x0010, 0xAA);
-        check("First write == 0xAA", mem_read(0x0010) == 0xAA);
-        mem_write(0x0010, 0xBB);
-        check("Overwrite -> 0xBB", mem_read(0x0010) == 0xBB);
+        mem_write(&test_bus.ram, 0x0010, 0xAA);
+        check("First write == 0xAA", mem_read(&test_bus.ram, 0x0010) == 0xAA);
+        mem_write(&test_bus.ram, 0x0010, 0xBB);
+        check("Overwrite -> 0xBB", mem_read(&test_bus.ram, 0x0010) == 0xBB);
     }
 
     // Write zero byte
     {
         test_reset();
         test_header("MEM RW - write 0xFF then overwrite with 0x00");
-        mem_write(0x0500, 0xFF);
-        mem_write(0x0500, 0x00);
-        check("mem_read == 0x00", mem_read(0x0500) == 0x00);
+        mem_write(&test_bus.ram, 0x0500, 0xFF);
+        mem_write(&test_bus.ram, 0x0500, 0x00);
+        check("mem_read == 0x00", mem_read(&test_bus.ram, 0x0500) == 0x00);
     }
 
     // Reset clears memory
     {
         test_reset();
         test_header("MEM RESET - cleared on bus_reset");
-        mem_write(0x0300, 0xDE);
-        mem_write(0x00FF, 0xAD);
-        bus_reset();
-        check("mem[0x0300] == 0x00 after reset", mem_read(0x0300) == 0x00);
-        check("mem[0x00FF] == 0x00 after reset", mem_read(0x00FF) == 0x00);
+        mem_write(&test_bus.ram, 0x0300, 0xDE);
+        mem_write(&test_bus.ram, 0x00FF, 0xAD);
+        bus_reset(&test_bus);
+        check("mem[0x0300] == 0x00 after reset", mem_read(&test_bus.ram, 0x0300) == 0x00);
+        check("mem[0x00FF] == 0x00 after reset", mem_read(&test_bus.ram, 0x00FF) == 0x00);
     }
 
     // Adjacent addresses independent
     {
         test_reset();
         test_header("MEM RW - adjacent addresses 0x0200/0x0201 are independent");
-        mem_write(0x0200, 0x11);
-        mem_write(0x0201, 0x22);
-        check("mem[0x0200] == 0x11", mem_read(0x0200) == 0x11);
-        check("mem[0x0201] == 0x22", mem_read(0x0201) == 0x22);
+        mem_write(&test_bus.ram, 0x0200, 0x11);
+        mem_write(&test_bus.ram, 0x0201, 0x22);
+        check("mem[0x0200] == 0x11", mem_read(&test_bus.ram, 0x0200) == 0x11);
+        check("mem[0x0201] == 0x22", mem_read(&test_bus.ram, 0x0201) == 0x22);
     }
 
     // High address - using only valid 2KB range
     {
         test_reset();
         test_header("MEM RW - high address within 2KB limit 0x07FF");
-        mem_write(0x07FF, 0x7E);
-        check("mem[0x07FF] == 0x7E", mem_read(0x07FF) == 0x7E);
+        mem_write(&test_bus.ram, 0x07FF, 0x7E);
+        check("mem[0x07FF] == 0x7E", mem_read(&test_bus.ram, 0x07FF) == 0x7E);
     }
 }
 
@@ -1532,9 +1544,9 @@ void test_stack() {
         Byte sp_before = cpu.SP;
         stack_push(0x42, &cpu);
         printf("  SP: 0x%02X -> 0x%02X, Stack[0x1%02X]=0x%02X\n",
-               sp_before, cpu.SP, sp_before, bus_read(0x100 + sp_before));
+               sp_before, cpu.SP, sp_before, bus_read(&test_bus, 0x100 + sp_before));
         check("SP decremented", cpu.SP == (Byte)(sp_before - 1));
-        check("Value on stack == 0x42", bus_read(0x100 + sp_before) == 0x42);
+        check("Value on stack == 0x42", bus_read(&test_bus, 0x100 + sp_before) == 0x42);
     }
 
     // Round-trip push/pop
@@ -1574,9 +1586,9 @@ void test_stack() {
         stack_push(0xCA, &cpu);
         stack_push(0xFE, &cpu);
         printf("  Stack[0x1FF]=0x%02X, Stack[0x1FE]=0x%02X\n",
-               bus_read(0x1FF), bus_read(0x1FE));
-        check("Stack[0x1FF] == 0xCA", bus_read(0x1FF) == 0xCA);
-        check("Stack[0x1FE] == 0xFE", bus_read(0x1FE) == 0xFE);
+               bus_read(&test_bus, 0x1FF), bus_read(&test_bus, 0x1FE));
+        check("Stack[0x1FF] == 0xCA", bus_read(&test_bus, 0x1FF) == 0xCA);
+        check("Stack[0x1FE] == 0xFE", bus_read(&test_bus, 0x1FE) == 0xFE);
     }
 
     // Push word big-endian (hi first, lo second) - like BRK does for PC
@@ -1623,7 +1635,7 @@ void test_clear_flags() {
         test_reset();
         test_header("CLC - clear carry flag");
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_CLC_IMP);
+        bus_write(&test_bus, PRG_START, OPC_CLC_IMP);
         print_program(PRG_START, 1);
         printf(" Before:\n");
         print_flags(&cpu);
@@ -1640,7 +1652,7 @@ void test_clear_flags() {
         test_reset();
         test_header("CLD - clear decimal flag");
         cpu_set_flag(D, 1, &cpu);
-        bus_write(PRG_START, OPC_CLD_IMP);
+        bus_write(&test_bus, PRG_START, OPC_CLD_IMP);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -1654,7 +1666,7 @@ void test_clear_flags() {
         test_reset();
         test_header("CLI - clear interrupt disable flag");
         cpu_set_flag(I, 1, &cpu);
-        bus_write(PRG_START, OPC_CLI_IMP);
+        bus_write(&test_bus, PRG_START, OPC_CLI_IMP);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -1668,7 +1680,7 @@ void test_clear_flags() {
         test_reset();
         test_header("CLV - clear overflow flag");
         cpu_set_flag(V, 1, &cpu);
-        bus_write(PRG_START, OPC_CLV_IMP);
+        bus_write(&test_bus, PRG_START, OPC_CLV_IMP);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -1688,8 +1700,8 @@ void test_cmp() {
         test_reset();
         test_header("CMP IM - A=0x50 vs 0x30 (A > operand)");
         cpu.regs.A = 0x50;
-        bus_write(PRG_START, OPC_CMP_IM);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, PRG_START, OPC_CMP_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -1708,8 +1720,8 @@ void test_cmp() {
         test_reset();
         test_header("CMP IM - A=0x42 vs 0x42 (A == operand)");
         cpu.regs.A = 0x42;
-        bus_write(PRG_START, OPC_CMP_IM);
-        bus_write(PRG_START + 1, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_CMP_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x42);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -1726,8 +1738,8 @@ void test_cmp() {
         test_reset();
         test_header("CMP IM - A=0x30 vs 0x50 (A < operand)");
         cpu.regs.A = 0x30;
-        bus_write(PRG_START, OPC_CMP_IM);
-        bus_write(PRG_START + 1, 0x50);
+        bus_write(&test_bus, PRG_START, OPC_CMP_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x50);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -1744,9 +1756,9 @@ void test_cmp() {
         test_reset();
         test_header("CMP ZP - A=0x80 vs ZP[0x10]=0x80 (equal)");
         cpu.regs.A = 0x80;
-        bus_write(0x10, 0x80);
-        bus_write(PRG_START, OPC_CMP_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_CMP_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
 
         cpu_execute(3, &cpu);
@@ -1763,9 +1775,9 @@ void test_cmp() {
         test_header("CMP ZP,X - A=0x70 vs ZP[0x10+X=0x05]=0x60");
         cpu.regs.A = 0x70;
         cpu.regs.X = 0x05;
-        bus_write(0x15, 0x60);
-        bus_write(PRG_START, OPC_CMP_ZPX);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x15, 0x60);
+        bus_write(&test_bus, PRG_START, OPC_CMP_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
 
         cpu_execute(4, &cpu);
@@ -1781,8 +1793,8 @@ void test_cmp() {
         test_reset();
         test_header("CMP ABS - A=0x20 vs mem[0x0300]=0x40");
         cpu.regs.A = 0x20;
-        bus_write(DATA_PAGE, 0x40);
-        bus_write(PRG_START, OPC_CMP_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x40);
+        bus_write(&test_bus, PRG_START, OPC_CMP_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -1801,8 +1813,8 @@ void test_cmp() {
         test_header("CMP ABS,X - no page cross");
         cpu.regs.A = 0xFF;
         cpu.regs.X = 0x05;
-        bus_write(DATA_PAGE + 0x05, 0xFF);
-        bus_write(PRG_START, OPC_CMP_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x05, 0xFF);
+        bus_write(&test_bus, PRG_START, OPC_CMP_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -1820,8 +1832,8 @@ void test_cmp() {
         test_header("CMP ABS,Y - page cross");
         cpu.regs.A = 0x01;
         cpu.regs.Y = 0x05;
-        bus_write(0x0403, 0x02);
-        bus_write(PRG_START, OPC_CMP_ABSY);
+        bus_write(&test_bus, 0x0403, 0x02);
+        bus_write(&test_bus, PRG_START, OPC_CMP_ABSY);
         bus_write_word(PRG_START + 1, 0x03FE);
         print_program(PRG_START, 3);
 
@@ -1838,11 +1850,11 @@ void test_cmp() {
         test_header("CMP (IND,X) - A=0x88 vs mem");
         cpu.regs.A = 0x88;
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x00);
-        bus_write(0x25, 0x03);
-        bus_write(DATA_PAGE, 0x88);
-        bus_write(PRG_START, OPC_CMP_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);
+        bus_write(&test_bus, 0x25, 0x03);
+        bus_write(&test_bus, DATA_PAGE, 0x88);
+        bus_write(&test_bus, PRG_START, OPC_CMP_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
 
         cpu_execute(6, &cpu);
@@ -1859,11 +1871,11 @@ void test_cmp() {
         test_header("CMP (IND),Y - A=0x10 vs mem=0x20");
         cpu.regs.A = 0x10;
         cpu.regs.Y = 0x05;
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
-        bus_write(0x0305, 0x20);
-        bus_write(PRG_START, OPC_CMP_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
+        bus_write(&test_bus, 0x0305, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_CMP_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         print_program(PRG_START, 2);
 
         cpu_execute(5, &cpu);
@@ -1885,8 +1897,8 @@ void test_cpx_cpy() {
         test_reset();
         test_header("CPX IM - X=0x50 vs 0x30 (X > operand)");
         cpu.regs.X = 0x50;
-        bus_write(PRG_START, OPC_CPX_IM);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, PRG_START, OPC_CPX_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -1905,8 +1917,8 @@ void test_cpx_cpy() {
         test_reset();
         test_header("CPX IM - X=0x42 vs 0x42 (equal)");
         cpu.regs.X = 0x42;
-        bus_write(PRG_START, OPC_CPX_IM);
-        bus_write(PRG_START + 1, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_CPX_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x42);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -1922,9 +1934,9 @@ void test_cpx_cpy() {
         test_reset();
         test_header("CPX ZP - X=0x20 vs ZP[0x10]=0x30");
         cpu.regs.X = 0x20;
-        bus_write(0x10, 0x30);
-        bus_write(PRG_START, OPC_CPX_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x30);
+        bus_write(&test_bus, PRG_START, OPC_CPX_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
 
         cpu_execute(3, &cpu);
@@ -1940,8 +1952,8 @@ void test_cpx_cpy() {
         test_reset();
         test_header("CPX ABS - X=0xFF vs mem[0x0300]=0x01");
         cpu.regs.X = 0xFF;
-        bus_write(DATA_PAGE, 0x01);
-        bus_write(PRG_START, OPC_CPX_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x01);
+        bus_write(&test_bus, PRG_START, OPC_CPX_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -1958,8 +1970,8 @@ void test_cpx_cpy() {
         test_reset();
         test_header("CPY IM - Y=0x80 vs 0x40 (Y > operand)");
         cpu.regs.Y = 0x80;
-        bus_write(PRG_START, OPC_CPY_IM);
-        bus_write(PRG_START + 1, 0x40);
+        bus_write(&test_bus, PRG_START, OPC_CPY_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x40);
         print_program(PRG_START, 2);
 
         cpu_execute(2, &cpu);
@@ -1977,9 +1989,9 @@ void test_cpx_cpy() {
         test_reset();
         test_header("CPY ZP - Y=0x55 vs ZP[0x20]=0x55 (equal)");
         cpu.regs.Y = 0x55;
-        bus_write(0x20, 0x55);
-        bus_write(PRG_START, OPC_CPY_ZP);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x20, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_CPY_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
 
         cpu_execute(3, &cpu);
@@ -1995,8 +2007,8 @@ void test_cpx_cpy() {
         test_reset();
         test_header("CPY ABS - Y=0x10 vs mem[0x0300]=0x20");
         cpu.regs.Y = 0x10;
-        bus_write(DATA_PAGE, 0x20);
-        bus_write(PRG_START, OPC_CPY_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_CPY_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -2018,9 +2030,9 @@ void test_dec() {
     {
         test_reset();
         test_header("DEC ZP - ZP[0x10]=0x42 -> 0x41");
-        bus_write(0x10, 0x42);
-        bus_write(PRG_START, OPC_DEC_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_DEC_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
         printf(" Before:\n");
         print_mem_range(0x10, 1);
@@ -2030,7 +2042,7 @@ void test_dec() {
         printf(" After:\n");
         print_mem_range(0x10, 1);
         print_flags(&cpu);
-        check("ZP[0x10] == 0x41", bus_read(0x10) == 0x41);
+        check("ZP[0x10] == 0x41", bus_read(&test_bus, 0x10) == 0x41);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
         check("N == 0", cpu_read_flag(N, &cpu) == 0);
     }
@@ -2039,9 +2051,9 @@ void test_dec() {
     {
         test_reset();
         test_header("DEC ZP - ZP[0x20]=0x00 -> 0xFF (wrap)");
-        bus_write(0x20, 0x00);
-        bus_write(PRG_START, OPC_DEC_ZP);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x20, 0x00);
+        bus_write(&test_bus, PRG_START, OPC_DEC_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         print_program(PRG_START, 2);
 
         cpu_execute(5, &cpu);
@@ -2049,7 +2061,7 @@ void test_dec() {
         printf(" After:\n");
         print_mem_range(0x20, 1);
         print_flags(&cpu);
-        check("ZP[0x20] == 0xFF (wrapped)", bus_read(0x20) == 0xFF);
+        check("ZP[0x20] == 0xFF (wrapped)", bus_read(&test_bus, 0x20) == 0xFF);
         check("N == 1 (negative)", cpu_read_flag(N, &cpu) == 1);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
     }
@@ -2058,9 +2070,9 @@ void test_dec() {
     {
         test_reset();
         test_header("DEC ZP - ZP[0x30]=0x01 -> 0x00 (zero flag)");
-        bus_write(0x30, 0x01);
-        bus_write(PRG_START, OPC_DEC_ZP);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x01);
+        bus_write(&test_bus, PRG_START, OPC_DEC_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         print_program(PRG_START, 2);
 
         cpu_execute(5, &cpu);
@@ -2068,7 +2080,7 @@ void test_dec() {
         printf(" After:\n");
         print_mem_range(0x30, 1);
         print_flags(&cpu);
-        check("ZP[0x30] == 0x00", bus_read(0x30) == 0x00);
+        check("ZP[0x30] == 0x00", bus_read(&test_bus, 0x30) == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
         check("N == 0", cpu_read_flag(N, &cpu) == 0);
     }
@@ -2078,24 +2090,24 @@ void test_dec() {
         test_reset();
         test_header("DEC ZP,X - ZP[0x10+X=0x05]=0x15, val=0x50 -> 0x4F");
         cpu.regs.X = 0x05;
-        bus_write(0x15, 0x50);
-        bus_write(PRG_START, OPC_DEC_ZPX);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x15, 0x50);
+        bus_write(&test_bus, PRG_START, OPC_DEC_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         print_program(PRG_START, 2);
 
         cpu_execute(6, &cpu);
 
         printf(" After:\n");
         print_mem_range(0x15, 1);
-        check("ZP[0x15] == 0x4F", bus_read(0x15) == 0x4F);
+        check("ZP[0x15] == 0x4F", bus_read(&test_bus, 0x15) == 0x4F);
     }
 
     // DEC ABS
     {
         test_reset();
         test_header("DEC ABS - mem[0x0300]=0x80 -> 0x7F");
-        bus_write(DATA_PAGE, 0x80);
-        bus_write(PRG_START, OPC_DEC_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_DEC_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -2104,7 +2116,7 @@ void test_dec() {
         printf(" After:\n");
         print_mem_range(DATA_PAGE, 1);
         print_flags(&cpu);
-        check("mem[0x0300] == 0x7F", bus_read(DATA_PAGE) == 0x7F);
+        check("mem[0x0300] == 0x7F", bus_read(&test_bus, DATA_PAGE) == 0x7F);
         check("N == 0", cpu_read_flag(N, &cpu) == 0);
     }
 
@@ -2113,8 +2125,8 @@ void test_dec() {
         test_reset();
         test_header("DEC ABS,X - mem[0x0300+X=0x02]=0x0302, val=0xFF -> 0xFE");
         cpu.regs.X = 0x02;
-        bus_write(DATA_PAGE + 0x02, 0xFF);
-        bus_write(PRG_START, OPC_DEC_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x02, 0xFF);
+        bus_write(&test_bus, PRG_START, OPC_DEC_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         print_program(PRG_START, 3);
 
@@ -2123,7 +2135,7 @@ void test_dec() {
         printf(" After:\n");
         print_mem_range(DATA_PAGE + 0x02, 1);
         print_flags(&cpu);
-        check("mem[0x0302] == 0xFE", bus_read(DATA_PAGE + 0x02) == 0xFE);
+        check("mem[0x0302] == 0xFE", bus_read(&test_bus, DATA_PAGE + 0x02) == 0xFE);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
     }
 }
@@ -2138,7 +2150,7 @@ void test_dex_dey() {
         test_reset();
         test_header("DEX - X=0x50 -> 0x4F");
         cpu.regs.X = 0x50;
-        bus_write(PRG_START, OPC_DEX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_DEX_IMP);
         print_program(PRG_START, 1);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -2158,7 +2170,7 @@ void test_dex_dey() {
         test_reset();
         test_header("DEX - X=0x01 -> 0x00 (zero flag)");
         cpu.regs.X = 0x01;
-        bus_write(PRG_START, OPC_DEX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_DEX_IMP);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -2176,7 +2188,7 @@ void test_dex_dey() {
         test_reset();
         test_header("DEX - X=0x00 -> 0xFF (wrap)");
         cpu.regs.X = 0x00;
-        bus_write(PRG_START, OPC_DEX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_DEX_IMP);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -2194,7 +2206,7 @@ void test_dex_dey() {
         test_reset();
         test_header("DEY - Y=0x80 -> 0x7F");
         cpu.regs.Y = 0x80;
-        bus_write(PRG_START, OPC_DEY_IMP);
+        bus_write(&test_bus, PRG_START, OPC_DEY_IMP);
         print_program(PRG_START, 1);
         printf(" Before:\n");
         print_regs(&cpu);
@@ -2214,7 +2226,7 @@ void test_dex_dey() {
         test_reset();
         test_header("DEY - Y=0x01 -> 0x00 (zero flag)");
         cpu.regs.Y = 0x01;
-        bus_write(PRG_START, OPC_DEY_IMP);
+        bus_write(&test_bus, PRG_START, OPC_DEY_IMP);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -2231,7 +2243,7 @@ void test_dex_dey() {
         test_reset();
         test_header("DEY - Y=0x00 -> 0xFF (wrap)");
         cpu.regs.Y = 0x00;
-        bus_write(PRG_START, OPC_DEY_IMP);
+        bus_write(&test_bus, PRG_START, OPC_DEY_IMP);
         print_program(PRG_START, 1);
 
         cpu_execute(2, &cpu);
@@ -2254,9 +2266,9 @@ void test_adc_modes() {
         test_header("ADC ZP - 0x10 + ZP[0x10]=0x20 = 0x30");
         cpu.regs.A = 0x10;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(0x10, 0x20);
-        bus_write(PRG_START, OPC_ADC_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
     }
@@ -2267,9 +2279,9 @@ void test_adc_modes() {
         cpu.regs.A = 0x10;
         cpu.regs.X = 0x04;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(0x24, 0x20);
-        bus_write(PRG_START, OPC_ADC_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
     }
@@ -2279,8 +2291,8 @@ void test_adc_modes() {
         test_header("ADC ABS - 0x10 + mem[0x0300]=0x20 = 0x30");
         cpu.regs.A = 0x10;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(DATA_PAGE, 0x20);
-        bus_write(PRG_START, OPC_ADC_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
@@ -2292,8 +2304,8 @@ void test_adc_modes() {
         cpu.regs.A = 0x10;
         cpu.regs.X = 0x04;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(DATA_PAGE + 0x04, 0x20);
-        bus_write(PRG_START, OPC_ADC_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
@@ -2305,8 +2317,8 @@ void test_adc_modes() {
         cpu.regs.A = 0x10;
         cpu.regs.Y = 0x04;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(DATA_PAGE + 0x04, 0x20);
-        bus_write(PRG_START, OPC_ADC_ABSY);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_ABSY);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
@@ -2318,11 +2330,11 @@ void test_adc_modes() {
         cpu.regs.A = 0x10;
         cpu.regs.X = 0x04;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(0x24, 0x00);
-        bus_write(0x25, 0x03);
-        bus_write(DATA_PAGE, 0x20);
-        bus_write(PRG_START, OPC_ADC_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);
+        bus_write(&test_bus, 0x25, 0x03);
+        bus_write(&test_bus, DATA_PAGE, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
     }
@@ -2333,11 +2345,11 @@ void test_adc_modes() {
         cpu.regs.A = 0x10;
         cpu.regs.Y = 0x08;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
-        bus_write(DATA_PAGE + 0x08, 0x20);
-        bus_write(PRG_START, OPC_ADC_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
+        bus_write(&test_bus, DATA_PAGE + 0x08, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ADC_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         cpu_execute(5, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
     }
@@ -2352,8 +2364,8 @@ void test_eor() {
         test_reset();
         test_header("EOR IM - 0xFF ^ 0x0F = 0xF0");
         cpu.regs.A = 0xFF;
-        bus_write(PRG_START, OPC_EOR_IM);
-        bus_write(PRG_START + 1, 0x0F);
+        bus_write(&test_bus, PRG_START, OPC_EOR_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x0F);
         cpu_execute(2, &cpu);
         check("A == 0xF0", cpu.regs.A == 0xF0);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2364,9 +2376,9 @@ void test_eor() {
         test_reset();
         test_header("EOR ZP - 0x55 ^ ZP[0x10]=0x55 = 0x00 (Z=1)");
         cpu.regs.A = 0x55;
-        bus_write(0x10, 0x55);
-        bus_write(PRG_START, OPC_EOR_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_EOR_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -2377,9 +2389,9 @@ void test_eor() {
         test_header("EOR ZPX - 0x55 ^ ZP[0x20+X=0x04]=0x24, val=0x55 = 0x00");
         cpu.regs.A = 0x55;
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x55);
-        bus_write(PRG_START, OPC_EOR_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_EOR_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -2389,8 +2401,8 @@ void test_eor() {
         test_reset();
         test_header("EOR ABS - 0x55 ^ mem[0x0300]=0x55 = 0x00");
         cpu.regs.A = 0x55;
-        bus_write(DATA_PAGE, 0x55);
-        bus_write(PRG_START, OPC_EOR_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_EOR_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
@@ -2402,8 +2414,8 @@ void test_eor() {
         test_header("EOR ABSX - 0x55 ^ mem[0x0300+X=0x04]=0x0304, val=0x55 = 0x00");
         cpu.regs.A = 0x55;
         cpu.regs.X = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x55);
-        bus_write(PRG_START, OPC_EOR_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_EOR_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
@@ -2415,8 +2427,8 @@ void test_eor() {
         test_header("EOR ABSY - 0x55 ^ mem[0x0300+Y=0x04]=0x0304, val=0x55 = 0x00");
         cpu.regs.A = 0x55;
         cpu.regs.Y = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x55);
-        bus_write(PRG_START, OPC_EOR_ABSY);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_EOR_ABSY);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
@@ -2428,11 +2440,11 @@ void test_eor() {
         test_header("EOR INDX - ptr at ZP (0x20+X=0x04)=0x24 -> 0x0300, val=0x55");
         cpu.regs.A = 0x55;
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x00);
-        bus_write(0x25, 0x03);
-        bus_write(DATA_PAGE, 0x55);
-        bus_write(PRG_START, OPC_EOR_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);
+        bus_write(&test_bus, 0x25, 0x03);
+        bus_write(&test_bus, DATA_PAGE, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_EOR_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -2443,11 +2455,11 @@ void test_eor() {
         test_header("EOR INDY - ptr at ZP 0x30 -> 0x0300 + Y=0x08 -> 0x0308, val=0x55");
         cpu.regs.A = 0x55;
         cpu.regs.Y = 0x08;
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
-        bus_write(DATA_PAGE + 0x08, 0x55);
-        bus_write(PRG_START, OPC_EOR_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
+        bus_write(&test_bus, DATA_PAGE + 0x08, 0x55);
+        bus_write(&test_bus, PRG_START, OPC_EOR_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         cpu_execute(5, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -2463,8 +2475,8 @@ void test_ora() {
         test_reset();
         test_header("ORA IM - 0x00 | 0xFF = 0xFF");
         cpu.regs.A = 0x00;
-        bus_write(PRG_START, OPC_ORA_IM);
-        bus_write(PRG_START + 1, 0xFF);
+        bus_write(&test_bus, PRG_START, OPC_ORA_IM);
+        bus_write(&test_bus, PRG_START + 1, 0xFF);
         cpu_execute(2, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2475,9 +2487,9 @@ void test_ora() {
         test_reset();
         test_header("ORA ZP - 0x0F | ZP[0x10]=0xF0 = 0xFF");
         cpu.regs.A = 0x0F;
-        bus_write(0x10, 0xF0);
-        bus_write(PRG_START, OPC_ORA_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_ORA_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2489,9 +2501,9 @@ void test_ora() {
         test_header("ORA ZPX - 0x0F | ZP[0x20+X=0x04]=0x24, val=0xF0 = 0xFF");
         cpu.regs.A = 0x0F;
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0xF0);
-        bus_write(PRG_START, OPC_ORA_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_ORA_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2502,8 +2514,8 @@ void test_ora() {
         test_reset();
         test_header("ORA ABS - 0x0F | mem[0x0300]=0xF0 = 0xFF");
         cpu.regs.A = 0x0F;
-        bus_write(DATA_PAGE, 0xF0);
-        bus_write(PRG_START, OPC_ORA_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_ORA_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
@@ -2516,8 +2528,8 @@ void test_ora() {
         test_header("ORA ABSX - 0x0F | mem[0x0300+X=0x04]=0x0304, val=0xF0 = 0xFF");
         cpu.regs.A = 0x0F;
         cpu.regs.X = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0xF0);
-        bus_write(PRG_START, OPC_ORA_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_ORA_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
@@ -2530,8 +2542,8 @@ void test_ora() {
         test_header("ORA ABSY - 0x0F | mem[0x0300+Y=0x04]=0x0304, val=0xF0 = 0xFF");
         cpu.regs.A = 0x0F;
         cpu.regs.Y = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0xF0);
-        bus_write(PRG_START, OPC_ORA_ABSY);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_ORA_ABSY);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
@@ -2544,11 +2556,11 @@ void test_ora() {
         test_header("ORA INDX - ptr at ZP (0x20+X=0x04)=0x24 -> 0x0300, val=0xF0");
         cpu.regs.A = 0x0F;
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x00);
-        bus_write(0x25, 0x03);
-        bus_write(DATA_PAGE, 0xF0);
-        bus_write(PRG_START, OPC_ORA_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);
+        bus_write(&test_bus, 0x25, 0x03);
+        bus_write(&test_bus, DATA_PAGE, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_ORA_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2560,11 +2572,11 @@ void test_ora() {
         test_header("ORA INDY - ptr at ZP 0x30 -> 0x0300 + Y=0x08 -> 0x0308, val=0xF0");
         cpu.regs.A = 0x0F;
         cpu.regs.Y = 0x08;
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
-        bus_write(DATA_PAGE + 0x08, 0xF0);
-        bus_write(PRG_START, OPC_ORA_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
+        bus_write(&test_bus, DATA_PAGE + 0x08, 0xF0);
+        bus_write(&test_bus, PRG_START, OPC_ORA_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         cpu_execute(5, &cpu);
         check("A == 0xFF", cpu.regs.A == 0xFF);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2582,8 +2594,8 @@ void test_sbc() {
         test_header("SBC IM - 0x50 - 0x30 = 0x20 (C=1, no borrow)");
         cpu.regs.A = 0x50;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_SBC_IM);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, PRG_START, OPC_SBC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         cpu_execute(2, &cpu);
         check("A == 0x20", cpu.regs.A == 0x20);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
@@ -2597,9 +2609,9 @@ void test_sbc() {
         test_header("SBC ZP - 0x40 - ZP[0x10]=0x10 = 0x30");
         cpu.regs.A = 0x40;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(0x10, 0x10);
-        bus_write(PRG_START, OPC_SBC_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_SBC_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
@@ -2611,9 +2623,9 @@ void test_sbc() {
         cpu.regs.A = 0x40;
         cpu.regs.X = 0x04;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(0x24, 0x10);
-        bus_write(PRG_START, OPC_SBC_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_SBC_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
@@ -2624,8 +2636,8 @@ void test_sbc() {
         test_header("SBC ABS - 0x40 - mem[0x0300]=0x10 = 0x30");
         cpu.regs.A = 0x40;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(DATA_PAGE, 0x10);
-        bus_write(PRG_START, OPC_SBC_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_SBC_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
@@ -2638,8 +2650,8 @@ void test_sbc() {
         cpu.regs.A = 0x40;
         cpu.regs.X = 0x04;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(DATA_PAGE + 0x04, 0x10);
-        bus_write(PRG_START, OPC_SBC_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_SBC_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
@@ -2652,8 +2664,8 @@ void test_sbc() {
         cpu.regs.A = 0x40;
         cpu.regs.Y = 0x04;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(DATA_PAGE + 0x04, 0x10);
-        bus_write(PRG_START, OPC_SBC_ABSY);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_SBC_ABSY);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
@@ -2666,11 +2678,11 @@ void test_sbc() {
         cpu.regs.A = 0x40;
         cpu.regs.X = 0x04;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(0x24, 0x00);
-        bus_write(0x25, 0x03);
-        bus_write(DATA_PAGE, 0x10);
-        bus_write(PRG_START, OPC_SBC_INDX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x00);
+        bus_write(&test_bus, 0x25, 0x03);
+        bus_write(&test_bus, DATA_PAGE, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_SBC_INDX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
@@ -2682,11 +2694,11 @@ void test_sbc() {
         cpu.regs.A = 0x40;
         cpu.regs.Y = 0x08;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(0x30, 0x00);
-        bus_write(0x31, 0x03);
-        bus_write(DATA_PAGE + 0x08, 0x10);
-        bus_write(PRG_START, OPC_SBC_INDY);
-        bus_write(PRG_START + 1, 0x30);
+        bus_write(&test_bus, 0x30, 0x00);
+        bus_write(&test_bus, 0x31, 0x03);
+        bus_write(&test_bus, DATA_PAGE + 0x08, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_SBC_INDY);
+        bus_write(&test_bus, PRG_START + 1, 0x30);
         cpu_execute(5, &cpu);
         check("A == 0x30", cpu.regs.A == 0x30);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
@@ -2697,8 +2709,8 @@ void test_sbc() {
         test_header("SBC IM - 0x50 - 0x50 = 0x00 (Z=1)");
         cpu.regs.A = 0x50;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_SBC_IM);
-        bus_write(PRG_START + 1, 0x50);
+        bus_write(&test_bus, PRG_START, OPC_SBC_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x50);
         cpu_execute(2, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -2713,8 +2725,8 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDX IM - load 0x42");
-        bus_write(PRG_START, OPC_LDX_IM);
-        bus_write(PRG_START + 1, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDX_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x42);
         cpu_execute(2, &cpu);
         check("X == 0x42", cpu.regs.X == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -2724,9 +2736,9 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDX ZP - load from ZP 0x10");
-        bus_write(0x10, 0x42);
-        bus_write(PRG_START, OPC_LDX_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDX_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
         check("X == 0x42", cpu.regs.X == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -2737,9 +2749,9 @@ void test_ldx_ldy() {
         test_reset();
         test_header("LDX ZPY - load from ZP[0x20+Y=0x04]=0x24");
         cpu.regs.Y = 0x04;
-        bus_write(0x24, 0x42);
-        bus_write(PRG_START, OPC_LDX_ZPY);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDX_ZPY);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
         check("X == 0x42", cpu.regs.X == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -2749,8 +2761,8 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDX ABS - load from 0x0300");
-        bus_write(DATA_PAGE, 0x42);
-        bus_write(PRG_START, OPC_LDX_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDX_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("X == 0x42", cpu.regs.X == 0x42);
@@ -2762,8 +2774,8 @@ void test_ldx_ldy() {
         test_reset();
         test_header("LDX ABY - load from 0x0300+Y=0x04 -> 0x0304");
         cpu.regs.Y = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x42);
-        bus_write(PRG_START, OPC_LDX_ABY);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDX_ABY);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("X == 0x42", cpu.regs.X == 0x42);
@@ -2774,8 +2786,8 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDX IM - load 0x80 (N=1)");
-        bus_write(PRG_START, OPC_LDX_IM);
-        bus_write(PRG_START + 1, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_LDX_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x80);
         cpu_execute(2, &cpu);
         check("X == 0x80", cpu.regs.X == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2784,8 +2796,8 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDY IM - load 0x42");
-        bus_write(PRG_START, OPC_LDY_IM);
-        bus_write(PRG_START + 1, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDY_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x42);
         cpu_execute(2, &cpu);
         check("Y == 0x42", cpu.regs.Y == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -2795,9 +2807,9 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDY ZP - load from ZP 0x10");
-        bus_write(0x10, 0x42);
-        bus_write(PRG_START, OPC_LDY_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDY_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
         check("Y == 0x42", cpu.regs.Y == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -2808,9 +2820,9 @@ void test_ldx_ldy() {
         test_reset();
         test_header("LDY ZPX - load from ZP[0x20+X=0x04]=0x24");
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x42);
-        bus_write(PRG_START, OPC_LDY_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDY_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
         check("Y == 0x42", cpu.regs.Y == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -2820,8 +2832,8 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDY ABS - load from 0x0300");
-        bus_write(DATA_PAGE, 0x42);
-        bus_write(PRG_START, OPC_LDY_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDY_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("Y == 0x42", cpu.regs.Y == 0x42);
@@ -2833,8 +2845,8 @@ void test_ldx_ldy() {
         test_reset();
         test_header("LDY ABX - load from 0x0300+X=0x04 -> 0x0304");
         cpu.regs.X = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x42);
-        bus_write(PRG_START, OPC_LDY_ABX);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x42);
+        bus_write(&test_bus, PRG_START, OPC_LDY_ABX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
         check("Y == 0x42", cpu.regs.Y == 0x42);
@@ -2845,8 +2857,8 @@ void test_ldx_ldy() {
     {
         test_reset();
         test_header("LDY IM - load 0x80 (N=1)");
-        bus_write(PRG_START, OPC_LDY_IM);
-        bus_write(PRG_START + 1, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_LDY_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x80);
         cpu_execute(2, &cpu);
         check("Y == 0x80", cpu.regs.Y == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -2862,12 +2874,12 @@ void test_stx_sty() {
         test_reset();
         test_header("STX ZP - store X=0xAB to ZP 0x10");
         cpu.regs.X = 0xAB;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_STX_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_STX_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
-        check("ZP[0x10] == 0xAB", bus_read(0x10) == 0xAB);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("ZP[0x10] == 0xAB", bus_read(&test_bus, 0x10) == 0xAB);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 
     {
@@ -2875,36 +2887,36 @@ void test_stx_sty() {
         test_header("STX ZPY - store X=0xAB to ZP[0x20+Y=0x04]=0x24");
         cpu.regs.X = 0xAB;
         cpu.regs.Y = 0x04;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_STX_ZPY);
-        bus_write(PRG_START + 1, 0x20);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_STX_ZPY);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
-        check("ZP[0x24] == 0xAB", bus_read(0x24) == 0xAB);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("ZP[0x24] == 0xAB", bus_read(&test_bus, 0x24) == 0xAB);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 
     {
         test_reset();
         test_header("STX ABS - store X=0xAB to 0x0300");
         cpu.regs.X = 0xAB;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_STX_ABS);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_STX_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
-        check("mem[0x0300] == 0xAB", bus_read(DATA_PAGE) == 0xAB);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("mem[0x0300] == 0xAB", bus_read(&test_bus, DATA_PAGE) == 0xAB);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 
     {
         test_reset();
         test_header("STY ZP - store Y=0xAB to ZP 0x10");
         cpu.regs.Y = 0xAB;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_STY_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_STY_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(3, &cpu);
-        check("ZP[0x10] == 0xAB", bus_read(0x10) == 0xAB);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("ZP[0x10] == 0xAB", bus_read(&test_bus, 0x10) == 0xAB);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 
     {
@@ -2912,24 +2924,24 @@ void test_stx_sty() {
         test_header("STY ZPX - store Y=0xAB to ZP[0x20+X=0x04]=0x24");
         cpu.regs.Y = 0xAB;
         cpu.regs.X = 0x04;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_STY_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_STY_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(4, &cpu);
-        check("ZP[0x24] == 0xAB", bus_read(0x24) == 0xAB);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("ZP[0x24] == 0xAB", bus_read(&test_bus, 0x24) == 0xAB);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 
     {
         test_reset();
         test_header("STY ABS - store Y=0xAB to 0x0300");
         cpu.regs.Y = 0xAB;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_STY_ABS);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_STY_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(4, &cpu);
-        check("mem[0x0300] == 0xAB", bus_read(DATA_PAGE) == 0xAB);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("mem[0x0300] == 0xAB", bus_read(&test_bus, DATA_PAGE) == 0xAB);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 }
 
@@ -2942,7 +2954,7 @@ void test_lsr() {
         test_reset();
         test_header("LSR ACC - 0x02 >> 1 = 0x01, C=0, Z=0, N=0");
         cpu.regs.A = 0x02;
-        bus_write(PRG_START, OPC_LSR_ACC);
+        bus_write(&test_bus, PRG_START, OPC_LSR_ACC);
         cpu_execute(2, &cpu);
         check("A == 0x01", cpu.regs.A == 0x01);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
@@ -2954,7 +2966,7 @@ void test_lsr() {
         test_reset();
         test_header("LSR ACC - 0x01 >> 1 = 0x00, C=1, Z=1");
         cpu.regs.A = 0x01;
-        bus_write(PRG_START, OPC_LSR_ACC);
+        bus_write(&test_bus, PRG_START, OPC_LSR_ACC);
         cpu_execute(2, &cpu);
         check("A == 0x00", cpu.regs.A == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
@@ -2964,11 +2976,11 @@ void test_lsr() {
     {
         test_reset();
         test_header("LSR ZP - ZP[0x10]=0x80 >> 1 = 0x40, C=0");
-        bus_write(0x10, 0x80);
-        bus_write(PRG_START, OPC_LSR_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_LSR_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(5, &cpu);
-        check("ZP[0x10] == 0x40", bus_read(0x10) == 0x40);
+        check("ZP[0x10] == 0x40", bus_read(&test_bus, 0x10) == 0x40);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
     }
 
@@ -2976,22 +2988,22 @@ void test_lsr() {
         test_reset();
         test_header("LSR ZPX - ZP[0x20+X=0x04]=0x24, val=0x80 >> 1 = 0x40");
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x80);
-        bus_write(PRG_START, OPC_LSR_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_LSR_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
-        check("ZP[0x24] == 0x40", bus_read(0x24) == 0x40);
+        check("ZP[0x24] == 0x40", bus_read(&test_bus, 0x24) == 0x40);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
     }
 
     {
         test_reset();
         test_header("LSR ABS - mem[0x0300]=0x80 >> 1 = 0x40");
-        bus_write(DATA_PAGE, 0x80);
-        bus_write(PRG_START, OPC_LSR_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_LSR_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(6, &cpu);
-        check("mem[0x0300] == 0x40", bus_read(DATA_PAGE) == 0x40);
+        check("mem[0x0300] == 0x40", bus_read(&test_bus, DATA_PAGE) == 0x40);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
     }
 
@@ -2999,11 +3011,11 @@ void test_lsr() {
         test_reset();
         test_header("LSR ABSX - mem[0x0300+X=0x04]=0x0304, val=0x80 >> 1 = 0x40");
         cpu.regs.X = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x80);
-        bus_write(PRG_START, OPC_LSR_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x80);
+        bus_write(&test_bus, PRG_START, OPC_LSR_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(7, &cpu);
-        check("mem[0x0304] == 0x40", bus_read(DATA_PAGE + 0x04) == 0x40);
+        check("mem[0x0304] == 0x40", bus_read(&test_bus, DATA_PAGE + 0x04) == 0x40);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
     }
 }
@@ -3018,7 +3030,7 @@ void test_rol() {
         test_header("ROL ACC - C=0: 0x40 << 1 = 0x80, C=0, N=1");
         cpu.regs.A = 0x40;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROL_ACC);
+        bus_write(&test_bus, PRG_START, OPC_ROL_ACC);
         cpu_execute(2, &cpu);
         check("A == 0x80", cpu.regs.A == 0x80);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
@@ -3030,7 +3042,7 @@ void test_rol() {
         test_header("ROL ACC - C=1: 0x40 << 1 | C = 0x81, C=0");
         cpu.regs.A = 0x40;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_ROL_ACC);
+        bus_write(&test_bus, PRG_START, OPC_ROL_ACC);
         cpu_execute(2, &cpu);
         check("A == 0x81", cpu.regs.A == 0x81);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
@@ -3039,12 +3051,12 @@ void test_rol() {
     {
         test_reset();
         test_header("ROL ZP - ZP[0x10]=0x80, C=0 -> 0x00, C=1, Z=1");
-        bus_write(0x10, 0x80);
+        bus_write(&test_bus, 0x10, 0x80);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROL_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_ROL_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(5, &cpu);
-        check("ZP[0x10] == 0x00", bus_read(0x10) == 0x00);
+        check("ZP[0x10] == 0x00", bus_read(&test_bus, 0x10) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3053,12 +3065,12 @@ void test_rol() {
         test_reset();
         test_header("ROL ZPX - ZP[0x20+X=0x04]=0x24, val=0x80, C=0 -> 0x00, C=1");
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x80);
+        bus_write(&test_bus, 0x24, 0x80);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROL_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ROL_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
-        check("ZP[0x24] == 0x00", bus_read(0x24) == 0x00);
+        check("ZP[0x24] == 0x00", bus_read(&test_bus, 0x24) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3066,12 +3078,12 @@ void test_rol() {
     {
         test_reset();
         test_header("ROL ABS - mem[0x0300]=0x80, C=0 -> 0x00, C=1, Z=1");
-        bus_write(DATA_PAGE, 0x80);
+        bus_write(&test_bus, DATA_PAGE, 0x80);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROL_ABS);
+        bus_write(&test_bus, PRG_START, OPC_ROL_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(6, &cpu);
-        check("mem[0x0300] == 0x00", bus_read(DATA_PAGE) == 0x00);
+        check("mem[0x0300] == 0x00", bus_read(&test_bus, DATA_PAGE) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3080,12 +3092,12 @@ void test_rol() {
         test_reset();
         test_header("ROL ABSX - mem[0x0300+X=0x04]=0x0304, val=0x80, C=0 -> 0x00, C=1");
         cpu.regs.X = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x80);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x80);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROL_ABSX);
+        bus_write(&test_bus, PRG_START, OPC_ROL_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(7, &cpu);
-        check("mem[0x0304] == 0x00", bus_read(DATA_PAGE + 0x04) == 0x00);
+        check("mem[0x0304] == 0x00", bus_read(&test_bus, DATA_PAGE + 0x04) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3101,7 +3113,7 @@ void test_ror() {
         test_header("ROR ACC - C=0: 0x02 >> 1 = 0x01, C=0");
         cpu.regs.A = 0x02;
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROR_ACC);
+        bus_write(&test_bus, PRG_START, OPC_ROR_ACC);
         cpu_execute(2, &cpu);
         check("A == 0x01", cpu.regs.A == 0x01);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
@@ -3112,7 +3124,7 @@ void test_ror() {
         test_header("ROR ACC - C=1: 0x02 >> 1 | C<<7 = 0x81, C=0, N=1");
         cpu.regs.A = 0x02;
         cpu_set_flag(C, 1, &cpu);
-        bus_write(PRG_START, OPC_ROR_ACC);
+        bus_write(&test_bus, PRG_START, OPC_ROR_ACC);
         cpu_execute(2, &cpu);
         check("A == 0x81", cpu.regs.A == 0x81);
         check("C == 0", cpu_read_flag(C, &cpu) == 0);
@@ -3122,12 +3134,12 @@ void test_ror() {
     {
         test_reset();
         test_header("ROR ZP - ZP[0x10]=0x01, C=0 -> 0x00, C=1, Z=1");
-        bus_write(0x10, 0x01);
+        bus_write(&test_bus, 0x10, 0x01);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROR_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_ROR_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(5, &cpu);
-        check("ZP[0x10] == 0x00", bus_read(0x10) == 0x00);
+        check("ZP[0x10] == 0x00", bus_read(&test_bus, 0x10) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3136,12 +3148,12 @@ void test_ror() {
         test_reset();
         test_header("ROR ZPX - ZP[0x20+X=0x04]=0x24, val=0x01, C=0 -> 0x00, C=1");
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x01);
+        bus_write(&test_bus, 0x24, 0x01);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROR_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, PRG_START, OPC_ROR_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
-        check("ZP[0x24] == 0x00", bus_read(0x24) == 0x00);
+        check("ZP[0x24] == 0x00", bus_read(&test_bus, 0x24) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3149,12 +3161,12 @@ void test_ror() {
     {
         test_reset();
         test_header("ROR ABS - mem[0x0300]=0x01, C=0 -> 0x00, C=1, Z=1");
-        bus_write(DATA_PAGE, 0x01);
+        bus_write(&test_bus, DATA_PAGE, 0x01);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROR_ABS);
+        bus_write(&test_bus, PRG_START, OPC_ROR_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(6, &cpu);
-        check("mem[0x0300] == 0x00", bus_read(DATA_PAGE) == 0x00);
+        check("mem[0x0300] == 0x00", bus_read(&test_bus, DATA_PAGE) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3163,12 +3175,12 @@ void test_ror() {
         test_reset();
         test_header("ROR ABSX - mem[0x0300+X=0x04]=0x0304, val=0x01, C=0 -> 0x00, C=1");
         cpu.regs.X = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x01);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x01);
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_ROR_ABSX);
+        bus_write(&test_bus, PRG_START, OPC_ROR_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(7, &cpu);
-        check("mem[0x0304] == 0x00", bus_read(DATA_PAGE + 0x04) == 0x00);
+        check("mem[0x0304] == 0x00", bus_read(&test_bus, DATA_PAGE + 0x04) == 0x00);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
@@ -3182,11 +3194,11 @@ void test_inc_inx_iny() {
     {
         test_reset();
         test_header("INC ZP - ZP[0x10]=0x10 -> 0x11");
-        bus_write(0x10, 0x10);
-        bus_write(PRG_START, OPC_INC_ZP);
-        bus_write(PRG_START + 1, 0x10);
+        bus_write(&test_bus, 0x10, 0x10);
+        bus_write(&test_bus, PRG_START, OPC_INC_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
         cpu_execute(5, &cpu);
-        check("ZP[0x10] == 0x11", bus_read(0x10) == 0x11);
+        check("ZP[0x10] == 0x11", bus_read(&test_bus, 0x10) == 0x11);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
         check("N == 0", cpu_read_flag(N, &cpu) == 0);
     }
@@ -3194,11 +3206,11 @@ void test_inc_inx_iny() {
     {
         test_reset();
         test_header("INC ZP - ZP[0x20]=0xFF -> 0x00 (Z=1)");
-        bus_write(0x20, 0xFF);
-        bus_write(PRG_START, OPC_INC_ZP);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x20, 0xFF);
+        bus_write(&test_bus, PRG_START, OPC_INC_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(5, &cpu);
-        check("ZP[0x20] == 0x00", bus_read(0x20) == 0x00);
+        check("ZP[0x20] == 0x00", bus_read(&test_bus, 0x20) == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
     }
 
@@ -3206,22 +3218,22 @@ void test_inc_inx_iny() {
         test_reset();
         test_header("INC ZPX - ZP[0x20+X=0x04]=0x24, val=0x7F -> 0x80 (N=1)");
         cpu.regs.X = 0x04;
-        bus_write(0x24, 0x7F);
-        bus_write(PRG_START, OPC_INC_ZPX);
-        bus_write(PRG_START + 1, 0x20);
+        bus_write(&test_bus, 0x24, 0x7F);
+        bus_write(&test_bus, PRG_START, OPC_INC_ZPX);
+        bus_write(&test_bus, PRG_START + 1, 0x20);
         cpu_execute(6, &cpu);
-        check("ZP[0x24] == 0x80", bus_read(0x24) == 0x80);
+        check("ZP[0x24] == 0x80", bus_read(&test_bus, 0x24) == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
     }
 
     {
         test_reset();
         test_header("INC ABS - mem[0x0300]=0x7F -> 0x80 (N=1)");
-        bus_write(DATA_PAGE, 0x7F);
-        bus_write(PRG_START, OPC_INC_ABS);
+        bus_write(&test_bus, DATA_PAGE, 0x7F);
+        bus_write(&test_bus, PRG_START, OPC_INC_ABS);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(6, &cpu);
-        check("mem[0x0300] == 0x80", bus_read(DATA_PAGE) == 0x80);
+        check("mem[0x0300] == 0x80", bus_read(&test_bus, DATA_PAGE) == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
     }
 
@@ -3229,11 +3241,11 @@ void test_inc_inx_iny() {
         test_reset();
         test_header("INC ABSX - mem[0x0300+X=0x04]=0x0304, val=0x7F -> 0x80 (N=1)");
         cpu.regs.X = 0x04;
-        bus_write(DATA_PAGE + 0x04, 0x7F);
-        bus_write(PRG_START, OPC_INC_ABSX);
+        bus_write(&test_bus, DATA_PAGE + 0x04, 0x7F);
+        bus_write(&test_bus, PRG_START, OPC_INC_ABSX);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(7, &cpu);
-        check("mem[0x0304] == 0x80", bus_read(DATA_PAGE + 0x04) == 0x80);
+        check("mem[0x0304] == 0x80", bus_read(&test_bus, DATA_PAGE + 0x04) == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
     }
 
@@ -3241,7 +3253,7 @@ void test_inc_inx_iny() {
         test_reset();
         test_header("INX - X=0x10 -> 0x11");
         cpu.regs.X = 0x10;
-        bus_write(PRG_START, OPC_INX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_INX_IMP);
         cpu_execute(2, &cpu);
         check("X == 0x11", cpu.regs.X == 0x11);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -3252,7 +3264,7 @@ void test_inc_inx_iny() {
         test_reset();
         test_header("INX - X=0xFF -> 0x00 (Z=1)");
         cpu.regs.X = 0xFF;
-        bus_write(PRG_START, OPC_INX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_INX_IMP);
         cpu_execute(2, &cpu);
         check("X == 0x00", cpu.regs.X == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -3263,7 +3275,7 @@ void test_inc_inx_iny() {
         test_reset();
         test_header("INY - Y=0x7F -> 0x80 (N=1)");
         cpu.regs.Y = 0x7F;
-        bus_write(PRG_START, OPC_INY_IMP);
+        bus_write(&test_bus, PRG_START, OPC_INY_IMP);
         cpu_execute(2, &cpu);
         check("Y == 0x80", cpu.regs.Y == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -3278,7 +3290,7 @@ void test_jmp() {
     {
         test_reset();
         test_header("JMP ABS - jump to 0x0250");
-        bus_write(PRG_START, OPC_JMP_ABS);
+        bus_write(&test_bus, PRG_START, OPC_JMP_ABS);
         bus_write_word(PRG_START + 1, 0x0250);
         cpu_execute(3, &cpu);
         check("PC == 0x0250", cpu.PC == 0x0250);
@@ -3287,9 +3299,9 @@ void test_jmp() {
     {
         test_reset();
         test_header("JMP IND - ptr at DATA_PAGE -> 0x0250");
-        bus_write(DATA_PAGE, 0x50);
-        bus_write(DATA_PAGE + 1, 0x02);
-        bus_write(PRG_START, OPC_JMP_IND);
+        bus_write(&test_bus, DATA_PAGE, 0x50);
+        bus_write(&test_bus, DATA_PAGE + 1, 0x02);
+        bus_write(&test_bus, PRG_START, OPC_JMP_IND);
         bus_write_word(PRG_START + 1, DATA_PAGE);
         cpu_execute(5, &cpu);
         check("PC == 0x0250", cpu.PC == 0x0250);
@@ -3305,10 +3317,10 @@ void test_jsr_rts() {
         test_reset();
         test_header("JSR ABS - jump to 0x0250, push return addr 0x0202");
         Byte sp_before = cpu.SP;
-        bus_write(PRG_START, OPC_JSR_ABS);
+        bus_write(&test_bus, PRG_START, OPC_JSR_ABS);
         bus_write_word(PRG_START + 1, 0x0250);
         cpu_execute(6, &cpu);
-        Word pushed_ret = ((Word)bus_read(0x100 + sp_before) << 8) | bus_read(0x100 + (Byte)(sp_before - 1));
+        Word pushed_ret = ((Word)bus_read(&test_bus, 0x100 + sp_before) << 8) | bus_read(&test_bus, 0x100 + (Byte)(sp_before - 1));
         check("PC == 0x0250", cpu.PC == 0x0250);
         check("SP decremented by 2", cpu.SP == (Byte)(sp_before - 2));
         check("Return addr on stack == 0x0202", pushed_ret == 0x0202);
@@ -3317,10 +3329,10 @@ void test_jsr_rts() {
     {
         test_reset();
         test_header("JSR then RTS - returns to PRG_START+3 = 0x0203");
-        bus_write(PRG_START, OPC_JSR_ABS);
+        bus_write(&test_bus, PRG_START, OPC_JSR_ABS);
         bus_write_word(PRG_START + 1, 0x0250);
         cpu_execute(6, &cpu);
-        bus_write(0x0250, OPC_RTS_IMP);
+        bus_write(&test_bus, 0x0250, OPC_RTS_IMP);
         cpu_execute(6, &cpu);
         check("PC == 0x0203 after RTS", cpu.PC == 0x0203);
     }
@@ -3338,7 +3350,7 @@ void test_rti() {
         stack_push(0x03, &cpu);
         stack_push(0x00, &cpu);
         stack_push(saved_flags, &cpu);
-        bus_write(PRG_START, OPC_RTI_IMP);
+        bus_write(&test_bus, PRG_START, OPC_RTI_IMP);
         cpu_execute(6, &cpu);
         check("PC == 0x0300", cpu.PC == 0x0300);
         check("U flag set", cpu_read_flag(U, &cpu) == 1);
@@ -3356,9 +3368,9 @@ void test_push_pop() {
         test_header("PHA - push A=0xAB");
         cpu.regs.A = 0xAB;
         Byte sp_before = cpu.SP;
-        bus_write(PRG_START, OPC_PHA_IMP);
+        bus_write(&test_bus, PRG_START, OPC_PHA_IMP);
         cpu_execute(3, &cpu);
-        check("Stack has 0xAB", bus_read(0x100 + sp_before) == 0xAB);
+        check("Stack has 0xAB", bus_read(&test_bus, 0x100 + sp_before) == 0xAB);
         check("SP decremented", cpu.SP == (Byte)(sp_before - 1));
     }
 
@@ -3366,9 +3378,9 @@ void test_push_pop() {
         test_reset();
         test_header("PHP - pushed byte has B=1");
         Byte sp_before = cpu.SP;
-        bus_write(PRG_START, OPC_PHP_IMP);
+        bus_write(&test_bus, PRG_START, OPC_PHP_IMP);
         cpu_execute(3, &cpu);
-        Byte pushed = bus_read(0x100 + sp_before);
+        Byte pushed = bus_read(&test_bus, 0x100 + sp_before);
         check("Pushed flags has B set", (pushed >> 4) & 1);
     }
 
@@ -3376,10 +3388,10 @@ void test_push_pop() {
         test_reset();
         test_header("PLA - pull 0xCD, check A and flags");
         cpu.regs.A = 0xCD;
-        bus_write(PRG_START, OPC_PHA_IMP);
+        bus_write(&test_bus, PRG_START, OPC_PHA_IMP);
         cpu_execute(3, &cpu);
         cpu.regs.A = 0x00;
-        bus_write(PRG_START + 1, OPC_PLA_IMP);
+        bus_write(&test_bus, PRG_START + 1, OPC_PLA_IMP);
         cpu.PC = PRG_START + 1;
         cpu_execute(4, &cpu);
         check("A == 0xCD", cpu.regs.A == 0xCD);
@@ -3390,11 +3402,11 @@ void test_push_pop() {
     {
         test_reset();
         test_header("PLP - restore flags from stack");
-        bus_write(PRG_START, OPC_PHP_IMP);
+        bus_write(&test_bus, PRG_START, OPC_PHP_IMP);
         cpu_execute(3, &cpu);
-        Byte pushed = cpu.flags | (1 << B);
-        cpu.flags = 0x00;
-        bus_write(PRG_START + 1, OPC_PLP_IMP);
+        Byte pushed = cpu_flags(&cpu) | (1 << B);
+        cpu_load_flags(&cpu, 0x00);
+        bus_write(&test_bus, PRG_START + 1, OPC_PLP_IMP);
         cpu.PC = PRG_START + 1;
         cpu_execute(4, &cpu);
         check("U flag set after PLP", cpu_read_flag(U, &cpu) == 1);
@@ -3412,7 +3424,7 @@ void test_set_flags() {
         test_reset();
         test_header("SEC - C=0 -> C=1");
         cpu_set_flag(C, 0, &cpu);
-        bus_write(PRG_START, OPC_SEC_IMP);
+        bus_write(&test_bus, PRG_START, OPC_SEC_IMP);
         cpu_execute(2, &cpu);
         check("C == 1", cpu_read_flag(C, &cpu) == 1);
     }
@@ -3421,7 +3433,7 @@ void test_set_flags() {
         test_reset();
         test_header("SED - D=0 -> D=1");
         cpu_set_flag(D, 0, &cpu);
-        bus_write(PRG_START, OPC_SED_IMP);
+        bus_write(&test_bus, PRG_START, OPC_SED_IMP);
         cpu_execute(2, &cpu);
         check("D == 1", cpu_read_flag(D, &cpu) == 1);
     }
@@ -3430,7 +3442,7 @@ void test_set_flags() {
         test_reset();
         test_header("SEI - I=0 -> I=1");
         cpu_set_flag(I, 0, &cpu);
-        bus_write(PRG_START, OPC_SEI_IMP);
+        bus_write(&test_bus, PRG_START, OPC_SEI_IMP);
         cpu_execute(2, &cpu);
         check("I == 1", cpu_read_flag(I, &cpu) == 1);
     }
@@ -3445,7 +3457,7 @@ void test_transfers() {
         test_reset();
         test_header("TAX - A=0x42 -> X=0x42");
         cpu.regs.A = 0x42;
-        bus_write(PRG_START, OPC_TAX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TAX_IMP);
         cpu_execute(2, &cpu);
         check("X == 0x42", cpu.regs.X == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -3456,7 +3468,7 @@ void test_transfers() {
         test_reset();
         test_header("TAX - A=0x00 -> Z=1");
         cpu.regs.A = 0x00;
-        bus_write(PRG_START, OPC_TAX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TAX_IMP);
         cpu_execute(2, &cpu);
         check("X == 0x00", cpu.regs.X == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -3466,7 +3478,7 @@ void test_transfers() {
         test_reset();
         test_header("TAX - A=0x80 -> N=1");
         cpu.regs.A = 0x80;
-        bus_write(PRG_START, OPC_TAX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TAX_IMP);
         cpu_execute(2, &cpu);
         check("X == 0x80", cpu.regs.X == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -3476,7 +3488,7 @@ void test_transfers() {
         test_reset();
         test_header("TAY - A=0x42 -> Y=0x42");
         cpu.regs.A = 0x42;
-        bus_write(PRG_START, OPC_TAY_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TAY_IMP);
         cpu_execute(2, &cpu);
         check("Y == 0x42", cpu.regs.Y == 0x42);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -3487,7 +3499,7 @@ void test_transfers() {
         test_reset();
         test_header("TAY - A=0x00 -> Z=1");
         cpu.regs.A = 0x00;
-        bus_write(PRG_START, OPC_TAY_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TAY_IMP);
         cpu_execute(2, &cpu);
         check("Y == 0x00", cpu.regs.Y == 0x00);
         check("Z == 1", cpu_read_flag(Z, &cpu) == 1);
@@ -3497,7 +3509,7 @@ void test_transfers() {
         test_reset();
         test_header("TAY - A=0x80 -> N=1");
         cpu.regs.A = 0x80;
-        bus_write(PRG_START, OPC_TAY_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TAY_IMP);
         cpu_execute(2, &cpu);
         check("Y == 0x80", cpu.regs.Y == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -3507,7 +3519,7 @@ void test_transfers() {
         test_reset();
         test_header("TXA - X=0x55 -> A=0x55");
         cpu.regs.X = 0x55;
-        bus_write(PRG_START, OPC_TXA_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TXA_IMP);
         cpu_execute(2, &cpu);
         check("A == 0x55", cpu.regs.A == 0x55);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -3518,7 +3530,7 @@ void test_transfers() {
         test_reset();
         test_header("TYA - Y=0x33 -> A=0x33");
         cpu.regs.Y = 0x33;
-        bus_write(PRG_START, OPC_TYA_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TYA_IMP);
         cpu_execute(2, &cpu);
         check("A == 0x33", cpu.regs.A == 0x33);
         check("Z == 0", cpu_read_flag(Z, &cpu) == 0);
@@ -3529,18 +3541,18 @@ void test_transfers() {
         test_reset();
         test_header("TXS - X=0x80 -> SP=0x80, no flags changed");
         cpu.regs.X = 0x80;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_TXS_IMP);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_TXS_IMP);
         cpu_execute(2, &cpu);
         check("SP == 0x80", cpu.SP == 0x80);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 
     {
         test_reset();
         test_header("TSX - SP=0x80 -> X=0x80, N=1");
         cpu.SP = 0x80;
-        bus_write(PRG_START, OPC_TSX_IMP);
+        bus_write(&test_bus, PRG_START, OPC_TSX_IMP);
         cpu_execute(2, &cpu);
         check("X == 0x80", cpu.regs.X == 0x80);
         check("N == 1", cpu_read_flag(N, &cpu) == 1);
@@ -3558,14 +3570,14 @@ void test_nop() {
         cpu.regs.A = 0x42;
         cpu.regs.X = 0x10;
         cpu.regs.Y = 0x20;
-        Byte flags_before = cpu.flags;
-        bus_write(PRG_START, OPC_NOP_IMP);
+        Byte flags_before = cpu_flags(&cpu);
+        bus_write(&test_bus, PRG_START, OPC_NOP_IMP);
         cpu_execute(2, &cpu);
         check("PC == PRG_START+1", cpu.PC == PRG_START + 1);
         check("A unchanged", cpu.regs.A == 0x42);
         check("X unchanged", cpu.regs.X == 0x10);
         check("Y unchanged", cpu.regs.Y == 0x20);
-        check("Flags unchanged", cpu.flags == flags_before);
+        check("Flags unchanged", cpu_flags(&cpu) == flags_before);
     }
 }
 
@@ -3591,16 +3603,18 @@ void test_mapper0_exec() {
     assert(cart != NULL);
     Mapper *m = mapper_create(cart);
     assert(m != NULL);
-    bus_set_mapper(m);
+    bus_set_mapper(&test_bus, m);
 
     CPU test_cpu;
+    cpu_init(&test_cpu, &test_bus);
     cpu_reset(&test_cpu);
     check("Reset vector: PC == 0x8010", test_cpu.PC == 0x8010);
 
     cpu_execute(4, &test_cpu);
     check("A == 0x42 after LDA from PRG-ROM", test_cpu.regs.A == 0x42);
+    cpu_free(&test_cpu);
 
-    bus_set_mapper(NULL);
+    bus_set_mapper(&test_bus, NULL);
     mapper_destroy(m);
     cartridge_free(cart);
 }
@@ -3623,20 +3637,1902 @@ void test_mapper0_32kb() {
     assert(cart != NULL);
     Mapper *m = mapper_create(cart);
     assert(m != NULL);
-    bus_set_mapper(m);
+    bus_set_mapper(&test_bus, m);
 
     CPU test_cpu;
+    cpu_init(&test_cpu, &test_bus);
     cpu_reset(&test_cpu);
     check("32KB reset vector: PC == 0x8100", test_cpu.PC == 0x8100);
 
     cpu_execute(2, &test_cpu);
     check("32KB ROM: A == 0x99", test_cpu.regs.A == 0x99);
+    cpu_free(&test_cpu);
 
-    bus_set_mapper(NULL);
+    bus_set_mapper(&test_bus, NULL);
     mapper_destroy(m);
     cartridge_free(cart);
 }
 
+// --- Flag coherency (lazy N/Z) ---
+
+void test_flag_coherency() {
+    printf("\n========== FLAG COHERENCY TESTS ==========\n");
+
+    // External cpu_set_flag(Z) must be seen by the next BEQ
+    {
+        test_reset();
+        test_header("cpu_set_flag(Z) before BEQ");
+        bus_write(&test_bus, PRG_START, OPC_BEQ_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
+        cpu_set_flag(Z, 1, &cpu);
+        cpu_step(&cpu);
+        check("BEQ taken", cpu.PC == PRG_START + 2 + 0x10);
+    }
+
+    // Direct write to flags must be seen by the next BMI
+    {
+        test_reset();
+        test_header("cpu_load_flags before BMI");
+        bus_write(&test_bus, PRG_START, OPC_BMI_REL);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
+        cpu_load_flags(&cpu, 0xA0);
+        cpu_step(&cpu);
+        check("BMI taken", cpu.PC == PRG_START + 2 + 0x10);
+    }
+
+    // N/Z produced by an instruction are visible in cpu_flags after the step
+    {
+        test_reset();
+        test_header("LDA #$00 then read flags");
+        bus_write(&test_bus, PRG_START, OPC_LDA_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x00);
+        cpu_load_flags(&cpu, 0xA0);
+        cpu_step(&cpu);
+        check("Z set in flags", (cpu_flags(&cpu) & 0x02) != 0);
+        check("N clear in flags", (cpu_flags(&cpu) & 0x80) == 0);
+        check("U set in flags", (cpu_flags(&cpu) & 0x20) != 0);
+    }
+
+    // BIT takes N from memory and Z from A & M; PHP must push both
+    {
+        test_reset();
+        test_header("BIT then PHP");
+        bus_write(&test_bus, 0x0010, 0x80);
+        cpu.regs.A = 0x01;
+        bus_write(&test_bus, PRG_START, OPC_BIT_ZP);
+        bus_write(&test_bus, PRG_START + 1, 0x10);
+        bus_write(&test_bus, PRG_START + 2, OPC_PHP_IMP);
+        cpu_step(&cpu);
+        cpu_step(&cpu);
+        Byte pushed = bus_read(&test_bus, 0x0100 + cpu.SP + 1);
+        check("Pushed N == 1", (pushed & 0x80) != 0);
+        check("Pushed Z == 1", (pushed & 0x02) != 0);
+    }
+
+    // NMI entry pushes the N/Z of the instruction it interrupts
+    {
+        test_reset();
+        test_header("NMI after LDA #$80");
+        bus_write(&test_bus, PRG_START, OPC_LDA_IM);
+        bus_write(&test_bus, PRG_START + 1, 0x80);
+        cpu.nmi_pending = 1;
+        cpu_step(&cpu);
+        Byte pushed = bus_read(&test_bus, 0x0100 + cpu.SP + 1);
+        check("Pushed N == 1", (pushed & 0x80) != 0);
+        check("Pushed Z == 0", (pushed & 0x02) == 0);
+        check("Pushed B == 0", (pushed & 0x10) == 0);
+    }
+}
+
+void test_prg_page_map() {
+    printf("\n========== PRG PAGE MAP (bank switching via bus) ==========\n");
+
+    /* UxROM, 64KB: each 16KB bank filled with its bank number */
+    {
+        const size_t PRG_SIZE = 64 * 1024;
+        static Byte prg[64 * 1024];
+        for (size_t i = 0; i < PRG_SIZE; i++) prg[i] = (Byte)(i / 0x4000);
+
+        Cartridge *cart = cartridge_create_from_buffer(prg, PRG_SIZE, NULL, 0, 2, 0);
+        assert(cart != NULL);
+        Mapper *m = mapper_create(cart);
+        assert(m != NULL);
+        bus_set_mapper(&test_bus, m);
+
+        check("UxROM: $8000 reads bank 0 at power-on", bus_read(&test_bus, 0x8000) == 0);
+        check("UxROM: $BFFF reads bank 0 at power-on", bus_read(&test_bus, 0xBFFF) == 0);
+        check("UxROM: $C000 reads fixed last bank", bus_read(&test_bus, 0xC000) == 3);
+        bus_write(&test_bus, 0x8000, 0x02);
+        check("UxROM: $8000 follows bank switch to 2", bus_read(&test_bus, 0x8000) == 2);
+        check("UxROM: $A123 follows bank switch to 2", bus_read(&test_bus, 0xA123) == 2);
+        check("UxROM: $FFFF still fixed last bank", bus_read(&test_bus, 0xFFFF) == 3);
+        check("UxROM: ROM not overwritten by register write", prg[0] == 0 && cart->prg_rom[0x8000] == 2);
+
+        bus_set_mapper(&test_bus, NULL);
+        mapper_destroy(m);
+        cartridge_free(cart);
+    }
+
+    /* MMC3 PRG-RAM write protect must still drop writes */
+    {
+        const size_t PRG_SIZE = 32 * 1024;
+        static Byte prg[32 * 1024];
+        memset(prg, 0xEA, PRG_SIZE);
+
+        Cartridge *cart = cartridge_create_from_buffer(prg, PRG_SIZE, NULL, 0, 4, 0);
+        assert(cart != NULL);
+        Mapper *m = mapper_create(cart);
+        assert(m != NULL);
+        bus_set_mapper(&test_bus, m);
+
+        bus_write(&test_bus, 0x6000, 0x55);
+        check("MMC3: PRG-RAM write/read", bus_read(&test_bus, 0x6000) == 0x55);
+        bus_write(&test_bus, 0xA001, 0xC0);  /* enable + write-protect */
+        bus_write(&test_bus, 0x6000, 0xAA);
+        check("MMC3: write-protected PRG-RAM ignores writes", bus_read(&test_bus, 0x6000) == 0x55);
+        bus_write(&test_bus, 0xA001, 0x80);  /* enable, writable */
+        bus_write(&test_bus, 0x6000, 0xAA);
+        check("MMC3: PRG-RAM writable again", bus_read(&test_bus, 0x6000) == 0xAA);
+
+        bus_set_mapper(&test_bus, NULL);
+        mapper_destroy(m);
+        cartridge_free(cart);
+    }
+}
+
+void test_decode_cache() {
+    printf("\n========== DECODE CACHE INVALIDATION ==========\n");
+
+    // Program patches the operand of an instruction that is already cached
+    {
+        test_reset();
+        test_header("Self-modifying code in RAM");
+        // $0200 LDA #$33 / $0202 STA $0206 / $0205 LDA #$00
+        bus_write(&test_bus, 0x0200, OPC_LDA_IM);  bus_write(&test_bus, 0x0201, 0x33);
+        bus_write(&test_bus, 0x0202, OPC_STA_ABS); bus_write_word(0x0203, 0x0206);
+        bus_write(&test_bus, 0x0205, OPC_LDA_IM);  bus_write(&test_bus, 0x0206, 0x00);
+
+        cpu.PC = 0x0205;
+        cpu_step_fused(&cpu);            // warm the cache with LDA #$00
+        check("Warm-up LDA #$00", cpu.regs.A == 0x00);
+
+        cpu.PC = 0x0200;
+        cpu_step_fused(&cpu);
+        cpu_step_fused(&cpu);
+        cpu_step_fused(&cpu);
+        check("Patched LDA now loads #$33", cpu.regs.A == 0x33);
+    }
+
+    // Same, but the patch goes through a RAM mirror
+    {
+        test_reset();
+        test_header("Self-modifying code through RAM mirror");
+        bus_write(&test_bus, 0x0300, OPC_LDX_IM);
+        bus_write(&test_bus, 0x0301, 0x01);
+        cpu.PC = 0x0300;
+        cpu_step_fused(&cpu);
+        check("Warm-up LDX #$01", cpu.regs.X == 0x01);
+
+        bus_write(&test_bus, 0x1301, 0x7F);         // $1301 mirrors $0301
+        cpu.PC = 0x0300;
+        cpu_step_fused(&cpu);
+        check("LDX sees mirrored write (#$7F)", cpu.regs.X == 0x7F);
+    }
+
+    // PRG bank switch replaces the code at $8000
+    {
+        test_header("PRG bank switch");
+        const size_t PRG_SIZE = 64 * 1024;
+        static Byte prg[64 * 1024];
+        memset(prg, OPC_NOP_IMP, PRG_SIZE);
+        for (int bank = 0; bank < 4; bank++) {
+            prg[bank * 0x4000 + 0] = OPC_LDA_IM;
+            prg[bank * 0x4000 + 1] = (Byte)(0x10 + bank);
+        }
+        Cartridge *cart = cartridge_create_from_buffer(prg, PRG_SIZE, NULL, 0, 2, 0);
+        assert(cart != NULL);
+        Mapper *m = mapper_create(cart);
+        assert(m != NULL);
+        bus_set_mapper(&test_bus, m);
+
+        CPU test_cpu;
+        cpu_init(&test_cpu, &test_bus);
+        cpu_reset(&test_cpu);
+        test_cpu.PC = 0x8000;
+        cpu_step_fused(&test_cpu);
+        check("Bank 0: LDA #$10", test_cpu.regs.A == 0x10);
+
+        bus_write(&test_bus, 0x8000, 0x02);
+        test_cpu.PC = 0x8000;
+        cpu_step_fused(&test_cpu);
+        check("Bank 2: LDA #$12 after switch", test_cpu.regs.A == 0x12);
+        cpu_free(&test_cpu);
+
+        bus_set_mapper(&test_bus, NULL);
+        mapper_destroy(m);
+        cartridge_free(cart);
+    }
+}
+
+// --- Profiler ---
+
+#ifdef NES_PROFILE
+static int file_has_line(const char *path, const char *line) {
+    char buf[256];
+    int found = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    while (!found && fgets(buf, sizeof(buf), f)) {
+        buf[strcspn(buf, "\n")] = 0;
+        found = strcmp(buf, line) == 0;
+    }
+    fclose(f);
+    return found;
+}
+
+void test_profiler() {
+    printf("\n========== GUEST PROFILER ==========\n");
+    test_reset();
+
+    static const Byte program[] = {
+        OPC_JSR_ABS, 0x10, 0x02,     /* $0200 JSR $0210 */
+        OPC_JSR_ABS, 0x10, 0x02,     /* $0203 JSR $0210 */
+        OPC_BRK_IMP, 0x00,           /* $0206 BRK */
+        OPC_JMP_ABS, 0x08, 0x02,     /* $0208 JMP $0208 */
+    };
+    static const Byte sub[] = {
+        OPC_LDX_IM,  0x03,           /* $0210 LDX #3 */
+        OPC_DEX_IMP,                 /* $0212 DEX */
+        OPC_BNE_REL, 0xFD,           /* $0213 BNE $0212 */
+        OPC_JSR_ABS, 0x20, 0x02,     /* $0215 JSR $0220 */
+        OPC_RTS_IMP,                 /* $0218 RTS */
+    };
+    for (Word i = 0; i < sizeof(program); i++) bus_write(&test_bus, 0x0200 + i, program[i]);
+    for (Word i = 0; i < sizeof(sub); i++) bus_write(&test_bus, 0x0210 + i, sub[i]);
+    bus_write(&test_bus, 0x0220, OPC_NOP_IMP);  /* $0220 NOP / RTS */
+    bus_write(&test_bus, 0x0221, OPC_RTS_IMP);
+    bus_write(&test_bus, 0x0230, OPC_NOP_IMP);  /* $0230 NOP / RTI (BRK handler) */
+    bus_write(&test_bus, 0x0231, OPC_RTI_IMP);
+    bus_write_word(0xFFFE, 0x0230);
+
+    check("Profiler starts", profiler_start("test_profile", 0) == 0);
+    for (int i = 0; i < 100 && cpu.PC != 0x0208; i++) cpu_step(&cpu);
+    profiler_finish();
+    check("Program reached $0208", cpu.PC == 0x0208);
+
+    /* self cycles: JSR x2 + BRK; LDX + 3 DEX + BNE x3 + JSR + RTS per call;
+       NOP + RTS per call; NOP + RTI */
+    check("Root frame",            file_has_line("test_profile.folded", "reset 19"));
+    check("Subroutine frame",      file_has_line("test_profile.folded", "reset;$0210 56"));
+    check("Nested call frame",     file_has_line("test_profile.folded", "reset;$0210;$0220 16"));
+    check("BRK handler frame",     file_has_line("test_profile.folded", "reset;brk:$0230 8"));
+
+    char line[256];
+    int loop_found = 0;
+    FILE *f = fopen("test_profile.txt", "r");
+    while (f && fgets(line, sizeof(line), f))
+        loop_found |= strstr(line, "$0212") && strstr(line, "$0213") && strstr(line, "4 iterations");
+    if (f) fclose(f);
+    check("DEX/BNE loop in the hot-loop report", loop_found);
+
+    remove("test_profile.folded");
+    remove("test_profile.txt");
+}
+#endif
+
+// --- Dispatcher tests ---
+
+static uint32_t engine_rng_state = 0x12345678;
+
+static Byte engine_rand() {
+    /* xorshift32 — deterministic so failures reproduce */
+    engine_rng_state ^= engine_rng_state << 13;
+    engine_rng_state ^= engine_rng_state >> 17;
+    engine_rng_state ^= engine_rng_state << 5;
+    return engine_rng_state & 0xFF;
+}
+
+static int engine_cpu_equal(const CPU *a, const CPU *b) {
+    return a->PC == b->PC && a->SP == b->SP &&
+           a->regs.A == b->regs.A && a->regs.X == b->regs.X && a->regs.Y == b->regs.Y &&
+           cpu_flags(a) == cpu_flags(b) && a->cycles == b->cycles &&
+           a->nmi_pending == b->nmi_pending && a->irq_pending == b->irq_pending;
+}
+
+// --- Idle-loop skipping ---
+
+#define IDLE_LOG_MAX 64
+
+typedef struct {
+    uint64_t steps;
+    int      nmi_count;
+    int      nmi_at[IDLE_LOG_MAX];   /* scanline * 341 + dot of each NMI entry */
+    uint32_t nmi_regs[IDLE_LOG_MAX]; /* A, X, Y and the pushed PCL there */
+    Word     nmi_ret[IDLE_LOG_MAX];  /* return address pushed by the NMI */
+    Byte     ram[4];                 /* $10-$13 */
+    Byte     status;
+} IdleRun;
+
+/* Drive PPU and CPU the way nes_run_frame does, for `frames` frames, on a
+   console of its own */
+static void idle_run(const Byte *prg, size_t prg_size, const Byte *chr, size_t chr_size,
+                     int skip, int frames, IdleRun *out) {
+    Cartridge *cart = cartridge_create_from_buffer(prg, prg_size, chr, chr_size, 0, 0);
+    assert(cart != NULL);
+    NES *nes = nes_create(cart);
+    assert(nes != NULL);
+    CPU *c   = &nes->cpu;
+    PPU *ppu = &nes->ppu;
+    ppu->ctrl = 0x80;                /* NMI on */
+    ppu->mask = 0x1E;                /* BG + sprites, no left clipping */
+    memset(ppu->oam, 0xF8, sizeof(ppu->oam));
+    ppu->oam[0] = 100;               /* sprite 0: Y, tile 0, attr 0, X */
+    ppu->oam[1] = 0;
+    ppu->oam[2] = 0;
+    ppu->oam[3] = 50;
+
+    memset(out, 0, sizeof(*out));
+    cpu_set_idle_skip(c, skip);
+
+    uint64_t system_clock = 0;
+    for (int f = 0; f < frames; f++) {
+        while (!ppu_frame_complete(ppu)) {
+            ppu_tick(ppu);
+            if (ppu->nmi_output) {
+                ppu->nmi_output = 0;
+                c->nmi_pending  = 1;
+            }
+            if (system_clock % 3 == 0) {
+                if (c->cycles_remaining > 0) {
+                    c->cycles_remaining--;
+                } else {
+                    cpu_step(c);
+                    c->cycles_remaining = c->cycles - 1;
+                    out->steps++;
+                    if (c->PC == 0x8100 && out->nmi_count < IDLE_LOG_MAX) {
+                        int n = out->nmi_count++;
+                        out->nmi_at[n]   = ppu->scanline * 341 + ppu->dot;
+                        out->nmi_regs[n] = c->regs.A | c->regs.X << 8 | c->regs.Y << 16 |
+                                           (uint32_t)cpu_flags(c) << 24;
+                        out->nmi_ret[n]  = bus_read(&nes->bus, 0x0100 + (Byte)(c->SP + 2)) |
+                                           bus_read(&nes->bus, 0x0100 + (Byte)(c->SP + 3)) << 8;
+                    }
+                }
+            }
+            system_clock++;
+        }
+    }
+
+    for (int i = 0; i < 4; i++) out->ram[i] = bus_read(&nes->bus, 0x10 + i);
+    out->status = ppu->status;
+    nes_destroy(nes);
+}
+
+void test_idle_skip() {
+    printf("\n========== IDLE-LOOP SKIPPING ==========\n");
+
+    const size_t PRG_SIZE = 16 * 1024;
+    static Byte prg[16 * 1024];
+    static Byte chr[8 * 1024];
+    memset(prg, OPC_NOP_IMP, PRG_SIZE);
+    memset(chr, 0, sizeof(chr));
+    memset(chr, 0xFF, 8);            /* tile 0: every pixel opaque */
+
+    static const Byte main_loop[] = {
+        OPC_BIT_ABS, 0x02, 0x20,     /* $8000 BIT $2002  wait for sprite 0 hit */
+        OPC_BVC_REL, 0xFB,           /* $8003 BVC $8000 */
+        OPC_INC_ZP,  0x11,           /* $8005 INC $11 */
+        OPC_BIT_ABS, 0x02, 0x20,     /* $8007 BIT $2002  wait for it to clear */
+        OPC_BVS_REL, 0xFB,           /* $800A BVS $8007 */
+        OPC_LDA_ZP,  0x10,           /* $800C LDA $10    wait for the NMI flag */
+        OPC_BEQ_REL, 0xFC,           /* $800E BEQ $800C */
+        OPC_LDA_IM,  0x00,           /* $8010 LDA #0 */
+        OPC_STA_ZP,  0x10,           /* $8012 STA $10 */
+        OPC_JMP_ABS, 0x00, 0x80,     /* $8014 JMP $8000 */
+    };
+    static const Byte nmi_handler[] = {
+        OPC_INC_ZP, 0x10,            /* $8100 INC $10 */
+        OPC_INC_ZP, 0x13,            /* $8102 INC $13 */
+        OPC_RTI_IMP,
+    };
+    memcpy(prg, main_loop, sizeof(main_loop));
+    memcpy(prg + 0x100, nmi_handler, sizeof(nmi_handler));
+    prg[0x3FFA] = 0x00; prg[0x3FFB] = 0x81;   /* NMI   -> $8100 */
+    prg[0x3FFC] = 0x00; prg[0x3FFD] = 0x80;   /* RESET -> $8000 */
+
+    static IdleRun slow, fast;
+    idle_run(prg, PRG_SIZE, chr, sizeof(chr), 0, 6, &slow);
+    idle_run(prg, PRG_SIZE, chr, sizeof(chr), 1, 6, &fast);
+
+    printf("  %llu steps interpreted, %llu with skipping\n",
+           (unsigned long long)slow.steps, (unsigned long long)fast.steps);
+    check("Sprite-0 waits completed each frame", slow.ram[1] >= 5);
+    check("Same sprite-0 and NMI counters",
+          memcmp(slow.ram, fast.ram, sizeof(slow.ram)) == 0);
+    check("NMIs entered at the same dots",
+          slow.nmi_count >= 5 && slow.nmi_count == fast.nmi_count &&
+          memcmp(slow.nmi_at, fast.nmi_at, sizeof(slow.nmi_at)) == 0);
+    check("Same registers and return address at every NMI",
+          memcmp(slow.nmi_regs, fast.nmi_regs, sizeof(slow.nmi_regs)) == 0 &&
+          memcmp(slow.nmi_ret, fast.nmi_ret, sizeof(slow.nmi_ret)) == 0);
+    check("Same PPUSTATUS", slow.status == fast.status);
+#ifndef NES_TRACE
+    /* trace builds log every instruction by default, which turns skipping off */
+    check("Skipping interprets far fewer instructions", fast.steps * 10 < slow.steps);
+#endif
+}
+
+/* Machine state compared between console runs */
+typedef struct {
+    Byte     ram[0x0800];
+    Regs     regs;
+    Byte     flags;
+    Byte     sp;
+    Word     pc;
+    uint64_t clock;
+} NesSnapshot;
+
+static void nes_snapshot(const NES *nes, NesSnapshot *out) {
+    memcpy(out->ram, nes->bus.ram.data, sizeof(out->ram));
+    out->regs  = nes->cpu.regs;
+    out->flags = cpu_flags(&nes->cpu);
+    out->sp    = nes->cpu.SP;
+    out->pc    = nes->cpu.PC;
+    out->clock = nes->system_clock;
+}
+
+static NES *nes_from_buffer(const Byte *prg, size_t prg_size, int mapper_id) {
+    Cartridge *cart = cartridge_create_from_buffer(prg, prg_size, NULL, 0, mapper_id, 0);
+    assert(cart != NULL);
+    NES *nes = nes_create(cart);
+    assert(nes != NULL);
+    return nes;
+}
+
+void test_nes_instances() {
+    printf("\n========== INDEPENDENT NES INSTANCES ==========\n");
+
+    const int FRAMES = 8;
+
+    /* Console A, NROM: idle-waits on an NMI flag and counts frames in X */
+    static Byte prg_a[16 * 1024];
+    static const Byte code_a[] = {
+        OPC_LDA_IM,  0x80,           /* $8000 LDA #$80 */
+        OPC_STA_ABS, 0x00, 0x20,     /* $8002 STA $2000  NMI on */
+        OPC_LDA_ZP,  0x10,           /* $8005 LDA $10 */
+        OPC_BEQ_REL, 0xFC,           /* $8007 BEQ $8005 */
+        OPC_LDA_IM,  0x00,           /* $8009 LDA #0 */
+        OPC_STA_ZP,  0x10,           /* $800B STA $10 */
+        OPC_INX_IMP,                 /* $800D INX */
+        OPC_STX_ABS, 0x00, 0x02,     /* $800E STX $0200 */
+        OPC_JMP_ABS, 0x05, 0x80,     /* $8011 JMP $8005 */
+    };
+    static const Byte nmi_a[] = {
+        OPC_INC_ZP, 0x10,            /* $8100 INC $10 */
+        OPC_INC_ZP, 0x12,            /* $8102 INC $12 */
+        OPC_RTI_IMP,
+    };
+    memset(prg_a, OPC_NOP_IMP, sizeof(prg_a));
+    memcpy(prg_a, code_a, sizeof(code_a));
+    memcpy(prg_a + 0x100, nmi_a, sizeof(nmi_a));
+    prg_a[0x3FFA] = 0x00; prg_a[0x3FFB] = 0x81;
+    prg_a[0x3FFC] = 0x00; prg_a[0x3FFD] = 0x80;
+
+    /* Console B, UxROM: calls into each switchable bank in turn; bank n
+       adds n + 1 to $20. Same $8000 addresses as A, different code. */
+    static Byte prg_b[64 * 1024];
+    static const Byte code_b[] = {
+        OPC_LDA_IM,  0x80,           /* $C000 LDA #$80 */
+        OPC_STA_ABS, 0x00, 0x20,     /* $C002 STA $2000  NMI on */
+        OPC_INY_IMP,                 /* $C005 INY */
+        OPC_TYA_IMP,                 /* $C006 TYA */
+        OPC_AND_IM,  0x03,           /* $C007 AND #3 */
+        OPC_STA_ABS, 0x00, 0x80,     /* $C009 STA $8000  select bank */
+        OPC_JSR_ABS, 0x00, 0x80,     /* $C00C JSR $8000 */
+        OPC_JMP_ABS, 0x05, 0xC0,     /* $C00F JMP $C005 */
+    };
+    static const Byte nmi_b[] = {
+        OPC_INC_ZP, 0x11,            /* $C100 INC $11 */
+        OPC_RTI_IMP,
+    };
+    memset(prg_b, OPC_NOP_IMP, sizeof(prg_b));
+    for (int bank = 0; bank < 4; bank++) {
+        Byte *p = prg_b + bank * 0x4000;
+        p[0] = OPC_LDA_IM;  p[1] = (Byte)(bank + 1);   /* $8000 LDA #n+1 */
+        p[2] = OPC_CLC_IMP;                            /* $8002 CLC */
+        p[3] = OPC_ADC_ZP;  p[4] = 0x20;               /* $8003 ADC $20 */
+        p[5] = OPC_STA_ZP;  p[6] = 0x20;               /* $8005 STA $20 */
+        p[7] = OPC_RTS_IMP;                            /* $8007 RTS */
+    }
+    memcpy(prg_b + 0xC000, code_b, sizeof(code_b));
+    memcpy(prg_b + 0xC100, nmi_b, sizeof(nmi_b));
+    prg_b[0xFFFA] = 0x00; prg_b[0xFFFB] = 0xC1;
+    prg_b[0xFFFC] = 0x00; prg_b[0xFFFD] = 0xC0;
+
+    static NesSnapshot solo_a, solo_b, both_a, both_b;
+
+    NES *a = nes_from_buffer(prg_a, sizeof(prg_a), 0);
+    for (int f = 0; f < FRAMES; f++) nes_run_frame(a);
+    nes_snapshot(a, &solo_a);
+    nes_destroy(a);
+
+    NES *b = nes_from_buffer(prg_b, sizeof(prg_b), 2);
+    for (int f = 0; f < FRAMES; f++) nes_run_frame(b);
+    nes_snapshot(b, &solo_b);
+    nes_destroy(b);
+
+    /* Both alive at once, run in alternation: any state shared between
+       them (RAM, page tables, decode cache, idle loop, JIT blocks) would
+       leak from one into the other */
+    a = nes_from_buffer(prg_a, sizeof(prg_a), 0);
+    b = nes_from_buffer(prg_b, sizeof(prg_b), 2);
+    for (int f = 0; f < FRAMES; f++) {
+        nes_run_frame(a);
+        nes_run_frame(b);
+    }
+    nes_snapshot(a, &both_a);
+    nes_snapshot(b, &both_b);
+    nes_destroy(b);
+
+    /* A console reused for another game must end up where a new one does */
+    static NesSnapshot reused_b;
+    Cartridge *cart_b = cartridge_create_from_buffer(prg_b, sizeof(prg_b), NULL, 0, 2, 0);
+    assert(cart_b != NULL);
+    int loaded = nes_load_cartridge(a, cart_b) == 0;
+    for (int f = 0; f < FRAMES && loaded; f++) nes_run_frame(a);
+    nes_snapshot(a, &reused_b);
+    nes_destroy(a);
+
+    check("A counted its NMIs", solo_a.ram[0x12] >= FRAMES - 1 && solo_a.ram[0x200] == solo_a.regs.X);
+    check("B ran code from every bank", solo_b.ram[0x20] != 0 && solo_b.ram[0x11] >= FRAMES - 1);
+    check("A alongside B matches A alone", memcmp(&solo_a, &both_a, sizeof(solo_a)) == 0);
+    check("B alongside A matches B alone", memcmp(&solo_b, &both_b, sizeof(solo_b)) == 0);
+    check("Console reloaded with B matches a new one", loaded &&
+          memcmp(&solo_b, &reused_b, sizeof(solo_b)) == 0);
+}
+
+/* NROM program for the lockstep tests: a loop mixing indexed and indirect
+   RAM traffic, a subroutine only some seeds ($00) call, and a PPUSTATUS
+   read the lanes have to take one by one */
+static void lanes_program(Byte *prg, size_t size) {
+    static const Byte code[] = {
+        OPC_LDX_IM,   0x00,          /* $8000 LDX #0 */
+        OPC_LDA_ZP,   0x00,          /* $8002 LDA $00 */
+        OPC_CLC_IMP,                 /* $8004 CLC */
+        OPC_ADC_IM,   0x1D,          /* $8005 ADC #$1D */
+        OPC_STA_ABSX, 0x00, 0x03,    /* $8007 STA $0300,X */
+        OPC_ASL_ACC,                 /* $800A ASL A */
+        OPC_ROL_ZP,   0x01,          /* $800B ROL $01 */
+        OPC_EOR_ABSX, 0x00, 0x03,    /* $800D EOR $0300,X */
+        OPC_STA_ZP,   0x04,          /* $8010 STA $04 */
+        OPC_AND_IM,   0x03,          /* $8012 AND #3 */
+        OPC_BEQ_REL,  0x03,          /* $8014 BEQ $8019 */
+        OPC_JSR_ABS,  0x40, 0x80,    /* $8016 JSR $8040 */
+        OPC_LDA_ZP,   0x04,          /* $8019 LDA $04 */
+        OPC_INX_IMP,                 /* $801B INX */
+        OPC_CPX_IM,   0x40,          /* $801C CPX #$40 */
+        OPC_BNE_REL,  0xE4,          /* $801E BNE $8004 */
+        OPC_LDA_ABS,  0x02, 0x20,    /* $8020 LDA $2002 */
+        OPC_INC_ZP,   0x02,          /* $8023 INC $02 */
+        OPC_JMP_ABS,  0x00, 0x80,    /* $8025 JMP $8000 */
+    };
+    static const Byte sub[] = {
+        OPC_PHA_IMP,                 /* $8040 PHA */
+        OPC_TXA_IMP,                 /* $8041 TXA */
+        OPC_ADC_ZP,   0x01,          /* $8042 ADC $01 */
+        OPC_LDY_IM,   0x02,          /* $8044 LDY #2 */
+        OPC_STA_INDY, 0x10,          /* $8046 STA ($10),Y */
+        OPC_LDA_INDY, 0x10,          /* $8048 LDA ($10),Y */
+        OPC_PHP_IMP,                 /* $804A PHP */
+        OPC_PLP_IMP,                 /* $804B PLP */
+        OPC_PLA_IMP,                 /* $804C PLA */
+        OPC_RTS_IMP,                 /* $804D RTS */
+    };
+    static const Byte nmi[] = {
+        OPC_PHA_IMP,                 /* $8100 PHA */
+        OPC_INC_ZP,   0x03,          /* $8101 INC $03 */
+        OPC_PLA_IMP,                 /* $8103 PLA */
+        OPC_RTI_IMP,                 /* $8104 RTI */
+    };
+    memset(prg, OPC_NOP_IMP, size);
+    memcpy(prg, code, sizeof(code));
+    memcpy(prg + 0x40, sub, sizeof(sub));
+    memcpy(prg + 0x100, nmi, sizeof(nmi));
+    prg[size - 6] = 0x00; prg[size - 5] = 0x81;
+    prg[size - 4] = 0x00; prg[size - 3] = 0x80;
+}
+
+/* Seed and indirect pointer ($10/$11 -> $0400) for lane i */
+static void lanes_seed(Byte *ram, int i) {
+    ram[0x00] = (Byte)(i * 37);
+    ram[0x11] = 0x04;
+}
+
+void test_cpu_lanes() {
+    printf("\n========== LOCKSTEP CPU LANES ==========\n");
+
+    /* Each lane must end every run exactly where a console of its own
+       does when stepped with the fused engine for the same cycles */
+    const int RUNS = 3000;
+    static Byte prg[16 * 1024];
+    static CpuLanes lanes;
+    NES *ref[CPU_LANES];
+    NES *con[CPU_LANES];
+    Bus *buses[CPU_LANES];
+    int  budget[CPU_LANES] = { 0 };
+    lanes_program(prg, sizeof(prg));
+    for (int i = 0; i < CPU_LANES; i++) {
+        ref[i] = nes_from_buffer(prg, sizeof(prg), 0);
+        con[i] = nes_from_buffer(prg, sizeof(prg), 0);
+        lanes_seed(ref[i]->bus.ram.data, i);
+        buses[i] = &con[i]->bus;
+    }
+    cpu_lanes_init(&lanes, buses, CPU_LANES);
+    for (int i = 0; i < CPU_LANES; i++) {
+        Byte seed[MEM_SIZE] = { 0 };
+        lanes_seed(seed, i);
+        for (int a = 0; a < MEM_SIZE; a++) lanes.ram[a][i] = seed[a];
+    }
+
+    int mismatches = 0;
+    int diverged   = 0;
+    for (int r = 0; r < RUNS; r++) {
+        int cycles = 1 + r * 7 % 400;   /* from single instructions to long runs */
+        if (r == RUNS / 2) {
+            /* an interrupt on one lane only */
+            lanes.nmi_pending[5] = 1;
+            ref[5]->cpu.nmi_pending = 1;
+        }
+        cpu_lanes_run(&lanes, cycles);
+        for (int i = 0; i < CPU_LANES; i++) {
+            CPU *c = &ref[i]->cpu;
+            for (budget[i] += cycles; budget[i] > 0; budget[i] -= c->cycles) cpu_step_fused(c);
+            if (lanes.PC[i] != c->PC || lanes.A[i] != c->regs.A || lanes.X[i] != c->regs.X ||
+                lanes.Y[i] != c->regs.Y || lanes.SP[i] != c->SP || lanes.P[i] != cpu_flags(c) ||
+                lanes.budget[i] != budget[i]) {
+                if (mismatches++ < 5)
+                    printf("  lane %d run %d: PC %04X/%04X A %02X/%02X P %02X/%02X budget %d/%d\n",
+                           i, r, lanes.PC[i], c->PC, lanes.A[i], c->regs.A,
+                           lanes.P[i], cpu_flags(c), lanes.budget[i], budget[i]);
+            }
+            if (lanes.PC[i] != lanes.PC[0]) diverged = 1;
+        }
+    }
+
+    int ram_same = 1;
+    for (int i = 0; i < CPU_LANES; i++)
+        for (int a = 0; a < MEM_SIZE; a++)
+            if (lanes.ram[a][i] != ref[i]->bus.ram.data[a]) ram_same = 0;
+
+    /* Lane 5 copied back into a console picks up where its reference is */
+    cpu_lanes_store(&lanes, 5, &con[5]->cpu);
+    int stored = memcmp(con[5]->bus.ram.data, ref[5]->bus.ram.data, MEM_SIZE) == 0 &&
+                 con[5]->cpu.PC == ref[5]->cpu.PC && cpu_flags(&con[5]->cpu) == cpu_flags(&ref[5]->cpu) &&
+                 con[5]->bus.ram.data[0x03] == 1;
+
+    printf("  %llu of %llu lane-instructions vectorised\n",
+           (unsigned long long)lanes.vector_steps, (unsigned long long)lanes.steps);
+    for (int i = 0; i < CPU_LANES; i++) {
+        nes_destroy(ref[i]);
+        nes_destroy(con[i]);
+    }
+
+    check("Every lane matches its own console after every run", mismatches == 0);
+    check("Lane RAM matches each console's RAM", ram_same);
+    check("Lanes took different paths", diverged);
+    check("Most lane-instructions ran vectorised", lanes.vector_steps * 2 > lanes.steps);
+    check("Stored lane matches its console, NMI included", stored);
+}
+
+void test_engine_crosscheck() {
+    printf("\n========== DISPATCHER CROSS-CHECK (table vs fused) ==========\n");
+
+    /* Random single instructions with random operands, registers, flags and
+       RAM. Operand addresses are kept inside internal RAM so no I/O
+       register is touched and both engines see the same memory. */
+    static Byte ram_before[MEM_SIZE];
+    static Byte ram_table[MEM_SIZE];
+    const int TRIALS = 20000;
+    int mismatches = 0;
+    int executed   = 0;
+
+    for (int t = 0; t < TRIALS; t++) {
+        cpu_reset(&cpu);
+        for (Word a = 0; a < MEM_SIZE; a++) bus_write(&test_bus, a, engine_rand());
+
+        Byte opcode = engine_rand();
+        while (cpu_opcode_name(opcode) == NULL) opcode = engine_rand();
+        Word pc     = 0x0200 + ((engine_rand() | (engine_rand() << 8)) % 0x0500);
+        Byte op1    = engine_rand();
+        Byte op2    = engine_rand() & 0x07;  /* absolute targets stay in RAM */
+
+        cpu.PC      = pc;
+        cpu.SP      = engine_rand();
+        cpu.regs.A  = engine_rand();
+        cpu.regs.X  = engine_rand();
+        cpu.regs.Y  = engine_rand();
+        cpu_load_flags(&cpu, engine_rand() | 0x20);
+        cpu.nmi_pending = (engine_rand() & 0x0F) == 0;
+        cpu.irq_pending = (engine_rand() & 0x0F) == 0;
+
+        bus_write(&test_bus, pc, opcode);
+        bus_write(&test_bus, pc + 1, op1);
+        bus_write(&test_bus, pc + 2, op2);
+        /* indirect pointers must also land in RAM */
+        bus_write(&test_bus, (Byte)(op1 + cpu.regs.X + 1), bus_read(&test_bus, (Byte)(op1 + cpu.regs.X + 1)) & 0x07);
+        bus_write(&test_bus, (Byte)(op1 + 1), bus_read(&test_bus, (Byte)(op1 + 1)) & 0x07);
+        bus_write_word(0xFFFE, 0x0400);
+
+        for (Word a = 0; a < MEM_SIZE; a++) ram_before[a] = bus_read(&test_bus, a);
+        CPU start = cpu;
+
+        cpu_step_table(&cpu);
+        CPU after_table = cpu;
+        for (Word a = 0; a < MEM_SIZE; a++) ram_table[a] = bus_read(&test_bus, a);
+
+        for (Word a = 0; a < MEM_SIZE; a++) bus_write(&test_bus, a, ram_before[a]);
+        cpu = start;
+        cpu_step_fused(&cpu);
+
+        int same = engine_cpu_equal(&after_table, &cpu);
+        for (Word a = 0; a < MEM_SIZE && same; a++) {
+            if (bus_read(&test_bus, a) != ram_table[a]) same = 0;
+        }
+        if (!same) {
+            if (mismatches < 8) {
+                printf("  mismatch: opcode=%02X PC=%04X | table PC=%04X A=%02X P=%02X cyc=%d"
+                       " | fused PC=%04X A=%02X P=%02X cyc=%d\n",
+                       opcode, pc, after_table.PC, after_table.regs.A, cpu_flags(&after_table),
+                       after_table.cycles, cpu.PC, cpu.regs.A, cpu_flags(&cpu), cpu.cycles);
+            }
+            mismatches++;
+        }
+        executed++;
+    }
+
+    printf("  %d random instructions compared\n", executed);
+    check("Fused dispatcher matches table dispatcher", mismatches == 0);
+}
+
+#ifdef NES_CPU_JIT
+typedef struct {
+    CPU  cpu;
+    long cycles;   /* cumulative cycles after the step */
+} JitSyncPoint;
+
+/* NMIs on, then a loop of 20 RAM-only instructions (84 cycles) that the
+   JIT translates into one block; the NMI handler only counts */
+static NES *jit_nmi_console(void) {
+    static Byte prg[16 * 1024];
+    static const Byte main_loop[] = {
+        OPC_LDA_IM,  0x80,           /* $8000 LDA #$80 */
+        OPC_STA_ABS, 0x00, 0x20,     /* $8002 STA $2000  NMI on */
+        OPC_LDA_ZP,  0x10,           /* $8005 LDA $10 */
+        OPC_CLC_IMP,
+        OPC_ADC_IM,  0x03,
+        OPC_STA_ZP,  0x10,
+        OPC_LDA_ZP,  0x11,
+        OPC_ADC_IM,  0x00,
+        OPC_STA_ZP,  0x11,
+        OPC_INC_ZP,  0x12,
+        OPC_LDX_ZP,  0x12,
+        OPC_STX_ZP,  0x13,
+        OPC_LDA_ZP,  0x13,
+        OPC_EOR_IM,  0x5A,
+        OPC_STA_ZP,  0x14,
+        OPC_INC_ZP,  0x15,
+        OPC_LDA_ZP,  0x14,
+        OPC_ADC_IM,  0x07,
+        OPC_STA_ZP,  0x16,
+        OPC_LDX_ZP,  0x16,
+        OPC_STX_ZP,  0x17,
+        OPC_INC_ZP,  0x18,
+        OPC_JMP_ABS, 0x05, 0x80,     /*       JMP $8005 */
+    };
+    static const Byte nmi_handler[] = {
+        OPC_INC_ZP,  0x20,           /* $8100 INC $20 */
+        OPC_RTI_IMP,                 /* $8102 RTI */
+    };
+    memset(prg, OPC_NOP_IMP, sizeof(prg));
+    memcpy(prg, main_loop, sizeof(main_loop));
+    memcpy(prg + 0x100, nmi_handler, sizeof(nmi_handler));
+    prg[0x3FFA] = 0x00; prg[0x3FFB] = 0x81;   /* NMI   -> $8100 */
+    prg[0x3FFC] = 0x00; prg[0x3FFD] = 0x80;   /* RESET -> $8000 */
+    return nes_from_buffer(prg, sizeof(prg), 0);
+}
+
+#define NMI_LOG_MAX 16
+
+typedef struct {
+    int      count;
+    uint64_t at[NMI_LOG_MAX];    /* system clock of the handler's first step */
+    Word     ret[NMI_LOG_MAX];   /* return address pushed */
+} NmiLog;
+
+/* Run frames frames with PPU and CPU in lockstep, the CPU stepped by step,
+   logging every NMI entry; destroys nes */
+static void jit_nmi_run(NES *nes, void (*step)(CPU *), int frames, NmiLog *log) {
+    CPU *c   = &nes->cpu;
+    PPU *ppu = &nes->ppu;
+    memset(log, 0, sizeof(*log));
+    for (int f = 0; f < frames; f++) {
+        while (!ppu_frame_complete(ppu)) {
+            ppu_tick(ppu);
+            if (ppu->nmi_output) {
+                ppu->nmi_output = 0;
+                c->nmi_pending  = 1;
+            }
+            if (nes->system_clock % 3 == 0) {
+                if (c->cycles_remaining > 0) {
+                    c->cycles_remaining--;
+                } else {
+                    step(c);
+                    c->cycles_remaining = c->cycles - 1;
+                    if (c->PC == 0x8100 && log->count < NMI_LOG_MAX) {
+                        log->at[log->count]  = nes->system_clock;
+                        log->ret[log->count] = bus_read(&nes->bus, 0x0100 + (Byte)(c->SP + 2)) |
+                                               bus_read(&nes->bus, 0x0100 + (Byte)(c->SP + 3)) << 8;
+                        log->count++;
+                    }
+                }
+            }
+            nes->system_clock++;
+        }
+    }
+    nes_destroy(nes);
+}
+
+void test_jit_crosscheck() {
+    printf("\n========== JIT CROSS-CHECK (jit vs fused) ==========\n");
+
+    /* Every RAM byte starts as a documented opcode, so execution can
+       wander anywhere (branches, JSR/RTS, self-modifying stores); jumps
+       outside RAM read zeros and BRK back to $0400. Each JIT step covers one block: the interpreter must reach
+       the same registers at the same cumulative cycle count. */
+    static Byte valid[256];
+    static Byte ram_before[MEM_SIZE];
+    static Byte ram_jit[MEM_SIZE];
+    static JitSyncPoint sync[2000];
+    const int PROGRAMS = 200;
+    const int STEPS    = 2000;
+    int n_valid = 0;
+    int mismatches = 0;
+    long blocks = 0, instructions = 0;
+
+    for (int op = 0; op < 256; op++) {
+        if (cpu_opcode_name((Byte)op) != NULL) valid[n_valid++] = (Byte)op;
+    }
+    bus_set_mapper(&test_bus, NULL);
+
+    for (int prog = 0; prog < PROGRAMS; prog++) {
+        cpu_reset(&cpu);
+        for (Word a = 0; a < MEM_SIZE; a++) bus_write(&test_bus, a, valid[engine_rand() % n_valid]);
+        bus_write_word(0xFFFE, 0x0400);
+        cpu.PC     = 0x0200 + engine_rand();
+        cpu.SP     = engine_rand();
+        cpu.regs.A = engine_rand();
+        cpu.regs.X = engine_rand();
+        cpu.regs.Y = engine_rand();
+        cpu_load_flags(&cpu, (engine_rand() | 0x20) & ~0x10);
+
+        for (Word a = 0; a < MEM_SIZE; a++) ram_before[a] = bus_read(&test_bus, a);
+        CPU start = cpu;
+
+        /* stores can plant undocumented opcodes: stop before reaching one */
+        long total = 0;
+        int  steps = 0;
+        for (; steps < STEPS && cpu_opcode_name(bus_peek(&test_bus, cpu.PC)) != NULL; steps++) {
+            cpu_step_jit(&cpu);
+            total += cpu.cycles;
+            sync[steps].cpu    = cpu;
+            sync[steps].cycles = total;
+        }
+        for (Word a = 0; a < MEM_SIZE; a++) ram_jit[a] = bus_read(&test_bus, a);
+
+        cpu_reset(&cpu);
+        for (Word a = 0; a < MEM_SIZE; a++) bus_write(&test_bus, a, ram_before[a]);
+        bus_write_word(0xFFFE, 0x0400);
+        cpu = start;
+
+        int same = 1;
+        total = 0;
+        for (int i = 0; i < steps && same; i++) {
+            while (total < sync[i].cycles) {
+                cpu_step_fused(&cpu);
+                total += cpu.cycles;
+                instructions++;
+            }
+            const CPU *j = &sync[i].cpu;
+            same = total == sync[i].cycles &&
+                   j->PC == cpu.PC && j->SP == cpu.SP && cpu_flags(j) == cpu_flags(&cpu) &&
+                   j->regs.A == cpu.regs.A && j->regs.X == cpu.regs.X &&
+                   j->regs.Y == cpu.regs.Y;
+            if (!same && mismatches < 8) {
+                printf("  mismatch: program %d step %d | jit PC=%04X A=%02X X=%02X Y=%02X P=%02X"
+                       " SP=%02X cyc=%ld | fused PC=%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X cyc=%ld\n",
+                       prog, i, j->PC, j->regs.A, j->regs.X, j->regs.Y, cpu_flags(j), j->SP,
+                       sync[i].cycles, cpu.PC, cpu.regs.A, cpu.regs.X, cpu.regs.Y, cpu_flags(&cpu),
+                       cpu.SP, total);
+            }
+            blocks++;
+        }
+        for (Word a = 0; a < MEM_SIZE && same; a++) {
+            if (bus_read(&test_bus, a) != ram_jit[a]) {
+                if (mismatches < 8) {
+                    printf("  mismatch: program %d RAM[%04X] jit=%02X fused=%02X\n",
+                           prog, a, ram_jit[a], bus_read(&test_bus, a));
+                }
+                same = 0;
+            }
+        }
+        if (!same) mismatches++;
+    }
+
+    printf("  %ld blocks / %ld instructions compared\n", blocks, instructions);
+    check("JIT matches fused dispatcher", mismatches == 0);
+
+    /* VBlank NMIs land at every point of a long RAM-only block: the JIT
+       must stop the block where the interpreter would take them */
+    NmiLog jit_log, fused_log;
+    jit_nmi_run(jit_nmi_console(), cpu_step_jit, 12, &jit_log);
+    jit_nmi_run(jit_nmi_console(), cpu_step_fused, 12, &fused_log);
+    int inside = 0;
+    for (int i = 0; i < fused_log.count; i++) inside += fused_log.ret[i] != 0x8005;
+    printf("  %d NMIs, %d returning into the middle of the block\n", fused_log.count, inside);
+    check("JIT takes NMIs after the same instruction and cycle",
+          fused_log.count >= 11 && inside > 0 && jit_log.count == fused_log.count &&
+          memcmp(jit_log.at, fused_log.at, sizeof(jit_log.at)) == 0 &&
+          memcmp(jit_log.ret, fused_log.ret, sizeof(jit_log.ret)) == 0);
+}
+#endif
+
+static void engine_load_benchmark() {
+    test_reset();
+    /* Inner loop over a RAM buffer mixing loads, ALU ops, stores and
+       branches, with a JMP back to the top:
+           LDX #$00
+       L:  LDA $0300,X / ADC #$01 / STA $0300,X / INX / BNE L
+           INC $10 / JMP $0200 */
+    const Byte prog[] = {
+        OPC_LDX_IM,   0x00,
+        OPC_LDA_ABSX, 0x00, 0x03,
+        OPC_ADC_IM,   0x01,
+        OPC_STA_ABSX, 0x00, 0x03,
+        OPC_INX_IMP,
+        OPC_BNE_REL,  0xF5,
+        OPC_INC_ZP,   0x10,
+        OPC_JMP_ABS,  0x00, 0x02,
+    };
+    for (Word i = 0; i < sizeof(prog); i++) bus_write(&test_bus, PRG_START + i, prog[i]);
+}
+
+/* Seconds to run the benchmark loop for the given number of CPU cycles. */
+static double engine_benchmark(void (*step)(CPU *), long cycles) {
+    engine_load_benchmark();
+    clock_t start = clock();
+    for (long c = 0; c < cycles; ) {
+        step(&cpu);
+        c += cpu.cycles;
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double engine_mips(long instructions, double secs) {
+    return secs > 0.0 ? instructions / secs / 1e6 : 0.0;
+}
+
+void test_engine_benchmark() {
+    printf("\n========== DISPATCHER BENCHMARK ==========\n");
+    /* Engines run for the same number of guest cycles; a JIT step covers
+       a whole block, so instructions are counted once with the fused engine */
+    const long CYCLES = 70000000;
+    long instructions = 0;
+    engine_load_benchmark();
+    for (long c = 0; c < CYCLES; instructions++) {
+        cpu_step_fused(&cpu);
+        c += cpu.cycles;
+    }
+
+    double table_mips = engine_mips(instructions, engine_benchmark(cpu_step_table, CYCLES));
+    double fused_mips = engine_mips(instructions, engine_benchmark(cpu_step_fused, CYCLES));
+    printf("  table: %.1f M instr/s\n", table_mips);
+    printf("  fused: %.1f M instr/s\n", fused_mips);
+    if (table_mips > 0.0) printf("  speedup: %.2fx\n", fused_mips / table_mips);
+#ifdef NES_CPU_JIT
+    double jit_mips = engine_mips(instructions, engine_benchmark(cpu_step_jit, CYCLES));
+    printf("  jit:   %.1f M instr/s\n", jit_mips);
+    if (fused_mips > 0.0) printf("  jit speedup over fused: %.2fx\n", jit_mips / fused_mips);
+#endif
+
+    /* Aggregate throughput of CPU_LANES consoles running the lockstep test
+       program for the same cycles, one after another with the fused engine
+       vs as lanes */
+    const int LANE_CYCLES = 2000000;
+    static Byte prg[16 * 1024];
+    static CpuLanes lanes;
+    NES *con[CPU_LANES];
+    Bus *buses[CPU_LANES];
+    lanes_program(prg, sizeof(prg));
+    for (int i = 0; i < CPU_LANES; i++) {
+        con[i] = nes_from_buffer(prg, sizeof(prg), 0);
+        lanes_seed(con[i]->bus.ram.data, i);
+        buses[i] = &con[i]->bus;
+    }
+    cpu_lanes_init(&lanes, buses, CPU_LANES);
+    for (int i = 0; i < CPU_LANES; i++) cpu_lanes_load(&lanes, i, &con[i]->cpu);
+
+    long solo_instructions = 0;
+    clock_t start = clock();
+    for (int i = 0; i < CPU_LANES; i++) {
+        for (long c = 0; c < LANE_CYCLES; solo_instructions++) {
+            cpu_step_fused(&con[i]->cpu);
+            c += con[i]->cpu.cycles;
+        }
+    }
+    double solo_mips = engine_mips(solo_instructions, (double)(clock() - start) / CLOCKS_PER_SEC);
+    start = clock();
+    for (long c = 0; c < LANE_CYCLES; c += 29780) cpu_lanes_run(&lanes, 29780);
+    double lanes_mips = engine_mips((long)lanes.steps, (double)(clock() - start) / CLOCKS_PER_SEC);
+    for (int i = 0; i < CPU_LANES; i++) nes_destroy(con[i]);
+
+    printf("  %d consoles, fused: %.1f M instr/s\n", CPU_LANES, solo_mips);
+    printf("  %d lanes:           %.1f M instr/s (%.0f%% vectorised)\n", CPU_LANES, lanes_mips,
+           lanes.steps ? 100.0 * lanes.vector_steps / lanes.steps : 0.0);
+    if (solo_mips > 0.0) printf("  lanes speedup: %.2fx\n", lanes_mips / solo_mips);
+}
+
+// --- PPU renderers ---
+
+/* NROM game for the renderer tests, with random CHR, nametables, palette
+   and OAM. Each frame it waits for sprite-0 hit, then mid-line changes
+   scroll, reads $2007, blanks rendering for a few dots, writes to the
+   mapper and turns rendering back on with the frame's clipping and
+   greyscale bits. The NMI handler cycles sprite size and pattern tables. */
+static NES *ppu_test_console(void) {
+    static Byte prg[16 * 1024];
+    static Byte chr[8 * 1024];
+    static const Byte main_loop[] = {
+        OPC_BIT_ABS, 0x02, 0x20,     /* $8000 BIT $2002  wait for sprite 0 hit */
+        OPC_BVC_REL, 0xFB,           /* $8003 BVC $8000 */
+        OPC_LDA_ZP,  0x10,           /* $8005 LDA $10 */
+        OPC_STA_ABS, 0x05, 0x20,     /* $8007 STA $2005  scroll X */
+        OPC_STA_ABS, 0x05, 0x20,     /* $800A STA $2005  scroll Y */
+        OPC_LDA_ABS, 0x07, 0x20,     /* $800D LDA $2007  moves v */
+        OPC_LDX_IM,  0x00,           /* $8010 LDX #0 */
+        OPC_STX_ABS, 0x01, 0x20,     /* $8012 STX $2001  rendering off */
+        OPC_STA_ABS, 0x00, 0x80,     /* $8015 STA $8000  mapper write */
+        OPC_LDA_ZP,  0x11,           /* $8018 LDA $11 */
+        OPC_ORA_IM,  0x18,           /* $801A ORA #$18 */
+        OPC_STA_ABS, 0x01, 0x20,     /* $801C STA $2001  rendering on */
+        OPC_INC_ZP,  0x10,           /* $801F INC $10 */
+        OPC_BIT_ABS, 0x02, 0x20,     /* $8021 BIT $2002  wait for it to clear */
+        OPC_BVS_REL, 0xFB,           /* $8024 BVS $8021 */
+        OPC_JMP_ABS, 0x00, 0x80,     /* $8026 JMP $8000 */
+    };
+    static const Byte nmi_handler[] = {
+        OPC_PHA_IMP,                 /* $8100 PHA */
+        OPC_INC_ZP,  0x11,           /* $8101 INC $11 */
+        OPC_LDA_ZP,  0x11,           /* $8103 LDA $11 */
+        OPC_AND_IM,  0x38,           /* $8105 AND #$38   8x16, pattern tables */
+        OPC_ORA_IM,  0x80,           /* $8107 ORA #$80 */
+        OPC_STA_ABS, 0x00, 0x20,     /* $8109 STA $2000 */
+        OPC_PLA_IMP,                 /* $810C PLA */
+        OPC_RTI_IMP,                 /* $810D RTI */
+    };
+    memset(prg, OPC_NOP_IMP, sizeof(prg));
+    memcpy(prg, main_loop, sizeof(main_loop));
+    memcpy(prg + 0x100, nmi_handler, sizeof(nmi_handler));
+    prg[0x3FFA] = 0x00; prg[0x3FFB] = 0x81;   /* NMI   -> $8100 */
+    prg[0x3FFC] = 0x00; prg[0x3FFD] = 0x80;   /* RESET -> $8000 */
+
+    engine_rng_state = 0x2C0FFEE;
+    for (size_t i = 0; i < sizeof(chr); i++) chr[i] = engine_rand();
+    Cartridge *cart = cartridge_create_from_buffer(prg, sizeof(prg), chr, sizeof(chr), 0, 1);
+    assert(cart != NULL);
+    NES *nes = nes_create(cart);
+    assert(nes != NULL);
+
+    PPU *ppu = &nes->ppu;
+    for (int i = 0; i < 0x400; i++) {
+        ppu->nametable[0][i] = engine_rand();
+        ppu->nametable[1][i] = engine_rand();
+    }
+    for (int i = 0; i < 32; i++) ppu->palette[i] = engine_rand() & 0x3F;
+    for (int i = 0; i < 256; i++) ppu->oam[i] = engine_rand();
+    ppu->oam[0] = 60;                /* sprite 0: Y, tile, attr, X */
+    ppu->oam[1] = 0x01;
+    ppu->oam[2] = 0x00;
+    ppu->oam[3] = 40;
+    ppu->ctrl = 0x80;                /* NMI on */
+    ppu->mask = 0x1E;                /* BG + sprites, no left clipping */
+    ppu_update_palette(ppu);
+    return nes;
+}
+
+/* One system clock, with PPU and CPU in lockstep */
+static void ppu_test_clock(NES *nes) {
+    CPU *c   = &nes->cpu;
+    PPU *ppu = &nes->ppu;
+    ppu_tick(ppu);
+    if (ppu->nmi_output) {
+        ppu->nmi_output = 0;
+        c->nmi_pending  = 1;
+    }
+    if (mapper_irq_pending(ppu->mapper)) c->irq_pending = 1;
+    if (nes->system_clock % 3 == 0) {
+        if (nes->apu_enabled) apu_tick(&nes->apu);
+        if (bus_dma_active(&nes->bus)) {
+            bus_dma_tick(&nes->bus, nes->system_clock);
+        } else if (c->cycles_remaining > 0) {
+            c->cycles_remaining--;
+        } else {
+            cpu_step(c);
+            c->cycles_remaining = c->cycles - 1;
+        }
+    }
+    nes->system_clock++;
+}
+
+static int ppu_pipeline_equal(const PPU *a, const PPU *b) {
+    return a->v == b->v && a->nt_latch == b->nt_latch && a->at_latch == b->at_latch &&
+           a->bg_lo_latch == b->bg_lo_latch && a->bg_hi_latch == b->bg_hi_latch &&
+           a->bg_shift_lo == b->bg_shift_lo && a->bg_shift_hi == b->bg_shift_hi &&
+           a->at_shift_lo == b->at_shift_lo && a->at_shift_hi == b->at_shift_hi &&
+           a->at_latch_lo == b->at_latch_lo && a->at_latch_hi == b->at_latch_hi &&
+           memcmp(a->sprite_shift_lo, b->sprite_shift_lo, 8) == 0 &&
+           memcmp(a->sprite_shift_hi, b->sprite_shift_hi, 8) == 0 &&
+           memcmp(a->sprite_x, b->sprite_x, 8) == 0 &&
+           a->sprite_zero_rendered == b->sprite_zero_rendered;
+}
+
+void test_ppu_line_renderer() {
+    printf("\n========== SCANLINE RENDERER ==========\n");
+
+    const int FRAMES = 40;
+    NES *dots = ppu_test_console();
+    NES *lines = ppu_test_console();
+    dots->ppu.line_renderer = 0;
+
+    int status_ok = 1, pipeline_ok = 1, frames_ok = 1, cpu_ok = 1;
+    long fast = 0, fallbacks = 0;
+    for (int f = 0; f < FRAMES; f++) {
+        while (!ppu_frame_complete(&lines->ppu)) {
+            int was_fast = lines->ppu.line_fast;
+            ppu_test_clock(dots);
+            ppu_test_clock(lines);
+            fast      += lines->ppu.line_fast && lines->ppu.dot == 2;
+            fallbacks += was_fast && lines->ppu.line_fast == 0 && lines->ppu.dot <= 256;
+            if (lines->ppu.status != dots->ppu.status) status_ok = 0;
+            if (lines->ppu.dot == 257 && !ppu_pipeline_equal(&lines->ppu, &dots->ppu)) {
+                if (pipeline_ok)
+                    printf("  pipeline differs at frame %d line %d\n", f, lines->ppu.scanline);
+                pipeline_ok = 0;
+            }
+        }
+        ppu_frame_complete(&dots->ppu);
+        if (memcmp(lines->ppu.framebuffer, dots->ppu.framebuffer,
+                   sizeof(dots->ppu.framebuffer)) != 0) {
+            if (frames_ok) printf("  frame %d differs\n", f);
+            frames_ok = 0;
+        }
+        if (!engine_cpu_equal(&lines->cpu, &dots->cpu)) cpu_ok = 0;
+    }
+    int waits = bus_read(&lines->bus, 0x10);
+
+    printf("  %ld lines drawn ahead, %ld handed back to the dot renderer\n", fast, fallbacks);
+    check("Sprite-0 waits completed most frames", waits >= FRAMES / 2);
+    check("Same PPUSTATUS after every dot", status_ok);
+    check("Same pipeline state at dot 257 of every line", pipeline_ok);
+    check("Same frames", frames_ok);
+    check("Same CPU state", cpu_ok);
+    check("Most lines drawn ahead, some handed back", fast > FRAMES * 200 && fallbacks >= FRAMES);
+    nes_destroy(dots);
+    nes_destroy(lines);
+}
+
+/* Serial MMC1 register load: five writes, each from its own instruction */
+static void mmc1_write(NES *nes, Word addr, Byte value) {
+    for (int bit = 0; bit < 5; bit++) {
+        bus_set_cpu_instruction_id(&nes->bus, nes->bus.instruction_id + 1);
+        bus_write(&nes->bus, addr, (value >> bit) & 1);
+    }
+}
+
+/* Physical page behind each of $2000/$2400/$2800/$2C00, as four digits */
+static int ppu_nt_layout(PPU *ppu) {
+    for (int page = 0; page < 4; page++) ppu->nametable[page][0x155] = (Byte)page;
+    int layout = 0;
+    for (int slot = 0; slot < 4; slot++)
+        layout = layout * 10 + ppu_vram_read(ppu, 0x2155 + slot * 0x400);
+    return layout;
+}
+
+static NES *ppu_mirroring_console(int mapper_id, Byte mirroring) {
+    static Byte prg[64 * 1024];
+    memset(prg, OPC_NOP_IMP, sizeof(prg));
+    Cartridge *cart = cartridge_create_from_buffer(prg, sizeof(prg), NULL, 0, mapper_id, mirroring);
+    assert(cart != NULL);
+    NES *nes = nes_create(cart);
+    assert(nes != NULL);
+    return nes;
+}
+
+void test_ppu_mirroring() {
+    printf("\n========== NAMETABLE MIRRORING ==========\n");
+
+    NES *h = ppu_mirroring_console(0, MIRROR_HORIZONTAL);
+    NES *v = ppu_mirroring_console(0, MIRROR_VERTICAL);
+    check("NROM horizontal: $2000=$2400, $2800=$2C00", ppu_nt_layout(&h->ppu) == 11);
+    check("NROM vertical: $2000=$2800, $2400=$2C00", ppu_nt_layout(&v->ppu) == 101);
+    nes_destroy(h);
+    nes_destroy(v);
+
+    /* MMC1 control bits 1-0: one-screen low, one-screen high, vertical,
+       horizontal */
+    static const int MMC1_LAYOUT[4] = { 0, 1111, 101, 11 };
+    NES *mmc1 = ppu_mirroring_console(1, MIRROR_HORIZONTAL);
+    int mmc1_ok = 1;
+    for (int mode = 0; mode < 4; mode++) {
+        mmc1_write(mmc1, 0x8000, (Byte)(0x0C | mode));
+        mmc1_ok &= ppu_nt_layout(&mmc1->ppu) == MMC1_LAYOUT[mode];
+    }
+    check("MMC1 control writes switch mirroring", mmc1_ok);
+    nes_destroy(mmc1);
+
+    NES *mmc3 = ppu_mirroring_console(4, MIRROR_VERTICAL);
+    int mmc3_v = ppu_nt_layout(&mmc3->ppu);
+    bus_write(&mmc3->bus, 0xA000, 0x01);
+    int mmc3_h = ppu_nt_layout(&mmc3->ppu);
+    bus_write(&mmc3->bus, 0xA000, 0x00);
+    check("MMC3 $A000 switches mirroring",
+          mmc3_v == 101 && mmc3_h == 11 && ppu_nt_layout(&mmc3->ppu) == 101);
+    nes_destroy(mmc3);
+
+    NES *four = ppu_mirroring_console(0, MIRROR_FOUR_SCREEN);
+    check("Four-screen NROM maps four pages", ppu_nt_layout(&four->ppu) == 123);
+    nes_destroy(four);
+
+    NES *four_mmc3 = ppu_mirroring_console(4, MIRROR_FOUR_SCREEN);
+    bus_write(&four_mmc3->bus, 0xA000, 0x01);
+    check("Four-screen MMC3 ignores $A000", ppu_nt_layout(&four_mmc3->ppu) == 123);
+    nes_destroy(four_mmc3);
+}
+
+/* Every mapped CHR window reads and decodes the same as chr_read */
+static int chr_cache_matches(Mapper *m) {
+    for (Word addr = 0; addr < 0x2000; addr++) {
+        const Byte *bank = m->chr_map[addr >> 10];
+        if (bank && bank[addr & 0x03FF] != mapper_chr_read(m, addr)) return 0;
+    }
+    for (Word addr = 0; addr < 0x2000; addr += (addr & 7) == 7 ? 9 : 1) {
+        const ChrRow *rows = m->chr_rows[addr >> 10];
+        if (!rows) return 0;
+        ChrRow want;
+        chr_decode_row(&want, mapper_chr_read(m, addr), mapper_chr_read(m, addr + 8));
+        if (memcmp(rows[((addr & 0x03FF) >> 4) * 8 + (addr & 7)].pixel, want.pixel, 8) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+void test_chr_cache() {
+    printf("\n========== DECODED CHR CACHE ==========\n");
+
+    static Byte prg[64 * 1024];
+    static Byte chr[128 * 1024];
+    memset(prg, OPC_NOP_IMP, sizeof(prg));
+    engine_rng_state = 0xC4A;
+    for (size_t i = 0; i < sizeof(chr); i++) chr[i] = engine_rand();
+
+    Cartridge *cart = cartridge_create_from_buffer(prg, sizeof(prg), chr, sizeof(chr), 1,
+                                                   MIRROR_HORIZONTAL);
+    NES *mmc1 = nes_create(cart);
+    assert(mmc1 != NULL);
+    int mmc1_ok = chr_cache_matches(mmc1->mapper);
+    mmc1_write(mmc1, 0x8000, 0x1C);   /* 4KB CHR banks */
+    mmc1_write(mmc1, 0xA000, 0x05);
+    mmc1_write(mmc1, 0xC000, 0x1A);
+    mmc1_ok &= chr_cache_matches(mmc1->mapper);
+    mmc1_ok &= ppu_vram_read(&mmc1->ppu, 0x1234) == chr[0x1A * 0x1000 + 0x234];
+    check("MMC1 CHR-ROM bank switches keep the cache in step", mmc1_ok);
+    nes_destroy(mmc1);
+
+    cart = cartridge_create_from_buffer(prg, sizeof(prg), chr, sizeof(chr), 4, MIRROR_VERTICAL);
+    NES *mmc3 = nes_create(cart);
+    int mmc3_ok = 1;
+    for (int r = 0; r < 8; r++) {
+        bus_write(&mmc3->bus, 0x8000, (Byte)(r | (r == 3 ? 0x80 : 0x00)));
+        bus_write(&mmc3->bus, 0x8001, (Byte)(r * 37 + 11));
+        mmc3_ok &= chr_cache_matches(mmc3->mapper);
+    }
+    check("MMC3 1KB CHR bank switches keep the cache in step", mmc3_ok);
+    nes_destroy(mmc3);
+
+    /* CHR-RAM written through PPUDATA: each write redoes its row */
+    cart = cartridge_create_from_buffer(prg, sizeof(prg), NULL, 0, 2, MIRROR_VERTICAL);
+    NES *uxrom = nes_create(cart);
+    ppu_reg_write(&uxrom->ppu, 0x06, 0x00);
+    ppu_reg_write(&uxrom->ppu, 0x06, 0x00);
+    for (int i = 0; i < 0x2000; i++) ppu_reg_write(&uxrom->ppu, 0x07, chr[i * 7]);
+    int ram_ok = chr_cache_matches(uxrom->mapper) &&
+                 ppu_vram_read(&uxrom->ppu, 0x1FFF) == chr[0x1FFF * 7];
+    check("CHR-RAM writes redecode their rows", ram_ok);
+    nes_destroy(uxrom);
+}
+
+/* Sprite evaluation as a full scan of OAM, to check the line index by */
+static int sprite_eval_scan(const PPU *ppu, int target, Byte *secondary, int *overflow) {
+    int height = (ppu->ctrl & 0x20) ? 16 : 8;
+    int count = 0;
+    *overflow = 0;
+    memset(secondary, 0xFF, 32);
+    for (int i = 0; i < 64; i++) {
+        int diff = target - (ppu->oam[i * 4] + 1);
+        if (diff < 0 || diff >= height) continue;
+        if (count == 8) { *overflow = 1; break; }
+        memcpy(&secondary[count++ * 4], &ppu->oam[i * 4], 4);
+    }
+    return count;
+}
+
+/* Run a frame a dot at a time, checking every line's evaluation */
+static int sprite_eval_frame_matches(PPU *ppu) {
+    int ok = 1;
+    do {
+        ppu_tick(ppu);
+        if (ppu->dot != 258 || ppu->scanline > 239) continue;
+        Byte secondary[32];
+        int overflow;
+        int count = sprite_eval_scan(ppu, ppu->scanline + 1, secondary, &overflow);
+        ok &= ppu->sprite_count == count;
+        ok &= memcmp(ppu->secondary_oam, secondary, 32) == 0;
+        ok &= ppu->sprite_zero_on_line == (count > 0 && secondary[0] == ppu->oam[0] &&
+                                           memcmp(secondary, ppu->oam, 4) == 0);
+        if (overflow) ok &= (ppu->status & 0x20) != 0;
+    } while (!ppu_frame_complete(ppu));
+    return ok;
+}
+
+void test_sprite_index() {
+    printf("\n========== SPRITE LINE INDEX ==========\n");
+
+    NES *nes = ppu_mirroring_console(0, MIRROR_HORIZONTAL);
+    PPU *ppu = &nes->ppu;
+    engine_rng_state = 0x0A11;
+    for (int i = 0; i < 256; i++) ppu->oam[i] = engine_rand();
+    for (int i = 0; i < 64; i += 3) ppu->oam[i * 4] = 100 + (engine_rand() & 0x0F);  /* overflow */
+    ppu->oam[0] = 96;
+    ppu->oam[62 * 4] = 235;    /* runs off the bottom */
+    ppu->mask = 0x18;
+
+    check("8x8 sprites: index matches a full OAM scan", sprite_eval_frame_matches(ppu));
+    ppu_reg_write(ppu, 0x00, 0x20);
+    check("8x16 sprites: index follows the height change", sprite_eval_frame_matches(ppu));
+
+    /* Move sprites through OAMDATA, Y bytes and others */
+    for (int i = 0; i < 40; i++) {
+        ppu_reg_write(ppu, 0x03, engine_rand());
+        ppu_reg_write(ppu, 0x04, 90 + (engine_rand() & 0x1F));
+    }
+    check("OAMDATA writes update the index", sprite_eval_frame_matches(ppu));
+    nes_destroy(nes);
+}
+
+void test_ppu_colors() {
+    printf("\n========== PALETTE INDEX FRAMEBUFFER ==========\n");
+
+    uint32_t colors[PPU_COLORS];
+    ppu_default_colors(colors);
+    check("Default colours: $20 is white, red emphasis darkens green and blue",
+          colors[0x20] == 0xFFFFFFFF && colors[1 << 6 | 0x20] == 0xFFFFBEBE &&
+          colors[7 << 6 | 0x20] == 0xFFBEBEBE);
+
+    /* Every pixel carries PPUMASK's emphasis bits; greyscale still masks */
+    NES *nes = ppu_mirroring_console(0, MIRROR_HORIZONTAL);
+    nes->ppu.palette[0] = 0x2A;
+    ppu_reg_write(&nes->ppu, 0x01, 0xBF);   /* red + blue, greyscale */
+    while (nes->ppu.scanline != 100) ppu_tick(&nes->ppu);
+    int emph_ok = 1;
+    for (int x = 0; x < 256; x++) emph_ok &= nes->ppu.framebuffer[99 * 256 + x] == (0x20 | 5 << 6);
+    check("Framebuffer holds palette index | emphasis << 6", emph_ok);
+
+    static uint32_t argb[256 * 240];
+    ppu_convert_frame(nes->ppu.framebuffer, argb, colors);
+    check("ppu_convert_frame looks every pixel up",
+          argb[99 * 256 + 17] == colors[0x20 | 5 << 6] && argb[0] == colors[nes->ppu.framebuffer[0]]);
+
+    /* The resolved palette follows palette writes, mirrors and PPUMASK */
+    PPU *ppu = &nes->ppu;
+    ppu_vram_write(ppu, 0x3F10, 0x16);
+    ppu_vram_write(ppu, 0x3F05, 0x27);
+    int resolved_ok = ppu->palette_out[0x00] == (0x10 | 5 << 6) &&
+                      ppu->palette_out[0x10] == (0x10 | 5 << 6) &&
+                      ppu->palette_out[0x05] == (0x20 | 5 << 6);
+    ppu_reg_write(ppu, 0x01, 0x1E);
+    resolved_ok &= ppu->palette_out[0x10] == 0x16 && ppu->palette_out[0x05] == 0x27 &&
+                   ppu->palette_out[0x15] == (ppu->palette[0x15] & 0x3F);
+    check("Resolved palette follows palette writes and PPUMASK", resolved_ok);
+    nes_destroy(nes);
+
+    /* .pal files: 64 colours get emphasis worked out, other sizes fail */
+    Byte pal[64 * 3];
+    for (int i = 0; i < (int)sizeof(pal); i++) pal[i] = (Byte)(i * 5);
+    FILE *f = fopen("test_palette.pal", "wb");
+    fwrite(pal, 1, sizeof(pal), f);
+    fclose(f);
+    int load_ok = ppu_load_palette(colors, "test_palette.pal") == 0 &&
+                  colors[1] == 0xFF0F1419 && colors[4 << 6 | 1] == 0xFF0B0E19;
+    f = fopen("test_palette.pal", "wb");
+    fwrite(pal, 1, 100, f);
+    fclose(f);
+    load_ok &= ppu_load_palette(colors, "test_palette.pal") == -1 && colors[1] == 0xFF0F1419;
+    remove("test_palette.pal");
+    check("Loading a .pal file swaps the colours", load_ok);
+}
+
+/* MMC3 game raising a scanline IRQ every 20 lines. The handler leaves
+   every fourth one unacknowledged, so it is taken again straight away. */
+static NES *ppu_irq_console(void) {
+    static Byte prg[64 * 1024];
+    static Byte chr[8 * 1024];
+    static const Byte reset[] = {
+        OPC_LDA_IM,  20,             /* $E000 LDA #20 */
+        OPC_STA_ABS, 0x00, 0xC0,     /* $E002 STA $C000  IRQ latch */
+        OPC_STA_ABS, 0x01, 0xC0,     /* $E005 STA $C001  reload */
+        OPC_STA_ABS, 0x01, 0xE0,     /* $E008 STA $E001  IRQ on */
+        OPC_CLI_IMP,                 /* $E00B CLI */
+        OPC_INC_ZP,  0x12,           /* $E00C INC $12 */
+        OPC_JMP_ABS, 0x0C, 0xE0,     /* $E00E JMP $E00C */
+    };
+    static const Byte irq_handler[] = {
+        OPC_PHA_IMP,                 /* $E100 PHA */
+        OPC_INC_ZP,  0x13,           /* $E101 INC $13 */
+        OPC_LDA_ZP,  0x13,           /* $E103 LDA $13 */
+        OPC_AND_IM,  0x03,           /* $E105 AND #3 */
+        OPC_BEQ_REL, 0x06,           /* $E107 BEQ $E10F */
+        OPC_STA_ABS, 0x00, 0xE0,     /* $E109 STA $E000  acknowledge */
+        OPC_STA_ABS, 0x01, 0xE0,     /* $E10C STA $E001 */
+        OPC_PLA_IMP,                 /* $E10F PLA */
+        OPC_RTI_IMP,                 /* $E110 RTI */
+    };
+    static const Byte nmi_handler[] = {
+        OPC_INC_ZP,  0x11,           /* $E200 INC $11 */
+        OPC_RTI_IMP,                 /* $E202 RTI */
+    };
+    memset(prg, OPC_NOP_IMP, sizeof(prg));
+    memcpy(prg + 0xE000, reset, sizeof(reset));
+    memcpy(prg + 0xE100, irq_handler, sizeof(irq_handler));
+    memcpy(prg + 0xE200, nmi_handler, sizeof(nmi_handler));
+    prg[0xFFFA] = 0x00; prg[0xFFFB] = 0xE2;   /* NMI   -> $E200 */
+    prg[0xFFFC] = 0x00; prg[0xFFFD] = 0xE0;   /* RESET -> $E000 */
+    prg[0xFFFE] = 0x00; prg[0xFFFF] = 0xE1;   /* IRQ   -> $E100 */
+
+    engine_rng_state = 0x5CA1AB1E;
+    for (size_t i = 0; i < sizeof(chr); i++) chr[i] = engine_rand();
+    Cartridge *cart = cartridge_create_from_buffer(prg, sizeof(prg), chr, sizeof(chr), 4, 1);
+    assert(cart != NULL);
+    NES *nes = nes_create(cart);
+    assert(nes != NULL);
+
+    PPU *ppu = &nes->ppu;
+    for (int i = 0; i < 256; i++) ppu->oam[i] = engine_rand();
+    ppu->ctrl = 0x88;                /* NMI on, sprites from $1000 */
+    ppu->mask = 0x1E;
+    return nes;
+}
+
+/* Run the same game through nes_run_frame and in lockstep; 1 if the two
+   agree after every frame */
+static int ppu_catch_up_matches(NES *(*console)(void), int frames) {
+    NES *lazy = console();
+    NES *lockstep = console();
+    int ok = 1;
+    for (int f = 0; f < frames && ok; f++) {
+        nes_run_frame(lazy);
+        while (!ppu_frame_complete(&lockstep->ppu)) ppu_test_clock(lockstep);
+        ok = lazy->system_clock == lockstep->system_clock &&
+             lazy->ppu.scanline == lockstep->ppu.scanline &&
+             lazy->ppu.dot == lockstep->ppu.dot &&
+             lazy->ppu.status == lockstep->ppu.status &&
+             lazy->cpu.cycles_remaining == lockstep->cpu.cycles_remaining &&
+             engine_cpu_equal(&lazy->cpu, &lockstep->cpu) &&
+             memcmp(lazy->bus.ram.data, lockstep->bus.ram.data, sizeof(lazy->bus.ram.data)) == 0 &&
+             memcmp(lazy->ppu.framebuffer, lockstep->ppu.framebuffer,
+                    sizeof(lazy->ppu.framebuffer)) == 0;
+        if (!ok) printf("  differs after frame %d\n", f);
+    }
+    nes_destroy(lazy);
+    nes_destroy(lockstep);
+    return ok;
+}
+
+void test_ppu_catch_up() {
+    printf("\n========== CATCH-UP PPU ==========\n");
+
+    check("Renderer test game: same as lockstep", ppu_catch_up_matches(ppu_test_console, 30));
+    check("MMC3 scanline IRQs: same as lockstep", ppu_catch_up_matches(ppu_irq_console, 30));
+
+    NES *nes = ppu_irq_console();
+    for (int f = 0; f < 10; f++) nes_run_frame(nes);
+    int irqs = bus_read(&nes->bus, 0x13), nmis = bus_read(&nes->bus, 0x11);
+    nes_destroy(nes);
+    printf("  %d IRQs and %d NMIs taken in 10 frames\n", irqs, nmis);
+    check("MMC3 game takes its IRQs and NMIs", irqs >= 40 && nmis >= 9);
+}
+
+/* Run the same game in lockstep with every frame drawn and under output
+   for the first frames, then one more drawn frame each; 1 if PPUSTATUS,
+   the pipeline and the CPU agree throughout, output leaves the
+   framebuffer alone and the drawn frame after it comes out the same */
+static int ppu_output_matches(NES *(*console)(void), int line_renderer, Byte output,
+                              int frames) {
+    NES *full = console();
+    NES *other = console();
+    full->ppu.line_renderer  = (Byte)line_renderer;
+    other->ppu.line_renderer = (Byte)line_renderer;
+    other->ppu.output = output;
+    for (int i = 0; i < 256 * 240; i++) other->ppu.framebuffer[i] = 0xFFFF;
+
+    int ok = 1;
+    for (int f = 0; f <= frames && ok; f++) {
+        if (f == frames) other->ppu.output = PPU_OUTPUT_FULL;
+        while (ok && !ppu_frame_complete(&full->ppu)) {
+            ppu_test_clock(full);
+            ppu_test_clock(other);
+            ok = full->ppu.status == other->ppu.status &&
+                 (full->ppu.dot != 257 || ppu_pipeline_equal(&full->ppu, &other->ppu));
+        }
+        ppu_frame_complete(&other->ppu);
+        ok = ok && engine_cpu_equal(&full->cpu, &other->cpu) &&
+             memcmp(full->bus.ram.data, other->bus.ram.data, sizeof(full->bus.ram.data)) == 0;
+        if (f < frames) {
+            for (int i = 0; i < 256 * 240 && ok; i++) ok = other->ppu.framebuffer[i] == 0xFFFF;
+        } else {
+            ok = ok && memcmp(full->ppu.framebuffer, other->ppu.framebuffer,
+                              sizeof(full->ppu.framebuffer)) == 0;
+        }
+        if (!ok) printf("  differs in frame %d\n", f);
+    }
+    nes_destroy(full);
+    nes_destroy(other);
+    return ok;
+}
+
+void test_ppu_output() {
+    printf("\n========== RENDER POLICIES ==========\n");
+
+    check("Collision only, scanline renderer: same game, framebuffer untouched",
+          ppu_output_matches(ppu_test_console, 1, PPU_OUTPUT_COLLISION, 30));
+    check("Collision only, dot renderer: same game, framebuffer untouched",
+          ppu_output_matches(ppu_test_console, 0, PPU_OUTPUT_COLLISION, 30));
+    check("Collision only, MMC3 scanline IRQs: same game, framebuffer untouched",
+          ppu_output_matches(ppu_irq_console, 1, PPU_OUTPUT_COLLISION, 30));
+
+    /* the test game waits on sprite-0 hit every frame */
+    NES *nes = ppu_test_console();
+    int hits = 0;
+    nes->ppu.output = PPU_OUTPUT_COLLISION;
+    for (int f = 0; f < 20; f++) {
+        nes_run_frame(nes);
+        hits = bus_read(&nes->bus, 0x10);
+    }
+    nes_destroy(nes);
+    check("Sprite-0 waits still complete with collision only", hits >= 10);
+}
+
+/* Game that keeps rendering off for long stretches, as loading screens
+   do: a busy loop through RAM of about 27 lines, then PPUSTATUS goes into
+   a log at $0300 and PPUMASK flips between $12 and 0, so every other
+   stretch is blank and rendering comes back on at all sorts of dots */
+static NES *ppu_blank_console(void) {
+    static Byte prg[16 * 1024];
+    static Byte chr[8 * 1024];
+    static const Byte main_loop[] = {
+        OPC_LDX_IM,   0x00,          /* $8000 LDX #0 */
+        OPC_INC_ABSX, 0x00, 0x02,    /* $8002 INC $0200,X */
+        OPC_DEX_IMP,                 /* $8005 DEX */
+        OPC_BNE_REL,  0xFA,          /* $8006 BNE $8002 */
+        OPC_LDY_ZP,   0x13,          /* $8008 LDY $13 */
+        OPC_LDA_ABS,  0x02, 0x20,    /* $800A LDA $2002 */
+        OPC_STA_ABSY, 0x00, 0x03,    /* $800D STA $0300,Y  PPUSTATUS log */
+        OPC_INC_ZP,   0x13,          /* $8010 INC $13 */
+        OPC_LDA_ZP,   0x10,          /* $8012 LDA $10 */
+        OPC_EOR_ZP,   0x12,          /* $8014 EOR $12 */
+        OPC_STA_ZP,   0x10,          /* $8016 STA $10 */
+        OPC_STA_ABS,  0x01, 0x20,    /* $8018 STA $2001 */
+        OPC_JMP_ABS,  0x00, 0x80,    /* $801B JMP $8000 */
+    };
+    static const Byte nmi_handler[] = {
+        OPC_INC_ZP,   0x11,          /* $8100 INC $11 */
+        OPC_RTI_IMP,                 /* $8102 RTI */
+    };
+    memset(prg, OPC_NOP_IMP, sizeof(prg));
+    memcpy(prg, main_loop, sizeof(main_loop));
+    memcpy(prg + 0x100, nmi_handler, sizeof(nmi_handler));
+    prg[0x3FFA] = 0x00; prg[0x3FFB] = 0x81;   /* NMI   -> $8100 */
+    prg[0x3FFC] = 0x00; prg[0x3FFD] = 0x80;   /* RESET -> $8000 */
+
+    engine_rng_state = 0xB1A4C;
+    for (size_t i = 0; i < sizeof(chr); i++) chr[i] = engine_rand();
+    Cartridge *cart = cartridge_create_from_buffer(prg, sizeof(prg), chr, sizeof(chr), 0, 1);
+    assert(cart != NULL);
+    NES *nes = nes_create(cart);
+    assert(nes != NULL);
+
+    PPU *ppu = &nes->ppu;
+    for (int i = 0; i < 0x400; i++) {
+        ppu->nametable[0][i] = engine_rand();
+        ppu->nametable[1][i] = engine_rand();
+    }
+    for (int i = 0; i < 32; i++) ppu->palette[i] = engine_rand() & 0x3F;
+    for (int i = 0; i < 256; i++) ppu->oam[i] = engine_rand();
+    for (int i = 0; i < 12; i++) ppu->oam[i * 4] = 120;   /* overflow on line 121 */
+    ppu->ctrl = 0x80;                /* NMI on */
+    ppu_update_palette(ppu);
+    bus_write(&nes->bus, 0x12, 0x18);
+    return nes;
+}
+
+/* The same with rendering never on, as a loading screen between levels */
+static NES *ppu_dark_console(void) {
+    NES *nes = ppu_blank_console();
+    bus_write(&nes->bus, 0x12, 0x00);
+    return nes;
+}
+
+/* FNV-1a over every frame of a lockstep run, and the dots each frame took */
+static uint64_t ppu_schedule_run(NES *nes, int line_renderer, int frames, int *dots) {
+    uint64_t h = 1469598103934665603ULL;
+    nes->ppu.line_renderer = (Byte)line_renderer;
+    for (int f = 0; f < frames; f++) {
+        dots[f] = 0;
+        while (!ppu_frame_complete(&nes->ppu)) {
+            ppu_test_clock(nes);
+            dots[f]++;
+        }
+        const Byte *p = (const Byte *)nes->ppu.framebuffer;
+        for (size_t i = 0; i < sizeof(nes->ppu.framebuffer); i++)
+            h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    nes_destroy(nes);
+    return h;
+}
+
+void test_ppu_schedule() {
+    printf("\n========== PPU DOT SCHEDULE ==========\n");
+
+    int dots[30];
+    int odd_ok = 1;
+    ppu_schedule_run(ppu_irq_console(), 0, 8, dots);
+    for (int f = 1; f < 8; f++) odd_ok &= dots[f] == (f & 1 ? 89341 : 89342);
+    check("Rendering on: odd frames skip a dot", odd_ok);
+
+    NES *nes = ppu_irq_console();
+    ppu_reg_write(&nes->ppu, 0x01, 0x00);
+    int even_ok = 1;
+    ppu_schedule_run(nes, 0, 8, dots);
+    for (int f = 1; f < 8; f++) even_ok &= dots[f] == 89342;
+    check("Rendering off: every frame is 262 x 341 dots", even_ok);
+
+    /* Frames as the PPU drew them before the dot schedule */
+    uint64_t h[3];
+    h[0] = ppu_schedule_run(ppu_test_console(), 0, 30, dots);
+    h[1] = ppu_schedule_run(ppu_test_console(), 1, 30, dots);
+    h[2] = ppu_schedule_run(ppu_irq_console(), 0, 30, dots);
+    check("Renderer test game, dot renderer: same frames", h[0] == 0x4eb5ea001817515cULL);
+    check("Renderer test game, scanline renderer: same frames", h[1] == 0x4eb5ea001817515cULL);
+    check("MMC3 scanline IRQs: same frames", h[2] == 0xa58e4c7456800383ULL);
+
+    /* Forced blank goes by a line at a time when the CPU leaves the PPU be */
+    check("Forced blank: same as lockstep", ppu_catch_up_matches(ppu_blank_console, 30));
+    check("Rendering never on: same as lockstep", ppu_catch_up_matches(ppu_dark_console, 30));
+    NES *dark = ppu_dark_console();
+    for (int f = 0; f < 30; f++) nes_run_frame(dark);
+    int nmis = bus_read(&dark->bus, 0x11), seen = 0;
+    for (int i = 0; i < 256; i++) seen |= bus_read(&dark->bus, 0x0300 + i);
+    nes_destroy(dark);
+    check("Rendering never on: NMIs still taken, overflow still set", nmis >= 29 && (seen & 0x20));
+}
+
+static void ntsc_rgb(uint32_t c, int *r, int *g, int *b) {
+    *r = (c >> 16) & 0xFF;
+    *g = (c >> 8) & 0xFF;
+    *b = c & 0xFF;
+}
+
+void test_ntsc_filter() {
+    printf("\n========== NTSC FILTER ==========\n");
+
+    static NtscFilter ntsc;
+    static uint16_t frame[256 * 240];
+    static uint32_t out[2][256 * NTSC_MAX_SCALE * 240];
+    uint32_t colors[PPU_COLORS];
+    ppu_default_colors(colors);
+    ntsc_init(&ntsc, 2);
+
+    /* flat fields: greys stay grey, colours come out near the palette */
+    int grey_ok = 1, last = -1;
+    double err = 0.0;
+    int n = 0;
+    for (int c = 0; c < 64; c++) {
+        if ((c & 0x0F) >= 0x0D) continue;
+        for (int i = 0; i < 256 * 240; i++) frame[i] = (uint16_t)c;
+        ntsc_filter_frame(&ntsc, frame, 0, out[0], 512);
+        int r, g, b, pr, pg, pb;
+        ntsc_rgb(out[0][120 * 512 + 256], &r, &g, &b);
+        ntsc_rgb(colors[c], &pr, &pg, &pb);
+        if ((c & 0x0F) == 0) {
+            grey_ok &= abs(r - g) <= 2 && abs(g - b) <= 2 && (r > last || r == 255);
+            last = r;
+        }
+        err += (r - pr) * (r - pr) + (g - pg) * (g - pg) + (b - pb) * (b - pb);
+        n += 3;
+    }
+    double rms = sqrt(err / n);
+    printf("  flat colours within %.1f (RMS) of the built-in palette\n", rms);
+    check("Greys decode grey, darkest to white", grey_ok && last == 255);
+    check("Colours decode close to the built-in palette", rms < 20.0);
+
+    /* a white/black column pattern picks up false colour at the edges */
+    for (int i = 0; i < 256 * 240; i++) frame[i] = (i & 4) ? 0x30 : 0x0F;
+    ntsc_init(&ntsc, 3);
+    ntsc_filter_frame(&ntsc, frame, ntsc_frame_phase(0), out[0], 768);
+    int fringe = 0;
+    for (int col = 0; col < 768; col++) {
+        int r, g, b;
+        ntsc_rgb(out[0][100 * 768 + col], &r, &g, &b);
+        fringe |= abs(r - b) > 16;
+    }
+    check("Sharp edges pick up colour fringes", fringe);
+
+    /* bands filtered separately match the whole frame */
+    engine_rng_state = 0xC0105;
+    for (int i = 0; i < 256 * 240; i++) frame[i] = engine_rand() | (engine_rand() & 1) << 8;
+    ntsc_filter_frame(&ntsc, frame, ntsc_frame_phase(1), out[0], 768);
+    for (int band = 0; band < 4; band++)
+        ntsc_filter_rows(&ntsc, frame, ntsc_frame_phase(1), out[1], 768, band * 60, 60);
+    check("Row bands match the whole frame", memcmp(out[0], out[1], sizeof(out[0])) == 0);
+}
+
+void test_scalers() {
+    printf("\n========== SCALERS ==========\n");
+
+    enum { W = 256, H = 240 };
+    static uint32_t src[W * H];
+    static uint32_t out[2][W * SCALE_MAX_FACTOR * H * SCALE_MAX_FACTOR];
+    static uint32_t wide[W * 2 * H * 2];
+    const uint32_t WHITE = 0xFFFFFFFF, BLACK = 0xFF000000;
+
+    /* blocky art: random 4x4 tiles from a few colours */
+    engine_rng_state = 0x5CA1E;
+    for (int y = 0; y < H; y += 4) {
+        for (int x = 0; x < W; x += 4) {
+            uint32_t c = 0xFF000000 | (uint32_t)(engine_rand() & 3) * 0x404040;
+            for (int i = 0; i < 16; i++) src[(y + i / 4) * W + x + i % 4] = c;
+        }
+    }
+
+    int nearest_ok = 1;
+    for (int f = 1; f <= SCALE_MAX_FACTOR; f++) {
+        scale_frame(SCALER_NEAREST, f, src, W, H, out[0], W * f);
+        for (int y = 0; y < H * f; y++)
+            for (int x = 0; x < W * f; x++)
+                nearest_ok &= out[0][y * W * f + x] == src[(y / f) * W + x / f];
+    }
+    check("Nearest repeats every pixel", nearest_ok);
+
+    /* Scale2x rounds the corner where two edges of one colour meet */
+    for (int i = 0; i < W * H; i++) src[i] = WHITE;
+    src[9 * W + 10] = BLACK;   /* above (10, 10) */
+    src[10 * W + 9] = BLACK;   /* left of it */
+    scale_frame(SCALER_SCALENX, 2, src, W, H, out[0], W * 2);
+    check("Scale2x fills the corner between two edges",
+          out[0][20 * W * 2 + 20] == BLACK && out[0][20 * W * 2 + 21] == WHITE &&
+          out[0][21 * W * 2 + 20] == WHITE && out[0][21 * W * 2 + 21] == WHITE);
+
+    /* Scale4x is Scale2x twice */
+    engine_rng_state = 0x5CA1E4;
+    for (int i = 0; i < W * H; i++) src[i] = (engine_rand() & 1) ? WHITE : BLACK;
+    scale_frame(SCALER_SCALENX, 2, src, W, H, wide, W * 2);
+    scale_frame(SCALER_SCALENX, 2, wide, W * 2, H * 2, out[0], W * 4);
+    scale_frame(SCALER_SCALENX, 4, src, W, H, out[1], W * 4);
+    check("Scale4x matches Scale2x twice",
+          memcmp(out[0], out[1], sizeof(uint32_t) * W * 4 * H * 4) == 0);
+
+    /* xBR: a diagonal edge is cut along the diagonal, a flat field is left alone */
+    for (int y = 0; y < H; y++)
+        for (int x = 0; x < W; x++) src[y * W + x] = x + y < 200 ? BLACK : WHITE;
+    scale_frame(SCALER_XBR, 4, src, W, H, out[0], W * 4);
+    scale_frame(SCALER_NEAREST, 4, src, W, H, out[1], W * 4);
+    int changed = 0, near_edge = 1;
+    for (int y = 0; y < H * 4; y++) {
+        for (int x = 0; x < W * 4; x++) {
+            if (out[0][y * W * 4 + x] == out[1][y * W * 4 + x]) continue;
+            changed++;
+            int d = x / 4 + y / 4 - 199;
+            near_edge &= d >= 0 && d <= 1;
+        }
+    }
+    printf("  xBR changed %d pixels of the diagonal against nearest\n", changed);
+    check("xBR smooths a diagonal edge and nothing else", changed > 200 && near_edge);
+
+    /* bands scaled separately match the whole frame */
+    engine_rng_state = 0xBA5D;
+    for (int i = 0; i < W * H; i++) src[i] = 0xFF000000 | (uint32_t)(engine_rand() & 7) * 0x202020;
+    int bands_ok = 1;
+    for (int kind = SCALER_NEAREST; kind <= SCALER_XBR; kind++) {
+        for (int f = 2; f <= SCALE_MAX_FACTOR; f++) {
+            scale_frame((ScalerKind)kind, f, src, W, H, out[0], W * f);
+            for (int band = 0; band < 3; band++)
+                scale_rows((ScalerKind)kind, f, src, W, H, out[1], W * f, band * 80, 80);
+            bands_ok &= memcmp(out[0], out[1], sizeof(uint32_t) * W * f * H * f) == 0;
+        }
+    }
+    check("Row bands match the whole frame", bands_ok);
+}
+
+/* Frames per second of the renderer test game, dot by dot and by lines */
+void test_ppu_benchmark() {
+    printf("\n========== PPU BENCHMARK ==========\n");
+    const int FRAMES = 600;
+    double fps[2];
+    for (int fast = 0; fast < 2; fast++) {
+        NES *nes = ppu_test_console();
+        nes->ppu.line_renderer = (Byte)fast;
+        clock_t start = clock();
+        for (int f = 0; f < FRAMES; f++) nes_run_frame(nes);
+        double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+        fps[fast] = secs > 0.0 ? FRAMES / secs : 0.0;
+        nes_destroy(nes);
+    }
+    printf("  dot renderer:      %.0f frames/s\n", fps[0]);
+    printf("  scanline renderer: %.0f frames/s\n", fps[1]);
+    if (fps[0] > 0.0) printf("  speedup: %.2fx\n", fps[1] / fps[0]);
+
+    NES *blank = ppu_dark_console();
+    clock_t blank_start = clock();
+    for (int f = 0; f < FRAMES; f++) nes_run_frame(blank);
+    double blank_secs = (double)(clock() - blank_start) / CLOCKS_PER_SEC;
+    printf("  forced blank:      %.0f frames/s\n", blank_secs > 0.0 ? FRAMES / blank_secs : 0.0);
+    nes_destroy(blank);
+
+    NES *skipped = ppu_test_console();
+    skipped->ppu.output = PPU_OUTPUT_COLLISION;
+    clock_t skipped_start = clock();
+    for (int f = 0; f < FRAMES; f++) nes_run_frame(skipped);
+    double skipped_secs = (double)(clock() - skipped_start) / CLOCKS_PER_SEC;
+    printf("  collision only:    %.0f frames/s\n", skipped_secs > 0.0 ? FRAMES / skipped_secs : 0.0);
+    nes_destroy(skipped);
+
+    static NtscFilter ntsc;
+    static uint32_t argb[256 * NTSC_MAX_SCALE * 240];
+    static uint32_t colors[PPU_COLORS];
+    static uint32_t argb_4x[256 * 4 * 240 * 4];
+    NES *nes = ppu_test_console();
+    nes_run_frame(nes);
+    for (int scale = 2; scale <= NTSC_MAX_SCALE; scale++) {
+        ntsc_init(&ntsc, scale);
+        clock_t start = clock();
+        for (int f = 0; f < FRAMES; f++)
+            ntsc_filter_frame(&ntsc, nes->ppu.framebuffer, ntsc_frame_phase(f), argb, 256 * scale);
+        double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+        printf("  NTSC filter, %dx:   %.0f frames/s\n", scale, secs > 0.0 ? FRAMES / secs : 0.0);
+    }
+
+    static const char *scalers[] = { "nearest", "scalenx", "xbr" };
+    static uint32_t frame[256 * 240];
+    ppu_default_colors(colors);
+    ppu_convert_frame(nes->ppu.framebuffer, frame, colors);
+    for (int kind = SCALER_NEAREST; kind <= SCALER_XBR; kind++) {
+        clock_t start = clock();
+        for (int f = 0; f < FRAMES; f++)
+            scale_frame((ScalerKind)kind, 4, frame, 256, 240, argb_4x, 256 * 4);
+        double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+        printf("  %-8s 4x:       %.0f frames/s\n", scalers[kind], secs > 0.0 ? FRAMES / secs : 0.0);
+    }
+    nes_destroy(nes);
+}
+
 // --- Menu ---
 
 void print_menu() {
@@ -3668,7 +5564,10 @@ void print_menu() {
     printf("  n. Transfers (TAX/TAY/TXA/TYA/TXS/TSX)\n");
     printf("  z. NOP\n");
     printf("  m. ADC (remaining modes)\n");
-    printf("  k. Mapper tests (NROM)\n");
+    printf("  k. Mapper tests (NROM, PRG page map)\n");
+    printf("  v. Dispatcher cross-check (table vs fused) + decode cache\n");
+    printf("  g. PPU renderers (scanline vs dot) + mirroring + CHR cache + sprite index + colours + catch-up + NTSC + scalers + render policies + dot schedule\n");
+    printf("  b. Dispatcher and PPU benchmarks\n");
     printf("  a. Run all tests\n");
     printf("  q. Quit\n");
     printf("Choice: ");
@@ -3686,6 +5585,12 @@ void print_summary() {
 int main() {
     char choice;
 
+    bus_init(&test_bus);
+    if (cpu_init(&cpu, &test_bus) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
     while (1) {
         test_pass = 0;
         test_fail = 0;
@@ -3723,6 +5628,7 @@ int main() {
                 break;
             case '6':
                 test_branches();
+                test_flag_coherency();
                 print_summary();
                 break;
             case '7':
@@ -3809,8 +5715,40 @@ int main() {
             case 'k':
                 test_mapper0_exec();
                 test_mapper0_32kb();
+                test_prg_page_map();
+                print_summary();
+                break;
+            case 'v':
+                test_engine_crosscheck();
+                test_decode_cache();
+                test_idle_skip();
+                test_nes_instances();
+                test_cpu_lanes();
+#ifdef NES_PROFILE
+                test_profiler();
+#endif
+#ifdef NES_CPU_JIT
+                test_jit_crosscheck();
+#endif
                 print_summary();
                 break;
+            case 'g':
+                test_ppu_line_renderer();
+                test_ppu_mirroring();
+                test_chr_cache();
+                test_sprite_index();
+                test_ppu_colors();
+                test_ppu_catch_up();
+                test_ntsc_filter();
+                test_scalers();
+                test_ppu_output();
+                test_ppu_schedule();
+                print_summary();
+                break;
+            case 'b':
+                test_engine_benchmark();
+                test_ppu_benchmark();
+                break;
             case 'a':
                 test_mem_rw();
                 test_stack();
@@ -3820,6 +5758,7 @@ int main() {
                 test_and();
                 test_asl();
                 test_branches();
+                test_flag_coherency();
                 test_bit();
                 test_brk();
                 test_clear_flags();
@@ -3846,6 +5785,28 @@ int main() {
                 test_adc_modes();
                 test_mapper0_exec();
                 test_mapper0_32kb();
+                test_prg_page_map();
+                test_engine_crosscheck();
+                test_decode_cache();
+                test_idle_skip();
+                test_nes_instances();
+                test_cpu_lanes();
+                test_ppu_line_renderer();
+                test_ppu_mirroring();
+                test_chr_cache();
+                test_sprite_index();
+                test_ppu_colors();
+                test_ppu_catch_up();
+                test_ntsc_filter();
+                test_scalers();
+                test_ppu_output();
+                test_ppu_schedule();
+#ifdef NES_PROFILE
+                test_profiler();
+#endif
+#ifdef NES_CPU_JIT
+                test_jit_crosscheck();
+#endif
                 print_summary();
                 break;
             case 'q':
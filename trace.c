@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "bus.h"
+
+/* ------------------------------------------------------------------ */
+/*  Runtime configuration                                              */
+/* ------------------------------------------------------------------ */
+
+#ifdef NES_TRACE
+/* Default matches what the old always-on diagnostics reported */
+unsigned trace_mask = TRACE_CPU | TRACE_BUS | TRACE_WATCHDOG | TRACE_SPRITE0;
+
+static Word watch_lo = 0x0000;
+static Word watch_hi = 0x0000;
+#endif
+
+static const struct {
+    const char *name;
+    unsigned    mask;
+} TRACE_NAMES[] = {
+    { "cpu",      TRACE_CPU      },
+    { "bus",      TRACE_BUS      },
+    { "watch",    TRACE_WATCH    },
+    { "watchdog", TRACE_WATCHDOG },
+    { "mmc1",     TRACE_MMC1     },
+    { "sprite0",  TRACE_SPRITE0  },
+    { "all",      TRACE_ALL      },
+    { "none",     0              },
+};
+
+int trace_configure(const char *spec) {
+    unsigned mask = 0;
+    const char *p = spec;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        int found = 0;
+        for (size_t i = 0; i < sizeof(TRACE_NAMES) / sizeof(TRACE_NAMES[0]); i++) {
+            if (strlen(TRACE_NAMES[i].name) == len &&
+                strncmp(TRACE_NAMES[i].name, p, len) == 0) {
+                mask |= TRACE_NAMES[i].mask;
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown trace category: %.*s\n", (int)len, p);
+            return -1;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+#ifdef NES_TRACE
+    trace_mask = mask;
+    return 0;
+#else
+    (void)mask;
+    fprintf(stderr, "Tracing not built in (configure with -DNES_TRACE=ON)\n");
+    return -1;
+#endif
+}
+
+int trace_set_watch(const char *range) {
+    unsigned lo, hi;
+    if (sscanf(range, "%x-%x", &lo, &hi) != 2 || lo > hi || hi > 0xFFFF) {
+        fprintf(stderr, "Bad watch range: %s (expected LO-HI in hex)\n", range);
+        return -1;
+    }
+#ifdef NES_TRACE
+    watch_lo = (Word)lo;
+    watch_hi = (Word)hi;
+    trace_mask |= TRACE_WATCH;
+    return 0;
+#else
+    fprintf(stderr, "Tracing not built in (configure with -DNES_TRACE=ON)\n");
+    return -1;
+#endif
+}
+
+#ifdef NES_TRACE
+
+/* ------------------------------------------------------------------ */
+/*  State                                                              */
+/* ------------------------------------------------------------------ */
+
+#define TRACE_RING 32
+
+typedef struct {
+    Word pc;
+    Byte op, b1, b2;
+    Byte a, x, y, p, sp;
+    Byte ppu_status;
+    Word ppu_v;
+} TraceRingEntry;
+
+static PPU *trace_ppu = NULL;
+
+static TraceRingEntry ring[TRACE_RING];
+static int ring_idx = 0;
+static int trap_fff0_logged = 0;
+
+static TraceBusStats bus_stats;
+
+static long cpu_steps_this_frame = 0;
+static long ppu_ticks_this_frame = 0;
+static int  watchdog_fired = 0;
+static int  ppu_watchdog_fired = 0;
+static int  watch_count = 0;
+
+static uint64_t last_frame_sig = 0;
+static int same_frame_sig_count = 0;
+static int frame_stall_logged = 0;
+
+static int sp0_eval_count = 0;
+static int sp0_hit_count = 0;
+
+void trace_connect_ppu(PPU *ppu) {
+    trace_ppu = ppu;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Frame boundaries and watchdogs                                     */
+/* ------------------------------------------------------------------ */
+
+void trace_frame_begin(void) {
+    cpu_steps_this_frame = 0;
+    ppu_ticks_this_frame = 0;
+    watchdog_fired = 0;
+    ppu_watchdog_fired = 0;
+    watch_count = 0;
+    memset(&bus_stats, 0, sizeof(bus_stats));
+}
+
+void trace_ppu_tick(void) {
+    if (!TRACE_ENABLED(TRACE_WATCHDOG)) return;
+    ppu_ticks_this_frame++;
+    if (ppu_ticks_this_frame > 2000000 && !ppu_watchdog_fired && trace_ppu) {
+        PPU *ppu = trace_ppu;
+        fprintf(stderr,
+                "PPU_WATCHDOG: frame exceeded 2M PPU ticks | sl=%d dot=%d frame=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X x=%d w=%d nmi=%d\n",
+                ppu->scanline, ppu->dot, ppu->frame, ppu->status, ppu->ctrl, ppu->mask,
+                ppu->v, ppu->t, ppu->x, ppu->w, ppu->nmi_output);
+        ppu_watchdog_fired = 1;
+    }
+}
+
+static void trace_dump_watchdog(const CPU *cpu) {
+    PPU *ppu = trace_ppu;
+    fprintf(stderr, "WATCHDOG: frame exceeded 200k CPU steps! PC=0x%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X",
+            cpu->PC, cpu->regs.A, cpu->regs.X, cpu->regs.Y, cpu_flags(cpu), cpu->SP);
+    if (ppu) {
+        fprintf(stderr, " | PPU sl=%d dot=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X",
+                ppu->scanline, ppu->dot, ppu->status, ppu->ctrl, ppu->mask, ppu->v, ppu->t);
+    }
+    fprintf(stderr, "\n");
+    if (ppu) {
+        /* Dump sprite 0 OAM entry */
+        fprintf(stderr, "  OAM[0]: Y=%d tile=%02X attr=%02X X=%d | sprite_zero_on_line=%d sprite_count=%d\n",
+                ppu->oam[0], ppu->oam[1], ppu->oam[2], ppu->oam[3],
+                ppu->sprite_zero_on_line, ppu->sprite_count);
+        fprintf(stderr, "  PPU fine_x=%d bg_shift_lo=%04X bg_shift_hi=%04X\n",
+                ppu->x, ppu->bg_shift_lo, ppu->bg_shift_hi);
+    }
+    fprintf(stderr, "  Sprite0 debug: eval_count=%d hit_count=%d\n",
+            sp0_eval_count, sp0_hit_count);
+    fprintf(stderr, "  Bus debug: $2002 reads=%llu (vblank=%llu, sp0=%llu, last=%02X) | $4014 starts=%llu last_page=%02X | $2003 writes=%llu last=%02X | $2004=%llu $2005=%llu $2006=%llu $2007=%llu\n",
+            (unsigned long long)bus_stats.ppustatus_reads,
+            (unsigned long long)bus_stats.ppustatus_vblank_set_reads,
+            (unsigned long long)bus_stats.ppustatus_sprite0_set_reads,
+            bus_stats.last_ppustatus_value,
+            (unsigned long long)bus_stats.oamdma_starts,
+            bus_stats.last_oamdma_page,
+            (unsigned long long)bus_stats.oamaddr_writes,
+            bus_stats.last_oamaddr_value,
+            (unsigned long long)bus_stats.oamdata_writes,
+            (unsigned long long)bus_stats.ppuscroll_writes,
+            (unsigned long long)bus_stats.ppuaddr_writes,
+            (unsigned long long)bus_stats.ppudata_writes);
+    fprintf(stderr, "  Recent instructions:\n");
+    for (int i = 0; i < TRACE_RING; i++) {
+        const TraceRingEntry *e = &ring[(ring_idx + i) & (TRACE_RING - 1)];
+        fprintf(stderr, "    PC=%04X OP=%02X %02X %02X | A=%02X X=%02X Y=%02X P=%02X SP=%02X | PPU status=%02X v=%04X\n",
+                e->pc, e->op, e->b1, e->b2, e->a, e->x, e->y, e->p, e->sp,
+                e->ppu_status, e->ppu_v);
+    }
+    fprintf(stderr, "  Bytes @%04X: ", cpu->PC);
+    for (int i = 0; i < 14; i++) {
+        fprintf(stderr, "%02X ", bus_peek(cpu->bus, (Word)(cpu->PC + i)));
+    }
+    fprintf(stderr, "\n");
+}
+
+void trace_frame_end(const CPU *cpu) {
+    if (!TRACE_ENABLED(TRACE_WATCHDOG) || !trace_ppu) return;
+    PPU *ppu = trace_ppu;
+
+    uint64_t sig = 1469598103934665603ULL;
+    for (int i = 0; i < 64; i++) {
+        int x = (i * 37) & 255;
+        int y = (i * 53) % 240;
+        uint32_t px = ppu->framebuffer[y * 256 + x];
+        sig ^= (uint64_t)px + ((uint64_t)x << 8) + ((uint64_t)y << 16);
+        sig *= 1099511628211ULL;
+    }
+    if (sig == last_frame_sig) {
+        same_frame_sig_count++;
+        if (!frame_stall_logged && same_frame_sig_count >= 120) {
+            fprintf(stderr,
+                    "FRAME_STALL: same_sig_frames=%d sig=%016llX | CPU PC=%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X | PPU sl=%d dot=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X x=%d w=%d frame=%d | $2002 reads=%llu sp0=%llu oamdma=%llu\n",
+                    same_frame_sig_count, (unsigned long long)sig,
+                    cpu->PC, cpu->regs.A, cpu->regs.X, cpu->regs.Y, cpu_flags(cpu), cpu->SP,
+                    ppu->scanline, ppu->dot, ppu->status, ppu->ctrl, ppu->mask, ppu->v, ppu->t, ppu->x, ppu->w, ppu->frame,
+                    (unsigned long long)bus_stats.ppustatus_reads,
+                    (unsigned long long)bus_stats.ppustatus_sprite0_set_reads,
+                    (unsigned long long)bus_stats.oamdma_starts);
+            frame_stall_logged = 1;
+        }
+    } else {
+        last_frame_sig = sig;
+        same_frame_sig_count = 0;
+        frame_stall_logged = 0;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  CPU                                                                */
+/* ------------------------------------------------------------------ */
+
+void trace_cpu_step(const CPU *cpu) {
+    if (TRACE_ENABLED(TRACE_CPU)) {
+        if (cpu->PC == 0xFFF0 && !trap_fff0_logged) {
+            fprintf(stderr,
+                    "CPU_TRAP_FFF0: A=%02X X=%02X Y=%02X P=%02X SP=%02X | stack_top=%02X %02X %02X %02X %02X %02X\n",
+                    cpu->regs.A, cpu->regs.X, cpu->regs.Y, cpu_flags(cpu), cpu->SP,
+                    bus_peek(cpu->bus, 0x0100 + ((cpu->SP + 1) & 0xFF)),
+                    bus_peek(cpu->bus, 0x0100 + ((cpu->SP + 2) & 0xFF)),
+                    bus_peek(cpu->bus, 0x0100 + ((cpu->SP + 3) & 0xFF)),
+                    bus_peek(cpu->bus, 0x0100 + ((cpu->SP + 4) & 0xFF)),
+                    bus_peek(cpu->bus, 0x0100 + ((cpu->SP + 5) & 0xFF)),
+                    bus_peek(cpu->bus, 0x0100 + ((cpu->SP + 6) & 0xFF)));
+            fprintf(stderr, "  Recent flow:\n");
+            for (int i = 0; i < TRACE_RING; i++) {
+                const TraceRingEntry *e = &ring[(ring_idx + i) & (TRACE_RING - 1)];
+                fprintf(stderr, "    PC=%04X OP=%02X\n", e->pc, e->op);
+            }
+            trap_fff0_logged = 1;
+        }
+
+        TraceRingEntry *e = &ring[ring_idx & (TRACE_RING - 1)];
+        e->pc = cpu->PC;
+        e->op = bus_peek(cpu->bus, cpu->PC);
+        e->b1 = bus_peek(cpu->bus, (Word)(cpu->PC + 1));
+        e->b2 = bus_peek(cpu->bus, (Word)(cpu->PC + 2));
+        e->a  = cpu->regs.A;
+        e->x  = cpu->regs.X;
+        e->y  = cpu->regs.Y;
+        e->p  = cpu_flags(cpu);
+        e->sp = cpu->SP;
+        e->ppu_status = trace_ppu ? trace_ppu->status : 0;
+        e->ppu_v      = trace_ppu ? trace_ppu->v : 0;
+        ring_idx++;
+    }
+
+    if (TRACE_ENABLED(TRACE_WATCH) && cpu->PC >= watch_lo && cpu->PC <= watch_hi) {
+        watch_count++;
+        if (watch_count <= 64 ||
+            watch_count == 100 || watch_count == 250 ||
+            watch_count == 500 || watch_count == 1000 ||
+            watch_count == 5000) {
+            PPU *ppu = trace_ppu;
+            fprintf(stderr,
+                    "WATCH: pc=%04X count=%d op=%02X %02X %02X | A=%02X X=%02X Y=%02X P=%02X SP=%02X | ZP[00..07]=%02X %02X %02X %02X %02X %02X %02X %02X",
+                    cpu->PC, watch_count,
+                    bus_peek(cpu->bus, cpu->PC), bus_peek(cpu->bus, (Word)(cpu->PC + 1)), bus_peek(cpu->bus, (Word)(cpu->PC + 2)),
+                    cpu->regs.A, cpu->regs.X, cpu->regs.Y, cpu_flags(cpu), cpu->SP,
+                    bus_peek(cpu->bus, 0x0000), bus_peek(cpu->bus, 0x0001), bus_peek(cpu->bus, 0x0002), bus_peek(cpu->bus, 0x0003),
+                    bus_peek(cpu->bus, 0x0004), bus_peek(cpu->bus, 0x0005), bus_peek(cpu->bus, 0x0006), bus_peek(cpu->bus, 0x0007));
+            if (ppu) {
+                fprintf(stderr, " | PPU sl=%d dot=%d status=%02X v=%04X t=%04X",
+                        ppu->scanline, ppu->dot, ppu->status, ppu->v, ppu->t);
+            }
+            fprintf(stderr, " | $2002 reads=%llu sp0=%llu oamdma=%llu page=%02X\n",
+                    (unsigned long long)bus_stats.ppustatus_reads,
+                    (unsigned long long)bus_stats.ppustatus_sprite0_set_reads,
+                    (unsigned long long)bus_stats.oamdma_starts,
+                    bus_stats.last_oamdma_page);
+        }
+    }
+
+    if (TRACE_ENABLED(TRACE_WATCHDOG)) {
+        /* Frame watchdog: detect hang by counting CPU steps per frame */
+        cpu_steps_this_frame++;
+        if (cpu_steps_this_frame > 200000 && !watchdog_fired) {
+            trace_dump_watchdog(cpu);
+            watchdog_fired = 1;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Bus                                                                */
+/* ------------------------------------------------------------------ */
+
+void trace_ppu_reg_read(Byte reg, Byte value) {
+    if (!TRACE_ENABLED(TRACE_BUS) || reg != 0x02) return;
+    bus_stats.ppustatus_reads++;
+    bus_stats.last_ppustatus_value = value;
+    if (value & 0x80) bus_stats.ppustatus_vblank_set_reads++;
+    if (value & 0x40) bus_stats.ppustatus_sprite0_set_reads++;
+    if (trace_ppu &&
+        (bus_stats.ppustatus_reads == 10000 ||
+         bus_stats.ppustatus_reads == 50000 ||
+         bus_stats.ppustatus_reads == 100000)) {
+        PPU *ppu = trace_ppu;
+        fprintf(stderr,
+                "PPUSTATUS_POLL: reads=%llu val=%02X vblank_reads=%llu sp0_reads=%llu | PPU sl=%d dot=%d status=%02X ctrl=%02X mask=%02X v=%04X t=%04X x=%d w=%d | OAM0 Y=%u tile=%02X attr=%02X X=%u\n",
+                (unsigned long long)bus_stats.ppustatus_reads,
+                value,
+                (unsigned long long)bus_stats.ppustatus_vblank_set_reads,
+                (unsigned long long)bus_stats.ppustatus_sprite0_set_reads,
+                ppu->scanline, ppu->dot, ppu->status,
+                ppu->ctrl, ppu->mask, ppu->v, ppu->t,
+                ppu->x, ppu->w,
+                ppu->oam[0], ppu->oam[1], ppu->oam[2], ppu->oam[3]);
+    }
+}
+
+void trace_ppu_reg_write(Byte reg, Byte value) {
+    if (!TRACE_ENABLED(TRACE_BUS)) return;
+    if (reg == 0x03) {
+        bus_stats.oamaddr_writes++;
+        bus_stats.last_oamaddr_value = value;
+    } else if (reg == 0x04) {
+        bus_stats.oamdata_writes++;
+    } else if (reg == 0x05) {
+        bus_stats.ppuscroll_writes++;
+    } else if (reg == 0x06) {
+        bus_stats.ppuaddr_writes++;
+    } else if (reg == 0x07) {
+        bus_stats.ppudata_writes++;
+    }
+}
+
+void trace_oamdma(Byte page) {
+    if (!TRACE_ENABLED(TRACE_BUS)) return;
+    bus_stats.oamdma_starts++;
+    bus_stats.last_oamdma_page = page;
+}
+
+void trace_get_bus_stats(TraceBusStats *out_stats) {
+    if (out_stats) *out_stats = bus_stats;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Sprite 0                                                           */
+/* ------------------------------------------------------------------ */
+
+void trace_sp0_eval(void) {
+    if (TRACE_ENABLED(TRACE_SPRITE0)) sp0_eval_count++;
+}
+
+void trace_sp0_hit(void) {
+    if (TRACE_ENABLED(TRACE_SPRITE0)) sp0_hit_count++;
+}
+
+void trace_sp0_reset(void) {
+    sp0_eval_count = 0;
+    sp0_hit_count = 0;
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "types.h"
+#include "cpu.h"
+#include "ppu.h"
+
+/* Diagnostic tracing.
+   All hooks below compile to nothing unless the build defines NES_TRACE
+   (CMake option NES_TRACE). In a trace build each category is switched on
+   at runtime with trace_configure(), e.g. "--trace=cpu,watchdog".
+   Trace state is process-wide; trace one console at a time. */
+
+typedef enum {
+    TRACE_CPU      = 1 << 0,  /* instruction ring, $FFF0 trap */
+    TRACE_BUS      = 1 << 1,  /* PPU register access counters, $2002 poll reports */
+    TRACE_WATCH    = 1 << 2,  /* log instructions inside a PC watch range */
+    TRACE_WATCHDOG = 1 << 3,  /* CPU/PPU frame watchdogs, frame stall detector */
+    TRACE_MMC1     = 1 << 4,  /* MMC1 register commits */
+    TRACE_SPRITE0  = 1 << 5,  /* sprite-0 evaluation/hit counters */
+    TRACE_ALL      = 0x3F
+} TraceCategory;
+
+typedef struct {
+    uint64_t ppustatus_reads;
+    uint64_t ppustatus_vblank_set_reads;
+    uint64_t ppustatus_sprite0_set_reads;
+    Byte     last_ppustatus_value;
+    uint64_t ppuscroll_writes;
+    uint64_t ppuaddr_writes;
+    uint64_t ppudata_writes;
+    uint64_t oamaddr_writes;
+    Byte     last_oamaddr_value;
+    uint64_t oamdata_writes;
+    uint64_t oamdma_starts;
+    Byte     last_oamdma_page;
+} TraceBusStats;
+
+/* Parse a comma-separated category list ("cpu,bus,watch,watchdog,mmc1,
+   sprite0,all,none") into the runtime mask. Returns 0 on success, -1 on an
+   unknown name or when tracing is not built in. */
+int  trace_configure(const char *spec);
+
+/* Parse "LO-HI" (hex) as the PC watch range and enable TRACE_WATCH. */
+int  trace_set_watch(const char *range);
+
+#ifdef NES_TRACE
+
+extern unsigned trace_mask;
+
+#define TRACE_ENABLED(cat) ((trace_mask & (cat)) != 0)
+
+void trace_connect_ppu(PPU *ppu);
+void trace_frame_begin(void);
+void trace_frame_end(const CPU *cpu);
+void trace_ppu_tick(void);
+void trace_cpu_step(const CPU *cpu);
+void trace_ppu_reg_read(Byte reg, Byte value);
+void trace_ppu_reg_write(Byte reg, Byte value);
+void trace_oamdma(Byte page);
+void trace_sp0_eval(void);
+void trace_sp0_hit(void);
+void trace_sp0_reset(void);
+void trace_get_bus_stats(TraceBusStats *out_stats);
+
+#define TRACE_CONNECT_PPU(ppu)          trace_connect_ppu(ppu)
+#define TRACE_FRAME_BEGIN()             trace_frame_begin()
+#define TRACE_FRAME_END(cpu)            trace_frame_end(cpu)
+#define TRACE_PPU_TICK()                trace_ppu_tick()
+#define TRACE_CPU_STEP(cpu)             trace_cpu_step(cpu)
+#define TRACE_PPU_REG_READ(reg, value)  trace_ppu_reg_read(reg, value)
+#define TRACE_PPU_REG_WRITE(reg, value) trace_ppu_reg_write(reg, value)
+#define TRACE_OAMDMA(page)              trace_oamdma(page)
+#define TRACE_SP0_EVAL()                trace_sp0_eval()
+#define TRACE_SP0_HIT()                 trace_sp0_hit()
+#define TRACE_SP0_RESET()               trace_sp0_reset()
+
+#else
+
+#define TRACE_ENABLED(cat)              0
+#define TRACE_CONNECT_PPU(ppu)          ((void)0)
+#define TRACE_FRAME_BEGIN()             ((void)0)
+#define TRACE_FRAME_END(cpu)            ((void)0)
+#define TRACE_PPU_TICK()                ((void)0)
+#define TRACE_CPU_STEP(cpu)             ((void)0)
+#define TRACE_PPU_REG_READ(reg, value)  ((void)0)
+#define TRACE_PPU_REG_WRITE(reg, value) ((void)0)
+#define TRACE_OAMDMA(page)              ((void)0)
+#define TRACE_SP0_EVAL()                ((void)0)
+#define TRACE_SP0_HIT()                 ((void)0)
+#define TRACE_SP0_RESET()               ((void)0)
+
+#endif
+
+#endif
@@ -1,6 +1,11 @@
+#ifndef UTIL_H
+#define UTIL_H
+
 #include "types.h"
 
-Byte read_bit(Byte value, Byte position) {
+static inline Byte read_bit(Byte value, Byte position) {
     Byte result = (value >> position) & 0x01;
     return result;
-}
\ No newline at end of file
+}
+
+#endif